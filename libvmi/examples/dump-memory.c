@@ -31,6 +31,7 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #define PAGE_SIZE 1 << 12
 
@@ -43,10 +44,8 @@ main(
     char *filename = NULL;
     FILE *f = NULL;
     unsigned char memory[PAGE_SIZE];
-    unsigned char zeros[PAGE_SIZE];
-
-    memset(zeros, 0, PAGE_SIZE);
-    uint32_t offset = 0;
+    const vmi_pa_range_t *ranges = NULL;
+    size_t count = 0, i;
     addr_t address = 0;
     addr_t size = 0;
 
@@ -70,31 +69,34 @@ main(
     }
 
     size = vmi_get_max_physical_address(vmi);
+    count = vmi_get_memory_map(vmi, &ranges);
 
-    while (address < size) {
+    /* only RAM is read, the holes are left sparse in the file */
+    for (i = 0; i < count; i++) {
+        addr_t end = ranges[i].paddr + ranges[i].length;
 
-        /* write memory to file */
-        if (PAGE_SIZE == vmi_read_pa(vmi, address, memory, PAGE_SIZE)) {
-            /* memory mapped, just write to file */
-            size_t written = fwrite(memory, 1, PAGE_SIZE, f);
+        if (fseeko(f, ranges[i].paddr, SEEK_SET)) {
+            printf("failed to seek in file.\n");
+            goto error_exit;
+        }
 
-            if (written != PAGE_SIZE) {
-                printf("failed to write memory to file.\n");
-                goto error_exit;
+        for (address = ranges[i].paddr; address < end; address += PAGE_SIZE) {
+            /* pages of RAM that can't be read are written as zeros */
+            if (PAGE_SIZE != vmi_read_pa(vmi, address, memory, PAGE_SIZE)) {
+                memset(memory, 0, PAGE_SIZE);
             }
-        }
-        else {
-            /* memory not mapped, write zeros to maintain offset */
-            size_t written = fwrite(zeros, 1, PAGE_SIZE, f);
 
-            if (written != PAGE_SIZE) {
-                printf("failed to write zeros to file.\n");
+            if (PAGE_SIZE != fwrite(memory, 1, PAGE_SIZE, f)) {
+                printf("failed to write memory to file.\n");
                 goto error_exit;
             }
         }
+    }
 
-        /* move on to the next page */
-        address += PAGE_SIZE;
+    /* keeps the offsets of the file the physical addresses */
+    if (fflush(f) || ftruncate(fileno(f), size)) {
+        printf("failed to set the size of the file.\n");
+        goto error_exit;
     }
 
 error_exit:
@@ -33,17 +33,19 @@
 
 #include <libvmi/libvmi.h>
 
+/* task_struct->comm, _EPROCESS.ImageFileName is one byte shorter */
+#define PROCNAME_LEN 16
+
 int main (int argc, char **argv)
 {
     vmi_instance_t vmi;
-    unsigned char *memory = NULL;
-    uint32_t offset;
-    addr_t list_head = 0, next_list_entry = 0;
+    addr_t list_head = 0;
     addr_t current_process = 0;
-    addr_t tmp_next = 0;
-    char *procname = NULL;
     vmi_pid_t pid = 0;
     unsigned long tasks_offset = 0, pid_offset = 0, name_offset = 0;
+    vmi_list_field_t fields[2];
+    vmi_list_walk_t walk;
+    size_t i;
     status_t status;
 
     /* this is the VM or file that we are looking at */
@@ -121,49 +123,44 @@ int main (int argc, char **argv)
         }
     }
 
-    next_list_entry = list_head;
-
-    /* walk the task list */
-    do {
-
-        current_process = next_list_entry - tasks_offset;
-
-        /* Note: the task_struct that we are looking at has a lot of
-         * information.  However, the process name and id are burried
-         * nice and deep.  Instead of doing something sane like mapping
-         * this data to a task_struct, I'm just jumping to the location
-         * with the info that I want.  This helps to make the example
-         * code cleaner, if not more fragile.  In a real app, you'd
-         * want to do this a little more robust :-)  See
-         * include/linux/sched.h for mode details */
+    /* Walk the task list, capturing the pid and the name of every process.
+     *
+     * Note: the task_struct that we are looking at has a lot of
+     * information.  However, the process name and id are burried
+     * nice and deep.  Instead of doing something sane like mapping
+     * this data to a task_struct, I'm just capturing the bytes at the
+     * locations with the info that I want.  This helps to make the example
+     * code cleaner, if not more fragile.  In a real app, you'd
+     * want to do this a little more robust :-)  See
+     * include/linux/sched.h for mode details */
+    fields[0].offset = pid_offset;
+    fields[0].length = sizeof(uint32_t);
+    fields[1].offset = name_offset;
+    fields[1].length = PROCNAME_LEN;
+
+    /* On Linux the head is init_task itself, on Windows it isn't a process */
+    status = vmi_walk_list(vmi, list_head, 0, tasks_offset, fields, 2, 0,
+                           VMI_OS_LINUX == vmi_get_ostype(vmi) ? VMI_WALK_INCLUDE_HEAD : 0,
+                           &walk);
+
+    for (i = 0; i < walk.count; i++) {
+        unsigned char *record = walk.records + i * walk.record_size;
+        char procname[PROCNAME_LEN + 1] = { 0 };
 
         /* NOTE: _EPROCESS.UniqueProcessId is a really VOID*, but is never > 32 bits,
          * so this is safe enough for x64 Windows for example purposes */
-        vmi_read_32_va(vmi, current_process + pid_offset, 0, (uint32_t*)&pid);
-
-        procname = vmi_read_str_va(vmi, current_process + name_offset, 0);
-
-        if (!procname) {
-            printf("Failed to find procname\n");
-            goto error_exit;
-        }
+        memcpy(&current_process, record, sizeof(addr_t));
+        memcpy(&pid, record + sizeof(addr_t), sizeof(uint32_t));
+        memcpy(procname, record + sizeof(addr_t) + sizeof(uint32_t), PROCNAME_LEN);
 
         /* print out the process name */
         printf("[%5d] %s (struct addr:%"PRIx64")\n", pid, procname, current_process);
-        if (procname) {
-            free(procname);
-            procname = NULL;
-        }
-
-        /* follow the next pointer */
-
-        status = vmi_read_addr_va(vmi, next_list_entry, 0, &next_list_entry);
-        if (status == VMI_FAILURE) {
-            printf("Failed to read next pointer in loop at %"PRIx64"\n", next_list_entry);
-            goto error_exit;
-        }
+    }
 
-    } while(next_list_entry != list_head);
+    if (status == VMI_FAILURE) {
+        printf("Failed to walk the whole process list, stopped after %zu processes\n", walk.count);
+    }
+    vmi_walk_list_free(&walk);
 
 error_exit:
     /* resume the vm */
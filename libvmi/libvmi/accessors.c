@@ -34,6 +34,9 @@ page_mode_t
 vmi_get_page_mode(
     vmi_instance_t vmi)
 {
+    if (VMI_PM_UNKNOWN == vmi->page_mode) {
+        os_init_lazy(vmi);
+    }
     return vmi->page_mode;
 }
 
@@ -71,6 +74,7 @@ vmi_get_winver(
 #else
     windows_instance_t windows_instance = NULL;
 
+    os_init_lazy(vmi);
     if (VMI_OS_WINDOWS != vmi->os_type || (VMI_INIT_PARTIAL & vmi->init_mode))
         return VMI_OS_WINDOWS_NONE;
 
@@ -136,6 +140,7 @@ vmi_get_offset(
 {
     size_t max_length = 100;
 
+    os_init_lazy(vmi);
     if (vmi->os_interface == NULL || vmi->os_interface->os_get_offset == NULL ) {
         return 0;
     }
@@ -157,6 +162,19 @@ vmi_get_max_physical_address(
     return vmi->max_physical_address;
 }
 
+size_t
+vmi_get_memory_map(
+    vmi_instance_t vmi,
+    const vmi_pa_range_t **ranges)
+{
+    if (!vmi || !ranges) {
+        return 0;
+    }
+
+    *ranges = vmi->memory_map;
+    return vmi->memory_map_count;
+}
+
 unsigned int
 vmi_get_num_vcpus(
     vmi_instance_t vmi)
@@ -195,7 +213,13 @@ status_t
 vmi_resume_vm(
     vmi_instance_t vmi)
 {
-    return driver_resume_vm(vmi);
+    if (VMI_FAILURE == driver_resume_vm(vmi)) {
+        return VMI_FAILURE;
+    }
+
+    /* the guest may map what was unmapped while it was paused */
+    g_atomic_int_inc(&vmi->v2p_generation);
+    return VMI_SUCCESS;
 }
 
 char *
@@ -236,9 +260,13 @@ addr_t vmi_translate_ksym2v (vmi_instance_t vmi, const char *symbol)
 
     if (VMI_FAILURE == sym_cache_get(vmi, base_vaddr, 0, symbol, &address)) {
 
+        os_init_lazy(vmi);
         if (vmi->os_interface && vmi->os_interface->os_ksym2v) {
+            uint64_t start = stat_enter(vmi, VMI_STAT_SYMBOL);
+
             status = vmi->os_interface->os_ksym2v(vmi, symbol, &base_vaddr,
                     &address);
+            stat_leave(vmi, VMI_STAT_SYMBOL, start);
             if (status == VMI_SUCCESS) {
                 sym_cache_set(vmi, base_vaddr, 0, symbol, address);
             }
@@ -257,6 +285,7 @@ addr_t vmi_translate_sym2v (vmi_instance_t vmi, addr_t base_vaddr, vmi_pid_t pid
 
     if (VMI_FAILURE == sym_cache_get(vmi, base_vaddr, pid, symbol, &address)) {
 
+        os_init_lazy(vmi);
         if (vmi->os_interface && vmi->os_interface->os_usym2rva) {
             status  = vmi->os_interface->os_usym2rva(vmi, base_vaddr, pid, symbol, &rva);
             if (status == VMI_SUCCESS) {
@@ -275,6 +304,7 @@ const char* vmi_translate_v2sym(vmi_instance_t vmi, addr_t base_vaddr, vmi_pid_t
     char *ret = NULL;
 
     if (VMI_FAILURE == rva_cache_get(vmi, base_vaddr, pid, rva, &ret)) {
+        os_init_lazy(vmi);
         if (vmi->os_interface && vmi->os_interface->os_v2sym) {
             ret = vmi->os_interface->os_v2sym(vmi, rva, base_vaddr, pid);
         }
@@ -292,6 +322,7 @@ addr_t vmi_pid_to_dtb (vmi_instance_t vmi, vmi_pid_t pid)
 {
     addr_t dtb = 0;
 
+    os_init_lazy(vmi);
     if (!vmi->os_interface) {
         return 0;
     }
@@ -318,6 +349,7 @@ vmi_pid_t vmi_dtb_to_pid (vmi_instance_t vmi, addr_t dtb)
 {
     vmi_pid_t pid = -1;
 
+    os_init_lazy(vmi);
     if (vmi->os_interface && vmi->os_interface->os_pgd_to_pid) {
         pid = vmi->os_interface->os_pgd_to_pid(vmi, dtb);
     }
@@ -332,6 +364,9 @@ vmi_read_page (vmi_instance_t vmi, addr_t frame_num)
 }
 
 GSList* vmi_get_va_pages(vmi_instance_t vmi, addr_t dtb) {
+    if (!vmi->arch_interface) {
+        os_init_lazy(vmi);
+    }
     if(vmi->arch_interface && vmi->arch_interface->get_va_pages) {
         return vmi->arch_interface->get_va_pages(vmi, dtb);
     } else {
@@ -340,6 +375,127 @@ GSList* vmi_get_va_pages(vmi_instance_t vmi, addr_t dtb) {
     }
 }
 
+/* whether every level of the translation of a page allows user access */
+static gboolean
+va_page_user(
+    vmi_instance_t vmi,
+    const page_info_t *info)
+{
+    addr_t entries[4] = { 0 };
+    size_t i;
+
+    switch (vmi->page_mode) {
+        case VMI_PM_LEGACY:
+            entries[0] = info->x86_legacy.pgd_value;
+            entries[1] = info->x86_legacy.pte_value;
+            break;
+        case VMI_PM_PAE:
+            entries[0] = info->x86_pae.pgd_value;
+            entries[1] = info->x86_pae.pte_value;
+            break;
+        case VMI_PM_IA32E:
+            entries[0] = info->x86_ia32e.pml4e_value;
+            entries[1] = info->x86_ia32e.pdpte_value;
+            entries[2] = info->x86_ia32e.pgd_value;
+            entries[3] = info->x86_ia32e.pte_value;
+            break;
+        default:
+            return TRUE;
+    }
+
+    /* the levels below a large page are left 0 */
+    for (i = 0; i < 4; i++) {
+        if (entries[i] && !VMI_GET_BIT(entries[i], 2)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int
+va_run_compare(
+    const void *a,
+    const void *b)
+{
+    const vmi_va_run_t *ra = a, *rb = b;
+
+    return ra->vaddr < rb->vaddr ? -1 : ra->vaddr > rb->vaddr;
+}
+
+size_t
+vmi_get_va_runs(
+    vmi_instance_t vmi,
+    addr_t dtb,
+    uint32_t flags,
+    vmi_va_run_t **runs)
+{
+    GSList *pages = NULL, *loop = NULL;
+    vmi_va_run_t *result = NULL;
+    size_t count = 0, merged = 0, i;
+
+    if (!vmi || !runs) {
+        return 0;
+    }
+    *runs = NULL;
+
+    pages = vmi_get_va_pages(vmi, dtb);
+    if (!pages) {
+        return 0;
+    }
+
+    result = malloc(g_slist_length(pages) * sizeof(vmi_va_run_t));
+    for (loop = pages; loop; loop = loop->next) {
+        page_info_t *info = loop->data;
+        addr_t length = 0;
+
+        switch (info->size) {
+            case VMI_PS_4KB:
+                length = 0x1000ULL;
+                break;
+            case VMI_PS_2MB:
+                length = 0x200000ULL;
+                break;
+            case VMI_PS_4MB:
+                length = 0x400000ULL;
+                break;
+            case VMI_PS_1GB:
+                length = 0x40000000ULL;
+                break;
+            default:
+                break;
+        }
+
+        if (result && length && (!(flags & VMI_VA_RUNS_USER) || va_page_user(vmi, info))) {
+            result[count].vaddr = info->vaddr;
+            result[count].paddr = info->paddr;
+            result[count].length = length;
+            count++;
+        }
+        g_free(info);
+    }
+    g_slist_free(pages);
+
+    if (!count) {
+        free(result);
+        return 0;
+    }
+
+    qsort(result, count, sizeof(vmi_va_run_t), va_run_compare);
+    for (i = 1; i < count; i++) {
+        vmi_va_run_t *last = &result[merged];
+
+        if (last->vaddr + last->length == result[i].vaddr
+            && last->paddr + last->length == result[i].paddr) {
+            last->length += result[i].length;
+        } else {
+            result[++merged] = result[i];
+        }
+    }
+
+    *runs = result;
+    return merged + 1;
+}
+
 addr_t vmi_pagetable_lookup (vmi_instance_t vmi, addr_t dtb, addr_t vaddr)
 {
     addr_t paddr = 0;
@@ -387,9 +543,18 @@ status_t vmi_pagetable_lookup_cache(
             v2p_cache_del(vmi, vaddr, dtb);
         }
     }
+    else if (VMI_SUCCESS == v2p_neg_cache_get(vmi, vaddr, dtb)) {
+        return VMI_FAILURE;
+    }
 
+    if (!vmi->arch_interface) {
+        os_init_lazy(vmi);
+    }
     if(vmi->arch_interface && vmi->arch_interface->v2p) {
+        uint64_t start = stat_enter(vmi, VMI_STAT_TRANSLATE);
+
         ret = vmi->arch_interface->v2p(vmi, dtb, vaddr, &info);
+        stat_leave(vmi, VMI_STAT_TRANSLATE, start);
     } else {
         errprint("Invalid paging mode during vmi_pagetable_lookup\n");
         ret = VMI_FAILURE;
@@ -400,6 +565,9 @@ status_t vmi_pagetable_lookup_cache(
         *paddr = info.paddr;
         v2p_cache_set(vmi, vaddr, dtb, info.paddr);
     }
+    else if (vmi->arch_interface) {
+        v2p_neg_cache_set(vmi, vaddr, dtb, &info);
+    }
     return ret;
 }
 
@@ -418,8 +586,14 @@ status_t vmi_pagetable_lookup_extended(
     info->vaddr = vaddr;
     info->dtb = dtb;
 
+    if (!vmi->arch_interface) {
+        os_init_lazy(vmi);
+    }
     if(vmi->arch_interface && vmi->arch_interface->v2p) {
+        uint64_t start = stat_enter(vmi, VMI_STAT_TRANSLATE);
+
         ret = vmi->arch_interface->v2p(vmi, dtb, vaddr, info);
+        stat_leave(vmi, VMI_STAT_TRANSLATE, start);
     } else {
         errprint("Invalid paging mode during vmi_pagetable_lookup\n");
     }
@@ -431,9 +605,82 @@ status_t vmi_pagetable_lookup_extended(
     return ret;
 }
 
+static gint
+translate_batch_cmp(
+    gconstpointer a,
+    gconstpointer b,
+    gpointer vaddrs)
+{
+    addr_t va = ((const addr_t *) vaddrs)[*(const size_t *) a];
+    addr_t vb = ((const addr_t *) vaddrs)[*(const size_t *) b];
+
+    return va < vb ? -1 : va > vb;
+}
+
+size_t
+vmi_translate_batch(
+    vmi_instance_t vmi,
+    addr_t dtb,
+    const addr_t *vaddrs,
+    addr_t *paddrs,
+    size_t n)
+{
+    size_t *order = NULL;
+    size_t i, count = 0;
+    gboolean sorted = TRUE;
+
+    if (!vaddrs || !paddrs || !n) {
+        return 0;
+    }
+
+    if (!vmi->arch_interface) {
+        os_init_lazy(vmi);
+    }
+
+    order = g_malloc(n * sizeof(size_t));
+    for (i = 0; i < n; i++) {
+        order[i] = i;
+        if (i && vaddrs[i] < vaddrs[i - 1]) {
+            sorted = FALSE;
+        }
+    }
+    if (!sorted) {
+        g_qsort_with_data(order, n, sizeof(size_t), translate_batch_cmp, (gpointer) vaddrs);
+    }
+
+    if (vmi->arch_interface && vmi->arch_interface->v2p_batch) {
+        count = vmi->arch_interface->v2p_batch(vmi, dtb, vaddrs, paddrs, order, n);
+    } else {
+        /* a walk per page */
+        addr_t page = 1, ppage = 0;
+        status_t status = VMI_FAILURE;
+
+        for (i = 0; i < n; i++) {
+            addr_t vaddr = vaddrs[order[i]];
+
+            if ((vaddr & ~((addr_t) vmi->page_size - 1)) != page) {
+                page = vaddr & ~((addr_t) vmi->page_size - 1);
+                status = vmi_pagetable_lookup_cache(vmi, dtb, page, &ppage);
+            }
+
+            paddrs[order[i]] = 0;
+            if (VMI_SUCCESS == status) {
+                paddrs[order[i]] = ppage | (vaddr & (vmi->page_size - 1));
+                count++;
+            }
+        }
+    }
+
+    g_free(order);
+    return count;
+}
+
 /* expose virtual to physical mapping for kernel space via api call */
 addr_t vmi_translate_kv2p (vmi_instance_t vmi, addr_t virt_address)
 {
+    if (!vmi->kpgd) {
+        os_init_lazy(vmi);
+    }
     if (!vmi->kpgd) {
         dbprint(VMI_DEBUG_PTLOOKUP, "--early bail on v2p lookup because the kernel page global directory is unknown\n");
         return 0;
@@ -454,10 +701,13 @@ addr_t vmi_translate_uv2p (vmi_instance_t vmi, addr_t virt_address, vmi_pid_t pi
     }
 
     if (VMI_SUCCESS != vmi_pagetable_lookup_cache(vmi, dtb, virt_address, &paddr)) {
+        addr_t stale_dtb = dtb;
+
         pid_cache_del(vmi, pid);
 
+        /* walking the same tables again would fail the same way */
         dtb = vmi_pid_to_dtb(vmi, pid);
-        if (dtb) {
+        if (dtb && dtb != stale_dtb) {
             page_info_t info = {0};
             /* _extended() skips the v2p_cache lookup that must have already failed */
             if (VMI_SUCCESS == vmi_pagetable_lookup_extended(vmi, dtb, virt_address, &info)) {
@@ -231,6 +231,82 @@ done:
     return status;
 }
 
+/*
+ * The addresses come sorted, so the entries read for an address are kept
+ * for the next ones and each entry is read once for the run of addresses
+ * it maps. The va of a kept entry is masked to the range it maps, 1 when
+ * nothing is kept.
+ */
+size_t v2p_batch_ia32e (vmi_instance_t vmi,
+    addr_t dtb,
+    const addr_t *vaddrs,
+    addr_t *paddrs,
+    const size_t *order,
+    size_t n)
+{
+    addr_t location = 0;
+    uint64_t pml4e = 0, pdpte = 0, pte = 0;
+    addr_t pde = 0;
+    addr_t pml4e_va = 1, pdpte_va = 1, pde_va = 1, pte_va = 1;
+    size_t i, count = 0;
+
+    for (i = 0; i < n; i++) {
+        addr_t vaddr = vaddrs[order[i]];
+
+        paddrs[order[i]] = 0;
+
+        if ((vaddr & VMI_BIT_MASK(39,63)) != pml4e_va) {
+            get_pml4e(vmi, vaddr, dtb, &location, &pml4e);
+            pml4e_va = vaddr & VMI_BIT_MASK(39,63);
+            pdpte_va = pde_va = pte_va = 1;
+        }
+        if (!ENTRY_PRESENT(vmi->os_type, pml4e)) {
+            continue;
+        }
+
+        if ((vaddr & VMI_BIT_MASK(30,63)) != pdpte_va) {
+            get_pdpte_ia32e(vmi, vaddr, pml4e, &location, &pdpte);
+            pdpte_va = vaddr & VMI_BIT_MASK(30,63);
+            pde_va = pte_va = 1;
+        }
+        if (!ENTRY_PRESENT(vmi->os_type, pdpte)) {
+            continue;
+        }
+        if (PAGE_SIZE(pdpte)) {
+            paddrs[order[i]] = get_gigpage_ia32e(vaddr, pdpte);
+            count++;
+            continue;
+        }
+
+        if ((vaddr & VMI_BIT_MASK(21,63)) != pde_va) {
+            get_pde_ia32e(vmi, vaddr, pdpte, &location, &pde);
+            pde_va = vaddr & VMI_BIT_MASK(21,63);
+            pte_va = 1;
+        }
+        if (!ENTRY_PRESENT(vmi->os_type, pde)) {
+            continue;
+        }
+        if (PAGE_SIZE(pde)) {
+            paddrs[order[i]] = get_2megpage_ia32e(vaddr, pde);
+            count++;
+            continue;
+        }
+
+        if ((vaddr & VMI_BIT_MASK(12,63)) != pte_va) {
+            get_pte_ia32e(vmi, vaddr, pde, &location, &pte);
+            pte_va = vaddr & VMI_BIT_MASK(12,63);
+        }
+        if (!ENTRY_PRESENT(vmi->os_type, pte)) {
+            continue;
+        }
+
+        paddrs[order[i]] = get_paddr_ia32e(vaddr, pte);
+        count++;
+    }
+
+    return count;
+}
+
 GSList* get_va_pages_ia32e(vmi_instance_t vmi, addr_t dtb) {
 
     GSList *ret = NULL;
@@ -365,6 +441,7 @@ status_t amd64_init(vmi_instance_t vmi) {
 
     vmi->arch_interface->v2p = v2p_ia32e;
     vmi->arch_interface->get_va_pages = get_va_pages_ia32e;
+    vmi->arch_interface->v2p_batch = v2p_batch_ia32e;
 
     return VMI_SUCCESS;
 }
@@ -25,10 +25,13 @@
 
 typedef status_t (*arch_v2p_t)(vmi_instance_t vmi, addr_t dtb, addr_t vaddr, page_info_t *info);
 typedef GSList* (*arch_get_va_pages_t)(vmi_instance_t vmi, addr_t dtb);
+typedef size_t (*arch_v2p_batch_t)(vmi_instance_t vmi, addr_t dtb, const addr_t *vaddrs,
+                                   addr_t *paddrs, const size_t *order, size_t n);
 
 struct arch_interface {
     arch_v2p_t v2p;
     arch_get_va_pages_t get_va_pages;
+    arch_v2p_batch_t v2p_batch; /**< optional, translates vaddrs[order[i]] in order */
 };
 typedef struct arch_interface *arch_interface_t;
 
@@ -381,6 +381,109 @@ done:
     return status;
 }
 
+/* see v2p_batch_ia32e */
+size_t v2p_batch_nopae (vmi_instance_t vmi,
+    addr_t dtb,
+    const addr_t *vaddrs,
+    addr_t *paddrs,
+    const size_t *order,
+    size_t n)
+{
+    addr_t location = 0, pgd = 0, pte = 0;
+    addr_t pgd_va = 1, pte_va = 1;
+    size_t i, count = 0;
+
+    for (i = 0; i < n; i++) {
+        addr_t vaddr = vaddrs[order[i]];
+
+        paddrs[order[i]] = 0;
+
+        if ((vaddr & VMI_BIT_MASK(22,63)) != pgd_va) {
+            get_pgd_nopae(vmi, vaddr, dtb, &location, &pgd);
+            pgd_va = vaddr & VMI_BIT_MASK(22,63);
+            pte_va = 1;
+        }
+        if (!ENTRY_PRESENT(vmi->os_type, pgd)) {
+            continue;
+        }
+        if (PAGE_SIZE(pgd) && (VMI_FILE == vmi->mode || vmi->pse)) {
+            paddrs[order[i]] = get_large_paddr_nopae(vaddr, pgd);
+            count++;
+            continue;
+        }
+
+        if ((vaddr & VMI_BIT_MASK(12,63)) != pte_va) {
+            get_pte_nopae(vmi, vaddr, pgd, &location, &pte);
+            pte_va = vaddr & VMI_BIT_MASK(12,63);
+        }
+        if (!ENTRY_PRESENT(vmi->os_type, pte)) {
+            continue;
+        }
+
+        paddrs[order[i]] = get_paddr_nopae(vaddr, pte);
+        count++;
+    }
+
+    return count;
+}
+
+/* see v2p_batch_ia32e */
+size_t v2p_batch_pae (vmi_instance_t vmi,
+    addr_t dtb,
+    const addr_t *vaddrs,
+    addr_t *paddrs,
+    const size_t *order,
+    size_t n)
+{
+    addr_t location = 0;
+    uint64_t pdpe = 0, pgd = 0, pte = 0;
+    addr_t pdpe_va = 1, pgd_va = 1, pte_va = 1;
+    size_t i, count = 0;
+
+    for (i = 0; i < n; i++) {
+        addr_t vaddr = vaddrs[order[i]];
+
+        paddrs[order[i]] = 0;
+
+        if ((vaddr & VMI_BIT_MASK(30,63)) != pdpe_va) {
+            pdpe = 0;
+            get_pdpi(vmi, vaddr, dtb, &location, &pdpe);
+            pdpe_va = vaddr & VMI_BIT_MASK(30,63);
+            pgd_va = pte_va = 1;
+        }
+        if (!ENTRY_PRESENT(vmi->os_type, pdpe)) {
+            continue;
+        }
+
+        if ((vaddr & VMI_BIT_MASK(21,63)) != pgd_va) {
+            get_pgd_pae(vmi, vaddr, pdpe, &location, &pgd);
+            pgd_va = vaddr & VMI_BIT_MASK(21,63);
+            pte_va = 1;
+        }
+        if (!ENTRY_PRESENT(vmi->os_type, pgd)) {
+            continue;
+        }
+        if (PAGE_SIZE(pgd)) {
+            paddrs[order[i]] = get_large_paddr_pae(vaddr, pgd);
+            count++;
+            continue;
+        }
+
+        if ((vaddr & VMI_BIT_MASK(12,63)) != pte_va) {
+            get_pte_pae(vmi, vaddr, pgd, &location, &pte);
+            pte_va = vaddr & VMI_BIT_MASK(12,63);
+        }
+        if (!ENTRY_PRESENT(vmi->os_type, pte)) {
+            continue;
+        }
+
+        paddrs[order[i]] = get_paddr_pae(vaddr, pte);
+        count++;
+    }
+
+    return count;
+}
+
 GSList* get_va_pages_nopae(vmi_instance_t vmi, addr_t dtb) {
 
     addr_t pgd_location = dtb;
@@ -550,9 +653,11 @@ status_t intel_init(vmi_instance_t vmi) {
     if(vmi->page_mode == VMI_PM_LEGACY) {
         vmi->arch_interface->v2p = v2p_nopae;
         vmi->arch_interface->get_va_pages = get_va_pages_nopae;
+        vmi->arch_interface->v2p_batch = v2p_batch_nopae;
     } else if(vmi->page_mode == VMI_PM_PAE) {
         vmi->arch_interface->v2p = v2p_pae;
         vmi->arch_interface->get_va_pages = get_va_pages_pae;
+        vmi->arch_interface->v2p_batch = v2p_batch_pae;
     } else {
         ret = VMI_FAILURE;
         free(vmi->arch_interface);
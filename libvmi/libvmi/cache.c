@@ -159,14 +159,18 @@ pid_cache_get(
     pid_cache_entry_t entry = NULL;
     gint key = (gint) pid;
 
+    status_t ret = VMI_FAILURE;
+
+    g_mutex_lock(&vmi->cache_lock);
     if ((entry = g_hash_table_lookup(vmi->pid_cache, &key)) != NULL) {
         entry->last_used = time(NULL);
         *dtb = entry->dtb;
         dbprint(VMI_DEBUG_PIDCACHE, "--PID cache hit %d -- 0x%.16"PRIx64"\n", pid, *dtb);
-        return VMI_SUCCESS;
+        ret = VMI_SUCCESS;
     }
+    g_mutex_unlock(&vmi->cache_lock);
 
-    return VMI_FAILURE;
+    return ret;
 }
 
 void
@@ -180,7 +184,9 @@ pid_cache_set(
     *key = pid;
     pid_cache_entry_t entry = pid_cache_entry_create(pid, dtb);
 
+    g_mutex_lock(&vmi->cache_lock);
     g_hash_table_insert(vmi->pid_cache, key, entry);
+    g_mutex_unlock(&vmi->cache_lock);
     dbprint(VMI_DEBUG_PIDCACHE, "--PID cache set %d -- 0x%.16"PRIx64"\n", pid, dtb);
 }
 
@@ -190,21 +196,23 @@ pid_cache_del(
     vmi_pid_t pid)
 {
     gint key = (gint) pid;
+    gboolean removed = FALSE;
 
     dbprint(VMI_DEBUG_PIDCACHE, "--PID cache del %d\n", pid);
-    if (TRUE == g_hash_table_remove(vmi->pid_cache, &key)) {
-        return VMI_SUCCESS;
-    }
-    else {
-        return VMI_FAILURE;
-    }
+    g_mutex_lock(&vmi->cache_lock);
+    removed = g_hash_table_remove(vmi->pid_cache, &key);
+    g_mutex_unlock(&vmi->cache_lock);
+
+    return removed ? VMI_SUCCESS : VMI_FAILURE;
 }
 
 void
 pid_cache_flush(
     vmi_instance_t vmi)
 {
+    g_mutex_lock(&vmi->cache_lock);
     g_hash_table_remove_all(vmi->pid_cache);
+    g_mutex_unlock(&vmi->cache_lock);
     dbprint(VMI_DEBUG_PIDCACHE, "--PID cache flushed\n");
 }
 
@@ -283,8 +291,9 @@ sym_cache_get(
     key_128_t key = &local_key;
     key_128_init(vmi, key, (uint64_t)base_addr, (uint64_t)pid);
 
+    g_mutex_lock(&vmi->cache_lock);
     if ((symbol_table = g_hash_table_lookup(vmi->sym_cache, key)) == NULL) {
-        return ret;
+        goto done;
     }
 
     if ((entry = g_hash_table_lookup(symbol_table, sym)) != NULL) {
@@ -294,6 +303,8 @@ sym_cache_get(
         ret=VMI_SUCCESS;
     }
 
+done:
+    g_mutex_unlock(&vmi->cache_lock);
     return ret;
 }
 
@@ -311,6 +322,7 @@ sym_cache_set(
 
     key_128_t key = key_128_build(vmi, (uint64_t)base_addr, (uint64_t)pid);
 
+    g_mutex_lock(&vmi->cache_lock);
     symbol_table = g_hash_table_lookup(vmi->sym_cache, key);
     if (symbol_table == NULL) {
         symbol_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
@@ -322,6 +334,7 @@ sym_cache_set(
 
     sym_dup = strndup(sym, 100);
     g_hash_table_insert(symbol_table, sym_dup, entry);
+    g_mutex_unlock(&vmi->cache_lock);
     dbprint(VMI_DEBUG_SYMCACHE, "--SYM cache set %s -- 0x%.16"PRIx64"\n", sym, va);
 }
 
@@ -338,8 +351,9 @@ sym_cache_del(
     key_128_t key = &local_key;
     key_128_init(vmi, key, (uint64_t)base_addr, (uint64_t)pid);
 
+    g_mutex_lock(&vmi->cache_lock);
     if ((symbol_table = g_hash_table_lookup(vmi->sym_cache, key)) == NULL) {
-        return ret;
+        goto done;
     }
 
     dbprint(VMI_DEBUG_SYMCACHE, "--SYM cache del %u:0x%.16"PRIx64":%s\n", pid, base_addr, sym);
@@ -352,6 +366,8 @@ sym_cache_del(
         }
     }
 
+done:
+    g_mutex_unlock(&vmi->cache_lock);
     return ret;
 }
 
@@ -359,7 +375,9 @@ void
 sym_cache_flush(
     vmi_instance_t vmi)
 {
+    g_mutex_lock(&vmi->cache_lock);
     g_hash_table_remove_all(vmi->sym_cache);
+    g_mutex_unlock(&vmi->cache_lock);
     dbprint(VMI_DEBUG_SYMCACHE, "--SYM cache flushed\n");
 }
 
@@ -396,8 +414,9 @@ rva_cache_get(
     key_128_t key = &local_key;
     key_128_init(vmi, key, (uint64_t)base_addr, (uint64_t)pid);
 
+    g_mutex_lock(&vmi->cache_lock);
     if ((rva_table = g_hash_table_lookup(vmi->rva_cache, key)) == NULL) {
-        return ret;
+        goto done;
     }
 
     if ((entry = g_hash_table_lookup(rva_table, GUINT_TO_POINTER(rva))) != NULL) {
@@ -407,6 +426,8 @@ rva_cache_get(
         ret=VMI_SUCCESS;
     }
 
+done:
+    g_mutex_unlock(&vmi->cache_lock);
     return ret;
 }
 
@@ -423,6 +444,7 @@ rva_cache_set(
 
     key_128_t key = key_128_build(vmi, (uint64_t)base_addr, (uint64_t)pid);
 
+    g_mutex_lock(&vmi->cache_lock);
     if ((rva_table = g_hash_table_lookup(vmi->rva_cache, key)) == NULL) {
         rva_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
                               sym_cache_entry_free);
@@ -432,6 +454,7 @@ rva_cache_set(
     }
 
     g_hash_table_insert(rva_table, GUINT_TO_POINTER(rva), entry);
+    g_mutex_unlock(&vmi->cache_lock);
     dbprint(VMI_DEBUG_RVACACHE, "--RVA cache set %s -- 0x%.16"PRIx64"\n", sym, rva);
 }
 
@@ -448,8 +471,9 @@ rva_cache_del(
     key_128_t key = &local_key;
     key_128_init(vmi, key, (uint64_t)base_addr, (uint64_t)pid);
 
+    g_mutex_lock(&vmi->cache_lock);
     if ((rva_table = g_hash_table_lookup(vmi->rva_cache, key)) == NULL) {
-        return ret;
+        goto done;
     }
 
     dbprint(VMI_DEBUG_RVACACHE, "--RVA cache del %u:0x%.16"PRIx64":0x%.16"PRIx64"\n",
@@ -463,6 +487,8 @@ rva_cache_del(
         }
     }
 
+done:
+    g_mutex_unlock(&vmi->cache_lock);
     return ret;
 }
 
@@ -470,7 +496,9 @@ void
 rva_cache_flush(
     vmi_instance_t vmi)
 {
+    g_mutex_lock(&vmi->cache_lock);
     g_hash_table_remove_all(vmi->rva_cache);
+    g_mutex_unlock(&vmi->cache_lock);
     dbprint(VMI_DEBUG_RVACACHE, "--RVA cache flushed\n");
 }
 
@@ -491,18 +519,166 @@ static v2p_cache_entry_t v2p_cache_entry_create (vmi_instance_t vmi, addr_t pa)
     return entry;
 }
 
+// translations are looked up on every read, so the v2p cache is striped
+static inline v2p_cache_shard_t *
+v2p_cache_shard(
+    vmi_instance_t vmi,
+    key_128_t key)
+{
+    return &vmi->v2p_cache[(key_128_hash(key) >> 32) & (VMI_CACHE_SHARDS - 1)];
+}
+
+/*
+ * Negative translations: a walk that stops at a non-present entry fails
+ * for the whole range the entry covers, up to 512 GB for a PML4E. The
+ * range is kept in a small direct mapped table, so probing unmapped
+ * addresses costs a lookup per paging level instead of a walk. Entries
+ * are valid for the v2p_generation they were made in, which every v2p
+ * flush and every resume of the VM advances.
+ */
+#define V2P_NEG_SLOTS 1024
+
+struct v2p_neg_entry {
+    addr_t dtb;
+    addr_t base;        /**< start of the unmapped range */
+    uint8_t shift;      /**< log2 of its size, 0 for a free slot */
+    gint generation;
+};
+
 void
 v2p_cache_init(
     vmi_instance_t vmi)
 {
-    vmi->v2p_cache = g_hash_table_new_full((GHashFunc) key_128_hash, key_128_equals, g_free, g_free);
+    int i;
+
+    for (i = 0; i < VMI_CACHE_SHARDS; i++) {
+        g_mutex_init(&vmi->v2p_cache[i].lock);
+        vmi->v2p_cache[i].cache = g_hash_table_new_full((GHashFunc) key_128_hash, key_128_equals, g_free, g_free);
+    }
+    g_mutex_init(&vmi->v2p_neg_lock);
+    vmi->v2p_neg_cache = g_malloc0(V2P_NEG_SLOTS * sizeof(struct v2p_neg_entry));
 }
 
 void
 v2p_cache_destroy(
     vmi_instance_t vmi)
 {
-    g_hash_table_destroy(vmi->v2p_cache);
+    int i;
+
+    for (i = 0; i < VMI_CACHE_SHARDS; i++) {
+        if (vmi->v2p_cache[i].cache) {
+            g_hash_table_destroy(vmi->v2p_cache[i].cache);
+            vmi->v2p_cache[i].cache = NULL;
+            g_mutex_clear(&vmi->v2p_cache[i].lock);
+        }
+    }
+    if (vmi->v2p_neg_cache) {
+        g_free(vmi->v2p_neg_cache);
+        vmi->v2p_neg_cache = NULL;
+        g_mutex_clear(&vmi->v2p_neg_lock);
+    }
+}
+
+/*
+ * The kernel half of the address space is mapped by the same tables in
+ * every process, so translations there are keyed by the top level entry
+ * (PML4E, PDPTE or PDE) instead of the dtb and shared by the processes
+ * whose entries match. The entries are cached as well, by (index, dtb).
+ * The tags in the low bits of the va keep the three kinds of keys apart,
+ * as the va of a translation is page aligned.
+ */
+#define V2P_KEY_SHARED 0x1
+#define V2P_KEY_TOP 0x2
+
+static gboolean
+v2p_cache_top_entry(
+    vmi_instance_t vmi,
+    addr_t va,
+    addr_t dtb,
+    uint64_t *entry)
+{
+    v2p_cache_entry_t cached = NULL;
+    struct key_128 local_key;
+    key_128_t key = &local_key;
+    v2p_cache_shard_t *shard = NULL;
+    addr_t table = 0;
+    uint64_t index = 0;
+    size_t size = 8;
+    gboolean found = FALSE;
+
+    switch (vmi->page_mode) {
+        case VMI_PM_IA32E:
+            if (!(va & VMI_BIT_MASK(47, 47))) {
+                return FALSE;
+            }
+            table = dtb & VMI_BIT_MASK(12, 51);
+            index = (va >> 39) & 0x1ff;
+            break;
+        case VMI_PM_PAE:
+            if (va < 0x80000000ULL) {
+                return FALSE;
+            }
+            table = dtb & VMI_BIT_MASK(5, 31);
+            index = (va >> 30) & 0x3;
+            break;
+        case VMI_PM_LEGACY:
+            if (va < 0x80000000ULL) {
+                return FALSE;
+            }
+            table = dtb & VMI_BIT_MASK(12, 31);
+            index = (va >> 22) & 0x3ff;
+            size = 4;
+            break;
+        default:
+            return FALSE;
+    }
+
+    key->low = (index << 2) | V2P_KEY_TOP;
+    key->high = dtb;
+    shard = v2p_cache_shard(vmi, key);
+
+    g_mutex_lock(&shard->lock);
+    if ((cached = g_hash_table_lookup(shard->cache, key)) != NULL) {
+        *entry = cached->pa;
+        found = TRUE;
+    }
+    g_mutex_unlock(&shard->lock);
+
+    if (!found) {
+        *entry = 0;
+        if (vmi_read_pa(vmi, table + index * size, entry, size) != size || !(*entry & 0x1)) {
+            return FALSE;
+        }
+        /* the accessed and dirty bits change under the guest's feet */
+        *entry &= ~0x60ULL;
+
+        cached = (v2p_cache_entry_t) safe_malloc(sizeof(struct v2p_cache_entry));
+        cached->pa = *entry;
+        cached->last_used = time(NULL);
+        key = g_memdup(key, sizeof(struct key_128));
+
+        g_mutex_lock(&shard->lock);
+        g_hash_table_insert(shard->cache, key, cached);
+        g_mutex_unlock(&shard->lock);
+    }
+
+    return TRUE;
+}
+
+static void
+v2p_cache_key(
+    vmi_instance_t vmi,
+    addr_t va,
+    addr_t dtb,
+    key_128_t key)
+{
+    uint64_t entry = 0;
+
+    key_128_init(vmi, key, (uint64_t)va, (uint64_t)dtb);
+    if (v2p_cache_top_entry(vmi, va, dtb, &entry)) {
+        key->low |= V2P_KEY_SHARED;
+        key->high = entry;
+    }
 }
 
 status_t
@@ -516,18 +692,24 @@ v2p_cache_get(
     struct key_128 local_key;
     key_128_t key = &local_key;
 
-    key_128_init(vmi, key, (uint64_t)va, (uint64_t)dtb);
+    v2p_cache_shard_t *shard = NULL;
+    status_t ret = VMI_FAILURE;
+
+    v2p_cache_key(vmi, va, dtb, key);
+    shard = v2p_cache_shard(vmi, key);
 
-    if ((entry = g_hash_table_lookup(vmi->v2p_cache, key)) != NULL) {
+    g_mutex_lock(&shard->lock);
+    if ((entry = g_hash_table_lookup(shard->cache, key)) != NULL) {
 
         entry->last_used = time(NULL);
         *pa = entry->pa | ((vmi->page_size - 1) & va);
         dbprint(VMI_DEBUG_V2PCACHE, "--V2P cache hit 0x%.16"PRIx64" -- 0x%.16"PRIx64" (0x%.16"PRIx64"/0x%.16"PRIx64")\n",
                 va, *pa, key->high, key->low);
-        return VMI_SUCCESS;
+        ret = VMI_SUCCESS;
     }
+    g_mutex_unlock(&shard->lock);
 
-    return VMI_FAILURE;
+    return ret;
 }
 
 void
@@ -540,11 +722,16 @@ v2p_cache_set(
     if (!va || !dtb || !pa) {
         return;
     }
-    key_128_t key = key_128_build(vmi, (uint64_t)va, (uint64_t)dtb);
+    key_128_t key = (key_128_t) safe_malloc(sizeof(struct key_128));
+    v2p_cache_key(vmi, va, dtb, key);
     v2p_cache_entry_t entry = v2p_cache_entry_create(vmi, pa);
-    g_hash_table_insert(vmi->v2p_cache, key, entry);
+    v2p_cache_shard_t *shard = v2p_cache_shard(vmi, key);
+
+    g_mutex_lock(&shard->lock);
+    g_hash_table_insert(shard->cache, key, entry);
     dbprint(VMI_DEBUG_V2PCACHE, "--V2P cache set 0x%.16"PRIx64" -- 0x%.16"PRIx64" (0x%.16"PRIx64"/0x%.16"PRIx64")\n", va,
             pa, key->high, key->low);
+    g_mutex_unlock(&shard->lock);
 }
 
 status_t
@@ -555,26 +742,144 @@ v2p_cache_del(
 {
     struct key_128 local_key;
     key_128_t key = &local_key;
-    key_128_init(vmi, key, (uint64_t)va, (uint64_t)dtb);
+    v2p_cache_shard_t *shard = NULL;
+    gboolean removed = FALSE;
+
+    v2p_cache_key(vmi, va, dtb, key);
+    shard = v2p_cache_shard(vmi, key);
     dbprint(VMI_DEBUG_V2PCACHE, "--V2P cache del 0x%.16"PRIx64" (0x%.16"PRIx64"/0x%.16"PRIx64")\n", va,
             key->high, key->low);
 
     // key collision doesn't really matter here because worst case
     // scenario we incur an small performance hit
 
-    if (TRUE == g_hash_table_remove(vmi->v2p_cache, key)){
-        return VMI_SUCCESS;
+    g_mutex_lock(&shard->lock);
+    removed = g_hash_table_remove(shard->cache, key);
+    g_mutex_unlock(&shard->lock);
+
+    return removed ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+static const uint8_t v2p_neg_shifts_ia32e[] = { 39, 30, 21, 12, 0 };
+static const uint8_t v2p_neg_shifts_pae[] = { 30, 21, 12, 0 };
+static const uint8_t v2p_neg_shifts_legacy[] = { 22, 12, 0 };
+
+static const uint8_t *
+v2p_neg_shifts(
+    vmi_instance_t vmi)
+{
+    switch (vmi->page_mode) {
+        case VMI_PM_IA32E:
+            return v2p_neg_shifts_ia32e;
+        case VMI_PM_PAE:
+            return v2p_neg_shifts_pae;
+        case VMI_PM_LEGACY:
+            return v2p_neg_shifts_legacy;
+        default:
+            return NULL;
     }
-    else{
+}
+
+static inline struct v2p_neg_entry *
+v2p_neg_slot(
+    vmi_instance_t vmi,
+    addr_t va,
+    addr_t dtb,
+    uint8_t shift)
+{
+    return &vmi->v2p_neg_cache[hash128to64((va >> shift) ^ ((uint64_t) shift << 56), dtb)
+                               & (V2P_NEG_SLOTS - 1)];
+}
+
+status_t
+v2p_neg_cache_get(
+    vmi_instance_t vmi,
+    addr_t va,
+    addr_t dtb)
+{
+    const uint8_t *shift = v2p_neg_shifts(vmi);
+    gint generation = g_atomic_int_get(&vmi->v2p_generation);
+    status_t ret = VMI_FAILURE;
+
+    if (!shift) {
         return VMI_FAILURE;
     }
+
+    g_mutex_lock(&vmi->v2p_neg_lock);
+    for (; *shift && ret == VMI_FAILURE; shift++) {
+        struct v2p_neg_entry *entry = v2p_neg_slot(vmi, va, dtb, *shift);
+
+        if (entry->shift == *shift && entry->dtb == dtb
+            && entry->base == (va >> *shift) << *shift
+            && entry->generation == generation) {
+            dbprint(VMI_DEBUG_V2PCACHE, "--V2P negative cache hit 0x%.16"PRIx64" (0x%.16"PRIx64"/%u)\n",
+                    va, dtb, *shift);
+            ret = VMI_SUCCESS;
+        }
+    }
+    g_mutex_unlock(&vmi->v2p_neg_lock);
+
+    return ret;
+}
+
+void
+v2p_neg_cache_set(
+    vmi_instance_t vmi,
+    addr_t va,
+    addr_t dtb,
+    const page_info_t *info)
+{
+    struct v2p_neg_entry *entry = NULL;
+    uint8_t shift = 0;
+
+    /* the deepest entry the walk looked at is the one that failed */
+    switch (vmi->page_mode) {
+        case VMI_PM_IA32E:
+            shift = info->x86_ia32e.pte_location ? 12 :
+                    info->x86_ia32e.pgd_location ? 21 :
+                    info->x86_ia32e.pdpte_location ? 30 :
+                    info->x86_ia32e.pml4e_location ? 39 : 0;
+            break;
+        case VMI_PM_PAE:
+            shift = info->x86_pae.pte_location ? 12 :
+                    info->x86_pae.pgd_location ? 21 :
+                    info->x86_pae.pdpe_location ? 30 : 0;
+            break;
+        case VMI_PM_LEGACY:
+            shift = info->x86_legacy.pte_location ? 12 :
+                    info->x86_legacy.pgd_location ? 22 : 0;
+            break;
+        default:
+            break;
+    }
+    if (!shift) {
+        return;
+    }
+
+    g_mutex_lock(&vmi->v2p_neg_lock);
+    entry = v2p_neg_slot(vmi, va, dtb, shift);
+    entry->dtb = dtb;
+    entry->base = (va >> shift) << shift;
+    entry->shift = shift;
+    entry->generation = g_atomic_int_get(&vmi->v2p_generation);
+    g_mutex_unlock(&vmi->v2p_neg_lock);
+
+    dbprint(VMI_DEBUG_V2PCACHE, "--V2P negative cache set 0x%.16"PRIx64" (0x%.16"PRIx64"/%u)\n",
+            entry->base, dtb, shift);
 }
 
 void
 v2p_cache_flush(
     vmi_instance_t vmi)
 {
-    g_hash_table_remove_all(vmi->v2p_cache);
+    int i;
+
+    for (i = 0; i < VMI_CACHE_SHARDS; i++) {
+        g_mutex_lock(&vmi->v2p_cache[i].lock);
+        g_hash_table_remove_all(vmi->v2p_cache[i].cache);
+        g_mutex_unlock(&vmi->v2p_cache[i].lock);
+    }
+    g_atomic_int_inc(&vmi->v2p_generation);
     dbprint(VMI_DEBUG_V2PCACHE, "--V2P cache flushed\n");
 }
 
@@ -624,8 +929,11 @@ v2m_cache_get(
     struct key_128 local_key;
     key_128_t key = &local_key;
 
+    status_t ret = VMI_FAILURE;
+
     key_128_init(vmi, key, (uint64_t)va, (uint64_t)pid);
 
+    g_mutex_lock(&vmi->cache_lock);
     if ((entry = g_hash_table_lookup(vmi->v2m_cache, key)) != NULL) {
 
         entry->last_used = time(NULL);
@@ -633,10 +941,11 @@ v2m_cache_get(
         *length = entry->length;
         dbprint(VMI_DEBUG_V2MCACHE, "--v2m cache hit 0x%.16"PRIx64" -- 0x%.16"PRIx64" len 0x%.16"PRIx64" (0x%.16"PRIx64"/0x%.16"PRIx64")\n",
                 va, *ma, *length, key->high, key->low);
-        return VMI_SUCCESS;
+        ret = VMI_SUCCESS;
     }
+    g_mutex_unlock(&vmi->cache_lock);
 
-    return VMI_FAILURE;
+    return ret;
 }
 
 void
@@ -652,9 +961,11 @@ v2m_cache_set(
     }
     key_128_t key = key_128_build(vmi, (uint64_t)va, (uint64_t)pid);
     v2m_cache_entry_t entry = v2m_cache_entry_create(vmi, ma, length);
+    g_mutex_lock(&vmi->cache_lock);
     g_hash_table_insert(vmi->v2m_cache, key, entry);
     dbprint(VMI_DEBUG_V2MCACHE, "--v2m cache set 0x%.16"PRIx64" -- 0x%.16"PRIx64" len 0x%.16"PRIx64" (0x%.16"PRIx64"/0x%.16"PRIx64")\n", va,
             ma, length, key->high, key->low);
+    g_mutex_unlock(&vmi->cache_lock);
 }
 
 status_t
@@ -672,19 +983,22 @@ v2m_cache_del(
     // key collision doesn't really matter here because worst case
     // scenario we incur an small performance hit
 
-    if (TRUE == g_hash_table_remove(vmi->v2m_cache, key)){
-        return VMI_SUCCESS;
-    }
-    else{
-        return VMI_FAILURE;
-    }
+    gboolean removed = FALSE;
+
+    g_mutex_lock(&vmi->cache_lock);
+    removed = g_hash_table_remove(vmi->v2m_cache, key);
+    g_mutex_unlock(&vmi->cache_lock);
+
+    return removed ? VMI_SUCCESS : VMI_FAILURE;
 }
 
 void
 v2m_cache_flush(
     vmi_instance_t vmi)
 {
+    g_mutex_lock(&vmi->cache_lock);
     g_hash_table_remove_all(vmi->v2m_cache);
+    g_mutex_unlock(&vmi->cache_lock);
     dbprint(VMI_DEBUG_V2MCACHE, "--v2m cache flushed\n");
 }
 #endif
@@ -886,11 +1200,31 @@ v2p_cache_del(
     return VMI_FAILURE;
 }
 
+status_t
+v2p_neg_cache_get(
+    vmi_instance_t vmi,
+    addr_t va,
+    addr_t dtb)
+{
+    return VMI_FAILURE;
+}
+
+void
+v2p_neg_cache_set(
+    vmi_instance_t vmi,
+    addr_t va,
+    addr_t dtb,
+    const page_info_t *info)
+{
+    return;
+}
+
 void
 v2p_cache_flush(
     vmi_instance_t vmi)
 {
-    return;
+    /* compiled access contexts keep translations of their own */
+    g_atomic_int_inc(&vmi->v2p_generation);
 }
 
 #if ENABLE_SHM_SNAPSHOT == 1
@@ -41,6 +41,10 @@
 #include "os/linux/linux.h"
 #include "config/config_parser.h"
 
+#if ENABLE_TRACE == 1
+#include "driver/trace/trace.h"
+#endif
+
 extern FILE *yyin;
 
 static FILE *
@@ -235,6 +239,61 @@ init_page_offset(
     return VMI_SUCCESS;
 }
 
+static gint
+memory_map_compare(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const vmi_pa_range_t *ra = a, *rb = b;
+
+    return ra->paddr < rb->paddr ? -1 : ra->paddr > rb->paddr;
+}
+
+/*
+ * The ranges of physical memory that hold RAM. Drivers that know the layout
+ * report it; for the others everything below the highest address is kept,
+ * guessing a hole could drop RAM of guests with another layout.
+ */
+static void
+init_memory_map(
+    vmi_instance_t vmi)
+{
+    vmi_pa_range_t *ranges = NULL;
+    size_t count = 0, i, merged = 0;
+
+    if (VMI_FAILURE == driver_get_memory_map(vmi, &ranges, &count) || !count) {
+        g_free(ranges);
+        ranges = g_malloc0(sizeof(vmi_pa_range_t));
+        ranges[0].length = vmi->max_physical_address;
+        count = 1;
+    }
+
+    /* sorted, without empty ranges, adjacent ranges joined */
+    qsort(ranges, count, sizeof(vmi_pa_range_t), memory_map_compare);
+    for (i = 0; i < count; i++) {
+        if (!ranges[i].length) {
+            continue;
+        }
+        if (merged && ranges[merged - 1].paddr + ranges[merged - 1].length >= ranges[i].paddr) {
+            addr_t end = ranges[i].paddr + ranges[i].length;
+            if (end > ranges[merged - 1].paddr + ranges[merged - 1].length) {
+                ranges[merged - 1].length = end - ranges[merged - 1].paddr;
+            }
+            continue;
+        }
+        ranges[merged++] = ranges[i];
+    }
+
+    g_free(vmi->memory_map);
+    vmi->memory_map = ranges;
+    vmi->memory_map_count = merged;
+
+    for (i = 0; i < merged; i++) {
+        dbprint(VMI_DEBUG_CORE, "**RAM range [0x%"PRIx64", 0x%"PRIx64")\n",
+                ranges[i].paddr, ranges[i].paddr + ranges[i].length);
+    }
+}
+
 static status_t
 set_driver_type(
     vmi_instance_t vmi,
@@ -291,14 +350,14 @@ set_id_and_name(
         return VMI_FAILURE;
     }
 
-    if (VMI_FILE == vmi->mode) {
+    if (VMI_FILE == vmi->mode || VMI_TRACE == vmi->mode || VMI_MEMORY == vmi->mode) {
         if (name) {
             set_image_type_for_file(vmi, name);
             driver_set_name(vmi, name);
             goto done;
         }
 
-        errprint("Must specify name for file mode.\n");
+        errprint("Must specify name for file, trace and memory mode.\n");
         return VMI_FAILURE;
     }
 
@@ -353,6 +412,40 @@ done:
     return VMI_SUCCESS;
 }
 
+/* setup OS specific stuff */
+static status_t
+init_os(
+    vmi_instance_t vmi)
+{
+    status_t status = VMI_FAILURE;
+    uint64_t start = stat_enter(vmi, VMI_STAT_INIT_OS);
+
+    switch (vmi->os_type)
+    {
+#ifdef ENABLE_LINUX
+    case VMI_OS_LINUX:
+        status = linux_init(vmi);
+        break;
+#endif
+#ifdef ENABLE_WINDOWS
+    case VMI_OS_WINDOWS:
+        status = windows_init(vmi);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    if (VMI_SUCCESS == status) {
+        /* counted from here on, so clones never race to allocate it */
+        vmi->os_refs = g_malloc(sizeof(gint));
+        *vmi->os_refs = 1;
+    }
+    /* a failed init is not recorded */
+    stat_leave(vmi, VMI_STAT_INIT_OS, VMI_SUCCESS == status ? start : 0);
+    return status;
+}
+
 static status_t
 vmi_init_private(
     vmi_instance_t *vmi,
@@ -365,6 +458,7 @@ vmi_init_private(
     uint32_t init_mode = flags & 0x00FF0000;
     uint32_t config_mode = flags & 0xFF000000;
     status_t status = VMI_FAILURE;
+    uint64_t start = 0;
 
     /* allocate memory for instance structure */
     *vmi = (vmi_instance_t) safe_malloc(sizeof(struct vmi_instance));
@@ -378,12 +472,28 @@ vmi_init_private(
     (*vmi)->init_mode = init_mode;
     (*vmi)->config_mode = config_mode;
 
-    /* the config hash table is set up later based on mode */
-    (*vmi)->config = NULL;
+    /* the config hash table is set up later based on mode, a GHashTable
+       is available to the drivers right away */
+    (*vmi)->config = (VMI_CONFIG_GHASHTABLE == config_mode) ? (GHashTable*)config : NULL;
 
     /* set page mode to unknown */
     (*vmi)->page_mode = VMI_PM_UNKNOWN;
 
+    /* latency statistics can be turned on for production runs */
+    (*vmi)->stats_enabled = (getenv("LIBVMI_STATS") != NULL);
+
+    /* the async pool is set up on first use, the config may be gone by then */
+    if ((*vmi)->config) {
+        uint64_t *workers = g_hash_table_lookup((*vmi)->config, "async_workers");
+        (*vmi)->async_workers = workers ? *workers : 0;
+    }
+
+    /* locks guarding the caches and the driver, see struct vmi_instance */
+    g_mutex_init(&(*vmi)->cache_lock);
+    g_rec_mutex_init(&(*vmi)->driver_lock);
+    g_rec_mutex_init(&(*vmi)->os_init_lock);
+    memory_cache_lock_init(*vmi);
+
     /* setup the caches */
     pid_cache_init(*vmi);
     sym_cache_init(*vmi);
@@ -401,6 +511,7 @@ vmi_init_private(
     }
 
     /* connecting to xen, kvm, file, etc */
+    start = stat_start(*vmi);
     if (VMI_FAILURE == set_driver_type(*vmi, access_mode, id, name)) {
         goto error_exit;
     }
@@ -421,6 +532,12 @@ vmi_init_private(
         goto error_exit;
     }
 
+#if ENABLE_TRACE == 1
+    if (VMI_FAILURE == trace_record_init(*vmi, config)) {
+        goto error_exit;
+    }
+#endif
+
     /* setup the page offset size */
     if (VMI_FAILURE == init_page_offset(*vmi)) {
         goto error_exit;
@@ -436,6 +553,8 @@ vmi_init_private(
                             "max_physical_address = 0x%"PRIx64"\n",
                             (*vmi)->allocated_ram_size,
                             (*vmi)->max_physical_address);
+    init_memory_map(*vmi);
+    stat_record(*vmi, VMI_STAT_INIT_DRIVER, start);
 
     // for file mode we need os-specific heuristics to deduce the architecture
     // for live mode, having arch_interface set even in VMI_PARTIAL mode
@@ -490,24 +609,13 @@ vmi_init_private(
             goto error_exit;
         }
 
-        /* setup OS specific stuff */
-        switch ( (*vmi)->os_type )
-        {
-#ifdef ENABLE_LINUX
-        case VMI_OS_LINUX:
-            if(VMI_FAILURE == linux_init(*vmi)) {
-                goto error_exit;
-            }
-            break;
-#endif
-#ifdef ENABLE_WINDOWS
-        case VMI_OS_WINDOWS:
-            if(VMI_FAILURE == windows_init(*vmi)) {
-                goto error_exit;
-            }
-            break;
-#endif
-        default:
+        /* the OS init may be able to reuse what an earlier attach found */
+        init_cache_open(*vmi);
+
+        if (init_mode & VMI_INIT_LAZY) {
+            /* the OS init runs on first use, see vmi_init_prefetch */
+            (*vmi)->os_pending = TRUE;
+        } else if (VMI_FAILURE == init_os(*vmi)) {
             goto error_exit;
         }
 
@@ -597,16 +705,28 @@ _done:
     return ret;
 }
 
+/* a trace replay takes the mode of the recorded session, but restarts from the trace */
+static uint32_t
+reinit_access_mode(
+    vmi_instance_t vmi)
+{
+    if (VMI_TRACE == (vmi->flags & 0x0000FFFF)) {
+        return VMI_TRACE;
+    }
+    return vmi->mode;
+}
+
 status_t
 vmi_init_complete(
     vmi_instance_t *vmi,
     const char *config)
 {
-    uint32_t flags = VMI_INIT_COMPLETE | (*vmi)->mode;
+    uint32_t mode = reinit_access_mode(*vmi);
+    uint32_t flags = VMI_INIT_COMPLETE | mode;
 
     char *name = NULL;
 
-    if (VMI_FILE == (*vmi)->mode) {
+    if (VMI_FILE == mode || VMI_TRACE == mode) {
         name = strdup((*vmi)->image_type_complete);
     }
     else {
@@ -625,6 +745,10 @@ vmi_init_complete(
         flags |= VMI_INIT_EVENTS;
     }
 
+    if (((*vmi)->flags) & VMI_INIT_LAZY) {
+        flags |= VMI_INIT_LAZY;
+    }
+
     vmi_destroy(*vmi);
     return vmi_init_private(vmi,
                             flags,
@@ -642,12 +766,14 @@ vmi_init_complete_custom(
     if (!vmi)
         return VMI_FAILURE;
 
-    flags |= VMI_INIT_COMPLETE | (*vmi)->mode;
+    uint32_t mode = reinit_access_mode(*vmi);
+
+    flags |= VMI_INIT_COMPLETE | mode;
 
     if ( flags & VMI_CONFIG_STRING ) {
         char *name = NULL;
 
-        if (VMI_FILE == (*vmi)->mode) {
+        if (VMI_FILE == mode || VMI_TRACE == mode) {
             name = strdup((*vmi)->image_type_complete);
         } else {
             name = strdup((*vmi)->image_type);
@@ -665,6 +791,132 @@ vmi_init_complete_custom(
     return vmi_init_custom(vmi, flags, config);
 }
 
+status_t
+vmi_init_prefetch(
+    vmi_instance_t vmi)
+{
+    status_t status = VMI_FAILURE;
+
+    if (!vmi || !(vmi->init_mode & VMI_INIT_COMPLETE))
+        return VMI_FAILURE;
+
+    /* the OS init reads through the API itself, hence the recursive lock
+       and the os_initializing flag letting those reads through */
+    g_rec_mutex_lock(&vmi->os_init_lock);
+    if (vmi->os_initializing) {
+        status = VMI_SUCCESS;
+    } else {
+        if (g_atomic_int_get(&vmi->os_pending)) {
+            vmi->os_initializing = TRUE;
+            vmi->os_status = init_os(vmi);
+            vmi->os_initializing = FALSE;
+            g_atomic_int_set(&vmi->os_pending, FALSE);
+            if (VMI_FAILURE == vmi->os_status) {
+                errprint("Deferred OS init failed, only physical memory is available.\n");
+            }
+        }
+        status = vmi->os_status;
+    }
+    g_rec_mutex_unlock(&vmi->os_init_lock);
+
+    return status;
+}
+
+status_t
+vmi_clone(
+    vmi_instance_t vmi,
+    vmi_instance_t *clone)
+{
+    vmi_instance_t new = NULL;
+    uint32_t mode = 0;
+    uint64_t id = VMI_INVALID_DOMID;
+    const char *name = NULL;
+
+    if (!vmi || !clone)
+        return VMI_FAILURE;
+
+    /* the clone shares the OS state, so a deferred OS init runs now */
+    if (g_atomic_int_get(&vmi->os_pending)) {
+        vmi_init_prefetch(vmi);
+    }
+
+    mode = reinit_access_mode(vmi);
+    if (VMI_FILE == mode || VMI_TRACE == mode || VMI_MEMORY == mode) {
+        name = vmi->image_type_complete;
+    } else {
+        id = driver_get_id(vmi);
+    }
+
+    new = (vmi_instance_t) safe_malloc(sizeof(struct vmi_instance));
+    memset(new, 0, sizeof(struct vmi_instance));
+
+    new->flags = vmi->flags & ~(VMI_INIT_EVENTS | VMI_INIT_SHM_SNAPSHOT);
+    new->init_mode = vmi->init_mode & ~(VMI_INIT_EVENTS | VMI_INIT_SHM_SNAPSHOT);
+    new->config_mode = vmi->config_mode;
+    /* a GHashTable config is the caller's and may be gone already */
+    new->config = NULL;
+    new->mode = mode;
+    new->stats_enabled = vmi->stats_enabled;
+    new->async_workers = vmi->async_workers;
+    new->os_status = vmi->os_status;
+
+    g_mutex_init(&new->cache_lock);
+    g_rec_mutex_init(&new->driver_lock);
+    g_rec_mutex_init(&new->os_init_lock);
+    memory_cache_lock_init(new);
+
+    pid_cache_init(new);
+    sym_cache_init(new);
+    rva_cache_init(new);
+    v2p_cache_init(new);
+
+    /* the clone gets its own driver handle */
+    if (VMI_FAILURE == driver_init(new)) {
+        goto error_exit;
+    }
+    if (VMI_FAILURE == set_id_and_name(new, mode, id, name)) {
+        goto error_exit;
+    }
+    if (VMI_FAILURE == driver_clone_vmi(vmi, new)) {
+        goto error_exit;
+    }
+
+    /* everything vmi_init found out is taken over */
+    new->page_shift = vmi->page_shift;
+    new->page_size = vmi->page_size;
+    new->allocated_ram_size = vmi->allocated_ram_size;
+    new->max_physical_address = vmi->max_physical_address;
+    new->memory_map = g_memdup(vmi->memory_map, vmi->memory_map_count * sizeof(vmi_pa_range_t));
+    new->memory_map_count = vmi->memory_map_count;
+    new->kpgd = vmi->kpgd;
+    new->init_task = vmi->init_task;
+    new->pae = vmi->pae;
+    new->pse = vmi->pse;
+    new->lme = vmi->lme;
+    new->page_mode = vmi->page_mode;
+    new->os_type = vmi->os_type;
+
+    if (vmi->arch_interface && VMI_FAILURE == arch_init(new)) {
+        goto error_exit;
+    }
+
+    /* the OS state is read-only after init, share it */
+    if (vmi->os_interface && vmi->os_refs) {
+        g_atomic_int_inc(vmi->os_refs);
+        new->os_refs = vmi->os_refs;
+        new->os_interface = vmi->os_interface;
+        new->os_data = vmi->os_data;
+    }
+
+    dbprint(VMI_DEBUG_CORE, "--cloned instance of %s\n", new->image_type);
+    *clone = new;
+    return VMI_SUCCESS;
+
+error_exit:
+    vmi_destroy(new);
+    return VMI_FAILURE;
+}
+
 page_mode_t
 vmi_init_paging(
     vmi_instance_t vmi,
@@ -690,14 +942,22 @@ vmi_destroy(
         return VMI_FAILURE;
 
     vmi->shutting_down = TRUE;
+    read_async_destroy(vmi);
     events_destroy(vmi);
     driver_destroy(vmi);
-    if (vmi->os_interface) {
-        os_destroy(vmi);
-    }
-    if (vmi->os_data) {
-        free(vmi->os_data);
+    if (vmi->os_refs && !g_atomic_int_dec_and_test(vmi->os_refs)) {
+        /* still used by a clone or the parent */
+        vmi->os_interface = NULL;
+    } else {
+        g_free(vmi->os_refs);
+        if (vmi->os_interface) {
+            os_destroy(vmi);
+        }
+        if (vmi->os_data) {
+            free(vmi->os_data);
+        }
     }
+    vmi->os_refs = NULL;
     if (vmi->arch_interface) {
         free(vmi->arch_interface);
     }
@@ -713,8 +973,15 @@ vmi_destroy(
 #endif
 
     memory_cache_destroy(vmi);
+    memory_cache_lock_clear(vmi);
+    g_rec_mutex_clear(&vmi->os_init_lock);
+    g_rec_mutex_clear(&vmi->driver_lock);
+    g_mutex_clear(&vmi->cache_lock);
     if (vmi->image_type)
         free(vmi->image_type);
+    g_free(vmi->init_cache);
+    g_free(vmi->init_cache_identity);
+    g_free(vmi->memory_map);
     free(vmi);
     return VMI_SUCCESS;
 }
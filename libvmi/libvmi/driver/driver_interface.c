@@ -43,6 +43,14 @@
 #include "driver/kvm/kvm.h"
 #endif
 
+#if ENABLE_TRACE == 1
+#include "driver/trace/trace.h"
+#endif
+
+#if ENABLE_MEMORY == 1
+#include "driver/memory/memory.h"
+#endif
+
 status_t driver_init_mode(vmi_instance_t vmi, uint64_t domainid, const char *name)
 {
     unsigned long count = 0;
@@ -113,6 +121,16 @@ status_t driver_init(vmi_instance_t vmi)
     case VMI_FILE:
         rc = driver_file_setup(vmi);
         break;
+#endif
+#if ENABLE_TRACE == 1
+    case VMI_TRACE:
+        rc = driver_trace_setup(vmi);
+        break;
+#endif
+#if ENABLE_MEMORY == 1
+    case VMI_MEMORY:
+        rc = driver_memory_setup(vmi);
+        break;
 #endif
     };
 
@@ -130,3 +148,13 @@ status_t driver_init_vmi(vmi_instance_t vmi)
 
     return rc;
 }
+
+/* sets up the driver of a clone from its parent, the config is only
+   read by vmi_init and may be gone by now */
+status_t driver_clone_vmi(vmi_instance_t vmi, vmi_instance_t clone)
+{
+    if (clone->driver.clone_vmi_ptr)
+        return clone->driver.clone_vmi_ptr(vmi, clone);
+
+    return driver_init_vmi(clone);
+}
@@ -35,6 +35,9 @@ typedef struct driver_interface {
         vmi_instance_t);
     status_t (*init_vmi_ptr) (
         vmi_instance_t);
+    status_t (*clone_vmi_ptr) (
+        vmi_instance_t,
+        vmi_instance_t);
     void (*destroy_ptr) (
         vmi_instance_t);
     uint64_t (*get_id_from_name_ptr) (
@@ -62,6 +65,10 @@ typedef struct driver_interface {
         vmi_instance_t,
         uint64_t *,
         addr_t *);
+    status_t (*get_memory_map_ptr) (
+        vmi_instance_t,
+        vmi_pa_range_t **,
+        size_t *);
     status_t (*get_vcpureg_ptr) (
         vmi_instance_t,
         reg_t *,
@@ -78,6 +85,10 @@ typedef struct driver_interface {
     void *(*read_page_ptr) (
         vmi_instance_t,
         addr_t);
+    status_t (*prefetch_ptr) (
+        vmi_instance_t,
+        addr_t,
+        size_t);
     status_t (*write_ptr) (
         vmi_instance_t,
         addr_t,
@@ -133,6 +144,9 @@ typedef struct driver_interface {
     /* Driver-specific data storage. */
     void* driver_data;
 
+    /* Trace recorder wrapping the driver, if any. */
+    void* trace_data;
+
     /* Set to true once driver is initialized. */
     bool initialized;
 
@@ -149,5 +163,9 @@ status_t driver_init(
 status_t driver_init_vmi(
     vmi_instance_t vmi);
 
+status_t driver_clone_vmi(
+    vmi_instance_t vmi,
+    vmi_instance_t clone);
+
 #endif /* DRIVER_INTERFACE_H */
 
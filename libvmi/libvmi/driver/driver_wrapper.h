@@ -33,6 +33,15 @@
 /*
  * The following functions are safety-wrappers that should be used internally
  * instead of calling the functions directly on the driver.
+ *
+ * Drivers are not required to be thread-safe. Wrappers of calls that may be
+ * made from several threads at once serialize them with vmi->driver_lock.
+ * Pages are fetched through the memory cache, which takes the lock itself,
+ * so driver_read_page is left unlocked. So is driver_write, as drivers
+ * drop written pages from the memory cache and the cache locks are always
+ * taken before the driver lock.
+ * Drivers must not call back into libvmi functions taking a cache lock,
+ * memory_cache_fill and memory_cache_contains excepted.
  */
 
 static inline void
@@ -152,7 +161,12 @@ driver_get_memsize(
     addr_t *max_physical_address)
 {
     if (vmi->driver.initialized && vmi->driver.get_memsize_ptr) {
-        return vmi->driver.get_memsize_ptr(vmi, allocated_ram_size, max_physical_address);
+        status_t ret;
+
+        g_rec_mutex_lock(&vmi->driver_lock);
+        ret = vmi->driver.get_memsize_ptr(vmi, allocated_ram_size, max_physical_address);
+        g_rec_mutex_unlock(&vmi->driver_lock);
+        return ret;
     }
     else {
         dbprint
@@ -161,6 +175,27 @@ driver_get_memsize(
     }
 }
 
+static inline status_t
+driver_get_memory_map(
+    vmi_instance_t vmi,
+    vmi_pa_range_t **ranges,
+    size_t *count)
+{
+    if (vmi->driver.initialized && vmi->driver.get_memory_map_ptr) {
+        status_t ret;
+
+        g_rec_mutex_lock(&vmi->driver_lock);
+        ret = vmi->driver.get_memory_map_ptr(vmi, ranges, count);
+        g_rec_mutex_unlock(&vmi->driver_lock);
+        return ret;
+    }
+    else {
+        dbprint
+            (VMI_DEBUG_DRIVER, "WARNING: driver_get_memory_map function not implemented.\n");
+        return VMI_FAILURE;
+    }
+}
+
 static inline status_t
 driver_get_vcpureg(
     vmi_instance_t vmi,
@@ -169,7 +204,12 @@ driver_get_vcpureg(
     unsigned long vcpu)
 {
     if (vmi->driver.initialized && vmi->driver.get_vcpureg_ptr) {
-        return vmi->driver.get_vcpureg_ptr(vmi, value, reg, vcpu);
+        status_t ret;
+
+        g_rec_mutex_lock(&vmi->driver_lock);
+        ret = vmi->driver.get_vcpureg_ptr(vmi, value, reg, vcpu);
+        g_rec_mutex_unlock(&vmi->driver_lock);
+        return ret;
     }
     else {
         dbprint
@@ -186,7 +226,12 @@ driver_set_vcpureg(
     unsigned long vcpu)
 {
     if (vmi->driver.initialized && vmi->driver.set_vcpureg_ptr){
-        return vmi->driver.set_vcpureg_ptr(vmi, value, reg, vcpu);
+        status_t ret;
+
+        g_rec_mutex_lock(&vmi->driver_lock);
+        ret = vmi->driver.set_vcpureg_ptr(vmi, value, reg, vcpu);
+        g_rec_mutex_unlock(&vmi->driver_lock);
+        return ret;
     }
     else{
         dbprint(VMI_DEBUG_DRIVER, "WARNING: driver_set_vcpureg function not implemented.\n");
@@ -200,7 +245,12 @@ driver_get_address_width(
     uint8_t * width)
 {
     if (vmi->driver.initialized && vmi->driver.get_address_width_ptr) {
-        return vmi->driver.get_address_width_ptr(vmi, width);
+        status_t ret;
+
+        g_rec_mutex_lock(&vmi->driver_lock);
+        ret = vmi->driver.get_address_width_ptr(vmi, width);
+        g_rec_mutex_unlock(&vmi->driver_lock);
+        return ret;
     }
     else {
         dbprint
@@ -224,6 +274,27 @@ driver_read_page(
     }
 }
 
+static inline status_t
+driver_prefetch(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    size_t length)
+{
+    if (vmi->driver.initialized && vmi->driver.prefetch_ptr) {
+        status_t ret;
+
+        g_rec_mutex_lock(&vmi->driver_lock);
+        ret = vmi->driver.prefetch_ptr(vmi, paddr, length);
+        g_rec_mutex_unlock(&vmi->driver_lock);
+        return ret;
+    }
+    else {
+        dbprint
+            (VMI_DEBUG_DRIVER, "WARNING: driver_prefetch function not implemented.\n");
+        return VMI_FAILURE;
+    }
+}
+
 static inline status_t
 driver_write(
     vmi_instance_t vmi,
@@ -245,7 +316,12 @@ driver_is_pv(
     vmi_instance_t vmi)
 {
     if (vmi->driver.initialized && vmi->driver.is_pv_ptr) {
-        return vmi->driver.is_pv_ptr(vmi);
+        int ret;
+
+        g_rec_mutex_lock(&vmi->driver_lock);
+        ret = vmi->driver.is_pv_ptr(vmi);
+        g_rec_mutex_unlock(&vmi->driver_lock);
+        return ret;
     }
     else {
         dbprint(VMI_DEBUG_DRIVER, "WARNING: driver_is_pv function not implemented.\n");
@@ -258,7 +334,12 @@ driver_pause_vm(
     vmi_instance_t vmi)
 {
     if (vmi->driver.initialized && vmi->driver.pause_vm_ptr) {
-        return vmi->driver.pause_vm_ptr(vmi);
+        status_t ret;
+
+        g_rec_mutex_lock(&vmi->driver_lock);
+        ret = vmi->driver.pause_vm_ptr(vmi);
+        g_rec_mutex_unlock(&vmi->driver_lock);
+        return ret;
     }
     else {
         dbprint(VMI_DEBUG_DRIVER, "WARNING: driver_pause_vm function not implemented.\n");
@@ -271,7 +352,12 @@ driver_resume_vm(
     vmi_instance_t vmi)
 {
     if (vmi->driver.initialized && vmi->driver.resume_vm_ptr) {
-        return vmi->driver.resume_vm_ptr(vmi);
+        status_t ret;
+
+        g_rec_mutex_lock(&vmi->driver_lock);
+        ret = vmi->driver.resume_vm_ptr(vmi);
+        g_rec_mutex_unlock(&vmi->driver_lock);
+        return ret;
     }
     else {
         dbprint
@@ -39,6 +39,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <limits.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
 
 // Use mmap() if this evaluates to true; otherwise, use a file pointer with
 // seek/read
@@ -49,6 +52,558 @@
 #define MAP_POPULATE 0
 #endif
 
+//----------------------------------------------------------------------------
+// Memory image layout
+
+static int
+file_segment_compare(
+    const void *a,
+    const void *b)
+{
+    const file_segment_t *sa = a;
+    const file_segment_t *sb = b;
+
+    if (sa->paddr < sb->paddr)
+        return -1;
+    return (sa->paddr > sb->paddr);
+}
+
+static void
+file_add_segment(
+    file_instance_t *fi,
+    addr_t paddr,
+    addr_t length,
+    addr_t offset)
+{
+    if (!length) {
+        return;
+    }
+
+    fi->segments = g_renew(file_segment_t, fi->segments, fi->nr_segments + 1);
+    fi->segments[fi->nr_segments].paddr = paddr;
+    fi->segments[fi->nr_segments].length = length;
+    fi->segments[fi->nr_segments].offset = offset;
+    fi->nr_segments++;
+
+    dbprint(VMI_DEBUG_FILE, "--file segment PA [0x%.16"PRIx64"-0x%.16"PRIx64"] at offset 0x%"PRIx64"\n",
+            paddr, paddr + length, offset);
+}
+
+static status_t
+file_parse_lime(
+    file_instance_t *fi)
+{
+    lime_range_header_t header;
+    uint64_t offset = 0;
+
+    while (offset + sizeof(header) <= fi->file_size) {
+        if (sizeof(header) != pread(fi->fd, &header, sizeof(header), offset)) {
+            break;
+        }
+        if (LIME_MAGIC != header.magic || header.e_addr < header.s_addr) {
+            break;
+        }
+
+        uint64_t length = header.e_addr - header.s_addr + 1;
+        offset += sizeof(header);
+        if (offset + length > fi->file_size) {
+            errprint("LiME range [0x%"PRIx64"-0x%"PRIx64"] is truncated.\n",
+                     header.s_addr, header.e_addr);
+            return VMI_FAILURE;
+        }
+
+        file_add_segment(fi, header.s_addr, length, offset);
+        offset += length;
+    }
+
+    if (offset != fi->file_size) {
+        errprint("Garbage after LiME range at offset 0x%"PRIx64".\n", offset);
+        return VMI_FAILURE;
+    }
+    return VMI_SUCCESS;
+}
+
+static status_t
+file_parse_elf(
+    file_instance_t *fi,
+    unsigned char *ident)
+{
+    uint64_t phoff, i;
+    uint16_t phnum, phentsize;
+
+    if (ELFCLASS64 == ident[EI_CLASS]) {
+        Elf64_Ehdr ehdr;
+        if (sizeof(ehdr) != pread(fi->fd, &ehdr, sizeof(ehdr), 0)) {
+            return VMI_FAILURE;
+        }
+        phoff = ehdr.e_phoff;
+        phnum = ehdr.e_phnum;
+        phentsize = ehdr.e_phentsize;
+    }
+    else if (ELFCLASS32 == ident[EI_CLASS]) {
+        Elf32_Ehdr ehdr;
+        if (sizeof(ehdr) != pread(fi->fd, &ehdr, sizeof(ehdr), 0)) {
+            return VMI_FAILURE;
+        }
+        phoff = ehdr.e_phoff;
+        phnum = ehdr.e_phnum;
+        phentsize = ehdr.e_phentsize;
+    }
+    else {
+        errprint("Unknown ELF class %u.\n", ident[EI_CLASS]);
+        return VMI_FAILURE;
+    }
+
+    for (i = 0; i < phnum; i++) {
+        uint64_t paddr, offset, filesz;
+
+        if (ELFCLASS64 == ident[EI_CLASS]) {
+            Elf64_Phdr phdr;
+            if (sizeof(phdr) != pread(fi->fd, &phdr, sizeof(phdr), phoff + i * phentsize)) {
+                return VMI_FAILURE;
+            }
+            if (PT_LOAD != phdr.p_type) {
+                continue;
+            }
+            paddr = phdr.p_paddr;
+            offset = phdr.p_offset;
+            filesz = phdr.p_filesz;
+        }
+        else {
+            Elf32_Phdr phdr;
+            if (sizeof(phdr) != pread(fi->fd, &phdr, sizeof(phdr), phoff + i * phentsize)) {
+                return VMI_FAILURE;
+            }
+            if (PT_LOAD != phdr.p_type) {
+                continue;
+            }
+            paddr = phdr.p_paddr;
+            offset = phdr.p_offset;
+            filesz = phdr.p_filesz;
+        }
+
+        if (offset + filesz > fi->file_size) {
+            errprint("ELF segment at offset 0x%"PRIx64" is truncated.\n", offset);
+            return VMI_FAILURE;
+        }
+        file_add_segment(fi, paddr, filesz, offset);
+    }
+
+    return VMI_SUCCESS;
+}
+
+/*
+ * Detect the format of the memory image and build the sorted index of the
+ * physical ranges it holds. Anything we don't recognize is a raw dump.
+ */
+static status_t
+file_init_layout(
+    file_instance_t *fi)
+{
+    unsigned char ident[EI_NIDENT] = { 0 };
+    uint32_t magic = 0;
+    struct stat s;
+    status_t ret = VMI_SUCCESS;
+
+    if (fstat(fi->fd, &s) == -1) {
+        errprint("Failed to stat file.\n");
+        return VMI_FAILURE;
+    }
+    fi->file_size = s.st_size;
+
+    if (pread(fi->fd, ident, sizeof(ident), 0) < 0) {
+        return VMI_FAILURE;
+    }
+    memcpy(&magic, ident, sizeof(magic));
+
+    if (!memcmp(ident, ELFMAG, SELFMAG)) {
+        fi->format = FILE_FORMAT_ELF;
+        ret = file_parse_elf(fi, ident);
+    }
+    else if (LIME_MAGIC == magic) {
+        fi->format = FILE_FORMAT_LIME;
+        ret = file_parse_lime(fi);
+    }
+    else {
+        fi->format = FILE_FORMAT_RAW;
+        file_add_segment(fi, 0, fi->file_size, 0);
+    }
+
+    if (VMI_FAILURE == ret || !fi->nr_segments) {
+        errprint("Failed to find any physical memory in '%s'.\n", fi->filename);
+        return VMI_FAILURE;
+    }
+
+    qsort(fi->segments, fi->nr_segments, sizeof(file_segment_t), file_segment_compare);
+
+    dbprint(VMI_DEBUG_FILE, "--file '%s' is %s with %zu physical range(s)\n", fi->filename,
+            (FILE_FORMAT_ELF == fi->format) ? "an ELF core" :
+            (FILE_FORMAT_LIME == fi->format) ? "a LiME image" : "a raw image",
+            fi->nr_segments);
+    return VMI_SUCCESS;
+}
+
+/*
+ * Binary search for the range holding paddr. If there is none, NULL is
+ * returned and next (if given) is set to the first range above paddr.
+ */
+static file_segment_t *
+file_lookup_segment(
+    file_instance_t *fi,
+    addr_t paddr,
+    file_segment_t **next)
+{
+    size_t lo = 0, hi = fi->nr_segments;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        file_segment_t *seg = &fi->segments[mid];
+
+        if (paddr < seg->paddr) {
+            hi = mid;
+        }
+        else if (paddr - seg->paddr >= seg->length) {
+            lo = mid + 1;
+        }
+        else {
+            return seg;
+        }
+    }
+
+    if (next) {
+        *next = (lo < fi->nr_segments) ? &fi->segments[lo] : NULL;
+    }
+    return NULL;
+}
+
+/*
+ * Translate a physical range to its offset in the file, failing unless the
+ * whole range is held by a single segment.
+ */
+static status_t
+file_paddr_to_offset(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    addr_t length,
+    addr_t *offset)
+{
+    file_segment_t *seg = file_lookup_segment(file_get_instance(vmi), paddr, NULL);
+
+    if (!seg || paddr - seg->paddr + length > seg->length) {
+        return VMI_FAILURE;
+    }
+
+    *offset = seg->offset + (paddr - seg->paddr);
+    return VMI_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// Prefetch
+
+#if ENABLE_IO_URING == 1
+static void
+file_prefetch_req_free(
+    gpointer data)
+{
+    file_prefetch_req_t *req = data;
+
+    if (req) {
+        free(req->frame);
+        g_free(req);
+    }
+}
+
+static status_t
+file_prefetch_init(
+    vmi_instance_t vmi)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    int rc;
+
+    rc = io_uring_queue_init(fi->prefetch_depth, &fi->ring, 0);
+    if (rc < 0) {
+        errprint("Failed to set up io_uring for prefetching: %s\n", strerror(-rc));
+        fi->ring_failed = true;
+        return VMI_FAILURE;
+    }
+
+    fi->prefetch = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                         g_free, file_prefetch_req_free);
+    fi->pending = g_queue_new();
+    fi->ring_ready = true;
+
+    dbprint(VMI_DEBUG_FILE, "--file prefetch queue depth %u\n", fi->prefetch_depth);
+    return VMI_SUCCESS;
+}
+
+/*
+ * Reap completed prefetch reads, waiting for at least one if asked to.
+ * Completions nobody waits for land in the page cache right away.
+ */
+static status_t
+file_prefetch_reap(
+    vmi_instance_t vmi,
+    bool wait)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    struct io_uring_cqe *cqe = NULL;
+
+    while (fi->inflight) {
+        int rc = wait ? io_uring_wait_cqe(&fi->ring, &cqe) :
+                        io_uring_peek_cqe(&fi->ring, &cqe);
+
+        if (-EINTR == rc) {
+            continue;
+        }
+        if (-EAGAIN == rc) {
+            break;
+        }
+        if (rc < 0) {
+            errprint("Failed to reap prefetch completion: %s\n", strerror(-rc));
+            return VMI_FAILURE;
+        }
+
+        file_prefetch_req_t *req = io_uring_cqe_get_data(cqe);
+        req->result = cqe->res;
+        req->completed = true;
+        io_uring_cqe_seen(&fi->ring, cqe);
+        fi->inflight--;
+        wait = false;
+
+        if (!req->wanted) {
+            gint64 key = req->paddr;
+
+            g_hash_table_steal(fi->prefetch, &key);
+            if (req->result == vmi->page_size) {
+                memory_cache_fill(vmi, req->paddr, req->frame);
+            }
+            else {
+                dbprint(VMI_DEBUG_FILE, "--prefetch of 0x%"PRIx64" failed (%d)\n",
+                        req->paddr, req->result);
+                free(req->frame);
+            }
+            g_free(req);
+        }
+    }
+
+    return VMI_SUCCESS;
+}
+
+/*
+ * Queue reads for pending pages while there are free slots.
+ */
+static void
+file_prefetch_pump(
+    vmi_instance_t vmi)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    unsigned int submitted = 0;
+
+    while (fi->inflight < fi->prefetch_depth && !g_queue_is_empty(fi->pending)) {
+        addr_t *page = g_queue_pop_head(fi->pending);
+        addr_t offset = 0;
+        gint64 key = *page;
+
+        // holes and partial pages are left to the synchronous path
+        if (!g_hash_table_lookup(fi->prefetch, &key)
+            && !memory_cache_contains(vmi, *page)
+            && VMI_SUCCESS == file_paddr_to_offset(vmi, *page, vmi->page_size, &offset)) {
+
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&fi->ring);
+            if (!sqe) {
+                g_queue_push_head(fi->pending, page);
+                break;
+            }
+
+            file_prefetch_req_t *req = g_malloc0(sizeof(file_prefetch_req_t));
+            req->paddr = *page;
+            req->frame = safe_malloc(vmi->page_size);
+
+            io_uring_prep_read(sqe, fi->fd, req->frame, vmi->page_size, offset);
+            io_uring_sqe_set_data(sqe, req);
+
+            gint64 *req_key = g_malloc(sizeof(gint64));
+            *req_key = *page;
+            g_hash_table_insert(fi->prefetch, req_key, req);
+
+            fi->inflight++;
+            submitted++;
+        }
+        g_free(page);
+    }
+
+    if (submitted) {
+        io_uring_submit(&fi->ring);
+    }
+}
+
+/*
+ * Take the frame of an outstanding prefetch of paddr, waiting for the read
+ * to complete. NULL if paddr is not being prefetched or the read failed.
+ */
+static void *
+file_prefetch_claim(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    file_prefetch_req_t *req = NULL;
+    gint64 key = paddr;
+    void *frame = NULL;
+
+    if (!fi->ring_ready || !(req = g_hash_table_lookup(fi->prefetch, &key))) {
+        return NULL;
+    }
+
+    req->wanted = true;
+    while (!req->completed) {
+        if (VMI_FAILURE == file_prefetch_reap(vmi, true)) {
+            return NULL;
+        }
+    }
+
+    g_hash_table_steal(fi->prefetch, &key);
+    if (req->result == vmi->page_size) {
+        frame = req->frame;
+    }
+    else {
+        free(req->frame);
+    }
+    g_free(req);
+    return frame;
+}
+
+static void
+file_prefetch_destroy(
+    vmi_instance_t vmi)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+
+    if (!fi->ring_ready) {
+        return;
+    }
+
+    // the kernel may still write into the frames of outstanding reads
+    while (fi->inflight) {
+        if (VMI_FAILURE == file_prefetch_reap(vmi, true)) {
+            return;
+        }
+    }
+
+    io_uring_queue_exit(&fi->ring);
+    g_hash_table_destroy(fi->prefetch);
+    g_queue_free_full(fi->pending, g_free);
+    fi->ring_ready = false;
+}
+#endif /* ENABLE_IO_URING */
+
+/* lets the kernel read ahead the backed parts of a range */
+static void
+file_prefetch_fadvise(
+    vmi_instance_t vmi,
+    addr_t page,
+    addr_t end)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+
+    while (page < end) {
+        file_segment_t *next = NULL;
+        file_segment_t *seg = file_lookup_segment(fi, page, &next);
+
+        if (!seg) {
+            if (!next) {
+                break;
+            }
+            page = next->paddr;
+            continue;
+        }
+
+        addr_t seg_end = seg->paddr + seg->length;
+        addr_t chunk = (end < seg_end ? end : seg_end) - page;
+        (void) posix_fadvise(fi->fd, seg->offset + (page - seg->paddr), chunk,
+                             POSIX_FADV_WILLNEED);
+        page += chunk;
+    }
+}
+
+status_t
+file_prefetch(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    size_t length)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    addr_t page = paddr & ~((addr_t) vmi->page_size - 1);
+    addr_t end = paddr + length;
+
+#if ENABLE_IO_URING == 1
+    // without a ring (old kernel, seccomp) the kernel readahead still helps
+    if (!fi->ring_ready
+        && (fi->ring_failed || VMI_FAILURE == file_prefetch_init(vmi))) {
+        file_prefetch_fadvise(vmi, page, end);
+        return VMI_SUCCESS;
+    }
+
+    for (; page < end; page += vmi->page_size) {
+        if (g_queue_get_length(fi->pending) >= FILE_PREFETCH_MAX_PENDING) {
+            dbprint(VMI_DEBUG_FILE, "--prefetch backlog full, dropping hints from 0x%"PRIx64"\n", page);
+            break;
+        }
+        addr_t *pending = g_malloc(sizeof(addr_t));
+        *pending = page;
+        g_queue_push_tail(fi->pending, pending);
+    }
+
+    if (VMI_FAILURE == file_prefetch_reap(vmi, false)) {
+        return VMI_FAILURE;
+    }
+    file_prefetch_pump(vmi);
+#else
+    (void) fi;
+    file_prefetch_fadvise(vmi, page, end);
+#endif
+    return VMI_SUCCESS;
+}
+
+/*
+ * Sequential page misses mean a scan, start fetching the pages that follow
+ * before they are asked for.
+ */
+static void
+file_readahead(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    unsigned int window = PREFETCH_QUEUE_DEPTH;
+
+    if (paddr == fi->last_miss + vmi->page_size) {
+        fi->sequential_misses++;
+    }
+    else {
+        fi->sequential_misses = 0;
+    }
+    fi->last_miss = paddr;
+
+    if (fi->sequential_misses < FILE_READAHEAD_TRIGGER) {
+        return;
+    }
+
+#if ENABLE_IO_URING == 1
+    if (fi->ring_ready) {
+        // keep the queue full, the pages up to here are in flight already
+        window = fi->prefetch_depth;
+        if (g_queue_get_length(fi->pending) || fi->inflight >= window) {
+            file_prefetch_reap(vmi, false);
+            file_prefetch_pump(vmi);
+            return;
+        }
+    }
+#endif
+
+    (void) file_prefetch(vmi, paddr + vmi->page_size, (size_t) window * vmi->page_size);
+}
+
 //----------------------------------------------------------------------------
 // File-Specific Interface Functions
 
@@ -58,35 +613,67 @@ file_get_memory(
     addr_t paddr,
     uint32_t length)
 {
+    file_instance_t *fi = file_get_instance(vmi);
+    file_segment_t *seg = NULL, *next = NULL;
     void *memory = 0;
+    uint32_t done = 0;
 
-    if (paddr + length >= vmi->max_physical_address) {
+    // holes are reported without touching the file
+    if (!file_lookup_segment(fi, paddr, NULL)) {
         dbprint
-            (VMI_DEBUG_FILE, "--%s: request for PA range [0x%.16"PRIx64"-0x%.16"PRIx64"] reads past end of file\n",
+            (VMI_DEBUG_FILE, "--%s: request for PA range [0x%.16"PRIx64"-0x%.16"PRIx64"] starts in a hole of the image\n",
              __FUNCTION__, paddr, paddr + length);
         goto error_noprint;
     }   // if
 
+    if (length == vmi->page_size) {
+        file_readahead(vmi, paddr);
+#if ENABLE_IO_URING == 1
+        if ((memory = file_prefetch_claim(vmi, paddr))) {
+            return memory;
+        }
+#endif
+    }
+
     memory = safe_malloc(length);
 
+    while (done < length) {
+        addr_t pa = paddr + done;
+        uint32_t chunk = length - done;
+
+        seg = file_lookup_segment(fi, pa, &next);
+        if (!seg) {
+            // a range may end mid-page, the rest of the page is not backed
+            if (next && next->paddr - pa < chunk) {
+                chunk = next->paddr - pa;
+            }
+            memset((uint8_t *) memory + done, 0, chunk);
+            done += chunk;
+            continue;
+        }
+
+        addr_t offset = seg->offset + (pa - seg->paddr);
+        if (seg->length - (pa - seg->paddr) < chunk) {
+            chunk = seg->length - (pa - seg->paddr);
+        }
+
 #if USE_MMAP
-    (void) memcpy(memory,
-                  ((uint8_t *) file_get_instance(vmi)->map) + paddr,
-                  length);
+        (void) memcpy((uint8_t *) memory + done,
+                      ((uint8_t *) fi->map) + offset,
+                      chunk);
 #else
-    if (paddr != lseek(file_get_instance(vmi)->fd, paddr, SEEK_SET)) {
-        goto error_print;
-    }
-    if (length != read(file_get_instance(vmi)->fd, memory, length)) {
-        goto error_print;
-    }
+        if (chunk != pread(fi->fd, (uint8_t *) memory + done, chunk, offset)) {
+            goto error_print;
+        }
 #endif // USE_MMAP
+        done += chunk;
+    }
 
     return memory;
 
 error_print:
-    dbprint(VMI_DEBUG_WRITE, "%s: failed to read %d bytes at "
-            "PA (offset) 0x%.16"PRIx64" [VM size 0x%.16"PRIx64"]\n", __FUNCTION__,
+    dbprint(VMI_DEBUG_FILE, "%s: failed to read %d bytes at "
+            "PA 0x%.16"PRIx64" [VM size 0x%.16"PRIx64"]\n", __FUNCTION__,
             length, paddr, vmi->allocated_ram_size);
 error_noprint:
     if (memory)
@@ -130,17 +717,39 @@ file_init_vmi(
 
     fi->fhandle = fhandle;
     fi->fd = fd;
+
+#if ENABLE_IO_URING == 1
+    /* the ring is set up on first prefetch, the config may be gone by then */
+    fi->prefetch_depth = PREFETCH_QUEUE_DEPTH;
+    if (vmi->config && VMI_CONFIG_GHASHTABLE == vmi->config_mode) {
+        uint64_t *depth = g_hash_table_lookup(vmi->config, "prefetch_depth");
+        if (depth && *depth) {
+            fi->prefetch_depth = *depth;
+        }
+    }
+#endif
+
+    if (VMI_FAILURE == file_init_layout(fi)) {
+        goto fail;
+    }
+
     memory_cache_init(vmi, file_get_memory, file_release_memory,
                       ULONG_MAX);
     //    memory_cache_init(vmi, file_get_memory, file_release_memory, 0);
 
+    /* instances of the same file may share their cached pages */
+    struct stat st;
+    if (!fstat(fd, &st)) {
+        char backing[64];
+
+        snprintf(backing, sizeof(backing), "file:%lu:%lu",
+                 (unsigned long) st.st_dev, (unsigned long) st.st_ino);
+        memory_cache_share(vmi, backing);
+    }
+
 #if USE_MMAP
     /* try memory mapped file I/O */
-    uint64_t size = 0;
-
-    if (VMI_FAILURE == file_get_memsize(vmi, &size)) {
-        goto fail;
-    }   // if
+    uint64_t size = fi->file_size;
 
     int mmap_flags = (MAP_PRIVATE | MAP_NORESERVE | MAP_POPULATE);
 
@@ -160,6 +769,7 @@ file_init_vmi(
         goto fail;
     }
     fi->map = map;
+    fi->map_size = size;
 
     // Note: madvise(.., MADV_SEQUENTIAL | MADV_WILLNEED) does not seem to
     // improve performance
@@ -174,24 +784,49 @@ fail:
     return VMI_FAILURE;
 }
 
+status_t
+file_clone_vmi(
+    vmi_instance_t vmi,
+    vmi_instance_t clone)
+{
+    if (VMI_FAILURE == file_init_vmi(clone)) {
+        return VMI_FAILURE;
+    }
+
+    /* what file_init_vmi took from the config of the parent */
+#if ENABLE_IO_URING == 1
+    file_get_instance(clone)->prefetch_depth = file_get_instance(vmi)->prefetch_depth;
+#endif
+    if (vmi->memory_cache_backing) {
+        clone->memory_cache_backing = vmi->memory_cache_backing;
+    }
+    return VMI_SUCCESS;
+}
+
 void
 file_destroy(
     vmi_instance_t vmi)
 {
     file_instance_t *fi = file_get_instance(vmi);
 
-#if USE_MMAP
+#if ENABLE_IO_URING == 1
+    file_prefetch_destroy(vmi);
+#endif
+#if ENABLE_SHM_SNAPSHOT == 1
+    v2m_tables_destroy(&fi->v2m_tables);
+#endif
     if (fi->map) {
-        (void) munmap(fi->map, vmi->size);
+        (void) munmap(fi->map, fi->map_size);
         fi->map = 0;
+        fi->map_size = 0;
     }
-#endif // USE_MMAP
     // fi->fhandle refers to fi->fd; closing both would be an error
     if (fi->fhandle) {
         fclose(fi->fhandle);
         fi->fhandle = 0;
         fi->fd = 0;
     }
+    g_free(fi->segments);
     free(fi);
 }
 
@@ -218,19 +853,47 @@ file_get_memsize(
     uint64_t *allocated_ram_size,
     addr_t *max_physical_address)
 {
-    status_t ret = VMI_FAILURE;
-    struct stat s;
+    file_instance_t *fi = file_get_instance(vmi);
+    file_segment_t *last = NULL;
+    uint64_t size = 0;
+    size_t i;
 
-    if (fstat(file_get_instance(vmi)->fd, &s) == -1) {
-        errprint("Failed to stat file.\n");
-        goto error_exit;
+    if (!fi->nr_segments) {
+        errprint("No physical memory ranges known for the file.\n");
+        return VMI_FAILURE;
     }
-    *allocated_ram_size = s.st_size;
-    *max_physical_address = s.st_size;
-    ret = VMI_SUCCESS;
 
-error_exit:
-    return ret;
+    for (i = 0; i < fi->nr_segments; i++) {
+        size += fi->segments[i].length;
+    }
+    last = &fi->segments[fi->nr_segments - 1];
+
+    *allocated_ram_size = size;
+    *max_physical_address = last->paddr + last->length;
+    return VMI_SUCCESS;
+}
+
+status_t
+file_get_memory_map(
+    vmi_instance_t vmi,
+    vmi_pa_range_t **ranges,
+    size_t *count)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    size_t i;
+
+    if (!fi->nr_segments) {
+        return VMI_FAILURE;
+    }
+
+    /* the segments of the image are the memory that exists */
+    *ranges = g_malloc0(fi->nr_segments * sizeof(vmi_pa_range_t));
+    for (i = 0; i < fi->nr_segments; i++) {
+        (*ranges)[i].paddr = fi->segments[i].paddr;
+        (*ranges)[i].length = fi->segments[i].length;
+    }
+    *count = fi->nr_segments;
+    return VMI_SUCCESS;
 }
 
 status_t
@@ -329,3 +992,78 @@ file_resume_vm(
 {
     return VMI_SUCCESS;
 }
+
+#if ENABLE_SHM_SNAPSHOT == 1
+/**
+ * A similar memory read semantic to vmi_read_pa() but a non-copy direct access.
+ * The whole file is mapped read-only on first use, so no page is read from
+ * disk until it is touched. The access ends at the end of the physical range
+ * holding paddr in the image.
+ * @param[in] vmi LibVMI instance
+ * @param[in] paddr
+ * @param[out] medial_addr_ptr
+ * @param[in] count the expected count of bytes
+ * @return the actual count that less or equal than count[in]
+ */
+size_t
+file_get_dgpma(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    void **medial_addr_ptr,
+    size_t count)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    file_segment_t *seg = file_lookup_segment(fi, paddr, NULL);
+
+    if (!seg) {
+        return 0;
+    }
+
+    if (!fi->map) {
+        void *map = mmap(NULL,  // addr
+                         fi->file_size, // len
+                         PROT_READ, // prot
+                         MAP_PRIVATE | MAP_NORESERVE,   // flags
+                         fi->fd,    // file descriptor
+                         (off_t) 0);    // offset
+
+        if (MAP_FAILED == map) {
+            errprint("Failed to mmap file '%s'.\n", fi->filename);
+            return 0;
+        }
+        fi->map = map;
+        fi->map_size = fi->file_size;
+    }
+
+    // the access is contiguous up to the end of the range
+    *medial_addr_ptr = (uint8_t *) fi->map + seg->offset + (paddr - seg->paddr);
+    size_t max_size = seg->length - (paddr - seg->paddr);
+    return max_size > count ? count : max_size;
+}
+
+/**
+ * A similar memory read semantic to vmi_read_va() but a non-copy direct access.
+ * The pages of the address space are mmap'ed from the memory image at their
+ * file offsets into a contiguous medial range on first use of a pid. Pages
+ * in holes of the image, or not page aligned in it (LiME), are left out.
+ * @param[in] vmi LibVMI instance
+ * @param[in] vaddr
+ * @param[in] pid
+ * @param[out] medial_addr_ptr
+ * @param[in] count the expected count of bytes
+ * @return the actual count that less or equal than count[in]
+ */
+size_t
+file_get_dgvma(
+    vmi_instance_t vmi,
+    addr_t vaddr,
+    pid_t pid,
+    void **medial_addr_ptr,
+    size_t count)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+
+    return v2m_get_dgvma(vmi, fi->fd, file_paddr_to_offset, &fi->v2m_tables,
+                         vaddr, pid, medial_addr_ptr, count);
+}
+#endif /* ENABLE_SHM_SNAPSHOT */
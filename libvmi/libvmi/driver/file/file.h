@@ -27,6 +27,9 @@ status_t file_init(
     vmi_instance_t vmi);
 status_t file_init_vmi(
     vmi_instance_t vmi);
+status_t file_clone_vmi(
+    vmi_instance_t vmi,
+    vmi_instance_t clone);
 void file_destroy(
     vmi_instance_t vmi);
 status_t file_get_name(
@@ -39,6 +42,10 @@ status_t file_get_memsize(
     vmi_instance_t vmi,
     uint64_t *allocated_ram_size,
     addr_t *maximum_physical_address);
+status_t file_get_memory_map(
+    vmi_instance_t vmi,
+    vmi_pa_range_t **ranges,
+    size_t *count);
 status_t file_get_vcpureg(
     vmi_instance_t vmi,
     reg_t *value,
@@ -47,6 +54,10 @@ status_t file_get_vcpureg(
 void *file_read_page(
     vmi_instance_t vmi,
     addr_t page);
+status_t file_prefetch(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    size_t length);
 status_t file_write(
     vmi_instance_t vmi,
     addr_t paddr,
@@ -61,6 +72,17 @@ status_t file_pause_vm(
     vmi_instance_t vmi);
 status_t file_resume_vm(
     vmi_instance_t vmi);
+size_t file_get_dgpma(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    void **medial_addr_ptr,
+    size_t count);
+size_t file_get_dgvma(
+    vmi_instance_t vmi,
+    addr_t vaddr,
+    pid_t pid,
+    void **medial_addr_ptr,
+    size_t count);
 
 static inline status_t
 driver_file_setup(vmi_instance_t vmi)
@@ -69,16 +91,23 @@ driver_file_setup(vmi_instance_t vmi)
     driver.initialized = true;
     driver.init_ptr = &file_init;
     driver.init_vmi_ptr = &file_init_vmi;
+    driver.clone_vmi_ptr = &file_clone_vmi;
     driver.destroy_ptr = &file_destroy;
     driver.get_name_ptr = &file_get_name;
     driver.set_name_ptr = &file_set_name;
     driver.get_memsize_ptr = &file_get_memsize;
+    driver.get_memory_map_ptr = &file_get_memory_map;
     driver.get_vcpureg_ptr = &file_get_vcpureg;
     driver.read_page_ptr = &file_read_page;
+    driver.prefetch_ptr = &file_prefetch;
     driver.write_ptr = &file_write;
     driver.is_pv_ptr = &file_is_pv;
     driver.pause_vm_ptr = &file_pause_vm;
     driver.resume_vm_ptr = &file_resume_vm;
+#if ENABLE_SHM_SNAPSHOT == 1
+    driver.get_dgpma_ptr = &file_get_dgpma;
+    driver.get_dgvma_ptr = &file_get_dgvma;
+#endif
     vmi->driver = driver;
     return VMI_SUCCESS;
 }
@@ -31,6 +31,54 @@
 #include "private.h"
 #include "driver/file/file.h"
 
+#if ENABLE_SHM_SNAPSHOT == 1
+#include "driver/v2m_table.h"
+#endif
+
+#if ENABLE_IO_URING == 1
+#include <liburing.h>
+#endif
+
+/* LiME range header, see lime.h of the LiME module */
+#define LIME_MAGIC 0x4C694D45
+#define LIME_VERSION 1
+
+typedef struct lime_range_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t s_addr;     /**< first physical address of the range */
+    uint64_t e_addr;     /**< last physical address of the range (inclusive) */
+    uint8_t reserved[8];
+} __attribute__ ((packed)) lime_range_header_t;
+
+typedef enum file_format {
+    FILE_FORMAT_RAW,     /**< flat physical memory dump */
+    FILE_FORMAT_LIME,    /**< LiME ranges, each preceded by a header */
+    FILE_FORMAT_ELF      /**< ELF core, a PT_LOAD segment per range */
+} file_format_t;
+
+typedef struct file_segment {
+    addr_t paddr;        /**< first physical address of the range */
+    addr_t length;       /**< size of the range in bytes */
+    addr_t offset;       /**< file offset of the range contents */
+} file_segment_t;
+
+/* number of consecutive page misses that trigger read-ahead */
+#define FILE_READAHEAD_TRIGGER 2
+
+/* max number of pages waiting for a free prefetch queue slot */
+#define FILE_PREFETCH_MAX_PENDING 4096
+
+#if ENABLE_IO_URING == 1
+typedef struct file_prefetch_req {
+    addr_t paddr;        /**< page being read */
+    void *frame;         /**< page cache frame the read lands in */
+    int result;          /**< bytes read or -errno once completed */
+    bool completed;      /**< set when the completion has been reaped */
+    bool wanted;         /**< a page miss waits for it, don't hand it to the cache */
+} file_prefetch_req_t;
+#endif
+
 typedef struct file_instance {
 
     FILE *fhandle;       /**< handle to the memory image file */
@@ -39,7 +87,41 @@ typedef struct file_instance {
 
     char *filename;      /**< name of the file being accessed */
 
+    uint64_t file_size;  /**< size of the file on disk */
+
+    file_format_t format;    /**< layout of the memory image */
+
+    file_segment_t *segments;    /**< backed physical ranges, sorted by paddr */
+
+    size_t nr_segments;  /**< number of entries in segments */
+
+    addr_t last_miss;    /**< last page read from the file */
+
+    unsigned int sequential_misses; /**< length of the current sequential run */
+
+#if ENABLE_IO_URING == 1
+    struct io_uring ring;    /**< prefetch submission and completion queues */
+
+    bool ring_ready;     /**< the ring is set up, done on first prefetch */
+
+    bool ring_failed;    /**< the ring could not be set up, don't retry */
+
+    unsigned int prefetch_depth; /**< max number of outstanding reads */
+
+    unsigned int inflight;   /**< number of outstanding reads */
+
+    GHashTable *prefetch;    /**< paddr -> file_prefetch_req_t of outstanding reads */
+
+    GQueue *pending;     /**< pages to prefetch once a queue slot frees up */
+#endif
+
     void *map;           /**< memory mapped file */
+
+    size_t map_size;     /**< length of the memory mapped file */
+
+#if ENABLE_SHM_SNAPSHOT == 1
+    v2m_table_t v2m_tables; /**< v2m tables of all pids, for dgvma */
+#endif
 } file_instance_t;
 
 static inline file_instance_t*
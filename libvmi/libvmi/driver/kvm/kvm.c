@@ -390,550 +390,6 @@ munmap_unlink_shm_snapshot_dev(
     return VMI_SUCCESS;
 }
 
-/**
- * Throw v2p consecutive mapping range to this m2p chunk creator.
- * @param[out] m2p_chunk_list_ptr
- * @param[out] m2p_chunk_head_ptr
- * @param[in] start_vaddr
- * @param[in] end_vaddr
- * @param[in] start_paddr
- * @param[in] end_paddr
- */
-void insert_v2p_page_pair_to_m2p_chunk_list(
-    m2p_mapping_clue_chunk_t *m2p_chunk_list_ptr,
-    m2p_mapping_clue_chunk_t *m2p_chunk_head_ptr,
-    addr_t start_vaddr,
-    addr_t end_vaddr,
-    addr_t start_paddr,
-    addr_t end_paddr)
-{
-    // the first chunk
-    if (NULL == *m2p_chunk_list_ptr) {
-        *m2p_chunk_list_ptr = malloc(sizeof(m2p_mapping_clue_chunk));
-        memset(*m2p_chunk_list_ptr, 0, sizeof(m2p_mapping_clue_chunk));
-        (*m2p_chunk_list_ptr)->vaddr_begin = start_vaddr;
-        (*m2p_chunk_list_ptr)->vaddr_end = end_vaddr;
-        (*m2p_chunk_list_ptr)->paddr_begin = start_paddr;
-        (*m2p_chunk_list_ptr)->paddr_end = end_paddr;
-        (*m2p_chunk_head_ptr) = *m2p_chunk_list_ptr;
-    } else {
-        if (start_paddr == (*m2p_chunk_head_ptr)->paddr_end + 1) {
-            // merge continuous mapping
-            (*m2p_chunk_head_ptr)->vaddr_end = end_vaddr;
-            (*m2p_chunk_head_ptr)->paddr_end = end_paddr;
-        } else {
-            // new entry
-            m2p_mapping_clue_chunk_t new_page = malloc(sizeof(m2p_mapping_clue_chunk));
-            memset(new_page, 0, sizeof(m2p_mapping_clue_chunk));
-            new_page->vaddr_begin = start_vaddr;
-            new_page->vaddr_end = end_vaddr;
-            new_page->paddr_begin = start_paddr;
-            new_page->paddr_end = end_paddr;
-            (*m2p_chunk_head_ptr)->next = new_page;
-            (*m2p_chunk_head_ptr) = new_page;
-        }
-    }
-}
-
-/**
- * Throw v2p consecutive mapping range to this v2m chunk creator.
- * @param[in] vmi LibVMI instance
- * @param[out] v2m_chunk_list_ptr
- * @param[out] v2m_chunk_head_ptr
- * @param[out] m2p_chunk_list_ptr
- * @param[out] m2p_chunk_head_ptr
- * @param[in] start_vaddr
- * @param[in] end_vaddr
- * @param[in] start_paddr
- * @param[in] end_paddr
- */
-void insert_v2p_page_pair_to_v2m_chunk_list(
-    vmi_instance_t vmi,
-    v2m_chunk_t *v2m_chunk_list_ptr,
-    v2m_chunk_t *v2m_chunk_head_ptr,
-    m2p_mapping_clue_chunk_t *m2p_chunk_list_ptr,
-    m2p_mapping_clue_chunk_t *m2p_chunk_head_ptr,
-    addr_t start_vaddr,
-    addr_t end_vaddr,
-    addr_t start_paddr,
-    addr_t end_paddr)
-{
-    // the first v2m chunk
-    if (NULL == *v2m_chunk_list_ptr) {
-        *v2m_chunk_list_ptr = malloc(sizeof(v2m_chunk));
-        memset(*v2m_chunk_list_ptr, 0, sizeof(v2m_chunk));
-        (*v2m_chunk_list_ptr)->vaddr_begin = start_vaddr;
-        (*v2m_chunk_list_ptr)->vaddr_end = end_vaddr;
-        (*v2m_chunk_head_ptr) = *v2m_chunk_list_ptr;
-
-        *m2p_chunk_list_ptr = (*v2m_chunk_head_ptr)->m2p_chunks;
-        *m2p_chunk_head_ptr = (*v2m_chunk_head_ptr)->m2p_chunks;
-
-        // the first m2p chunk
-        insert_v2p_page_pair_to_m2p_chunk_list(m2p_chunk_list_ptr, m2p_chunk_head_ptr, start_vaddr,
-            end_vaddr, start_paddr, end_paddr);
-        (*v2m_chunk_head_ptr)->m2p_chunks = *m2p_chunk_list_ptr;
-    } else {
-        if (start_vaddr == (*v2m_chunk_head_ptr)->vaddr_end + 1) {
-            // continuous vaddr
-            //  1. insert p2m chunk.
-            insert_v2p_page_pair_to_m2p_chunk_list(m2p_chunk_list_ptr, m2p_chunk_head_ptr, start_vaddr,
-                end_vaddr, start_paddr, end_paddr);
-            //  2. expand v2m chunk
-            (*v2m_chunk_head_ptr)->vaddr_end = end_vaddr;
-        } else {
-            // incontinuous vaddr, so new v2m chunk
-            v2m_chunk_t new_page = malloc(sizeof(v2m_chunk));
-            memset(new_page, 0, sizeof(v2m_chunk));
-            new_page->vaddr_begin = start_vaddr;
-            new_page->vaddr_end = end_vaddr;
-            (*v2m_chunk_head_ptr)->next = new_page;
-            (*v2m_chunk_head_ptr) = new_page;
-
-            *m2p_chunk_list_ptr = (*v2m_chunk_head_ptr)->m2p_chunks;
-            *m2p_chunk_head_ptr = (*v2m_chunk_head_ptr)->m2p_chunks;
-
-            // the first p2m chunk
-            insert_v2p_page_pair_to_m2p_chunk_list(m2p_chunk_list_ptr, m2p_chunk_head_ptr, start_vaddr,
-                end_vaddr, start_paddr, end_paddr);
-            (*v2m_chunk_head_ptr)->m2p_chunks = *m2p_chunk_list_ptr;
-        }
-    }
-}
-
-/**
- * Walk through the page table to gather v2m chunks.
- * @param[in] vmi LibVMI instance
- * @param[in] dtb
- * @param[out] v2m_chunk_list_ptr
- * @param[out] v2m_chunk_head_ptr
- */
-status_t
-walkthrough_shm_snapshot_pagetable(
-    vmi_instance_t vmi,
-    addr_t dtb,
-    v2m_chunk_t* v2m_chunk_list_ptr,
-    v2m_chunk_t* v2m_chunk_head_ptr)
-{
-
-    v2m_chunk_t v2m_chunk_list = *v2m_chunk_list_ptr;
-    v2m_chunk_t v2m_chunk_head = *v2m_chunk_head_ptr;
-    m2p_mapping_clue_chunk_t m2p_chunk_list = NULL;
-    m2p_mapping_clue_chunk_t m2p_chunk_head = NULL;
-
-    GSList *pages = vmi_get_va_pages(vmi, dtb);
-    GSList *loop = pages;
-    while(loop) {
-        page_info_t *page = pages->data;
-        addr_t start_vaddr = page->vaddr;
-        addr_t start_paddr = page->paddr;
-        addr_t end_vaddr = start_vaddr | (page->size-1);
-        addr_t end_paddr = start_paddr | (page->size-1);
-        if (start_paddr < vmi->size) {
-            insert_v2p_page_pair_to_v2m_chunk_list(vmi, &v2m_chunk_list, &v2m_chunk_head,
-                &m2p_chunk_list, &m2p_chunk_head,
-                start_vaddr, end_vaddr, start_paddr, end_paddr);
-        }
-
-        free(page);
-        loop = loop->next;
-    }
-
-    if(pages) {
-        g_slist_free(pages);
-        return VMI_SUCCESS;
-    }
-
-    return VMI_FAILURE;
-}
-
-/**
- * As we must ensure consecutive v2m mappings which are usually constituted by
- *  many m2p chunks, we should probe a large enough medial address range (i.e.
- *  LibVMI virtual address) to place those m2p mappings together.
- * @param[in] vmi LibVMI instance
- * @param[in] v2m_chunk
- * @param[out] maddr_indicator_export
- */
-status_t probe_v2m_medial_addr(
-    vmi_instance_t vmi,
-    v2m_chunk_t v2m_chunk,
-    void** maddr_indicator_export)
-{
-    if (NULL != v2m_chunk) {
-        dbprint(VMI_DEBUG_KVM, "probe medial space for va: %016llx - %016llx, size: %dKB\n",
-            v2m_chunk->vaddr_begin, v2m_chunk->vaddr_end,
-            (v2m_chunk->vaddr_end - v2m_chunk->vaddr_begin+1)>>10);
-
-        // find a large enough vaddr base
-        size_t size = v2m_chunk->vaddr_end - v2m_chunk->vaddr_begin;
-        void *map = mmap(NULL,  // addr
-            (long long unsigned int)size,   // vaddr space
-            PROT_READ,   // prot
-            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,  // flags
-            0,    // file descriptor
-            0);  // offset
-        if (MAP_FAILED != map) {
-            *maddr_indicator_export = map;
-            (void) munmap(map, size);
-        } else {
-            errprint("Failed to find large enough medial address space,"
-                " size:"PRIu64" MB\n", size>>20);
-            perror("");
-            return VMI_FAILURE;
-        }
-    }
-    return VMI_SUCCESS;
-}
-
-/**
- * mmap m2p indicated by a list of m2p mappping clue chunks and a medial address.
- * @param[in] vmi LibVMI instance
- * @param[in] medial_addr_indicator the start address
- * @param[in] m2p_chunk_list
- */
-status_t mmap_m2p_chunks(
-    vmi_instance_t vmi,
-    void* medial_addr_indicator,
-    m2p_mapping_clue_chunk_t m2p_chunk_list)
-{
-    size_t map_offset = 0;
-     while (NULL != m2p_chunk_list) {
-         dbprint(VMI_DEBUG_KVM, "map va: %016llx - %016llx, pa: %016llx - %016llx, size: %dKB\n",
-             m2p_chunk_list->vaddr_begin, m2p_chunk_list->vaddr_end,
-             m2p_chunk_list->paddr_begin, m2p_chunk_list->paddr_end,
-             (m2p_chunk_list->vaddr_end - m2p_chunk_list->vaddr_begin+1)>>10);
-         size_t size = m2p_chunk_list->vaddr_end - m2p_chunk_list->vaddr_begin + 1;
-
-         void *map = mmap(medial_addr_indicator + map_offset,  // addr
-             (long long unsigned int)size,   // len
-             PROT_READ,   // prot
-             MAP_PRIVATE | MAP_NORESERVE | MAP_POPULATE | MAP_FIXED,  // flags
-             kvm_get_instance(vmi)->shm_snapshot_fd,    // file descriptor
-             m2p_chunk_list->paddr_begin);  // offset
-
-         if (MAP_FAILED == map) {
-             perror("Failed to mmap page");
-             return VMI_FAILURE;
-         }
-
-         map_offset += size;
-         m2p_chunk_list->medial_mapping_addr = map;
-         m2p_chunk_list = m2p_chunk_list->next;
-     }
-     return VMI_SUCCESS;
-}
-
-/**
- * delete m2p chunks in a collection.
- * @param[in] vmi LibVMI instance
- * @param[in] medial_addr_indicator the start address
- * @param[out] m2p_chunk_list_ptr
- */
-status_t delete_m2p_chunks(
-    vmi_instance_t vmi,
-    m2p_mapping_clue_chunk_t* m2p_chunk_list_ptr)
-{
-    m2p_mapping_clue_chunk_t tmp = *m2p_chunk_list_ptr;
-    while (NULL != tmp) {
-        m2p_mapping_clue_chunk_t tmp2 = tmp->next;
-        free(tmp);
-        tmp = tmp2;
-    }
-    *m2p_chunk_list_ptr = NULL;
-    return VMI_SUCCESS;
-}
-
-/**
- * Insert a v2m table to the collection
- * @param[in] vmi LibVMI instance
- * @param[in] entry v2m table
- */
-status_t
-insert_v2m_table(
-    vmi_instance_t vmi,
-    v2m_table_t entry)
-{
-    kvm_instance_t *kvm = kvm_get_instance(vmi);
-
-    // the first v2m table
-    if (kvm->shm_snapshot_v2m_tables == NULL) {
-        kvm->shm_snapshot_v2m_tables = entry;
-        return VMI_SUCCESS;
-    }
-    else {
-        // append to the existed v2m table link list
-        v2m_table_t head = kvm->shm_snapshot_v2m_tables;
-        while (NULL != head->next) {
-            head = head->next;
-        }
-        head->next = entry;
-        return VMI_SUCCESS;
-    }
-}
-
-/**
- * Setup a v2m table of a given pid and dtb.
- * @param[in] vmi LibVMI instance
- * @param[in] pid
- * @param[in] dtb correspond to the pid
- * @param[out] v2m_table_pt the generated v2m table
- */
-status_t
-setup_v2m_table(
-    vmi_instance_t vmi,
-    pid_t pid,
-    addr_t dtb,
-    v2m_table_t* v2m_table_pt)
-{
-    v2m_chunk_t v2m_chunk_list = NULL;
-    v2m_chunk_t v2m_chunk_head = NULL;
-
-    if (VMI_SUCCESS ==
-        walkthrough_shm_snapshot_pagetable(vmi, dtb, &v2m_chunk_list, &v2m_chunk_head))
-    {
-        v2m_chunk_t v2m_chunk_tmp = v2m_chunk_list;
-        while (NULL != v2m_chunk_tmp) {
-            // probe v2m medial address
-            void* maddr_indicator;
-            if (VMI_SUCCESS != probe_v2m_medial_addr(vmi, v2m_chunk_tmp, &maddr_indicator)) {
-                return VMI_FAILURE;
-            }
-
-            // mmap each m2p memory chunk
-            if (VMI_SUCCESS !=
-                mmap_m2p_chunks(vmi, maddr_indicator, v2m_chunk_tmp->m2p_chunks)) {
-                return VMI_FAILURE;
-            }
-
-            // delete m2p chunks
-            if (VMI_SUCCESS !=
-                delete_m2p_chunks(vmi, &v2m_chunk_tmp->m2p_chunks)) {
-                return VMI_FAILURE;
-            }
-
-            // assign valid maddr
-            v2m_chunk_tmp->medial_mapping_addr = maddr_indicator;
-
-            v2m_chunk_tmp = v2m_chunk_tmp->next;
-        }
-
-        v2m_table_t v2m_table_tmp = malloc(sizeof(v2m_table));
-        v2m_table_tmp->pid = pid;
-        v2m_table_tmp->v2m_chunks = v2m_chunk_list;
-        v2m_table_tmp->next = NULL;
-
-        *v2m_table_pt = v2m_table_tmp;
-        return insert_v2m_table(vmi, v2m_table_tmp);
-    }
-    return VMI_FAILURE;
-}
-
-/**
- * Create a v2m table of a given pid.
- * This function will walkthrough the page table of the given pid, establish
- *  the mappings of v2m and m2p, and then insert the new v2m table to a
- *  collection.
- * @param[in] vmi LibVMI instance
- * @param[in] pid Pid of the virtual address space (0 for kernel)
- * @param[out] the generated v2m table.
- */
-status_t
-create_v2m_table(
-    vmi_instance_t vmi,
-    pid_t pid,
-    v2m_table_t* v2m_table_pt)
-{
-    addr_t dtb = 0;
-    if (VMI_SUCCESS == test_using_shm_snapshot(kvm_get_instance(vmi))) {
-        // kernel page table
-        if (0 == pid) {
-            reg_t cr3 = 0;
-
-            if (vmi->kpgd) {
-                cr3 = vmi->kpgd;
-            }
-            else {
-                driver_get_vcpureg(vmi, &cr3, CR3, 0);
-            }
-            if (!cr3) {
-                dbprint(VMI_DEBUG_KVM, "--early bail on TEVAT create because cr3 is zero\n");
-                return VMI_FAILURE;
-            }
-            else {
-                dtb = cr3;
-            }
-        }
-        else {
-            // user process page table
-            dtb = vmi_pid_to_dtb(vmi, pid);
-            if (!dtb) {
-                dbprint(VMI_DEBUG_KVM, "--early bail on TEVAT create because dtb is zero\n");
-                return VMI_FAILURE;
-            }
-        }
-        return setup_v2m_table(vmi, pid, dtb, v2m_table_pt);
-    }
-    else {
-        errprint("can't create TEVAT because shm-snapshot is not using.\n");
-        return VMI_FAILURE;
-    }
-}
-
-/**
- * Search the collection of v2m tables by a pid.
- * @param[in] vmi LibVMI instance
- * @param[in] pid Pid of the virtual address space (0 for kernel)
- */
-v2m_table_t
-get_v2m_table(
-    vmi_instance_t vmi,
-    pid_t pid)
-{
-    kvm_instance_t *kvm = kvm_get_instance(vmi);
-
-    if (NULL != kvm->shm_snapshot_v2m_tables) {
-        v2m_table_t tmp = kvm->shm_snapshot_v2m_tables;
-        while (NULL != tmp) {
-            if (pid == tmp->pid)
-                return tmp;
-            tmp = tmp->next;
-        }
-    }
-    return NULL;
-}
-
-/**
- * Search the medial address of a given virtual address.
- * @param[in] vmi LibVMI instance
- * @param[in] v2m_chunk_list
- * @param[in] vaddr the virtual address
- * @param[out] medial_vaddr_ptr the corresponded medial address
- */
-size_t
-lookup_v2m_table(
-    vmi_instance_t vmi,
-    v2m_chunk_t v2m_chunk_list,
-    addr_t vaddr,
-    void** medial_vaddr_ptr)
-{
-    if (NULL != v2m_chunk_list) {
-        v2m_chunk_t tmp = v2m_chunk_list;
-        while (NULL != tmp) {
-            if (vaddr >= tmp->vaddr_begin && vaddr <= tmp->vaddr_end) {
-                size_t size = tmp->vaddr_end - vaddr + 1;
-                *medial_vaddr_ptr = tmp->medial_mapping_addr + vaddr - tmp->vaddr_begin;
-                return size;
-            }
-            tmp = tmp->next;
-        }
-    }
-    return 0;
-}
-
-/**
- * munmap many m2p mappings in a same v2m chunk.
- * @param[in] v2m_chunk_list
- */
-status_t
-munmap_m2p_chunks(
-    v2m_chunk_t v2m_chunk_list)
-{
-    v2m_chunk_t tail = v2m_chunk_list;
-    if (NULL != tail) {
-        do {
-            v2m_chunk_t tmp = tail->next;
-            munmap(tail->medial_mapping_addr,
-                (tail->vaddr_end - tail->vaddr_begin + 1));
-            free(tail);
-            tail = tmp;
-        } while (NULL != tail);
-        return VMI_SUCCESS;
-    }
-    else {
-        errprint("try to free NULL v2m_entry->chunks");
-        return VMI_FAILURE;
-    }
-}
-
-/**
- * delete a given v2m table structure
- * @param[in] vmi LibVMI instance
- * @param[in] v2m_table the table to delete
- */
-status_t
-delete_v2m_table(
-    vmi_instance_t vmi,
-    v2m_table_t v2m_table)
-{
-    kvm_instance_t *kvm = kvm_get_instance(vmi);
-
-    // the 1st entry matches
-    if (NULL != kvm->shm_snapshot_v2m_tables
-        && v2m_table == kvm->shm_snapshot_v2m_tables) {
-        v2m_table_t tmp = kvm->shm_snapshot_v2m_tables;
-        kvm->shm_snapshot_v2m_tables = tmp->next;
-        free(tmp);
-        return VMI_SUCCESS;
-    }
-    // there are two or more entries
-    else if (NULL != kvm->shm_snapshot_v2m_tables
-        && NULL != kvm->shm_snapshot_v2m_tables->next) {
-        v2m_table_t tmp[2];
-        tmp[0] = kvm->shm_snapshot_v2m_tables;
-        tmp[1] = kvm->shm_snapshot_v2m_tables->next;
-        while (NULL != tmp[1]) {
-            if (v2m_table == tmp[1]) {
-                tmp[0]->next = tmp[1]->next;
-                free(tmp[1]);
-                return VMI_SUCCESS;
-            }
-            tmp[0] = tmp[1];
-            tmp[1] = tmp[1]->next;
-        }
-        return VMI_FAILURE;
-    }
-    // no entry matches
-    else
-        return VMI_FAILURE;
-}
-
-/**
- * Destroy v2m mappings.
- *  1. munmap many m2p mappings in a v2m;
- *  2. delete v2m table.
- * @param[in] vmi LibVMI instance
- */
-status_t
-destroy_v2m(
-    vmi_instance_t vmi)
-{
-    kvm_instance_t *kvm = kvm_get_instance(vmi);
-
-    v2m_table_t tail = kvm->shm_snapshot_v2m_tables;
-    if (NULL != tail) {
-        do {
-            v2m_table_t tmp = tail->next;
-
-            if (VMI_SUCCESS
-                != munmap_m2p_chunks(tail->v2m_chunks)) {
-                errprint("fail to free_chunks_of_tevat_mapping_table_entry\n");
-                return VMI_FAILURE;
-            }
-
-            tail->v2m_chunks = NULL;
-
-            if (VMI_SUCCESS != delete_v2m_table(vmi, tail)) {
-                errprint("fail to delete_tevat_mapping_table_entry\n");
-                return VMI_FAILURE;
-            }
-            tail = tmp;
-        } while (NULL != tail);
-        kvm->shm_snapshot_v2m_tables = NULL;
-    }
-    return VMI_SUCCESS;
-}
-
 /**
  * kvm_get_memory_shm_snapshot
  *
@@ -1751,7 +1207,7 @@ status_t
 kvm_destroy_shm_snapshot(
     vmi_instance_t vmi)
 {
-    destroy_v2m(vmi);
+    v2m_tables_destroy(&kvm_get_instance(vmi)->shm_snapshot_v2m_tables);
     kvm_teardown_shm_snapshot_mode(vmi);
 
     return kvm_setup_live_mode(vmi);
@@ -1797,33 +1253,14 @@ kvm_get_dgvma(
     void** medial_addr_ptr,
     size_t count)
 {
-    // check if entry exists in the cache
-    addr_t maddr;
-    uint64_t length;
-    if (VMI_SUCCESS == v2m_cache_get(vmi, vaddr, pid, &maddr, &length)) {
-        *medial_addr_ptr = (void*)maddr;
-        return length>count?count:length;
-    }
-
-    // get v2m table of a pid
-    v2m_table_t v2m = get_v2m_table(vmi, pid);
-    // v2m table is not existed
-    if (NULL == v2m) {
-        // create v2m table
-        if (VMI_SUCCESS != create_v2m_table(vmi, pid, &v2m)) {
-            return 0; // cannot create new v2m mapping
-        }
-    }
-
-    // get medial addr
-    size_t v2m_size = lookup_v2m_table(vmi,v2m->v2m_chunks, vaddr,
-        medial_addr_ptr);
+    kvm_instance_t *kvm = kvm_get_instance(vmi);
 
-    // add this to the cache
-    if (*medial_addr_ptr) {
-        v2m_cache_set(vmi, vaddr, pid, (addr_t)*medial_addr_ptr, v2m_size);
+    if (VMI_SUCCESS != test_using_shm_snapshot(kvm)) {
+        errprint("can't create TEVAT because shm-snapshot is not using.\n");
+        return 0;
     }
 
-    return v2m_size>count?count:v2m_size;
+    return v2m_get_dgvma(vmi, kvm->shm_snapshot_fd, NULL, &kvm->shm_snapshot_v2m_tables,
+                         vaddr, pid, medial_addr_ptr, count);
 }
 #endif /* ENABLE_SHM_SNAPSHOT */
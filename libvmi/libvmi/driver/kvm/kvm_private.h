@@ -32,7 +32,7 @@
 #include <libvirt/virterror.h>
 
 #if ENABLE_SHM_SNAPSHOT == 1
-#include "driver/kvm/kvm_shm.h"
+#include "driver/v2m_table.h"
 #endif
 
 typedef struct kvm_instance {
@@ -0,0 +1,409 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+#include "driver/driver_wrapper.h"
+#include "driver/memory/memory.h"
+#include "driver/memory/memory_private.h"
+
+//----------------------------------------------------------------------------
+// Helper functions
+
+static int
+memory_range_compare(
+    const void *a,
+    const void *b)
+{
+    const vmi_memory_range_t *ra = a;
+    const vmi_memory_range_t *rb = b;
+
+    return (ra->paddr > rb->paddr) - (ra->paddr < rb->paddr);
+}
+
+static gint64
+memory_register_key(
+    registers_t reg,
+    unsigned long vcpu)
+{
+    return ((gint64) vcpu << 32) | (uint32_t) reg;
+}
+
+/* the range holding paddr */
+static vmi_memory_range_t *
+memory_lookup_range(
+    memory_instance_t *mi,
+    addr_t paddr)
+{
+    size_t lo = 0, hi = mi->nr_ranges;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        vmi_memory_range_t *range = &mi->ranges[mid];
+
+        if (paddr < range->paddr) {
+            hi = mid;
+        }
+        else if (paddr >= range->paddr + range->length) {
+            lo = mid + 1;
+        }
+        else {
+            return range;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t
+memory_config_uint64(
+    GHashTable *config,
+    const char *key,
+    uint64_t fallback)
+{
+    uint64_t *value = g_hash_table_lookup(config, key);
+
+    return value ? *value : fallback;
+}
+
+static status_t
+memory_init_ranges(
+    vmi_instance_t vmi,
+    GHashTable *config)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+    vmi_memory_range_t *ranges = g_hash_table_lookup(config, "memory_ranges");
+    void *buffer = g_hash_table_lookup(config, "memory");
+    size_t i;
+
+    if (ranges) {
+        mi->nr_ranges = memory_config_uint64(config, "memory_range_count", 1);
+        mi->ranges = g_malloc0(mi->nr_ranges * sizeof(vmi_memory_range_t));
+        memcpy(mi->ranges, ranges, mi->nr_ranges * sizeof(vmi_memory_range_t));
+    }
+    else if (buffer) {
+        mi->nr_ranges = 1;
+        mi->ranges = g_malloc0(sizeof(vmi_memory_range_t));
+        mi->ranges->buffer = buffer;
+        mi->ranges->length = memory_config_uint64(config, "memory_size", 0);
+    }
+
+    if (!mi->nr_ranges) {
+        errprint("VMI_MEMORY needs \"memory\" or \"memory_ranges\" in the config.\n");
+        return VMI_FAILURE;
+    }
+
+    qsort(mi->ranges, mi->nr_ranges, sizeof(vmi_memory_range_t), memory_range_compare);
+
+    for (i = 0; i < mi->nr_ranges; i++) {
+        vmi_memory_range_t *range = &mi->ranges[i];
+
+        if (!range->buffer || !range->length
+            || (range->paddr | range->length) & (MEMORY_PAGE_SIZE - 1)) {
+            errprint("Invalid memory range 0x%"PRIx64"+0x%zx, ranges must be page aligned.\n",
+                     range->paddr, range->length);
+            return VMI_FAILURE;
+        }
+        if (i && range->paddr < mi->ranges[i - 1].paddr + mi->ranges[i - 1].length) {
+            errprint("Memory range at 0x%"PRIx64" overlaps the previous one.\n", range->paddr);
+            return VMI_FAILURE;
+        }
+        dbprint(VMI_DEBUG_DRIVER, "--memory range 0x%"PRIx64"-0x%"PRIx64" at %p\n",
+                range->paddr, range->paddr + range->length, range->buffer);
+    }
+
+    return VMI_SUCCESS;
+}
+
+static void
+memory_init_registers(
+    vmi_instance_t vmi,
+    GHashTable *config)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+    vmi_memory_register_t *regs = g_hash_table_lookup(config, "vcpu_registers");
+    uint64_t count = memory_config_uint64(config, "vcpu_register_count", regs ? 1 : 0);
+    uint64_t i;
+
+    vmi->num_vcpus = 1;
+    for (i = 0; i < count; i++) {
+        memory_set_vcpureg(vmi, regs[i].value, regs[i].reg, regs[i].vcpu);
+        if (regs[i].vcpu >= vmi->num_vcpus) {
+            vmi->num_vcpus = regs[i].vcpu + 1;
+        }
+    }
+
+    mi->address_width = memory_config_uint64(config, "address_width", 0);
+}
+
+//----------------------------------------------------------------------------
+// General Interface Functions (1-1 mapping to driver_* function)
+
+status_t
+memory_init(
+    vmi_instance_t vmi)
+{
+    memory_instance_t *mi = g_malloc0(sizeof(memory_instance_t));
+
+    mi->registers = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+    vmi->driver.driver_data = mi;
+    return VMI_SUCCESS;
+}
+
+status_t
+memory_init_vmi(
+    vmi_instance_t vmi)
+{
+    if (!vmi->config || VMI_CONFIG_GHASHTABLE != vmi->config_mode) {
+        errprint("VMI_MEMORY requires a GHashTable config, see vmi_init_custom.\n");
+        return VMI_FAILURE;
+    }
+
+    if (VMI_FAILURE == memory_init_ranges(vmi, vmi->config)) {
+        return VMI_FAILURE;
+    }
+    memory_init_registers(vmi, vmi->config);
+
+    vmi->hvm = 1;
+    return VMI_SUCCESS;
+}
+
+status_t
+memory_clone_vmi(
+    vmi_instance_t vmi,
+    vmi_instance_t clone)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+    memory_instance_t *ci = memory_get_instance(clone);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    /* the buffers stay the caller's, only the description is copied */
+    ci->nr_ranges = mi->nr_ranges;
+    ci->ranges = g_memdup(mi->ranges, mi->nr_ranges * sizeof(vmi_memory_range_t));
+    ci->address_width = mi->address_width;
+
+    g_hash_table_iter_init(&iter, mi->registers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_hash_table_insert(ci->registers, g_memdup(key, sizeof(gint64)),
+                            g_memdup(value, sizeof(reg_t)));
+    }
+
+    clone->num_vcpus = vmi->num_vcpus;
+    clone->hvm = 1;
+    return VMI_SUCCESS;
+}
+
+void
+memory_destroy(
+    vmi_instance_t vmi)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+
+    if (!mi) {
+        return;
+    }
+    g_hash_table_destroy(mi->registers);
+    g_free(mi->ranges);
+    free(mi->name);
+    g_free(mi);
+    vmi->driver.driver_data = NULL;
+}
+
+status_t
+memory_get_name(
+    vmi_instance_t vmi,
+    char **name)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+
+    if (!mi->name) {
+        return VMI_FAILURE;
+    }
+    *name = strdup(mi->name);
+    return VMI_SUCCESS;
+}
+
+void
+memory_set_name(
+    vmi_instance_t vmi,
+    const char *name)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+
+    free(mi->name);
+    mi->name = strndup(name, 500);
+}
+
+status_t
+memory_get_memsize(
+    vmi_instance_t vmi,
+    uint64_t *allocated_ram_size,
+    addr_t *maximum_physical_address)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+    vmi_memory_range_t *last = &mi->ranges[mi->nr_ranges - 1];
+    uint64_t size = 0;
+    size_t i;
+
+    for (i = 0; i < mi->nr_ranges; i++) {
+        size += mi->ranges[i].length;
+    }
+
+    *allocated_ram_size = size;
+    *maximum_physical_address = last->paddr + last->length;
+    return VMI_SUCCESS;
+}
+
+status_t
+memory_get_memory_map(
+    vmi_instance_t vmi,
+    vmi_pa_range_t **ranges,
+    size_t *count)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+    size_t i;
+
+    *ranges = g_malloc0(mi->nr_ranges * sizeof(vmi_pa_range_t));
+    for (i = 0; i < mi->nr_ranges; i++) {
+        (*ranges)[i].paddr = mi->ranges[i].paddr;
+        (*ranges)[i].length = mi->ranges[i].length;
+    }
+    *count = mi->nr_ranges;
+    return VMI_SUCCESS;
+}
+
+status_t
+memory_get_vcpureg(
+    vmi_instance_t vmi,
+    reg_t *value,
+    registers_t reg,
+    unsigned long vcpu)
+{
+    gint64 key = memory_register_key(reg, vcpu);
+    reg_t *stored = g_hash_table_lookup(memory_get_instance(vmi)->registers, &key);
+
+    if (!stored) {
+        return VMI_FAILURE;
+    }
+    *value = *stored;
+    return VMI_SUCCESS;
+}
+
+status_t
+memory_set_vcpureg(
+    vmi_instance_t vmi,
+    reg_t value,
+    registers_t reg,
+    unsigned long vcpu)
+{
+    gint64 *key = g_malloc(sizeof(gint64));
+    reg_t *stored = g_malloc(sizeof(reg_t));
+
+    *key = memory_register_key(reg, vcpu);
+    *stored = value;
+    g_hash_table_replace(memory_get_instance(vmi)->registers, key, stored);
+    return VMI_SUCCESS;
+}
+
+status_t
+memory_get_address_width(
+    vmi_instance_t vmi,
+    uint8_t * width)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+
+    if (!mi->address_width) {
+        return VMI_FAILURE;
+    }
+    *width = mi->address_width;
+    return VMI_SUCCESS;
+}
+
+void *
+memory_read_page(
+    vmi_instance_t vmi,
+    addr_t page)
+{
+    addr_t paddr = page << vmi->page_shift;
+    vmi_memory_range_t *range = memory_lookup_range(memory_get_instance(vmi), paddr);
+
+    // the ranges are page aligned, so the page is within the buffer
+    return range ? (uint8_t *) range->buffer + (paddr - range->paddr) : NULL;
+}
+
+status_t
+memory_write(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    void *buf,
+    uint32_t length)
+{
+    memory_instance_t *mi = memory_get_instance(vmi);
+
+    while (length) {
+        vmi_memory_range_t *range = memory_lookup_range(mi, paddr);
+        addr_t offset = 0;
+        uint32_t chunk = length;
+
+        if (!range) {
+            dbprint(VMI_DEBUG_DRIVER, "--write to unbacked PA 0x%"PRIx64"\n", paddr);
+            return VMI_FAILURE;
+        }
+
+        offset = paddr - range->paddr;
+        if (chunk > range->length - offset) {
+            chunk = range->length - offset;
+        }
+        memcpy((uint8_t *) range->buffer + offset, buf, chunk);
+
+        buf = (uint8_t *) buf + chunk;
+        paddr += chunk;
+        length -= chunk;
+    }
+
+    return VMI_SUCCESS;
+}
+
+int
+memory_is_pv(
+    vmi_instance_t vmi)
+{
+    return 0;
+}
+
+// the memory doesn't change under us, so there is nothing to pause
+status_t
+memory_pause_vm(
+    vmi_instance_t vmi)
+{
+    return VMI_SUCCESS;
+}
+
+status_t
+memory_resume_vm(
+    vmi_instance_t vmi)
+{
+    return VMI_SUCCESS;
+}
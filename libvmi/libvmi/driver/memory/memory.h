@@ -0,0 +1,103 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORY_DRIVER_H
+#define MEMORY_DRIVER_H
+
+status_t memory_init(
+    vmi_instance_t vmi);
+status_t memory_init_vmi(
+    vmi_instance_t vmi);
+status_t memory_clone_vmi(
+    vmi_instance_t vmi,
+    vmi_instance_t clone);
+void memory_destroy(
+    vmi_instance_t vmi);
+status_t memory_get_name(
+    vmi_instance_t vmi,
+    char **name);
+void memory_set_name(
+    vmi_instance_t vmi,
+    const char *name);
+status_t memory_get_memsize(
+    vmi_instance_t vmi,
+    uint64_t *allocated_ram_size,
+    addr_t *maximum_physical_address);
+status_t memory_get_memory_map(
+    vmi_instance_t vmi,
+    vmi_pa_range_t **ranges,
+    size_t *count);
+status_t memory_get_vcpureg(
+    vmi_instance_t vmi,
+    reg_t *value,
+    registers_t reg,
+    unsigned long vcpu);
+status_t memory_set_vcpureg(
+    vmi_instance_t vmi,
+    reg_t value,
+    registers_t reg,
+    unsigned long vcpu);
+status_t memory_get_address_width(
+    vmi_instance_t vmi,
+    uint8_t * width);
+void *memory_read_page(
+    vmi_instance_t vmi,
+    addr_t page);
+status_t memory_write(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    void *buf,
+    uint32_t length);
+int memory_is_pv(
+    vmi_instance_t vmi);
+status_t memory_pause_vm(
+    vmi_instance_t vmi);
+status_t memory_resume_vm(
+    vmi_instance_t vmi);
+
+static inline status_t
+driver_memory_setup(vmi_instance_t vmi)
+{
+    driver_interface_t driver = { 0 };
+    driver.initialized = true;
+    driver.init_ptr = &memory_init;
+    driver.init_vmi_ptr = &memory_init_vmi;
+    driver.clone_vmi_ptr = &memory_clone_vmi;
+    driver.destroy_ptr = &memory_destroy;
+    driver.get_name_ptr = &memory_get_name;
+    driver.set_name_ptr = &memory_set_name;
+    driver.get_memsize_ptr = &memory_get_memsize;
+    driver.get_memory_map_ptr = &memory_get_memory_map;
+    driver.get_vcpureg_ptr = &memory_get_vcpureg;
+    driver.set_vcpureg_ptr = &memory_set_vcpureg;
+    driver.get_address_width_ptr = &memory_get_address_width;
+    driver.read_page_ptr = &memory_read_page;
+    driver.write_ptr = &memory_write;
+    driver.is_pv_ptr = &memory_is_pv;
+    driver.pause_vm_ptr = &memory_pause_vm;
+    driver.resume_vm_ptr = &memory_resume_vm;
+    vmi->driver = driver;
+    return VMI_SUCCESS;
+}
+
+#endif /* MEMORY_DRIVER_H */
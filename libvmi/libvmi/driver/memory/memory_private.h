@@ -0,0 +1,48 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORY_PRIVATE_H
+#define MEMORY_PRIVATE_H
+
+#include "private.h"
+#include "driver/memory/memory.h"
+
+/* ranges have to be page aligned, LibVMI assumes 4k pages (see init_page_offset) */
+#define MEMORY_PAGE_SIZE 0x1000
+
+typedef struct memory_instance {
+    char *name;                  /**< label of the instance */
+    vmi_memory_range_t *ranges;  /**< the caller's buffers, sorted by paddr */
+    size_t nr_ranges;
+    GHashTable *registers;       /**< reg_t by vcpu << 32 | register */
+    uint8_t address_width;       /**< 0 if not configured */
+} memory_instance_t;
+
+static inline
+memory_instance_t *memory_get_instance(
+    vmi_instance_t vmi)
+{
+    return ((memory_instance_t *)vmi->driver.driver_data);
+}
+
+#endif /* MEMORY_PRIVATE_H */
@@ -24,8 +24,10 @@
  * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+
 #define _GNU_SOURCE
 #include <glib.h>
+#include <stdlib.h>
 #include <time.h>
 
 #include "private.h"
@@ -37,31 +39,136 @@ struct memory_cache_entry {
     time_t last_updated;
     time_t last_used;
     void *data;
+    void (*release) (void *, size_t); /* of the driver that fetched data */
+    struct shared_frame *frame; /* set if data belongs to a shared frame */
 };
 typedef struct memory_cache_entry *memory_cache_entry_t;
-static void *(
-    *get_data_callback) (
-    vmi_instance_t,
-    addr_t,
-    uint32_t) = NULL;
-static void (
-    *release_data_callback) (
-    void *,
-    size_t) = NULL;
 
+/*
+ * Drivers are not thread-safe, fetches are serialized by the driver lock.
+ * It is taken with the page cache lock of the page held, never the other
+ * way around.
+ */
 static inline
 void *get_memory_data(
     vmi_instance_t vmi,
     addr_t paddr,
     uint32_t length)
 {
-    return get_data_callback(vmi, paddr, length);
+    void *data = NULL;
+    uint64_t start = stat_start(vmi);
+
+    g_rec_mutex_lock(&vmi->driver_lock);
+    data = vmi->get_data_callback(vmi, paddr, length);
+    g_rec_mutex_unlock(&vmi->driver_lock);
+    stat_record(vmi, VMI_STAT_READ_PAGE, start);
+    return data;
 }
 
 #if ENABLE_PAGE_CACHE == 1
+//---------------------------------------------------------
+// Page frames shared by the instances opened on the same backing
+
+typedef struct shared_frame {
+    const char *backing;    /* interned, compared by pointer */
+    addr_t paddr;
+    void *data;
+    uint32_t length;
+    void (*release) (void *, size_t); /* of the driver that fetched data */
+    gint refs;
+} shared_frame_t;
+
+static GMutex shared_frames_lock;
+static GHashTable *shared_frames = NULL;
+
+static guint
+shared_frame_hash(
+    gconstpointer key)
+{
+    const shared_frame_t *frame = key;
+
+    return g_direct_hash(frame->backing) ^ g_int64_hash(&frame->paddr);
+}
+
+static gboolean
+shared_frame_equal(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const shared_frame_t *frame_a = a;
+    const shared_frame_t *frame_b = b;
+
+    return frame_a->backing == frame_b->backing && frame_a->paddr == frame_b->paddr;
+}
+
+/*
+ * Take a reference on the frame of paddr. Without a frame yet, data (if
+ * any) becomes the frame, else data is released in favour of the frame.
+ */
+static shared_frame_t *
+shared_frame_get(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    void *data,
+    uint32_t length)
+{
+    shared_frame_t lookup = { .backing = vmi->memory_cache_backing, .paddr = paddr };
+    shared_frame_t *frame = NULL;
+
+    g_mutex_lock(&shared_frames_lock);
+    if (!shared_frames) {
+        shared_frames = g_hash_table_new(shared_frame_hash, shared_frame_equal);
+    }
+
+    frame = g_hash_table_lookup(shared_frames, &lookup);
+    if (frame) {
+        frame->refs++;
+    } else if (data) {
+        frame = g_malloc0(sizeof(shared_frame_t));
+        frame->backing = lookup.backing;
+        frame->paddr = paddr;
+        frame->data = data;
+        frame->length = length;
+        frame->release = vmi->release_data_callback;
+        frame->refs = 1;
+        g_hash_table_insert(shared_frames, frame, frame);
+        data = NULL;
+    }
+    g_mutex_unlock(&shared_frames_lock);
+
+    if (data) {
+        vmi->release_data_callback(data, length);
+    }
+    return frame;
+}
+
+static void
+shared_frame_put(
+    shared_frame_t *frame)
+{
+    g_mutex_lock(&shared_frames_lock);
+    if (--frame->refs) {
+        g_mutex_unlock(&shared_frames_lock);
+        return;
+    }
+    g_hash_table_remove(shared_frames, frame);
+    g_mutex_unlock(&shared_frames_lock);
+
+    frame->release(frame->data, frame->length);
+    g_free(frame);
+}
+
 //---------------------------------------------------------
 // Internal implementation functions
 
+static inline memory_cache_shard_t *
+memory_cache_shard(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    return &vmi->memory_cache[(paddr >> vmi->page_shift) & (VMI_CACHE_SHARDS - 1)];
+}
+
 static void
 memory_cache_entry_free(
     gpointer data)
@@ -69,47 +176,63 @@ memory_cache_entry_free(
     memory_cache_entry_t entry = (memory_cache_entry_t) data;
 
     if (entry) {
-        release_data_callback(entry->data, entry->length);
+        if (entry->frame)
+            shared_frame_put(entry->frame);
+        else
+            entry->release(entry->data, entry->length);
         free(entry);
     }
 }
 
 static void
 clean_cache(
-    vmi_instance_t vmi)
+    vmi_instance_t vmi,
+    memory_cache_shard_t *shard)
 {
-    GList *list = NULL;
+    uint32_t shard_max = vmi->memory_cache_size_max / VMI_CACHE_SHARDS;
 
-    while (g_queue_get_length(vmi->memory_cache_lru) > vmi->memory_cache_size_max / 2) {
-        gint64 *paddr = g_queue_pop_tail(vmi->memory_cache_lru);
+    while (g_queue_get_length(shard->lru) > shard_max / 2) {
+        gint64 *paddr = g_queue_pop_tail(shard->lru);
 
-        g_hash_table_remove(vmi->memory_cache, paddr);
+        g_hash_table_remove(shard->cache, paddr);
         g_free(paddr);
     }
 
-    dbprint(VMI_DEBUG_MEMCACHE, "--MEMORY cache cleanup round complete (cache size = %u)\n",
-            g_hash_table_size(vmi->memory_cache));
+    dbprint(VMI_DEBUG_MEMCACHE, "--MEMORY cache cleanup round complete (shard size = %u)\n",
+            g_hash_table_size(shard->cache));
+}
+
+static bool
+shard_full(
+    vmi_instance_t vmi,
+    memory_cache_shard_t *shard)
+{
+    uint32_t shard_max = vmi->memory_cache_size_max / VMI_CACHE_SHARDS;
+
+    return g_queue_get_length(shard->lru) >= (shard_max ? shard_max : 1);
 }
 
 static void *
 validate_and_return_data(
     vmi_instance_t vmi,
+    memory_cache_shard_t *shard,
     memory_cache_entry_t entry)
 {
     time_t now = time(NULL);
 
-    if (vmi->memory_cache_age &&
+    // shared backings don't change, their frames are never refreshed
+    if (vmi->memory_cache_age && !entry->frame &&
         (now - entry->last_updated > vmi->memory_cache_age)) {
         dbprint(VMI_DEBUG_MEMCACHE, "--MEMORY cache refresh 0x%"PRIx64"\n", entry->paddr);
-        release_data_callback(entry->data, entry->length);
+        entry->release(entry->data, entry->length);
         entry->data = get_memory_data(vmi, entry->paddr, entry->length);
         entry->last_updated = now;
 
-        GList* lru_entry = g_queue_find_custom(vmi->memory_cache_lru,
+        GList* lru_entry = g_queue_find_custom(shard->lru,
                 &entry->paddr, g_int64_equal);
-        g_queue_unlink(vmi->memory_cache_lru,
+        g_queue_unlink(shard->lru,
                 lru_entry);
-        g_queue_push_head_link(vmi->memory_cache_lru, lru_entry);
+        g_queue_push_head_link(shard->lru, lru_entry);
     }
     entry->last_used = now;
     return entry->data;
@@ -144,13 +267,85 @@ static memory_cache_entry_t create_new_entry (vmi_instance_t vmi, addr_t paddr,
     entry->length = length;
     entry->last_updated = time(NULL);
     entry->last_used = entry->last_updated;
+    entry->data = NULL;
+    entry->release = vmi->release_data_callback;
+    entry->frame = NULL;
+
+    if (vmi->memory_cache_backing) {
+        entry->frame = shared_frame_get(vmi, paddr, NULL, 0);
+        if (!entry->frame) {
+            void *data = get_memory_data(vmi, paddr, length);
+
+            if (data) {
+                entry->frame = shared_frame_get(vmi, paddr, data, length);
+            }
+        }
+        if (entry->frame) {
+            entry->data = entry->frame->data;
+        }
+        return entry;
+    }
+
     entry->data = get_memory_data(vmi, paddr, length);
 
     return entry;
 }
 
+static void
+shard_insert(
+    memory_cache_shard_t *shard,
+    memory_cache_entry_t entry)
+{
+    gint64 *key = safe_malloc(sizeof(gint64));
+    gint64 *key2 = safe_malloc(sizeof(gint64));
+
+    *key = entry->paddr;
+    g_hash_table_insert(shard->cache, key, entry);
+
+    *key2 = entry->paddr;
+    g_queue_push_head(shard->lru, key2);
+}
+
 //---------------------------------------------------------
 // External API functions
+void
+memory_cache_lock_init(
+    vmi_instance_t vmi)
+{
+    int i;
+
+    for (i = 0; i < VMI_CACHE_SHARDS; i++) {
+        g_rec_mutex_init(&vmi->memory_cache[i].lock);
+    }
+}
+
+void
+memory_cache_lock_clear(
+    vmi_instance_t vmi)
+{
+    int i;
+
+    for (i = 0; i < VMI_CACHE_SHARDS; i++) {
+        g_rec_mutex_clear(&vmi->memory_cache[i].lock);
+    }
+}
+
+void
+memory_cache_lock(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    g_rec_mutex_lock(&memory_cache_shard(vmi, paddr)->lock);
+}
+
+void
+memory_cache_unlock(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    g_rec_mutex_unlock(&memory_cache_shard(vmi, paddr)->lock);
+}
+
 void
 memory_cache_init(
     vmi_instance_t vmi,
@@ -161,15 +356,45 @@ memory_cache_init(
                           size_t),
     unsigned long age_limit)
 {
-    vmi->memory_cache =
-        g_hash_table_new_full(g_int64_hash, g_int64_equal,
-                              g_free,
-                              memory_cache_entry_free);
-    vmi->memory_cache_lru = g_queue_new();
+    int i;
+
+    for (i = 0; i < VMI_CACHE_SHARDS; i++) {
+        memory_cache_shard_t *shard = &vmi->memory_cache[i];
+
+        shard->cache =
+            g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                  g_free,
+                                  memory_cache_entry_free);
+        shard->lru = g_queue_new();
+    }
     vmi->memory_cache_age = age_limit;
     vmi->memory_cache_size_max = MAX_PAGE_CACHE_SIZE;
-    get_data_callback = get_data;
-    release_data_callback = release_data;
+    vmi->get_data_callback = get_data;
+    vmi->release_data_callback = release_data;
+}
+
+/*
+ * Share the cached pages with other instances opened on the same backing,
+ * a string identifying the memory source. Only for sources that don't
+ * change. Enabled by the "shared_page_cache" key of a GHashTable config
+ * or the LIBVMI_SHARED_PAGE_CACHE environment variable.
+ */
+void
+memory_cache_share(
+    vmi_instance_t vmi,
+    const char *backing)
+{
+    gboolean enabled = (getenv("LIBVMI_SHARED_PAGE_CACHE") != NULL);
+
+    if (vmi->config && VMI_CONFIG_GHASHTABLE == vmi->config_mode
+        && g_hash_table_lookup(vmi->config, "shared_page_cache")) {
+        enabled = TRUE;
+    }
+    if (!enabled)
+        return;
+
+    vmi->memory_cache_backing = g_intern_string(backing);
+    dbprint(VMI_DEBUG_MEMCACHE, "--MEMORY cache shared for %s\n", backing);
 }
 
 void *
@@ -177,50 +402,119 @@ memory_cache_insert(
     vmi_instance_t vmi,
     addr_t paddr)
 {
+    memory_cache_shard_t *shard = memory_cache_shard(vmi, paddr);
     memory_cache_entry_t entry = NULL;
     addr_t paddr_aligned = paddr & ~(((addr_t) vmi->page_size) - 1);
+    void *data = NULL;
 
     if (paddr != paddr_aligned) {
         errprint("Memory cache request for non-aligned page\n");
         return NULL;
     }
 
+    g_rec_mutex_lock(&shard->lock);
+
     gint64 *key = (gint64*)&paddr;
-    if ((entry = g_hash_table_lookup(vmi->memory_cache, key)) != NULL) {
+    if ((entry = g_hash_table_lookup(shard->cache, key)) != NULL) {
         dbprint(VMI_DEBUG_MEMCACHE, "--MEMORY cache hit 0x%"PRIx64"\n", paddr);
-        return validate_and_return_data(vmi, entry);
+        data = validate_and_return_data(vmi, shard, entry);
+        goto done;
     }
-    else {
-        if (g_queue_get_length(vmi->memory_cache_lru) >= vmi->memory_cache_size_max) {
-            clean_cache(vmi);
-        }
 
-        dbprint(VMI_DEBUG_MEMCACHE, "--MEMORY cache set 0x%"PRIx64"\n", paddr);
+    if (shard_full(vmi, shard)) {
+        clean_cache(vmi, shard);
+    }
 
-        entry = create_new_entry(vmi, paddr, vmi->page_size);
-        if (!entry) {
-            errprint("create_new_entry failed\n");
-            return 0;
-        }
+    dbprint(VMI_DEBUG_MEMCACHE, "--MEMORY cache set 0x%"PRIx64"\n", paddr);
 
-        key = safe_malloc(sizeof(gint64));
-        *key = paddr;
-        g_hash_table_insert(vmi->memory_cache, key, entry);
+    entry = create_new_entry(vmi, paddr, vmi->page_size);
+    if (!entry) {
+        errprint("create_new_entry failed\n");
+        goto done;
+    }
 
-        gint64 *key2 = safe_malloc(sizeof(gint64));
+    shard_insert(shard, entry);
+    data = entry->data;
 
-        *key2 = paddr;
-        g_queue_push_head(vmi->memory_cache_lru, key2);
+done:
+    g_rec_mutex_unlock(&shard->lock);
+    return data;
+}
 
-        return entry->data;
+/*
+ * Hand a page the driver fetched on its own (e.g. by prefetching) to the
+ * cache. The cache owns data afterwards. Drivers call this with the driver
+ * lock held, so a busy shard is not waited for and the page dropped.
+ */
+void
+memory_cache_fill(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    void *data)
+{
+    memory_cache_shard_t *shard = memory_cache_shard(vmi, paddr);
+    gint64 lookup = paddr;
+
+    if (!shard->cache || !g_rec_mutex_trylock(&shard->lock)) {
+        vmi->release_data_callback(data, vmi->page_size);
+        return;
     }
+
+    if (g_hash_table_lookup(shard->cache, &lookup)) {
+        vmi->release_data_callback(data, vmi->page_size);
+        goto done;
+    }
+
+    if (shard_full(vmi, shard)) {
+        clean_cache(vmi, shard);
+    }
+
+    dbprint(VMI_DEBUG_MEMCACHE, "--MEMORY cache fill 0x%"PRIx64"\n", paddr);
+
+    memory_cache_entry_t entry =
+        (memory_cache_entry_t)
+        safe_malloc(sizeof(struct memory_cache_entry));
+
+    entry->paddr = paddr;
+    entry->length = vmi->page_size;
+    entry->last_updated = time(NULL);
+    entry->last_used = entry->last_updated;
+    entry->data = data;
+    entry->release = vmi->release_data_callback;
+    entry->frame = NULL;
+    if (vmi->memory_cache_backing) {
+        entry->frame = shared_frame_get(vmi, paddr, data, vmi->page_size);
+        entry->data = entry->frame->data;
+    }
+    shard_insert(shard, entry);
+
+done:
+    g_rec_mutex_unlock(&shard->lock);
+}
+
+/* like memory_cache_fill, a busy shard counts as not containing the page */
+bool
+memory_cache_contains(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    memory_cache_shard_t *shard = memory_cache_shard(vmi, paddr);
+    gint64 key = paddr;
+    bool found = false;
+
+    if (!shard->cache || !g_rec_mutex_trylock(&shard->lock)) {
+        return false;
+    }
+    found = (g_hash_table_lookup(shard->cache, &key) != NULL);
+    g_rec_mutex_unlock(&shard->lock);
+    return found;
 }
 
 void memory_cache_remove(
     vmi_instance_t vmi,
     addr_t paddr)
 {
-    memory_cache_entry_t entry = NULL;
+    memory_cache_shard_t *shard = memory_cache_shard(vmi, paddr);
     addr_t paddr_aligned = paddr & ~(((addr_t) vmi->page_size) - 1);
 
     if (paddr != paddr_aligned) {
@@ -230,37 +524,74 @@ void memory_cache_remove(
 
     gint64 *key = (gint64*)&paddr;
 
-    g_hash_table_remove(vmi->memory_cache, key);
+    g_rec_mutex_lock(&shard->lock);
+    g_hash_table_remove(shard->cache, key);
+    g_rec_mutex_unlock(&shard->lock);
 }
 
 void
 memory_cache_destroy(
     vmi_instance_t vmi)
 {
+    int i;
+
     vmi->memory_cache_size_max = 0;
 
-    if (vmi->memory_cache_lru) {
+    for (i = 0; i < VMI_CACHE_SHARDS; i++) {
+        memory_cache_shard_t *shard = &vmi->memory_cache[i];
+
+        if (shard->lru) {
 #if GLIB_CHECK_VERSION(2, 32, 0)
-        g_queue_free_full(vmi->memory_cache_lru, g_free);
+            g_queue_free_full(shard->lru, g_free);
 #else
-        g_queue_foreach(vmi->memory_cache_lru, g_free, NULL);
-        g_queue_free(vmi->memory_cache_lru);
+            g_queue_foreach(shard->lru, g_free, NULL);
+            g_queue_free(shard->lru);
 #endif
-        vmi->memory_cache_lru = NULL;
-    }
+            shard->lru = NULL;
+        }
 
-    if (vmi->memory_cache) {
-        g_hash_table_destroy(vmi->memory_cache);
-        vmi->memory_cache = NULL;
+        if (shard->cache) {
+            g_hash_table_destroy(shard->cache);
+            shard->cache = NULL;
+        }
     }
 
     vmi->memory_cache_age = 0;
     vmi->memory_cache_size_max = 0;
-    get_data_callback = NULL;
-    release_data_callback = NULL;
+    vmi->memory_cache_backing = NULL;
 }
 
 #else
+void
+memory_cache_lock_init(
+    vmi_instance_t vmi)
+{
+    g_rec_mutex_init(&vmi->memory_cache_lock);
+}
+
+void
+memory_cache_lock_clear(
+    vmi_instance_t vmi)
+{
+    g_rec_mutex_clear(&vmi->memory_cache_lock);
+}
+
+void
+memory_cache_lock(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    g_rec_mutex_lock(&vmi->memory_cache_lock);
+}
+
+void
+memory_cache_unlock(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    g_rec_mutex_unlock(&vmi->memory_cache_lock);
+}
+
 void
 memory_cache_init(
     vmi_instance_t vmi,
@@ -271,8 +602,8 @@ memory_cache_init(
                           size_t),
     unsigned long age_limit)
 {
-    get_data_callback = get_data;
-    release_data_callback = release_data;
+    vmi->get_data_callback = get_data;
+    vmi->release_data_callback = release_data;
 }
 
 void *
@@ -280,25 +611,59 @@ memory_cache_insert(
     vmi_instance_t vmi,
     addr_t paddr)
 {
+    void *data = NULL;
+
+    g_rec_mutex_lock(&vmi->memory_cache_lock);
     if(paddr == vmi->last_used_page_key && vmi->last_used_page) {
-        return vmi->last_used_page;
+        data = vmi->last_used_page;
     } else {
         if(vmi->last_used_page_key && vmi->last_used_page) {
-            release_data_callback(vmi->last_used_page, vmi->page_size);
+            vmi->release_data_callback(vmi->last_used_page, vmi->page_size);
         }
         vmi->last_used_page = get_memory_data(vmi, paddr, vmi->page_size);
         vmi->last_used_page_key = paddr;
-        return vmi->last_used_page;
+        data = vmi->last_used_page;
     }
+    g_rec_mutex_unlock(&vmi->memory_cache_lock);
+    return data;
+}
+
+void
+memory_cache_share(
+    vmi_instance_t vmi,
+    const char *backing)
+{
+    // a single page isn't worth sharing
+}
+
+void
+memory_cache_fill(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    void *data)
+{
+    // only the last used page is kept, nowhere to put it
+    vmi->release_data_callback(data, vmi->page_size);
+}
+
+bool
+memory_cache_contains(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    return (paddr == vmi->last_used_page_key && vmi->last_used_page);
 }
 
 void memory_cache_remove(
     vmi_instance_t vmi,
     addr_t paddr)
 {
+    g_rec_mutex_lock(&vmi->memory_cache_lock);
     if(paddr == vmi->last_used_page_key && vmi->last_used_page) {
-        release_data_callback(vmi->last_used_page, vmi->page_size);
+        vmi->release_data_callback(vmi->last_used_page, vmi->page_size);
+        vmi->last_used_page = NULL;
     }
+    g_rec_mutex_unlock(&vmi->memory_cache_lock);
 }
 
 void
@@ -306,11 +671,9 @@ memory_cache_destroy(
     vmi_instance_t vmi)
 {
     if(vmi->last_used_page_key && vmi->last_used_page) {
-        release_data_callback(vmi->last_used_page, vmi->page_size);
+        vmi->release_data_callback(vmi->last_used_page, vmi->page_size);
     }
     vmi->last_used_page_key = 0;
     vmi->last_used_page = NULL;
-    get_data_callback = NULL;
-    release_data_callback = NULL;
 }
 #endif
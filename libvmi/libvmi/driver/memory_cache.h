@@ -38,10 +38,41 @@ void memory_cache_init(
                           size_t),
     unsigned long age_limit);
 
+void memory_cache_lock_init(
+    vmi_instance_t vmi);
+
+void memory_cache_lock_clear(
+    vmi_instance_t vmi);
+
+/*
+ * Pin the cached page of paddr while its data is being copied out, the
+ * page is not refreshed or evicted by other threads until unlocked.
+ */
+void memory_cache_lock(
+    vmi_instance_t vmi,
+    addr_t paddr);
+
+void memory_cache_unlock(
+    vmi_instance_t vmi,
+    addr_t paddr);
+
+void memory_cache_share(
+    vmi_instance_t vmi,
+    const char *backing);
+
 void *memory_cache_insert(
     vmi_instance_t vmi,
     addr_t paddr);
 
+void memory_cache_fill(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    void *data);
+
+bool memory_cache_contains(
+    vmi_instance_t vmi,
+    addr_t paddr);
+
 void memory_cache_remove(
     vmi_instance_t vmi,
     addr_t paddr);
@@ -0,0 +1,377 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+#include "driver/driver_wrapper.h"
+#include "driver/trace/trace.h"
+#include "driver/trace/trace_private.h"
+
+//----------------------------------------------------------------------------
+// Helper functions
+
+static guint
+trace_key_hash(
+    gconstpointer key)
+{
+    const trace_key_t *k = key;
+    uint64_t h = k->arg * 0x9E3779B97F4A7C15ULL;
+
+    return (guint) (h >> 32) ^ (guint) h ^ (k->id << 8) ^ k->type;
+}
+
+static gboolean
+trace_key_equal(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const trace_key_t *ka = a;
+    const trace_key_t *kb = b;
+
+    return ka->type == kb->type && ka->id == kb->id && ka->arg == kb->arg;
+}
+
+static void
+trace_responses_free(
+    gpointer data)
+{
+    trace_responses_t *responses = data;
+
+    g_array_free(responses->records, TRUE);
+    g_free(responses);
+}
+
+static void
+trace_add_response(
+    trace_instance_t *ti,
+    trace_record_t *record)
+{
+    trace_key_t key = { record->type, 0, 0 };
+    trace_responses_t *responses = NULL;
+
+    switch (record->type) {
+    case TRACE_REC_READ_PAGE:
+        key.arg = record->arg;
+        break;
+    case TRACE_REC_VCPUREG:
+        key.id = record->id;
+        key.arg = record->arg;
+        break;
+    default:
+        break;
+    }
+
+    if (!(responses = g_hash_table_lookup(ti->responses, &key))) {
+        trace_key_t *new_key = g_malloc(sizeof(trace_key_t));
+
+        *new_key = key;
+
+        responses = g_malloc0(sizeof(trace_responses_t));
+        responses->records = g_array_new(FALSE, FALSE, sizeof(trace_record_t));
+        g_hash_table_insert(ti->responses, new_key, responses);
+    }
+    g_array_append_val(responses->records, *record);
+}
+
+/*
+ * The next recorded response to a call. The responses to a call are served
+ * in the order they were recorded, a page read as many times as it was
+ * counted, and the last one is repeated once they run out. This keeps the replay deterministic even when the code under test
+ * issues the calls in a different order or more often than when recording.
+ */
+static trace_record_t *
+trace_next_response(
+    vmi_instance_t vmi,
+    uint8_t type,
+    uint32_t id,
+    uint64_t arg)
+{
+    trace_instance_t *ti = trace_get_instance(vmi);
+    trace_key_t key = { type, id, arg };
+    trace_responses_t *responses = g_hash_table_lookup(ti->responses, &key);
+    trace_record_t *record = NULL;
+
+    if (!responses) {
+        dbprint(VMI_DEBUG_DRIVER, "--trace has no response for call %u (%u, 0x%"PRIx64")\n",
+                type, id, arg);
+        return NULL;
+    }
+
+    record = &g_array_index(responses->records, trace_record_t, responses->next);
+    if (TRACE_REC_READ_PAGE == type && ++responses->served < record->value) {
+        return record;
+    }
+    if (responses->next + 1 < responses->records->len) {
+        responses->next++;
+        responses->served = 0;
+    }
+    return record;
+}
+
+static status_t
+trace_load(
+    vmi_instance_t vmi)
+{
+    trace_instance_t *ti = trace_get_instance(vmi);
+    trace_header_t header;
+    trace_record_t record;
+    void *file = NULL;
+    status_t ret = VMI_FAILURE;
+
+    if (!(file = trace_open(ti->path, "rb"))) {
+        errprint("Failed to open trace '%s' for reading.\n", ti->path);
+        return VMI_FAILURE;
+    }
+
+    if (!trace_io(file, &header, sizeof(header), false)
+        || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic))) {
+        errprint("'%s' is not a LibVMI trace.\n", ti->path);
+        goto done;
+    }
+    if (header.version != TRACE_VERSION) {
+        errprint("Unsupported trace version %u.\n", header.version);
+        goto done;
+    }
+
+    ti->name = g_malloc0(header.name_length + 1);
+    if (!trace_io(file, ti->name, header.name_length, false)) {
+        errprint("Truncated trace header.\n");
+        goto done;
+    }
+
+    // page id 0 stands for a failed read
+    g_ptr_array_add(ti->pages, NULL);
+
+    while (trace_io(file, &record, sizeof(record), false)) {
+        if (TRACE_REC_PAGE == record.type) {
+            void *page = NULL;
+
+            if (record.id != ti->pages->len) {
+                errprint("Trace page %u out of order.\n", record.id);
+                goto done;
+            }
+            page = safe_malloc(record.value);
+            if (!trace_io(file, page, record.value, false)) {
+                free(page);
+                break;
+            }
+            g_ptr_array_add(ti->pages, page);
+            continue;
+        }
+
+        if (TRACE_REC_READ_PAGE == record.type && record.id >= ti->pages->len) {
+            errprint("Trace read of unknown page %u.\n", record.id);
+            goto done;
+        }
+        trace_add_response(ti, &record);
+    }
+
+    // the trace of a session that didn't exit cleanly ends in the middle of a record
+    dbprint(VMI_DEBUG_DRIVER, "--loaded trace of '%s': %u pages, %u distinct calls\n",
+            ti->name, ti->pages->len - 1, g_hash_table_size(ti->responses));
+
+    // a replay behaves like the recorded session from here on
+    vmi->mode = header.mode;
+    vmi->hvm = header.hvm;
+    vmi->num_vcpus = header.num_vcpus;
+    ret = VMI_SUCCESS;
+
+done:
+    trace_close(file);
+    return ret;
+}
+
+//----------------------------------------------------------------------------
+// Trace-Specific Interface Functions (no direct mapping to driver_*)
+
+status_t
+trace_init(
+    vmi_instance_t vmi)
+{
+    trace_instance_t *ti = g_malloc0(sizeof(trace_instance_t));
+
+    ti->pages = g_ptr_array_new_with_free_func(free);
+    ti->responses = g_hash_table_new_full(trace_key_hash, trace_key_equal,
+                                          g_free, trace_responses_free);
+    vmi->driver.driver_data = ti;
+    return VMI_SUCCESS;
+}
+
+status_t
+trace_init_vmi(
+    vmi_instance_t vmi)
+{
+    trace_instance_t *ti = trace_get_instance(vmi);
+
+    if (!ti->path) {
+        errprint("Must specify the trace file to replay.\n");
+        return VMI_FAILURE;
+    }
+    if (VMI_FAILURE == trace_load(vmi)) {
+        return VMI_FAILURE;
+    }
+
+    // identify as the recorded VM or file so its config entry is found,
+    // image_type_complete keeps pointing to the trace
+    free(vmi->image_type);
+    if (VMI_FILE == vmi->mode) {
+        char *base = strrchr(ti->name, '/');
+        vmi->image_type = strndup(base ? base + 1 : ti->name, 500);
+    }
+    else {
+        vmi->image_type = strndup(ti->name, 100);
+    }
+
+    return VMI_SUCCESS;
+}
+
+void
+trace_destroy(
+    vmi_instance_t vmi)
+{
+    trace_instance_t *ti = trace_get_instance(vmi);
+
+    if (!ti) {
+        return;
+    }
+    g_ptr_array_free(ti->pages, TRUE);
+    g_hash_table_destroy(ti->responses);
+    g_free(ti->name);
+    free(ti->path);
+    g_free(ti);
+    vmi->driver.driver_data = NULL;
+}
+
+status_t
+trace_get_name(
+    vmi_instance_t vmi,
+    char **name)
+{
+    trace_instance_t *ti = trace_get_instance(vmi);
+
+    *name = strdup(ti->name ? ti->name : ti->path);
+    return VMI_SUCCESS;
+}
+
+void
+trace_set_name(
+    vmi_instance_t vmi,
+    const char *name)
+{
+    trace_instance_t *ti = trace_get_instance(vmi);
+
+    free(ti->path);
+    ti->path = strndup(name, 500);
+}
+
+status_t
+trace_get_memsize(
+    vmi_instance_t vmi,
+    uint64_t *allocated_ram_size,
+    addr_t *maximum_physical_address)
+{
+    trace_record_t *record = trace_next_response(vmi, TRACE_REC_MEMSIZE, 0, 0);
+
+    if (!record || VMI_FAILURE == record->status) {
+        return VMI_FAILURE;
+    }
+    *allocated_ram_size = record->arg;
+    *maximum_physical_address = record->value;
+    return VMI_SUCCESS;
+}
+
+status_t
+trace_get_vcpureg(
+    vmi_instance_t vmi,
+    reg_t *value,
+    registers_t reg,
+    unsigned long vcpu)
+{
+    trace_record_t *record = trace_next_response(vmi, TRACE_REC_VCPUREG, vcpu, reg);
+
+    if (!record || VMI_FAILURE == record->status) {
+        return VMI_FAILURE;
+    }
+    *value = record->value;
+    return VMI_SUCCESS;
+}
+
+status_t
+trace_get_address_width(
+    vmi_instance_t vmi,
+    uint8_t * width)
+{
+    trace_record_t *record = trace_next_response(vmi, TRACE_REC_ADDRESS_WIDTH, 0, 0);
+
+    if (!record || VMI_FAILURE == record->status) {
+        return VMI_FAILURE;
+    }
+    *width = record->value;
+    return VMI_SUCCESS;
+}
+
+void *
+trace_read_page(
+    vmi_instance_t vmi,
+    addr_t page)
+{
+    trace_instance_t *ti = trace_get_instance(vmi);
+    trace_record_t *record = NULL;
+
+    // pages are not fetched through the memory cache, serialize here
+    g_rec_mutex_lock(&vmi->driver_lock);
+    record = trace_next_response(vmi, TRACE_REC_READ_PAGE, 0, page);
+    g_rec_mutex_unlock(&vmi->driver_lock);
+
+    // the pages are owned by the trace, like the page cache owns driver pages
+    return record ? g_ptr_array_index(ti->pages, record->id) : NULL;
+}
+
+int
+trace_is_pv(
+    vmi_instance_t vmi)
+{
+    trace_record_t *record = trace_next_response(vmi, TRACE_REC_IS_PV, 0, 0);
+
+    return record ? (int) record->value : 0;
+}
+
+status_t
+trace_pause_vm(
+    vmi_instance_t vmi)
+{
+    trace_record_t *record = trace_next_response(vmi, TRACE_REC_PAUSE, 0, 0);
+
+    return record ? record->status : VMI_SUCCESS;
+}
+
+status_t
+trace_resume_vm(
+    vmi_instance_t vmi)
+{
+    trace_record_t *record = trace_next_response(vmi, TRACE_REC_RESUME, 0, 0);
+
+    return record ? record->status : VMI_SUCCESS;
+}
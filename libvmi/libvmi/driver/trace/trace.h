@@ -0,0 +1,92 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_DRIVER_H
+#define TRACE_DRIVER_H
+
+/* replay driver, serves the responses recorded in a trace file */
+status_t trace_init(
+    vmi_instance_t vmi);
+status_t trace_init_vmi(
+    vmi_instance_t vmi);
+void trace_destroy(
+    vmi_instance_t vmi);
+status_t trace_get_name(
+    vmi_instance_t vmi,
+    char **name);
+void trace_set_name(
+    vmi_instance_t vmi,
+    const char *name);
+status_t trace_get_memsize(
+    vmi_instance_t vmi,
+    uint64_t *allocated_ram_size,
+    addr_t *maximum_physical_address);
+status_t trace_get_vcpureg(
+    vmi_instance_t vmi,
+    reg_t *value,
+    registers_t reg,
+    unsigned long vcpu);
+status_t trace_get_address_width(
+    vmi_instance_t vmi,
+    uint8_t * width);
+void *trace_read_page(
+    vmi_instance_t vmi,
+    addr_t page);
+int trace_is_pv(
+    vmi_instance_t vmi);
+status_t trace_pause_vm(
+    vmi_instance_t vmi);
+status_t trace_resume_vm(
+    vmi_instance_t vmi);
+
+/*
+ * Record the responses of the driver of vmi to the trace file configured
+ * by the "trace_record" key of a GHashTable config or the
+ * LIBVMI_TRACE_RECORD environment variable. Does nothing if neither is set.
+ */
+status_t trace_record_init(
+    vmi_instance_t vmi,
+    vmi_config_t config);
+
+static inline status_t
+driver_trace_setup(vmi_instance_t vmi)
+{
+    driver_interface_t driver = { 0 };
+    driver.initialized = true;
+    driver.init_ptr = &trace_init;
+    driver.init_vmi_ptr = &trace_init_vmi;
+    driver.destroy_ptr = &trace_destroy;
+    driver.get_name_ptr = &trace_get_name;
+    driver.set_name_ptr = &trace_set_name;
+    driver.get_memsize_ptr = &trace_get_memsize;
+    driver.get_vcpureg_ptr = &trace_get_vcpureg;
+    driver.get_address_width_ptr = &trace_get_address_width;
+    driver.read_page_ptr = &trace_read_page;
+    driver.is_pv_ptr = &trace_is_pv;
+    driver.pause_vm_ptr = &trace_pause_vm;
+    driver.resume_vm_ptr = &trace_resume_vm;
+    vmi->driver = driver;
+    return VMI_SUCCESS;
+}
+
+#endif /* TRACE_DRIVER_H */
@@ -0,0 +1,159 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_PRIVATE_H
+#define TRACE_PRIVATE_H
+
+#include "private.h"
+#include "driver/trace/trace.h"
+
+#if HAVE_ZLIB_H == 1
+#include <zlib.h>
+#endif
+
+/*
+ * A trace is a header followed by a stream of records, in host byte order.
+ * The contents of every distinct page are stored once, in a TRACE_REC_PAGE
+ * record preceding the first read that returned them. Consecutive reads of
+ * a page returning the same are stored as one TRACE_REC_READ_PAGE record
+ * with their count. With zlib the whole stream is gzip compressed.
+ */
+#define TRACE_MAGIC "LVMITRCE"
+#define TRACE_VERSION 1
+
+typedef struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t mode;          /**< access mode of the recorded session */
+    uint32_t hvm;           /**< vmi->hvm of the recorded session */
+    uint32_t num_vcpus;     /**< vmi->num_vcpus of the recorded session */
+    uint32_t name_length;   /**< length of the name following the header */
+} __attribute__ ((packed)) trace_header_t;
+
+typedef enum trace_record_type {
+    TRACE_REC_PAGE = 1,     /**< id: page id, value: length, followed by the contents */
+    TRACE_REC_READ_PAGE,    /**< arg: paddr, id: page id (0 if the read failed),
+                                 value: number of reads */
+    TRACE_REC_MEMSIZE,      /**< arg: allocated ram size, value: max physical address */
+    TRACE_REC_VCPUREG,      /**< arg: register, id: vcpu, value: register value */
+    TRACE_REC_ADDRESS_WIDTH,/**< value: address width */
+    TRACE_REC_IS_PV,        /**< value: result */
+    TRACE_REC_PAUSE,
+    TRACE_REC_RESUME
+} trace_record_type_t;
+
+typedef struct trace_record {
+    uint8_t type;
+    uint8_t status;         /**< status_t of the recorded call */
+    uint16_t reserved;
+    uint32_t id;
+    uint64_t arg;
+    uint64_t value;
+} __attribute__ ((packed)) trace_record_t;
+
+/* a call and its arguments */
+typedef struct trace_key {
+    uint8_t type;
+    uint32_t id;
+    uint64_t arg;
+} trace_key_t;
+
+/* the responses recorded for one call, served in order */
+typedef struct trace_responses {
+    GArray *records;
+    guint next;
+    uint64_t served;        /**< times the next record was served already */
+} trace_responses_t;
+
+typedef struct trace_instance {
+    char *path;             /**< trace file */
+    char *name;             /**< name of the recorded VM or file */
+    GPtrArray *pages;       /**< page contents indexed by page id */
+    GHashTable *responses;  /**< trace_responses_t by call and arguments */
+} trace_instance_t;
+
+typedef struct trace_recorder {
+    driver_interface_t driver; /**< the recorded driver */
+    void *file;
+    GHashTable *page_ids;   /**< page id by checksum of the contents */
+    trace_record_t last;    /**< read being counted, written once it changes */
+    void *last_page;        /**< contents returned by that read */
+    uint32_t next_page_id;
+    bool failed;            /**< stop recording after a write error */
+} trace_recorder_t;
+
+static inline
+trace_instance_t *trace_get_instance(
+    vmi_instance_t vmi)
+{
+    return ((trace_instance_t *)vmi->driver.driver_data);
+}
+
+static inline
+trace_recorder_t *trace_get_recorder(
+    vmi_instance_t vmi)
+{
+    return ((trace_recorder_t *)vmi->driver.trace_data);
+}
+
+/* trace file access, gzip compressed when zlib is available */
+static inline void *
+trace_open(
+    const char *path,
+    const char *mode)
+{
+#if HAVE_ZLIB_H == 1
+    return gzopen(path, mode);
+#else
+    return fopen(path, mode);
+#endif
+}
+
+static inline bool
+trace_io(
+    void *file,
+    void *buf,
+    size_t length,
+    bool write)
+{
+#if HAVE_ZLIB_H == 1
+    int rc = write ? gzwrite(file, buf, length) : gzread(file, buf, length);
+    return rc == (int) length;
+#else
+    size_t rc = write ? fwrite(buf, length, 1, file) : fread(buf, length, 1, file);
+    return rc == 1;
+#endif
+}
+
+static inline void
+trace_close(
+    void *file)
+{
+#if HAVE_ZLIB_H == 1
+    gzclose(file);
+#else
+    fclose(file);
+#endif
+}
+
+#endif /* TRACE_PRIVATE_H */
@@ -0,0 +1,320 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+#include "driver/driver_wrapper.h"
+#include "driver/trace/trace.h"
+#include "driver/trace/trace_private.h"
+
+/*
+ * The recorder sits between LibVMI and the driver of a live session: the
+ * recorded calls of the driver interface are replaced by wrappers that
+ * pass the call on to the driver and append its response to the trace.
+ */
+
+static void
+trace_record_write(
+    trace_recorder_t *rec,
+    trace_record_t *record,
+    void *data,
+    size_t length)
+{
+    if (rec->failed) {
+        return;
+    }
+
+    if (!trace_io(rec->file, record, sizeof(*record), true)
+        || (length && !trace_io(rec->file, data, length, true))) {
+        errprint("Failed to write trace, recording stopped.\n");
+        rec->failed = true;
+    }
+}
+
+/* writes the page read being counted, before anything that came later */
+static void
+trace_record_flush(
+    trace_recorder_t *rec)
+{
+    if (rec->last.type) {
+        trace_record_write(rec, &rec->last, NULL, 0);
+        rec->last.type = 0;
+    }
+}
+
+static void
+trace_record_call(
+    vmi_instance_t vmi,
+    uint8_t type,
+    status_t status,
+    uint32_t id,
+    uint64_t arg,
+    uint64_t value)
+{
+    trace_recorder_t *rec = trace_get_recorder(vmi);
+    trace_record_t record = { 0 };
+
+    record.type = type;
+    record.status = status;
+    record.id = id;
+    record.arg = arg;
+    record.value = value;
+    trace_record_flush(rec);
+    trace_record_write(rec, &record, NULL, 0);
+}
+
+/* id of the page contents, storing them in the trace when first seen */
+static uint32_t
+trace_record_page(
+    vmi_instance_t vmi,
+    void *page)
+{
+    trace_recorder_t *rec = trace_get_recorder(vmi);
+    gchar *checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5, page, vmi->page_size);
+    gpointer id = g_hash_table_lookup(rec->page_ids, checksum);
+    trace_record_t record = { 0 };
+
+    if (id) {
+        g_free(checksum);
+        return GPOINTER_TO_UINT(id);
+    }
+
+    record.type = TRACE_REC_PAGE;
+    record.id = rec->next_page_id++;
+    record.value = vmi->page_size;
+    trace_record_write(rec, &record, page, vmi->page_size);
+
+    g_hash_table_insert(rec->page_ids, checksum, GUINT_TO_POINTER(record.id));
+    return record.id;
+}
+
+//----------------------------------------------------------------------------
+// Recording wrappers of the driver interface
+
+static status_t
+trace_record_get_memsize(
+    vmi_instance_t vmi,
+    uint64_t *allocated_ram_size,
+    addr_t *maximum_physical_address)
+{
+    status_t ret = trace_get_recorder(vmi)->driver.get_memsize_ptr(
+                       vmi, allocated_ram_size, maximum_physical_address);
+
+    trace_record_call(vmi, TRACE_REC_MEMSIZE, ret, 0,
+                      VMI_SUCCESS == ret ? *allocated_ram_size : 0,
+                      VMI_SUCCESS == ret ? *maximum_physical_address : 0);
+    return ret;
+}
+
+static status_t
+trace_record_get_vcpureg(
+    vmi_instance_t vmi,
+    reg_t *value,
+    registers_t reg,
+    unsigned long vcpu)
+{
+    status_t ret = trace_get_recorder(vmi)->driver.get_vcpureg_ptr(vmi, value, reg, vcpu);
+
+    trace_record_call(vmi, TRACE_REC_VCPUREG, ret, vcpu, reg,
+                      VMI_SUCCESS == ret ? *value : 0);
+    return ret;
+}
+
+static status_t
+trace_record_get_address_width(
+    vmi_instance_t vmi,
+    uint8_t * width)
+{
+    status_t ret = trace_get_recorder(vmi)->driver.get_address_width_ptr(vmi, width);
+
+    trace_record_call(vmi, TRACE_REC_ADDRESS_WIDTH, ret, 0, 0,
+                      VMI_SUCCESS == ret ? *width : 0);
+    return ret;
+}
+
+static void *
+trace_record_read_page(
+    vmi_instance_t vmi,
+    addr_t page)
+{
+    trace_recorder_t *rec = trace_get_recorder(vmi);
+    void *data = rec->driver.read_page_ptr(vmi, page);
+    trace_record_t *last = &rec->last;
+
+    // page reads are not serialized by the driver wrappers
+    g_rec_mutex_lock(&vmi->driver_lock);
+
+    // a read returning what the read before it did is only counted, the
+    // contents are hashed once a record for them is written
+    if (last->type && last->arg == page
+        && (data ? VMI_SUCCESS == last->status
+                   && !memcmp(data, rec->last_page, vmi->page_size)
+                 : VMI_FAILURE == last->status)) {
+        last->value++;
+    } else {
+        trace_record_flush(rec);
+        last->type = TRACE_REC_READ_PAGE;
+        last->status = data ? VMI_SUCCESS : VMI_FAILURE;
+        last->id = data ? trace_record_page(vmi, data) : 0;
+        last->arg = page;
+        last->value = 1;
+        if (data) {
+            if (!rec->last_page) {
+                rec->last_page = g_malloc(vmi->page_size);
+            }
+            memcpy(rec->last_page, data, vmi->page_size);
+        }
+    }
+
+    g_rec_mutex_unlock(&vmi->driver_lock);
+    return data;
+}
+
+static int
+trace_record_is_pv(
+    vmi_instance_t vmi)
+{
+    int ret = trace_get_recorder(vmi)->driver.is_pv_ptr(vmi);
+
+    trace_record_call(vmi, TRACE_REC_IS_PV, VMI_SUCCESS, 0, 0, ret);
+    return ret;
+}
+
+static status_t
+trace_record_pause_vm(
+    vmi_instance_t vmi)
+{
+    status_t ret = trace_get_recorder(vmi)->driver.pause_vm_ptr(vmi);
+
+    trace_record_call(vmi, TRACE_REC_PAUSE, ret, 0, 0, 0);
+    return ret;
+}
+
+static status_t
+trace_record_resume_vm(
+    vmi_instance_t vmi)
+{
+    status_t ret = trace_get_recorder(vmi)->driver.resume_vm_ptr(vmi);
+
+    trace_record_call(vmi, TRACE_REC_RESUME, ret, 0, 0, 0);
+    return ret;
+}
+
+static void
+trace_record_destroy(
+    vmi_instance_t vmi)
+{
+    trace_recorder_t *rec = trace_get_recorder(vmi);
+    void (*destroy)(vmi_instance_t) = rec->driver.destroy_ptr;
+
+    dbprint(VMI_DEBUG_DRIVER, "--trace recorded %u distinct pages\n", rec->next_page_id - 1);
+
+    trace_record_flush(rec);
+    trace_close(rec->file);
+    g_hash_table_destroy(rec->page_ids);
+    g_free(rec->last_page);
+    vmi->driver.trace_data = NULL;
+    g_free(rec);
+
+    if (destroy) {
+        destroy(vmi);
+    }
+}
+
+//----------------------------------------------------------------------------
+// General Interface Functions
+
+status_t
+trace_record_init(
+    vmi_instance_t vmi,
+    vmi_config_t config)
+{
+    const char *path = NULL;
+    trace_recorder_t *rec = NULL;
+    trace_header_t header = { { 0 } };
+    char *name = vmi->image_type_complete ? vmi->image_type_complete : vmi->image_type;
+
+    if (config && VMI_CONFIG_GHASHTABLE == vmi->config_mode) {
+        path = g_hash_table_lookup((GHashTable *) config, "trace_record");
+    }
+    if (!path) {
+        path = getenv("LIBVMI_TRACE_RECORD");
+    }
+    if (!path || !*path) {
+        return VMI_SUCCESS;
+    }
+
+    // the trace being replayed could be the one to record to
+    if (VMI_TRACE == (vmi->flags & 0x0000FFFF)) {
+        dbprint(VMI_DEBUG_DRIVER, "--not recording a trace replay\n");
+        return VMI_SUCCESS;
+    }
+
+    rec = g_malloc0(sizeof(trace_recorder_t));
+    if (!(rec->file = trace_open(path, "wb"))) {
+        errprint("Failed to open trace '%s' for writing.\n", path);
+        g_free(rec);
+        return VMI_FAILURE;
+    }
+
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.mode = vmi->mode;
+    header.hvm = vmi->hvm;
+    header.num_vcpus = vmi->num_vcpus;
+    header.name_length = name ? strlen(name) : 0;
+
+    if (!trace_io(rec->file, &header, sizeof(header), true)
+        || (header.name_length && !trace_io(rec->file, name, header.name_length, true))) {
+        errprint("Failed to write trace header to '%s'.\n", path);
+        trace_close(rec->file);
+        g_free(rec);
+        return VMI_FAILURE;
+    }
+
+    rec->page_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    rec->next_page_id = 1;
+    rec->driver = vmi->driver;
+
+    if (vmi->driver.get_memsize_ptr)
+        vmi->driver.get_memsize_ptr = &trace_record_get_memsize;
+    if (vmi->driver.get_vcpureg_ptr)
+        vmi->driver.get_vcpureg_ptr = &trace_record_get_vcpureg;
+    if (vmi->driver.get_address_width_ptr)
+        vmi->driver.get_address_width_ptr = &trace_record_get_address_width;
+    if (vmi->driver.read_page_ptr)
+        vmi->driver.read_page_ptr = &trace_record_read_page;
+    if (vmi->driver.is_pv_ptr)
+        vmi->driver.is_pv_ptr = &trace_record_is_pv;
+    if (vmi->driver.pause_vm_ptr)
+        vmi->driver.pause_vm_ptr = &trace_record_pause_vm;
+    if (vmi->driver.resume_vm_ptr)
+        vmi->driver.resume_vm_ptr = &trace_record_resume_vm;
+    vmi->driver.destroy_ptr = &trace_record_destroy;
+    vmi->driver.trace_data = rec;
+
+    dbprint(VMI_DEBUG_DRIVER, "--recording trace to %s\n", path);
+    return VMI_SUCCESS;
+}
@@ -0,0 +1,508 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "private.h"
+#include "driver/driver_wrapper.h"
+#include "driver/v2m_table.h"
+
+/**
+ * Throw v2p consecutive mapping range to this m2p chunk creator.
+ * @param[out] m2p_chunk_list_ptr
+ * @param[out] m2p_chunk_head_ptr
+ * @param[in] start_vaddr
+ * @param[in] end_vaddr
+ * @param[in] start_paddr
+ * @param[in] end_paddr
+ */
+static void
+insert_v2p_page_pair_to_m2p_chunk_list(
+    m2p_mapping_clue_chunk_t *m2p_chunk_list_ptr,
+    m2p_mapping_clue_chunk_t *m2p_chunk_head_ptr,
+    addr_t start_vaddr,
+    addr_t end_vaddr,
+    addr_t start_paddr,
+    addr_t end_paddr)
+{
+    // the first chunk
+    if (NULL == *m2p_chunk_list_ptr) {
+        *m2p_chunk_list_ptr = g_malloc0(sizeof(m2p_mapping_clue_chunk));
+        (*m2p_chunk_list_ptr)->vaddr_begin = start_vaddr;
+        (*m2p_chunk_list_ptr)->vaddr_end = end_vaddr;
+        (*m2p_chunk_list_ptr)->paddr_begin = start_paddr;
+        (*m2p_chunk_list_ptr)->paddr_end = end_paddr;
+        (*m2p_chunk_head_ptr) = *m2p_chunk_list_ptr;
+    } else {
+        if (start_paddr == (*m2p_chunk_head_ptr)->paddr_end + 1) {
+            // merge continuous mapping
+            (*m2p_chunk_head_ptr)->vaddr_end = end_vaddr;
+            (*m2p_chunk_head_ptr)->paddr_end = end_paddr;
+        } else {
+            // new entry
+            m2p_mapping_clue_chunk_t new_page = g_malloc0(sizeof(m2p_mapping_clue_chunk));
+            new_page->vaddr_begin = start_vaddr;
+            new_page->vaddr_end = end_vaddr;
+            new_page->paddr_begin = start_paddr;
+            new_page->paddr_end = end_paddr;
+            (*m2p_chunk_head_ptr)->next = new_page;
+            (*m2p_chunk_head_ptr) = new_page;
+        }
+    }
+}
+
+/**
+ * Throw v2p consecutive mapping range to this v2m chunk creator.
+ * @param[out] v2m_chunk_list_ptr
+ * @param[out] v2m_chunk_head_ptr
+ * @param[out] m2p_chunk_list_ptr
+ * @param[out] m2p_chunk_head_ptr
+ * @param[in] start_vaddr
+ * @param[in] end_vaddr
+ * @param[in] start_paddr
+ * @param[in] end_paddr
+ */
+static void
+insert_v2p_page_pair_to_v2m_chunk_list(
+    v2m_chunk_t *v2m_chunk_list_ptr,
+    v2m_chunk_t *v2m_chunk_head_ptr,
+    m2p_mapping_clue_chunk_t *m2p_chunk_list_ptr,
+    m2p_mapping_clue_chunk_t *m2p_chunk_head_ptr,
+    addr_t start_vaddr,
+    addr_t end_vaddr,
+    addr_t start_paddr,
+    addr_t end_paddr)
+{
+    if (NULL != *v2m_chunk_list_ptr
+        && start_vaddr == (*v2m_chunk_head_ptr)->vaddr_end + 1) {
+        // continuous vaddr
+        //  1. insert m2p chunk.
+        insert_v2p_page_pair_to_m2p_chunk_list(m2p_chunk_list_ptr, m2p_chunk_head_ptr,
+            start_vaddr, end_vaddr, start_paddr, end_paddr);
+        //  2. expand v2m chunk
+        (*v2m_chunk_head_ptr)->vaddr_end = end_vaddr;
+        return;
+    }
+
+    // the first v2m chunk or incontinuous vaddr, so new v2m chunk
+    v2m_chunk_t new_page = g_malloc0(sizeof(v2m_chunk));
+    new_page->vaddr_begin = start_vaddr;
+    new_page->vaddr_end = end_vaddr;
+
+    if (NULL == *v2m_chunk_list_ptr) {
+        *v2m_chunk_list_ptr = new_page;
+    } else {
+        (*v2m_chunk_head_ptr)->next = new_page;
+    }
+    (*v2m_chunk_head_ptr) = new_page;
+
+    // the first m2p chunk of the new v2m chunk
+    *m2p_chunk_list_ptr = NULL;
+    *m2p_chunk_head_ptr = NULL;
+    insert_v2p_page_pair_to_m2p_chunk_list(m2p_chunk_list_ptr, m2p_chunk_head_ptr,
+        start_vaddr, end_vaddr, start_paddr, end_paddr);
+    new_page->m2p_chunks = *m2p_chunk_list_ptr;
+}
+
+/**
+ * Walk through the page table to gather v2m chunks.
+ * Pages that are not fully backed by the physical memory are skipped, as
+ *  touching their mapping would fault.
+ * @param[in] vmi LibVMI instance
+ * @param[in] p2o physical address to fd offset translation, or NULL
+ * @param[in] dtb
+ * @param[out] v2m_chunk_list_ptr
+ */
+static status_t
+walkthrough_pagetable(
+    vmi_instance_t vmi,
+    v2m_p2o_t p2o,
+    addr_t dtb,
+    v2m_chunk_t *v2m_chunk_list_ptr)
+{
+    v2m_chunk_t v2m_chunk_head = NULL;
+    m2p_mapping_clue_chunk_t m2p_chunk_list = NULL;
+    m2p_mapping_clue_chunk_t m2p_chunk_head = NULL;
+
+    GSList *pages = vmi_get_va_pages(vmi, dtb);
+    GSList *loop = pages;
+    while (loop) {
+        page_info_t *page = loop->data;
+        addr_t start_vaddr = page->vaddr;
+        addr_t start_paddr = page->paddr;
+        addr_t end_vaddr = start_vaddr | (page->size-1);
+        addr_t end_paddr = start_paddr | (page->size-1);
+        bool backed = false;
+
+        if (p2o) {
+            // the offset of the page contents in the backing fd, which
+            // mmap() can only use if it is host page aligned
+            if (VMI_SUCCESS == p2o(vmi, start_paddr, page->size, &start_paddr)
+                && !(start_paddr & (getpagesize() - 1))) {
+                end_paddr = start_paddr + page->size - 1;
+                backed = true;
+            }
+        }
+        else {
+            backed = (end_paddr < vmi->max_physical_address);
+        }
+
+        if (backed) {
+            insert_v2p_page_pair_to_v2m_chunk_list(v2m_chunk_list_ptr, &v2m_chunk_head,
+                &m2p_chunk_list, &m2p_chunk_head,
+                start_vaddr, end_vaddr, start_paddr, end_paddr);
+        }
+
+        g_free(page);
+        loop = loop->next;
+    }
+
+    if (pages) {
+        g_slist_free(pages);
+        return VMI_SUCCESS;
+    }
+
+    return VMI_FAILURE;
+}
+
+/**
+ * As we must ensure consecutive v2m mappings which are usually constituted by
+ *  many m2p chunks, we reserve a large enough medial address range (i.e.
+ *  LibVMI virtual address) to place those m2p mappings together. The
+ *  reservation stays in place until the m2p mappings replace it, so
+ *  nothing else can be mapped into the range meanwhile.
+ * @param[in] v2m_chunk
+ * @param[out] maddr_indicator_export
+ */
+static status_t
+reserve_v2m_medial_addr(
+    v2m_chunk_t v2m_chunk,
+    void **maddr_indicator_export)
+{
+    size_t size = v2m_chunk->vaddr_end - v2m_chunk->vaddr_begin + 1;
+
+    dbprint(VMI_DEBUG_DRIVER, "reserve medial space for va: %016"PRIx64" - %016"PRIx64", size: %zuKB\n",
+        v2m_chunk->vaddr_begin, v2m_chunk->vaddr_end, size >> 10);
+
+    void *map = mmap(NULL,  // addr
+        size,   // vaddr space
+        PROT_NONE,   // prot
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,  // flags
+        -1,    // file descriptor
+        0);  // offset
+    if (MAP_FAILED == map) {
+        errprint("Failed to find large enough medial address space,"
+            " size: %zu MB\n", size >> 20);
+        return VMI_FAILURE;
+    }
+
+    *maddr_indicator_export = map;
+    return VMI_SUCCESS;
+}
+
+/**
+ * mmap m2p indicated by a list of m2p mappping clue chunks and a medial address.
+ * @param[in] fd file descriptor of the physical memory backing
+ * @param[in] medial_addr_indicator the start address
+ * @param[in] m2p_chunk_list
+ */
+static status_t
+mmap_m2p_chunks(
+    int fd,
+    void *medial_addr_indicator,
+    m2p_mapping_clue_chunk_t m2p_chunk_list)
+{
+    size_t map_offset = 0;
+    while (NULL != m2p_chunk_list) {
+        size_t size = m2p_chunk_list->vaddr_end - m2p_chunk_list->vaddr_begin + 1;
+
+        dbprint(VMI_DEBUG_DRIVER, "map va: %016"PRIx64" - %016"PRIx64", pa: %016"PRIx64" - %016"PRIx64", size: %zuKB\n",
+            m2p_chunk_list->vaddr_begin, m2p_chunk_list->vaddr_end,
+            m2p_chunk_list->paddr_begin, m2p_chunk_list->paddr_end,
+            size >> 10);
+
+        void *map = mmap((uint8_t *) medial_addr_indicator + map_offset,  // addr
+            size,   // len
+            PROT_READ,   // prot
+            MAP_PRIVATE | MAP_NORESERVE | MAP_FIXED,  // flags
+            fd,    // file descriptor
+            m2p_chunk_list->paddr_begin);  // offset
+
+        if (MAP_FAILED == map) {
+            errprint("Failed to mmap PA 0x%"PRIx64" for dgvma\n",
+                m2p_chunk_list->paddr_begin);
+            return VMI_FAILURE;
+        }
+
+        map_offset += size;
+        m2p_chunk_list->medial_mapping_addr = map;
+        m2p_chunk_list = m2p_chunk_list->next;
+    }
+    return VMI_SUCCESS;
+}
+
+/**
+ * delete m2p chunks in a collection.
+ * @param[out] m2p_chunk_list_ptr
+ */
+static void
+delete_m2p_chunks(
+    m2p_mapping_clue_chunk_t *m2p_chunk_list_ptr)
+{
+    m2p_mapping_clue_chunk_t tmp = *m2p_chunk_list_ptr;
+    while (NULL != tmp) {
+        m2p_mapping_clue_chunk_t tmp2 = tmp->next;
+        g_free(tmp);
+        tmp = tmp2;
+    }
+    *m2p_chunk_list_ptr = NULL;
+}
+
+/**
+ * munmap many m2p mappings in a same v2m chunk list and free the list.
+ * @param[in] v2m_chunk_list
+ */
+static void
+munmap_v2m_chunks(
+    v2m_chunk_t v2m_chunk_list)
+{
+    while (NULL != v2m_chunk_list) {
+        v2m_chunk_t tmp = v2m_chunk_list->next;
+        if (v2m_chunk_list->medial_mapping_addr) {
+            munmap(v2m_chunk_list->medial_mapping_addr,
+                v2m_chunk_list->vaddr_end - v2m_chunk_list->vaddr_begin + 1);
+        }
+        delete_m2p_chunks(&v2m_chunk_list->m2p_chunks);
+        g_free(v2m_chunk_list);
+        v2m_chunk_list = tmp;
+    }
+}
+
+/**
+ * Setup a v2m table of a given pid and dtb.
+ * @param[in] vmi LibVMI instance
+ * @param[in] fd file descriptor of the physical memory backing
+ * @param[in] p2o physical address to fd offset translation, or NULL
+ * @param[in] pid
+ * @param[in] dtb correspond to the pid
+ * @param[out] v2m_table_pt the generated v2m table
+ */
+static status_t
+setup_v2m_table(
+    vmi_instance_t vmi,
+    int fd,
+    v2m_p2o_t p2o,
+    pid_t pid,
+    addr_t dtb,
+    v2m_table_t *v2m_table_pt)
+{
+    v2m_chunk_t v2m_chunk_list = NULL;
+
+    if (VMI_SUCCESS != walkthrough_pagetable(vmi, p2o, dtb, &v2m_chunk_list)) {
+        return VMI_FAILURE;
+    }
+
+    v2m_chunk_t v2m_chunk_tmp = v2m_chunk_list;
+    while (NULL != v2m_chunk_tmp) {
+        // reserve v2m medial address
+        void *maddr_indicator = NULL;
+        if (VMI_SUCCESS != reserve_v2m_medial_addr(v2m_chunk_tmp, &maddr_indicator)) {
+            goto error_exit;
+        }
+
+        // assign valid maddr, so the reservation is released on error
+        v2m_chunk_tmp->medial_mapping_addr = maddr_indicator;
+
+        // mmap each m2p memory chunk
+        if (VMI_SUCCESS != mmap_m2p_chunks(fd, maddr_indicator, v2m_chunk_tmp->m2p_chunks)) {
+            goto error_exit;
+        }
+
+        // m2p chunks are not needed anymore, munmap() is done by v2m chunk
+        delete_m2p_chunks(&v2m_chunk_tmp->m2p_chunks);
+
+        v2m_chunk_tmp = v2m_chunk_tmp->next;
+    }
+
+    v2m_table_t v2m_table_tmp = g_malloc0(sizeof(v2m_table));
+    v2m_table_tmp->pid = pid;
+    v2m_table_tmp->v2m_chunks = v2m_chunk_list;
+
+    *v2m_table_pt = v2m_table_tmp;
+    return VMI_SUCCESS;
+
+error_exit:
+    munmap_v2m_chunks(v2m_chunk_list);
+    return VMI_FAILURE;
+}
+
+status_t
+v2m_table_create(
+    vmi_instance_t vmi,
+    int fd,
+    v2m_p2o_t p2o,
+    v2m_table_t *tables,
+    pid_t pid,
+    v2m_table_t *v2m_table_pt)
+{
+    addr_t dtb = 0;
+
+    if (0 == pid) {
+        // kernel page table
+        reg_t cr3 = 0;
+
+        if (vmi->kpgd) {
+            cr3 = vmi->kpgd;
+        }
+        else {
+            driver_get_vcpureg(vmi, &cr3, CR3, 0);
+        }
+        if (!cr3) {
+            dbprint(VMI_DEBUG_DRIVER, "--early bail on v2m table create because cr3 is zero\n");
+            return VMI_FAILURE;
+        }
+        dtb = cr3;
+    }
+    else {
+        // user process page table
+        dtb = vmi_pid_to_dtb(vmi, pid);
+        if (!dtb) {
+            dbprint(VMI_DEBUG_DRIVER, "--early bail on v2m table create because dtb is zero\n");
+            return VMI_FAILURE;
+        }
+    }
+
+    if (VMI_SUCCESS != setup_v2m_table(vmi, fd, p2o, pid, dtb, v2m_table_pt)) {
+        return VMI_FAILURE;
+    }
+
+    // append to the v2m table link list
+    if (NULL == *tables) {
+        *tables = *v2m_table_pt;
+    }
+    else {
+        v2m_table_t head = *tables;
+        while (NULL != head->next) {
+            head = head->next;
+        }
+        head->next = *v2m_table_pt;
+    }
+    return VMI_SUCCESS;
+}
+
+v2m_table_t
+v2m_table_get(
+    v2m_table_t tables,
+    pid_t pid)
+{
+    while (NULL != tables) {
+        if (pid == tables->pid)
+            return tables;
+        tables = tables->next;
+    }
+    return NULL;
+}
+
+size_t
+v2m_table_lookup(
+    v2m_chunk_t v2m_chunk_list,
+    addr_t vaddr,
+    void **medial_vaddr_ptr)
+{
+    while (NULL != v2m_chunk_list) {
+        if (vaddr >= v2m_chunk_list->vaddr_begin && vaddr <= v2m_chunk_list->vaddr_end) {
+            *medial_vaddr_ptr = (uint8_t *) v2m_chunk_list->medial_mapping_addr
+                + (vaddr - v2m_chunk_list->vaddr_begin);
+            return v2m_chunk_list->vaddr_end - vaddr + 1;
+        }
+        v2m_chunk_list = v2m_chunk_list->next;
+    }
+    return 0;
+}
+
+status_t
+v2m_tables_destroy(
+    v2m_table_t *tables)
+{
+    v2m_table_t tail = *tables;
+    while (NULL != tail) {
+        v2m_table_t tmp = tail->next;
+        munmap_v2m_chunks(tail->v2m_chunks);
+        g_free(tail);
+        tail = tmp;
+    }
+    *tables = NULL;
+    return VMI_SUCCESS;
+}
+
+size_t
+v2m_get_dgvma(
+    vmi_instance_t vmi,
+    int fd,
+    v2m_p2o_t p2o,
+    v2m_table_t *tables,
+    addr_t vaddr,
+    pid_t pid,
+    void **medial_addr_ptr,
+    size_t count)
+{
+    addr_t maddr;
+    uint64_t length;
+    addr_t page_offset = vaddr & (vmi->page_size - 1);
+
+    *medial_addr_ptr = NULL;
+
+    // check if entry exists in the cache, the cached length counts from
+    // the start of the page
+    if (vmi->v2m_cache
+        && VMI_SUCCESS == v2m_cache_get(vmi, vaddr, pid, &maddr, &length)) {
+        *medial_addr_ptr = (void *) maddr;
+        length -= page_offset;
+        return length > count ? count : length;
+    }
+
+    // get v2m table of a pid
+    v2m_table_t v2m = v2m_table_get(*tables, pid);
+    // v2m table is not existed
+    if (NULL == v2m) {
+        // create v2m table
+        if (VMI_SUCCESS != v2m_table_create(vmi, fd, p2o, tables, pid, &v2m)) {
+            return 0; // cannot create new v2m mapping
+        }
+    }
+
+    // get medial addr
+    size_t v2m_size = v2m_table_lookup(v2m->v2m_chunks, vaddr, medial_addr_ptr);
+
+    // add this to the cache
+    if (vmi->v2m_cache && v2m_size) {
+        v2m_cache_set(vmi, vaddr, pid, (addr_t) *medial_addr_ptr,
+                      v2m_size + page_offset);
+    }
+
+    return v2m_size > count ? count : v2m_size;
+}
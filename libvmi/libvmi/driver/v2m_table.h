@@ -21,12 +21,15 @@
  * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef KVM_SHM_H
-#define KVM_SHM_H
+#ifndef V2M_TABLE_H
+#define V2M_TABLE_H
+
+#include "private.h"
 
 /** Guest virtual-medial-physical address mapping enables
- *   Direct Guest Virtual Memory Access (DGVMA) to the
- *   shm-snapshot.
+ *   Direct Guest Virtual Memory Access (DGVMA) to any
+ *   physical memory backing that can be mmap'ed from a file
+ *   descriptor at paddr offsets (shm-snapshot, memory dump file).
  *  While the m2p mapping will be established at process
  *   page table and so MMU will take care of it, we must
  *   maintain v2m mapping by ourself.
@@ -35,11 +38,23 @@
  *   v2m_chunk and m2p mapping clue chunk.
  */
 
+/* Translate a guest physical range to the offset of its contents in the
+ *  file descriptor of the memory backing. Fails if the range is not backed
+ *  contiguously. Drivers backed by a flat physical image pass NULL.
+ */
+typedef status_t (*v2m_p2o_t) (
+    vmi_instance_t vmi,
+    addr_t paddr,
+    addr_t length,
+    addr_t *offset);
+
 /* m2p mapping clue chunk is used to mmap guest physical
  *  address to medial address (i.e. LibVMI virtual address),
  *  and will be deleted just after mmap() because munmap()
  *  can be done with v2m chunk.
  * In a m2p chunk, the mappings between m and p are consecutive.
+ * paddr_begin/paddr_end are offsets into the backing file descriptor,
+ *  i.e. guest physical addresses translated by v2m_p2o_t if one is given.
  */
 typedef struct m2p_mapping_clue_chunk_struct {
     void * medial_mapping_addr;
@@ -72,4 +87,59 @@ typedef struct v2m_table_struct {
     struct v2m_table_struct* next;
 } v2m_table, *v2m_table_t;
 
-#endif /* KVM_SHM_H */
+/**
+ * Create the v2m table of a given pid, mmap'ing the guest physical pages
+ *  found in its page table from fd, and append it to the tables list.
+ * @param[in] vmi LibVMI instance
+ * @param[in] fd file descriptor of the physical memory backing
+ * @param[in] p2o physical address to fd offset translation, or NULL
+ * @param[in,out] tables the collection of v2m tables
+ * @param[in] pid Pid of the virtual address space (0 for kernel)
+ * @param[out] v2m_table_pt the generated v2m table
+ */
+status_t v2m_table_create(
+    vmi_instance_t vmi,
+    int fd,
+    v2m_p2o_t p2o,
+    v2m_table_t *tables,
+    pid_t pid,
+    v2m_table_t *v2m_table_pt);
+
+/**
+ * Search the collection of v2m tables by a pid.
+ */
+v2m_table_t v2m_table_get(
+    v2m_table_t tables,
+    pid_t pid);
+
+/**
+ * Search the medial address of a given virtual address.
+ * @return the count of contiguous bytes available at *medial_vaddr_ptr
+ */
+size_t v2m_table_lookup(
+    v2m_chunk_t v2m_chunk_list,
+    addr_t vaddr,
+    void **medial_vaddr_ptr);
+
+/**
+ * munmap all v2m mappings and delete all v2m tables of the collection.
+ */
+status_t v2m_tables_destroy(
+    v2m_table_t *tables);
+
+/**
+ * Common dgvma implementation for drivers: lookup the v2m cache, then the
+ *  v2m table of the pid (creating it on first use).
+ * @return the actual count that less or equal than count
+ */
+size_t v2m_get_dgvma(
+    vmi_instance_t vmi,
+    int fd,
+    v2m_p2o_t p2o,
+    v2m_table_t *tables,
+    addr_t vaddr,
+    pid_t pid,
+    void **medial_addr_ptr,
+    size_t count);
+
+#endif /* V2M_TABLE_H */
@@ -0,0 +1,300 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include "private.h"
+
+/*
+ * The OS init spends most of its time scanning memory for the kernel and
+ * parsing profiles, although the result only changes when the guest
+ * reboots. When a cache directory is given with the "init_cache" config key
+ * or the LIBVMI_INIT_CACHE environment variable, the result is kept there
+ * in a key file per target and reused by the next attach once the OS code
+ * has checked it still matches the memory.
+ *
+ * Drivers don't report a domain UUID, so targets are told apart by the
+ * identity of the image file or by mode and domain name. The OS checks
+ * catch a reboot into another kernel.
+ */
+
+#define INIT_CACHE_GROUP "init"
+
+/* the identity of a file, changes whenever the file is replaced or written */
+char *
+init_cache_file_identity(
+    const char *path)
+{
+    struct stat st;
+
+    if (!path || stat(path, &st)) {
+        return NULL;
+    }
+
+    return g_strdup_printf("%s:%llu:%llu:%lld:%lld", path,
+                           (unsigned long long) st.st_dev,
+                           (unsigned long long) st.st_ino,
+                           (long long) st.st_size,
+                           (long long) st.st_mtime);
+}
+
+static char *
+init_cache_identity(
+    vmi_instance_t vmi)
+{
+    if (VMI_FILE == vmi->mode) {
+        return init_cache_file_identity(vmi->image_type_complete);
+    }
+
+    if (!vmi->image_type) {
+        return NULL;
+    }
+
+    return g_strdup_printf("%d:%s", vmi->mode, vmi->image_type);
+}
+
+void
+init_cache_open(
+    vmi_instance_t vmi)
+{
+    const char *dir = NULL;
+    char *identity = NULL;
+    char *digest = NULL;
+
+    if (vmi->config) {
+        dir = g_hash_table_lookup(vmi->config, "init_cache");
+    }
+    if (!dir) {
+        dir = getenv("LIBVMI_INIT_CACHE");
+    }
+    if (!dir || !*dir) {
+        return;
+    }
+
+    identity = init_cache_identity(vmi);
+    if (!identity) {
+        dbprint(VMI_DEBUG_CORE, "--no identity for the init cache\n");
+        return;
+    }
+
+    digest = g_compute_checksum_for_string(G_CHECKSUM_SHA1, identity, -1);
+    g_free(vmi->init_cache);
+    vmi->init_cache = g_build_filename(dir, digest, NULL);
+    g_free(vmi->init_cache_identity);
+    vmi->init_cache_identity = identity;
+    g_free(digest);
+
+    dbprint(VMI_DEBUG_CORE, "--init cache %s for %s\n", vmi->init_cache, identity);
+}
+
+GKeyFile *
+init_cache_load(
+    vmi_instance_t vmi)
+{
+    GKeyFile *cache = NULL;
+    char *identity = NULL;
+    uint64_t ostype = 0;
+
+    if (!vmi->init_cache) {
+        return NULL;
+    }
+
+    cache = g_key_file_new();
+    if (!g_key_file_load_from_file(cache, vmi->init_cache, G_KEY_FILE_NONE, NULL)) {
+        goto miss;
+    }
+
+    /* a digest collision or an entry of another OS */
+    identity = g_key_file_get_string(cache, INIT_CACHE_GROUP, "identity", NULL);
+    if (!identity || strcmp(identity, vmi->init_cache_identity)) {
+        goto miss;
+    }
+    if (!init_cache_get(cache, "ostype", &ostype) || ostype != vmi->os_type) {
+        goto miss;
+    }
+
+    g_free(identity);
+    return cache;
+
+miss:
+    dbprint(VMI_DEBUG_CORE, "--init cache miss\n");
+    g_free(identity);
+    g_key_file_free(cache);
+    return NULL;
+}
+
+gboolean
+init_cache_get(
+    GKeyFile *cache,
+    const char *key,
+    uint64_t *value)
+{
+    GError *error = NULL;
+    uint64_t v = g_key_file_get_uint64(cache, INIT_CACHE_GROUP, key, &error);
+
+    if (error) {
+        g_error_free(error);
+        return FALSE;
+    }
+
+    *value = v;
+    return TRUE;
+}
+
+void
+init_cache_set(
+    GKeyFile *cache,
+    const char *key,
+    uint64_t value)
+{
+    g_key_file_set_uint64(cache, INIT_CACHE_GROUP, key, value);
+}
+
+char *
+init_cache_get_string(
+    GKeyFile *cache,
+    const char *key)
+{
+    return g_key_file_get_string(cache, INIT_CACHE_GROUP, key, NULL);
+}
+
+void
+init_cache_set_string(
+    GKeyFile *cache,
+    const char *key,
+    const char *value)
+{
+    g_key_file_set_string(cache, INIT_CACHE_GROUP, key, value ? value : "");
+}
+
+/* the digest of a physical page, used to recognize the kernel image */
+char *
+init_cache_page_digest(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    unsigned char page[VMI_PS_4KB];
+
+    if (vmi_read_pa(vmi, paddr, page, VMI_PS_4KB) != VMI_PS_4KB) {
+        return NULL;
+    }
+
+    return g_compute_checksum_for_data(G_CHECKSUM_SHA1, page, VMI_PS_4KB);
+}
+
+status_t
+init_cache_restore(
+    vmi_instance_t vmi,
+    GKeyFile *cache,
+    init_cache_check_t check)
+{
+    page_mode_t page_mode = vmi->page_mode;
+    int had_arch = (vmi->arch_interface != NULL);
+    uint64_t cached_mode = 0, kpgd = 0, init_task = 0;
+
+    if (!init_cache_get(cache, "page_mode", &cached_mode)
+        || !init_cache_get(cache, "kpgd", &kpgd)
+        || !init_cache_get(cache, "init_task", &init_task)) {
+        return VMI_FAILURE;
+    }
+
+    /* a live guest that switched modes runs another kernel */
+    if (VMI_PM_UNKNOWN != page_mode && cached_mode != page_mode) {
+        return VMI_FAILURE;
+    }
+
+    vmi->page_mode = cached_mode;
+    if (!had_arch || VMI_PM_UNKNOWN == page_mode) {
+        if (VMI_FAILURE == arch_init(vmi)) {
+            goto discard;
+        }
+    }
+    vmi->kpgd = kpgd;
+    vmi->init_task = init_task;
+
+    if (VMI_FAILURE == check(vmi, cache)) {
+        goto discard;
+    }
+
+    dbprint(VMI_DEBUG_CORE, "--restored init state from %s\n", vmi->init_cache);
+    return VMI_SUCCESS;
+
+discard:
+    dbprint(VMI_DEBUG_CORE, "--init cache is stale\n");
+    vmi->page_mode = page_mode;
+    vmi->kpgd = 0;
+    vmi->init_task = 0;
+    if (!had_arch && vmi->arch_interface) {
+        free(vmi->arch_interface);
+        vmi->arch_interface = NULL;
+    }
+    v2p_cache_flush(vmi);
+    return VMI_FAILURE;
+}
+
+GKeyFile *
+init_cache_new(
+    vmi_instance_t vmi)
+{
+    GKeyFile *cache = NULL;
+
+    if (!vmi->init_cache) {
+        return NULL;
+    }
+
+    cache = g_key_file_new();
+    init_cache_set_string(cache, "identity", vmi->init_cache_identity);
+    init_cache_set(cache, "ostype", vmi->os_type);
+    init_cache_set(cache, "page_mode", vmi->page_mode);
+    init_cache_set(cache, "kpgd", vmi->kpgd);
+    init_cache_set(cache, "init_task", vmi->init_task);
+    return cache;
+}
+
+void
+init_cache_save(
+    vmi_instance_t vmi,
+    GKeyFile *cache)
+{
+    char *dir = NULL;
+    char *data = NULL;
+    gsize length = 0;
+    GError *error = NULL;
+
+    dir = g_path_get_dirname(vmi->init_cache);
+    if (g_mkdir_with_parents(dir, 0700)) {
+        warnprint("Failed to create init cache directory %s\n", dir);
+        goto done;
+    }
+
+    data = g_key_file_to_data(cache, &length, NULL);
+    if (!g_file_set_contents(vmi->init_cache, data, length, &error)) {
+        warnprint("Failed to write init cache %s: %s\n", vmi->init_cache, error->message);
+        g_error_free(error);
+        goto done;
+    }
+
+    dbprint(VMI_DEBUG_CORE, "--saved init state to %s\n", vmi->init_cache);
+
+done:
+    g_free(data);
+    g_free(dir);
+}
@@ -59,6 +59,10 @@ typedef uint32_t vmi_mode_t;
 
 #define VMI_FILE (1 << 3)  /**< libvmi is viewing a file on disk */
 
+#define VMI_TRACE (1 << 4) /**< libvmi is replaying a recorded trace */
+
+#define VMI_MEMORY (1 << 5) /**< libvmi is viewing memory in caller-provided buffers */
+
 #define VMI_INIT_PARTIAL  (1 << 16) /**< init enough to view physical addresses */
 
 #define VMI_INIT_COMPLETE (1 << 17) /**< full initialization */
@@ -67,6 +71,8 @@ typedef uint32_t vmi_mode_t;
 
 #define VMI_INIT_SHM_SNAPSHOT (1 << 19) /**< setup shm-snapshot in vmi_init() if the feature is activated */
 
+#define VMI_INIT_LAZY (1 << 20) /**< with VMI_INIT_COMPLETE, defer the OS init to the first use */
+
 #define VMI_CONFIG_NONE (1 << 24) /**< no config provided */
 
 #define VMI_CONFIG_GLOBAL_FILE_ENTRY (1 << 25) /**< config in file provided */
@@ -309,6 +315,33 @@ typedef uint64_t addr_t;
  */
 typedef int32_t vmi_pid_t;
 
+/**
+ * A range of guest physical memory
+ */
+typedef struct vmi_pa_range {
+    addr_t paddr;       /**< first physical address */
+    addr_t length;      /**< size in bytes */
+} vmi_pa_range_t;
+
+/**
+ * A range of guest physical memory held in a buffer of the caller, see
+ * VMI_MEMORY. The buffer is used in place and must outlive the instance.
+ */
+typedef struct vmi_memory_range {
+    addr_t paddr;       /**< first physical address, page aligned */
+    size_t length;      /**< size in bytes, a multiple of the page size */
+    void *buffer;       /**< contents of the range */
+} vmi_memory_range_t;
+
+/**
+ * Initial value of a vCPU register of a VMI_MEMORY instance
+ */
+typedef struct vmi_memory_register {
+    unsigned long vcpu;
+    registers_t reg;
+    reg_t value;
+} vmi_memory_register_t;
+
 /**
  * Struct for holding page lookup information
  */
@@ -379,6 +412,32 @@ typedef struct {
     vmi_pid_t pid;  /**< specify iff using VMI_TM_PROCESS_PID */
 } access_context_t;
 
+/**
+ * Operations LibVMI keeps latency statistics for, see vmi_get_stats.
+ */
+typedef enum vmi_stat {
+    VMI_STAT_READ,          /**< vmi_read and the functions built on it, not the reads LibVMI makes for itself */
+    VMI_STAT_TRANSLATE,     /**< page table walks, v2p cache hits excluded */
+    VMI_STAT_READ_PAGE,     /**< pages fetched from the driver, page cache hits excluded */
+    VMI_STAT_SYMBOL,        /**< kernel symbol lookups, sym cache hits excluded */
+    VMI_STAT_INIT_DRIVER,   /**< driver part of vmi_init */
+    VMI_STAT_INIT_OS,       /**< OS part of vmi_init */
+    VMI_STAT_MAX
+} vmi_stat_t;
+
+#define VMI_STAT_BUCKETS 64
+
+/**
+ * Latency histogram of an operation. Bucket i counts the calls that took
+ * from 2^i up to 2^(i+1) nanoseconds.
+ */
+typedef struct vmi_stat_histogram {
+    uint64_t count;     /**< number of calls */
+    uint64_t total_ns;  /**< time spent in all calls */
+    uint64_t max_ns;    /**< the slowest call */
+    uint64_t buckets[VMI_STAT_BUCKETS]; /**< log2 buckets of the latencies */
+} vmi_stat_histogram_t;
+
 /**
  * Macro to test bitfield values (up to 64-bits)
  */
@@ -428,9 +487,28 @@ typedef struct vmi_instance *vmi_instance_t;
  * You should call this function only once per VM or file, and then use the
  * resulting instance when calling any of the other library functions.
  *
+ * If the LIBVMI_TRACE_RECORD environment variable (or the "trace_record"
+ * key of a GHashTable config) names a file, the responses of the driver
+ * are recorded to it. Passing VMI_TRACE and the name of that file replays
+ * the recorded responses without the VM.
+ *
+ * If the LIBVMI_INIT_CACHE environment variable (or the "init_cache" key of
+ * a GHashTable config) names a directory, the kernel addresses and offsets
+ * found by VMI_INIT_COMPLETE are saved there, per file or domain name, and
+ * the next init of the same target reuses them after a quick check against
+ * the memory instead of searching again.
+ *
+ * With VMI_INIT_LAZY, VMI_INIT_COMPLETE returns once physical memory can
+ * be read and the OS init runs on the first call needing the kernel page
+ * directory, the page mode, a symbol or the process list. A failure of the
+ * OS init then leaves only physical memory available, vmi_init_prefetch
+ * reports it.
+ *
+ * VMI_MEMORY needs the memory buffers of vmi_init_custom, see there.
+ *
  * @param[out] vmi Struct that holds instance information
- * @param[in] flags VMI_AUTO, VMI_XEN, VMI_KVM, or VMI_FILE plus
- *  VMI_INIT_PARTIAL or VMI_INIT_COMPLETE
+ * @param[in] flags VMI_AUTO, VMI_XEN, VMI_KVM, VMI_FILE or VMI_TRACE plus
+ *  VMI_INIT_PARTIAL or VMI_INIT_COMPLETE, optionally VMI_INIT_LAZY
  * @param[in] name Unique name specifying the VM or file to view
  * @return VMI_SUCCESS or VMI_FAILURE
  */
@@ -447,8 +525,24 @@ status_t vmi_init(
  * You should call this function only once per VM or file, and then use the
  * resulting instance when calling any of the other library functions.
  *
+ * VMI_MEMORY views memory the caller already holds, given in a GHashTable
+ * config by either
+ *  - "memory" (void *) and "memory_size" (uint64_t *): a single range
+ *    starting at physical address 0, or
+ *  - "memory_ranges" (vmi_memory_range_t *) and "memory_range_count"
+ *    (uint64_t *).
+ * The optional "vcpu_registers" (vmi_memory_register_t *) and
+ * "vcpu_register_count" (uint64_t *) set the initial vCPU registers,
+ * "address_width" (uint64_t *) the guest address width in bytes. The
+ * "name" key only labels the instance. Reads don't copy the buffers and
+ * writes go straight to them.
+ *
+ * A GHashTable config is not copied. With VMI_INIT_LAZY the OS init reads
+ * it on first use, so it must stay valid until then, or until
+ * vmi_init_prefetch returns.
+ *
  * @param[out] vmi Struct that holds instance information
- * @param[in] flags VMI_AUTO, VMI_XEN, VMI_KVM, or VMI_FILE plus
+ * @param[in] flags VMI_AUTO, VMI_XEN, VMI_KVM, VMI_FILE, or VMI_MEMORY plus
  *  VMI_INIT_PARTIAL or VMI_INIT_COMPLETE plus
  *  VMI_CONFIG_FILE/STRING/GHASHTABLE
  * @param[in] config Pointer to the specified configuration structure
@@ -499,6 +593,18 @@ status_t vmi_init_complete_custom(
     uint32_t flags,
     vmi_config_t config);
 
+/**
+ * Runs the OS init deferred by VMI_INIT_LAZY right away, for callers that
+ * want everything resolved up front or want to know whether the OS was
+ * found. Safe to call from several threads and more than once, the OS init
+ * runs only once.
+ *
+ * @param[in] vmi LibVMI instance initialized with VMI_INIT_COMPLETE
+ * @return VMI_SUCCESS if the OS layer is available, VMI_FAILURE otherwise
+ */
+status_t vmi_init_prefetch(
+    vmi_instance_t vmi);
+
 /**
  * Initialize or reinitialize the paging specific functionality of LibVMI.
  * This function is most useful when dynamically monitoring the booting of
@@ -513,6 +619,28 @@ page_mode_t vmi_init_paging(
     vmi_instance_t vmi,
     uint8_t force_reinit);
 
+/**
+ * Creates a new instance of the same domain or image as an existing one,
+ * without repeating the configuration parsing and OS discovery of vmi_init.
+ * The clone shares the OS specific state (profile, offsets, symbol lookup
+ * data) of the parent as it was at the time of the call, and takes over
+ * its page mode, kpgd and memory layout. It opens its own driver handle
+ * and starts with empty caches, so it can be handed to another thread.
+ *
+ * Clones don't receive events, don't use shm-snapshots and don't record
+ * traces. Parent and clones can be destroyed in any order. Several threads
+ * may clone the same instance at once, as long as it isn't destroyed
+ * meanwhile. The config given to vmi_init_custom isn't read again, it may
+ * be freed before the instance is cloned.
+ *
+ * @param[in] vmi LibVMI instance to clone
+ * @param[out] clone The new instance
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_clone(
+    vmi_instance_t vmi,
+    vmi_instance_t *clone);
+
 /**
  * Destroys an instance by freeing memory and closing any open handles.
  *
@@ -657,6 +785,27 @@ status_t vmi_pagetable_lookup_extended(
     addr_t vaddr,
     page_info_t *info);
 
+/**
+ * Translates many virtual addresses of an address space at once, e.g.
+ * every pointer found by a scan or every page of a module. The addresses
+ * are walked in sorted order, reading each page table entry once for all
+ * the addresses it maps, so a dense set costs about one PTE read per
+ * distinct page. The v2p cache is neither used nor filled.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] dtb address of the relevant page directory base
+ * @param[in] vaddrs virtual addresses to translate, in any order
+ * @param[out] paddrs physical address of each virtual address, zero if unmapped
+ * @param[in] n number of addresses
+ * @return The number of addresses translated
+ */
+size_t vmi_translate_batch(
+    vmi_instance_t vmi,
+    addr_t dtb,
+    const addr_t *vaddrs,
+    addr_t *paddrs,
+    size_t n);
+
 /*---------------------------------------------------------
  * Memory access functions
  */
@@ -806,6 +955,529 @@ size_t vmi_read_pa(
     void *buf,
     size_t count);
 
+/**
+ * A finished asynchronous read, see vmi_read_async.
+ */
+typedef struct vmi_read_completion {
+    access_context_t ctx;   /**< access context of the request */
+    void *buf;              /**< buffer the data was read into */
+    size_t count;           /**< number of bytes requested */
+    size_t bytes_read;      /**< number of bytes read */
+    void *data;             /**< user data of the request */
+} vmi_read_completion_t;
+
+/**
+ * Callback of an asynchronous read, called from a worker thread.
+ */
+typedef void (*vmi_read_callback_t) (
+    vmi_instance_t vmi,
+    const vmi_read_completion_t *completion);
+
+/**
+ * Starts reading \a count bytes from memory into \a buf and returns right
+ * away. The reads are run by a pool of worker threads, so many page
+ * fetches can be in flight for drivers with a high latency. The workers
+ * read through \a vmi and share its caches, so concurrent misses on a page
+ * are fetched once and a vmi_v2pcache_flush applies to the reads queued
+ * after it. Physical reads are handed to the driver as a prefetch hint when
+ * queued. The fetches themselves take turns on the driver, so only drivers
+ * with a real prefetch (the file driver) overlap them; to read through
+ * several driver handles, queue the reads on clones of \a vmi (see
+ * vmi_clone).
+ *
+ * When \a callback is given it is called from a worker once the read is
+ * done. Otherwise the completion is queued, to be picked up with
+ * vmi_read_async_reap, and the descriptor of vmi_read_async_fd becomes
+ * readable. \a buf must stay valid until the read completed; \a ctx is
+ * copied. Reads still in flight are waited for by vmi_destroy.
+ *
+ * The size of the pool is set with the "async_workers" key (uint64_t) of
+ * a GHashTable config, 8 by default.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] ctx Access context
+ * @param[out] buf The data read from memory
+ * @param[in] count The number of bytes to read
+ * @param[in] callback Called when done, or NULL to queue the completion
+ * @param[in] data User data passed back in the completion
+ * @return VMI_SUCCESS if the read was queued, VMI_FAILURE otherwise
+ */
+status_t vmi_read_async(
+    vmi_instance_t vmi,
+    access_context_t *ctx,
+    void *buf,
+    size_t count,
+    vmi_read_callback_t callback,
+    void *data);
+
+/**
+ * Gets a descriptor that is readable while queued completions of
+ * vmi_read_async are waiting to be reaped, for use with poll or select.
+ *
+ * @param[in] vmi LibVMI instance
+ * @return The descriptor or -1 on error
+ */
+int vmi_read_async_fd(
+    vmi_instance_t vmi);
+
+/**
+ * Picks up to \a max queued completions of vmi_read_async. With \a wait
+ * set this blocks until at least one is available, or until no read is
+ * left in flight, which makes it usable to wait for reads with callbacks.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[out] completions Array receiving the completions
+ * @param[in] max Size of the array
+ * @param[in] wait Nonzero to block
+ * @return The number of completions stored
+ */
+size_t vmi_read_async_reap(
+    vmi_instance_t vmi,
+    vmi_read_completion_t *completions,
+    size_t max,
+    uint8_t wait);
+
+/**
+ * Hints that \a count bytes of memory located at the physical address
+ * \a paddr will be read soon. Drivers that support it start fetching the
+ * pages in the background so that the reads later hit the page cache.
+ * This never blocks on the reads themselves.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] paddr Physical address to prefetch from
+ * @param[in] count The number of bytes to prefetch
+ * @return VMI_SUCCESS or VMI_FAILURE if the driver can't prefetch
+ */
+status_t vmi_prefetch_pa(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    size_t count);
+
+/**
+ * An access context with its translation resolved, see vmi_ctx_compile.
+ */
+typedef struct vmi_compiled_ctx *vmi_compiled_ctx_t;
+
+/**
+ * Resolves an access context once for reads in a loop: the kernel symbol
+ * or the pid is looked up, the address width taken from the page mode and
+ * the translation of the last page read is kept in the handle. Reads
+ * through the handle skip the symbol and pid lookups and, while they stay
+ * on the same page, the page table walk.
+ *
+ * The handle doesn't notice a process exiting or memory being remapped,
+ * compile again then. vmi_v2pcache_flush drops the kept translations.
+ * Several threads may read through one handle, the kept translation is
+ * then shared under a lock.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] ctx Access context to compile
+ * @return The handle, to be freed with vmi_ctx_free, or NULL on error
+ */
+vmi_compiled_ctx_t vmi_ctx_compile(
+    vmi_instance_t vmi,
+    const access_context_t *ctx);
+
+/**
+ * Reads \a count bytes at \a offset from the address of a compiled
+ * access context and stores the output in \a buf.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] cctx Compiled access context
+ * @param[in] offset Offset from the address of the context
+ * @param[out] buf The data read from memory
+ * @param[in] count The number of bytes to read
+ * @return The number of bytes read.
+ */
+size_t vmi_read_compiled(
+    vmi_instance_t vmi,
+    vmi_compiled_ctx_t cctx,
+    addr_t offset,
+    void *buf,
+    size_t count);
+
+/**
+ * Reads an address, of the width given by the page mode when compiling,
+ * at \a offset from the address of a compiled access context.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] cctx Compiled access context
+ * @param[in] offset Offset from the address of the context
+ * @param[out] value The value read from memory
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_read_addr_compiled(
+    vmi_instance_t vmi,
+    vmi_compiled_ctx_t cctx,
+    addr_t offset,
+    addr_t *value);
+
+/**
+ * Frees a compiled access context.
+ *
+ * @param[in] cctx Compiled access context, may be NULL
+ */
+void vmi_ctx_free(
+    vmi_compiled_ctx_t cctx);
+
+/**
+ * A field captured from every node by vmi_walk_list.
+ */
+typedef struct vmi_list_field {
+    addr_t offset;  /**< offset from the start of the node */
+    size_t length;  /**< number of bytes to capture */
+} vmi_list_field_t;
+
+#define VMI_WALK_INCLUDE_HEAD (1 << 0) /**< the head is the link of a node as well */
+
+/**
+ * The nodes captured by vmi_walk_list. A record holds the address of the
+ * node followed by the bytes of the fields in the order they were given,
+ * without padding, so the record of node i starts at
+ * records + i * record_size.
+ */
+typedef struct vmi_list_walk {
+    size_t count;           /**< number of records */
+    size_t record_size;     /**< size of a record in bytes */
+    unsigned char *records; /**< the records */
+} vmi_list_walk_t;
+
+/**
+ * Walks a circular doubly linked list (Linux list_head, Windows
+ * LIST_ENTRY) and captures some fields of every node, replacing the
+ * pointer chasing and field reads of a hand written loop. The pages of a
+ * node are prefetched as soon as its address is known.
+ *
+ * The walk starts after \a head and ends when it comes back to it. With
+ * VMI_WALK_INCLUDE_HEAD the node containing \a head is captured first.
+ * It stops with VMI_FAILURE on a pointer that can't be read, on a node
+ * whose back link doesn't point at the node it was entered from (a
+ * corrupted list or a cycle not through the head) or after \a max_nodes
+ * nodes. The nodes captured until then are kept in \a result.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] head Virtual address of the list head
+ * @param[in] pid Process whose address space holds the list, 0 for the kernel
+ * @param[in] link_offset Offset of the link within the node
+ * @param[in] fields Fields to capture from every node
+ * @param[in] nfields Number of fields
+ * @param[in] max_nodes Most nodes to capture, 0 for 1048576
+ * @param[in] flags 0 or VMI_WALK_INCLUDE_HEAD
+ * @param[out] result The captured nodes, free with vmi_walk_list_free
+ * @return VMI_SUCCESS if the walk came back to the head, VMI_FAILURE otherwise
+ */
+status_t vmi_walk_list(
+    vmi_instance_t vmi,
+    addr_t head,
+    vmi_pid_t pid,
+    addr_t link_offset,
+    const vmi_list_field_t *fields,
+    size_t nfields,
+    size_t max_nodes,
+    uint32_t flags,
+    vmi_list_walk_t *result);
+
+/**
+ * Walks a list like vmi_walk_list, but stops at the first node whose first
+ * field equals \a key, e.g. the task of a pid. Only the record of that
+ * node is kept, so \a result holds one record on success and none
+ * otherwise. The nodes before the match are not copied. Like vmi_walk_list
+ * with a \a max_nodes of 0, it gives up after 1048576 nodes.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] head Virtual address of the list head
+ * @param[in] pid Process whose address space holds the list, 0 for the kernel
+ * @param[in] link_offset Offset of the link within the node
+ * @param[in] fields Fields to capture, the first one is compared to \a key
+ * @param[in] nfields Number of fields, at least 1
+ * @param[in] flags 0 or VMI_WALK_INCLUDE_HEAD
+ * @param[in] key fields[0].length bytes to look for
+ * @param[out] result The matching node, free with vmi_walk_list_free
+ * @return VMI_SUCCESS if a node matched, VMI_FAILURE otherwise
+ */
+status_t vmi_walk_list_find(
+    vmi_instance_t vmi,
+    addr_t head,
+    vmi_pid_t pid,
+    addr_t link_offset,
+    const vmi_list_field_t *fields,
+    size_t nfields,
+    uint32_t flags,
+    const void *key,
+    vmi_list_walk_t *result);
+
+/**
+ * Frees the records of a list walk.
+ *
+ * @param[in] result Result of vmi_walk_list
+ */
+void vmi_walk_list_free(
+    vmi_list_walk_t *result);
+
+/**
+ * A member of a struct read by vmi_struct_read.
+ */
+typedef struct vmi_struct_member {
+    const char *name;   /**< member name, or offset name of the config */
+    size_t length;      /**< size of the member in bytes */
+} vmi_struct_member_t;
+
+/**
+ * A struct layout with the copy of the last struct read, see vmi_struct_new.
+ */
+typedef struct vmi_struct *vmi_struct_t;
+
+/**
+ * Resolves the offsets of some members of a kernel struct, so that
+ * vmi_struct_read can copy them all with a single read. With a
+ * \a struct_name the offsets are looked up in the Rekall profile (e.g.
+ * "task_struct" with members "pid" and "comm"), without it the member
+ * names are offset names of the config (e.g. "linux_pid" and
+ * "linux_name"), as taken by vmi_get_offset.
+ *
+ * A handle must not be used by several threads at once.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] struct_name Struct name of the Rekall profile, or NULL
+ * @param[in] members Members to read, referred to by their index
+ * @param[in] nmembers Number of members
+ * @return The handle, to be freed with vmi_struct_free, or NULL if an
+ *  offset isn't known
+ */
+vmi_struct_t vmi_struct_new(
+    vmi_instance_t vmi,
+    const char *struct_name,
+    const vmi_struct_member_t *members,
+    size_t nmembers);
+
+/**
+ * Copies the members of the struct at the address of \a ctx, from the
+ * lowest to the end of the highest, replacing the copy of the previous
+ * read. The members that could be copied stay readable if the struct
+ * crosses into an unmapped page.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] s Struct handle
+ * @param[in] ctx Access context of the start of the struct
+ * @return VMI_SUCCESS if all members were copied, VMI_FAILURE otherwise
+ */
+status_t vmi_struct_read(
+    vmi_instance_t vmi,
+    vmi_struct_t s,
+    const access_context_t *ctx);
+
+/**
+ * Gets the offset of a member within the struct.
+ *
+ * @param[in] s Struct handle
+ * @param[in] member Index of the member
+ * @return The offset, 0 for an unknown member
+ */
+addr_t vmi_struct_offset(
+    vmi_struct_t s,
+    unsigned int member);
+
+/**
+ * Gets 8 bits of a member from the last struct read.
+ *
+ * @param[in] s Struct handle
+ * @param[in] member Index of the member
+ * @param[out] value The value of the member
+ * @return VMI_SUCCESS or VMI_FAILURE if the member is shorter or wasn't read
+ */
+status_t vmi_struct_get_8(
+    vmi_struct_t s,
+    unsigned int member,
+    uint8_t *value);
+
+/**
+ * Gets 16 bits of a member from the last struct read.
+ *
+ * @param[in] s Struct handle
+ * @param[in] member Index of the member
+ * @param[out] value The value of the member
+ * @return VMI_SUCCESS or VMI_FAILURE if the member is shorter or wasn't read
+ */
+status_t vmi_struct_get_16(
+    vmi_struct_t s,
+    unsigned int member,
+    uint16_t *value);
+
+/**
+ * Gets 32 bits of a member from the last struct read.
+ *
+ * @param[in] s Struct handle
+ * @param[in] member Index of the member
+ * @param[out] value The value of the member
+ * @return VMI_SUCCESS or VMI_FAILURE if the member is shorter or wasn't read
+ */
+status_t vmi_struct_get_32(
+    vmi_struct_t s,
+    unsigned int member,
+    uint32_t *value);
+
+/**
+ * Gets 64 bits of a member from the last struct read.
+ *
+ * @param[in] s Struct handle
+ * @param[in] member Index of the member
+ * @param[out] value The value of the member
+ * @return VMI_SUCCESS or VMI_FAILURE if the member is shorter or wasn't read
+ */
+status_t vmi_struct_get_64(
+    vmi_struct_t s,
+    unsigned int member,
+    uint64_t *value);
+
+/**
+ * Gets an address member from the last struct read, 32 bits wide if the
+ * member was declared with a length of 4, 64 bits wide otherwise.
+ *
+ * @param[in] s Struct handle
+ * @param[in] member Index of the member
+ * @param[out] value The value of the member
+ * @return VMI_SUCCESS or VMI_FAILURE if the member is shorter or wasn't read
+ */
+status_t vmi_struct_get_addr(
+    vmi_struct_t s,
+    unsigned int member,
+    addr_t *value);
+
+/**
+ * Gets a character array member from the last struct read, as a string
+ * that ends at the first null byte or at the end of the member.
+ *
+ * @param[in] s Struct handle
+ * @param[in] member Index of the member
+ * @return String to be freed by the caller, or NULL if the member wasn't read
+ */
+char *vmi_struct_get_str(
+    vmi_struct_t s,
+    unsigned int member);
+
+/**
+ * Frees a struct handle.
+ *
+ * @param[in] s Struct handle, may be NULL
+ */
+void vmi_struct_free(
+    vmi_struct_t s);
+
+/**
+ * A reverse map from physical pages to the virtual pages mapping them,
+ * see vmi_p2v_map_build.
+ */
+typedef struct vmi_p2v_map *vmi_p2v_map_t;
+
+/**
+ * A virtual address a physical address is mapped at.
+ */
+typedef struct vmi_p2v {
+    addr_t dtb;     /**< dtb of the address space */
+    addr_t vaddr;   /**< virtual address */
+} vmi_p2v_t;
+
+/**
+ * Walks the page tables of some address spaces once and indexes every
+ * mapped page by its physical frame, so that vmi_translate_p2v can
+ * attribute physical addresses (e.g. the hits of a physical memory scan)
+ * to the address spaces and virtual addresses that map them.
+ *
+ * The map doesn't follow the guest, refresh the address spaces that
+ * changed with vmi_p2v_map_refresh. A map must not be used while it is
+ * refreshed.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] dtbs Address spaces to index
+ * @param[in] ndtbs Number of address spaces, 0 for the kernel one only
+ * @return The map, to be freed with vmi_p2v_map_free, or NULL on error
+ */
+vmi_p2v_map_t vmi_p2v_map_build(
+    vmi_instance_t vmi,
+    const addr_t *dtbs,
+    size_t ndtbs);
+
+/**
+ * Walks the page tables of an address space again, replacing its pages
+ * in the map, or adds it to the map if it wasn't indexed yet.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] map Reverse map
+ * @param[in] dtb Address space to index
+ * @return VMI_SUCCESS or VMI_FAILURE if no page of the address space could be read
+ */
+status_t vmi_p2v_map_refresh(
+    vmi_instance_t vmi,
+    vmi_p2v_map_t map,
+    addr_t dtb);
+
+/**
+ * Removes an address space, e.g. of a process that exited, from the map.
+ *
+ * @param[in] map Reverse map
+ * @param[in] dtb Address space to remove
+ * @return VMI_SUCCESS or VMI_FAILURE if it wasn't indexed
+ */
+status_t vmi_p2v_map_remove(
+    vmi_p2v_map_t map,
+    addr_t dtb);
+
+/**
+ * Looks up the virtual addresses a physical address is mapped at, with
+ * one hash lookup per page size present in the map.
+ *
+ * @param[in] map Reverse map
+ * @param[in] paddr Physical address
+ * @param[out] mappings Receives up to \a max mappings
+ * @param[in] max Size of \a mappings
+ * @return The number of mappings, which may exceed \a max
+ */
+size_t vmi_translate_p2v(
+    vmi_p2v_map_t map,
+    addr_t paddr,
+    vmi_p2v_t *mappings,
+    size_t max);
+
+/**
+ * Frees a reverse map.
+ *
+ * @param[in] map Reverse map, may be NULL
+ */
+void vmi_p2v_map_free(
+    vmi_p2v_map_t map);
+
+/**
+ * A run of pages that are contiguous both in the virtual and in the
+ * physical address space, see vmi_get_va_runs.
+ */
+typedef struct vmi_va_run {
+    addr_t vaddr;   /**< first virtual address */
+    addr_t paddr;   /**< physical address of vaddr */
+    addr_t length;  /**< size in bytes */
+} vmi_va_run_t;
+
+/**
+ * Only the pages accessible from user mode, see vmi_get_va_runs.
+ */
+#define VMI_VA_RUNS_USER (1 << 0)
+
+/**
+ * Gets the pages mapped into an address space as runs sorted by virtual
+ * address, each of which can be read with a single vmi_read_pa. Neighbour
+ * pages mapped to neighbour frames are joined into one run.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] dtb The directory table base of the address space
+ * @param[in] flags VMI_VA_RUNS_USER to skip the supervisor pages (x86 only)
+ * @param[out] runs The runs, to be freed with free
+ * @return The number of runs
+ */
+size_t vmi_get_va_runs(
+    vmi_instance_t vmi,
+    addr_t dtb,
+    uint32_t flags,
+    vmi_va_run_t **runs);
+
 /**
  * Reads 8 bits from memory, given a kernel symbol.
  *
@@ -1435,6 +2107,65 @@ status_t vmi_write_addr_pa(
     addr_t paddr,
     addr_t * value);
 
+/*---------------------------------------------------------
+ * Latency statistics from performance.c
+ */
+
+/**
+ * Turns the collection of latency statistics on or off. Collection costs
+ * two clock reads per operation and is off by default, unless the
+ * LIBVMI_STATS environment variable is set (which also covers vmi_init).
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] enabled Nonzero to collect statistics
+ */
+void vmi_set_stats(
+    vmi_instance_t vmi,
+    uint8_t enabled);
+
+/**
+ * Copies the latency histogram of an operation. Safe to call while other
+ * threads use the instance.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] stat The operation
+ * @param[out] histogram The histogram
+ * @return VMI_SUCCESS or VMI_FAILURE for an unknown operation
+ */
+status_t vmi_get_stats(
+    vmi_instance_t vmi,
+    vmi_stat_t stat,
+    vmi_stat_histogram_t *histogram);
+
+/**
+ * Clears the latency statistics of all operations.
+ *
+ * @param[in] vmi LibVMI instance
+ */
+void vmi_reset_stats(
+    vmi_instance_t vmi);
+
+/**
+ * Estimates a percentile of a latency histogram, as the upper bound of the
+ * bucket holding it (at most twice the real value).
+ *
+ * @param[in] histogram The histogram
+ * @param[in] percentile Percentile to get, e.g. 99.9
+ * @return The latency in nanoseconds, 0 for an empty histogram
+ */
+uint64_t vmi_stat_percentile(
+    const vmi_stat_histogram_t *histogram,
+    double percentile);
+
+/**
+ * Gets a printable name of an operation.
+ *
+ * @param[in] stat The operation
+ * @return The name, or NULL for an unknown operation
+ */
+const char *vmi_stat_name(
+    vmi_stat_t stat);
+
 /*---------------------------------------------------------
  * Print util functions from pretty_print.c
  */
@@ -1520,7 +2251,8 @@ uint64_t vmi_get_vmid(
 /**
  * Gets the current access mode for LibVMI, which tells what
  * resource is being using to access the memory (e.g., VMI_XEN,
- * VMI_KVM, or VMI_FILE).
+ * VMI_KVM, or VMI_FILE). The replay of a trace reports the access mode
+ * of the recorded session.
  *
  * @param[in] vmi LibVMI instance
  * @return Access mode
@@ -1645,6 +2377,23 @@ uint64_t vmi_get_memsize(
 addr_t vmi_get_max_physical_address(
     vmi_instance_t vmi);
 
+/**
+ * Gets the ranges of guest physical memory that hold RAM, sorted by
+ * address. Scanning these instead of everything below
+ * vmi_get_max_physical_address skips the MMIO and firmware holes.
+ *
+ * File images report their segments and VMI_MEMORY instances their
+ * buffers. For live guests the layout isn't exposed by the drivers, so the
+ * map is a single range up to vmi_get_max_physical_address, holes included.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[out] ranges The ranges, owned by the instance
+ * @return Number of ranges
+ */
+size_t vmi_get_memory_map(
+    vmi_instance_t vmi,
+    const vmi_pa_range_t **ranges);
+
 /**
  * Gets the memory size of the guest that LibVMI is accessing.
  * This information is required for any interaction with of VCPU registers.
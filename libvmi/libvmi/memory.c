@@ -180,3 +180,58 @@ status_t find_page_mode_live(vmi_instance_t vmi) {
 
     return VMI_FAILURE;
 }
+
+/* whether [paddr, paddr + length) is RAM, as far as the memory map knows */
+gboolean
+memory_map_contains(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    size_t length)
+{
+    size_t lo = 0, hi = vmi->memory_map_count;
+
+    if (!vmi->memory_map) {
+        return paddr + length <= vmi->max_physical_address;
+    }
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const vmi_pa_range_t *range = &vmi->memory_map[mid];
+
+        if (paddr < range->paddr) {
+            hi = mid;
+        } else if (paddr >= range->paddr + range->length) {
+            lo = mid + 1;
+        } else {
+            return paddr + length <= range->paddr + range->length;
+        }
+    }
+
+    return FALSE;
+}
+
+/* the first address of RAM at or above paddr, max_physical_address if none */
+addr_t
+memory_map_next(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    size_t i;
+
+    if (!vmi->memory_map) {
+        return paddr;
+    }
+
+    for (i = 0; i < vmi->memory_map_count; i++) {
+        const vmi_pa_range_t *range = &vmi->memory_map[i];
+
+        if (paddr < range->paddr) {
+            return range->paddr;
+        }
+        if (paddr < range->paddr + range->length) {
+            return paddr;
+        }
+    }
+
+    return paddr > vmi->max_physical_address ? paddr : vmi->max_physical_address;
+}
@@ -220,10 +220,94 @@ static status_t init_from_rekall_profile(vmi_instance_t vmi) {
 done: return ret;
 }
 
+/* the profile the offsets and init_task came from */
+static char *linux_profile_identity(linux_instance_t linux_instance)
+{
+    if (linux_instance->rekall_profile)
+        return init_cache_file_identity(linux_instance->rekall_profile);
+
+    return init_cache_file_identity(linux_instance->sysmap);
+}
+
+/* Checks a cached init state: same profile, and init_task is still mapped
+ * where it was with pid 0. */
+static status_t linux_init_cache_check(vmi_instance_t vmi, GKeyFile *cache)
+{
+    status_t ret = VMI_FAILURE;
+    linux_instance_t linux_instance = vmi->os_data;
+    struct linux_instance cached = *linux_instance;
+    char *profile = linux_profile_identity(linux_instance);
+    char *cached_profile = init_cache_get_string(cache, "profile");
+    uint64_t init_task_pa = 0;
+    uint32_t pid = ~0;
+
+    if (!profile || !cached_profile || strcmp(profile, cached_profile))
+        goto done;
+
+    if (!init_cache_get(cache, "init_task_pa", &init_task_pa)
+        || !init_cache_get(cache, "linux_tasks", &cached.tasks_offset)
+        || !init_cache_get(cache, "linux_mm", &cached.mm_offset)
+        || !init_cache_get(cache, "linux_pid", &cached.pid_offset)
+        || !init_cache_get(cache, "linux_name", &cached.name_offset)
+        || !init_cache_get(cache, "linux_pgd", &cached.pgd_offset))
+        goto done;
+
+    if (init_task_pa != vmi_pagetable_lookup(vmi, vmi->kpgd, vmi->init_task)) {
+        dbprint(VMI_DEBUG_MISC, "--cached init_task is not mapped\n");
+        goto done;
+    }
+
+    if (cached.pid_offset
+        && (VMI_FAILURE == vmi_read_32_pa(vmi, init_task_pa + cached.pid_offset, &pid) || pid)) {
+        dbprint(VMI_DEBUG_MISC, "--cached init_task is not the swapper\n");
+        goto done;
+    }
+
+    *linux_instance = cached;
+    ret = VMI_SUCCESS;
+
+done:
+    g_free(profile);
+    g_free(cached_profile);
+    return ret;
+}
+
+static void linux_init_cache_save(vmi_instance_t vmi)
+{
+    linux_instance_t linux_instance = vmi->os_data;
+    GKeyFile *cache = NULL;
+    char *profile = NULL;
+    addr_t init_task_pa = 0;
+
+    if (!vmi->init_cache)
+        return;
+
+    profile = linux_profile_identity(linux_instance);
+    init_task_pa = vmi_pagetable_lookup(vmi, vmi->kpgd, vmi->init_task);
+    if (!profile || !init_task_pa)
+        goto done;
+
+    cache = init_cache_new(vmi);
+    init_cache_set_string(cache, "profile", profile);
+    init_cache_set(cache, "init_task_pa", init_task_pa);
+    init_cache_set(cache, "linux_tasks", linux_instance->tasks_offset);
+    init_cache_set(cache, "linux_mm", linux_instance->mm_offset);
+    init_cache_set(cache, "linux_pid", linux_instance->pid_offset);
+    init_cache_set(cache, "linux_name", linux_instance->name_offset);
+    init_cache_set(cache, "linux_pgd", linux_instance->pgd_offset);
+    init_cache_save(vmi, cache);
+    g_key_file_free(cache);
+
+done:
+    g_free(profile);
+}
+
 status_t linux_init(vmi_instance_t vmi) {
 
     status_t rc;
     os_interface_t os_interface = NULL;
+    GKeyFile *cache = NULL;
+    gboolean restored = FALSE;
 
     if (vmi->config == NULL) {
         errprint("No config table found\n");
@@ -241,17 +325,25 @@ status_t linux_init(vmi_instance_t vmi) {
 
     g_hash_table_foreach(vmi->config, (GHFunc)linux_read_config_ghashtable_entries, vmi);
 
-    if(linux_instance->rekall_profile)
-        rc = init_from_rekall_profile(vmi);
-    else
-        rc = linux_symbol_to_address(vmi, "init_task", NULL, &vmi->init_task);
-
-    if (VMI_FAILURE == rc) {
-        errprint("Could not get init_task from Rekall profile or System.map\n");
-        goto _exit;
+    cache = init_cache_load(vmi);
+    if (cache) {
+        restored = (VMI_SUCCESS == init_cache_restore(vmi, cache, linux_init_cache_check));
+        g_key_file_free(cache);
     }
 
-    vmi->init_task = canonical_addr(vmi->init_task);
+    if (!restored) {
+        if(linux_instance->rekall_profile)
+            rc = init_from_rekall_profile(vmi);
+        else
+            rc = linux_symbol_to_address(vmi, "init_task", NULL, &vmi->init_task);
+
+        if (VMI_FAILURE == rc) {
+            errprint("Could not get init_task from Rekall profile or System.map\n");
+            goto _exit;
+        }
+
+        vmi->init_task = canonical_addr(vmi->init_task);
+    }
 
 #if defined(ARM)
     rc = driver_get_vcpureg(vmi, &vmi->kpgd, TTBR1, 0);
@@ -264,12 +356,15 @@ status_t linux_init(vmi_instance_t vmi) {
      * As a fall-back, try to init using heuristics.
      * This path is taken in FILE mode as well.
      */
-    if (VMI_FAILURE == rc)
+    if (VMI_FAILURE == rc && !restored)
         if (VMI_FAILURE == linux_filemode_init(vmi))
             goto _exit;
 
     dbprint(VMI_DEBUG_MISC, "**set vmi->kpgd (0x%.16"PRIx64").\n", vmi->kpgd);
 
+    if (!restored)
+        linux_init_cache_save(vmi);
+
 done:
     os_interface = safe_malloc(sizeof(struct os_interface));
     bzero(os_interface, sizeof(struct os_interface));
@@ -348,6 +443,10 @@ void linux_read_config_ghashtable_entries(char* key, gpointer value,
         goto _done;
     }
 
+    if (strncmp(key, "init_cache", CONFIG_STR_LENGTH) == 0) {
+        goto _done;
+    }
+
     warnprint("Invalid offset %s given for Linux target\n", key);
 
     _done: return;
@@ -37,11 +37,10 @@ linux_get_taskstruct_addr_from_pid(
     vmi_instance_t vmi,
     vmi_pid_t pid)
 {
-    addr_t list_head = 0, next_process = 0;
-    vmi_pid_t task_pid = -1;
+    addr_t ts_addr = 0;
     linux_instance_t linux_instance = NULL;
-    int pid_offset = 0;
-    int tasks_offset = 0;
+    vmi_list_field_t field = { 0, sizeof(vmi_pid_t) };
+    vmi_list_walk_t walk;
 
     if (vmi->os_data == NULL) {
         errprint("VMI_ERROR: No os_data initialized\n");
@@ -49,33 +48,19 @@ linux_get_taskstruct_addr_from_pid(
     }
 
     linux_instance = vmi->os_data;
+    field.offset = linux_instance->pid_offset;
 
-    pid_offset = linux_instance->pid_offset;
-    tasks_offset = linux_instance->tasks_offset;
-
-    /* First we need a pointer to the initial entry in the tasks list.
-     * Note that this is task_struct->tasks, not the base addr
-     *  of task_struct: task_struct base = $entry - tasks_offset.
+    /* The tasks list links task_struct->tasks, starting with init_task
+     * (pid 0). The walk stops at the task of the pid.
      */
-    next_process = vmi->init_task;
-    list_head = next_process;
-
-    do {
-        vmi_read_32_va(vmi, next_process + pid_offset, 0, (uint32_t*)&task_pid);
-
-        /* if pid matches, then we found what we want */
-        if (task_pid == pid) {
-            return next_process;
-        }
-
-        vmi_read_addr_va(vmi, next_process + tasks_offset, 0, &next_process);
-        next_process -= tasks_offset;
-
-        /* if we are back at the list head, we are done */
-    } while(list_head != next_process);
+    if (VMI_SUCCESS == vmi_walk_list_find(vmi, vmi->init_task + linux_instance->tasks_offset, 0,
+                                          linux_instance->tasks_offset, &field, 1,
+                                          VMI_WALK_INCLUDE_HEAD, &pid, &walk)) {
+        memcpy(&ts_addr, walk.records, sizeof(addr_t));
+    }
 
-error_exit:
-    return 0;
+    vmi_walk_list_free(&walk);
+    return ts_addr;
 }
 
 static addr_t
@@ -87,6 +87,10 @@ get_ntoskrnl_base(
 
     for(; page_paddr + VMI_PS_4KB < vmi->max_physical_address; page_paddr += VMI_PS_4KB) {
 
+        if(!memory_map_contains(vmi, page_paddr, VMI_PS_4KB)) {
+            continue;
+        }
+
         uint8_t page[VMI_PS_4KB];
         status_t rc = peparse_get_image_phys(vmi, page_paddr, VMI_PS_4KB, page);
         if(VMI_FAILURE == rc) {
@@ -512,6 +516,10 @@ void windows_read_config_ghashtable_entries(char* key, gpointer value,
         goto _done;
     }
 
+    if (strncmp(key, "init_cache", CONFIG_STR_LENGTH) == 0) {
+        goto _done;
+    }
+
     warnprint("Invalid offset \"%s\" given for Windows target\n", key);
 
     _done: return;
@@ -660,6 +668,109 @@ init_core(vmi_instance_t vmi)
     }
 }
 
+/* Checks a cached init state against the memory: the kernel image must be
+ * where it was and unchanged, and the System process must use the kpgd. */
+static status_t
+windows_init_cache_check(
+    vmi_instance_t vmi,
+    GKeyFile *cache)
+{
+    status_t ret = VMI_FAILURE;
+    windows_instance_t windows = vmi->os_data;
+    struct windows_instance cached = *windows;
+    uint64_t version = 0;
+    addr_t dtb = 0;
+    char *fingerprint = NULL;
+    char *digest = NULL;
+
+    if (!init_cache_get(cache, "win_ntoskrnl", &cached.ntoskrnl)
+        || !init_cache_get(cache, "win_ntoskrnl_va", &cached.ntoskrnl_va)
+        || !init_cache_get(cache, "win_kdvb", &cached.kdbg_va)
+        || !init_cache_get(cache, "win_sysproc", &cached.sysproc)
+        || !init_cache_get(cache, "win_tasks", &cached.tasks_offset)
+        || !init_cache_get(cache, "win_pdbase", &cached.pdbase_offset)
+        || !init_cache_get(cache, "win_pid", &cached.pid_offset)
+        || !init_cache_get(cache, "win_pname", &cached.pname_offset)
+        || !init_cache_get(cache, "win_kpcr", &cached.kpcr_offset)
+        || !init_cache_get(cache, "win_kdbg", &cached.kdbg_offset)
+        || !init_cache_get(cache, "win_version", &version)) {
+        goto done;
+    }
+    cached.version = version;
+
+    if (cached.ntoskrnl != vmi_pagetable_lookup(vmi, vmi->kpgd, cached.ntoskrnl_va)) {
+        dbprint(VMI_DEBUG_MISC, "--cached ntoskrnl is not mapped\n");
+        goto done;
+    }
+
+    /* the PE header holds the timestamp and size of this very build */
+    fingerprint = init_cache_get_string(cache, "win_fingerprint");
+    digest = init_cache_page_digest(vmi, cached.ntoskrnl);
+    if (!fingerprint || !digest || strcmp(fingerprint, digest)) {
+        dbprint(VMI_DEBUG_MISC, "--cached ntoskrnl was replaced\n");
+        goto done;
+    }
+
+    if (VMI_FAILURE == vmi_read_addr_pa(vmi, cached.sysproc + cached.pdbase_offset, &dtb)
+        || dtb != vmi->kpgd) {
+        dbprint(VMI_DEBUG_MISC, "--cached System process is gone\n");
+        goto done;
+    }
+
+    *windows = cached;
+    ret = VMI_SUCCESS;
+
+done:
+    g_free(fingerprint);
+    g_free(digest);
+    return ret;
+}
+
+static void
+windows_init_cache_save(
+    vmi_instance_t vmi)
+{
+    windows_instance_t windows = vmi->os_data;
+    GKeyFile *cache = NULL;
+    char *digest = NULL;
+    addr_t sysproc = windows->sysproc;
+
+    if (!vmi->init_cache || !windows->ntoskrnl || !windows->ntoskrnl_va) {
+        return;
+    }
+
+    /* only the System process scan records its physical address */
+    if (!sysproc) {
+        sysproc = vmi_translate_kv2p(vmi, vmi->init_task);
+    }
+
+    digest = init_cache_page_digest(vmi, windows->ntoskrnl);
+    if (!sysproc || !digest) {
+        goto done;
+    }
+    cache = init_cache_new(vmi);
+
+    init_cache_set(cache, "win_ntoskrnl", windows->ntoskrnl);
+    init_cache_set(cache, "win_ntoskrnl_va", windows->ntoskrnl_va);
+    init_cache_set(cache, "win_kdvb", windows->kdbg_va);
+    init_cache_set(cache, "win_sysproc", sysproc);
+    init_cache_set(cache, "win_tasks", windows->tasks_offset);
+    init_cache_set(cache, "win_pdbase", windows->pdbase_offset);
+    init_cache_set(cache, "win_pid", windows->pid_offset);
+    init_cache_set(cache, "win_pname", windows->pname_offset);
+    init_cache_set(cache, "win_kpcr", windows->kpcr_offset);
+    init_cache_set(cache, "win_kdbg", windows->kdbg_offset);
+    init_cache_set(cache, "win_version", windows->version);
+    init_cache_set_string(cache, "win_fingerprint", digest);
+    init_cache_save(vmi, cache);
+
+done:
+    if (cache) {
+        g_key_file_free(cache);
+    }
+    g_free(digest);
+}
+
 status_t
 windows_init(
     vmi_instance_t vmi)
@@ -668,6 +779,7 @@ windows_init(
     windows_instance_t windows = NULL;
     os_interface_t os_interface = NULL;
     status_t real_kpgd_found = VMI_FAILURE;
+    GKeyFile *cache = NULL;
 
     if (vmi->config == NULL) {
         errprint("VMI_ERROR: No config table found\n");
@@ -700,6 +812,13 @@ windows_init(
 
     vmi->os_interface = os_interface;
 
+    cache = init_cache_load(vmi);
+    if (cache && VMI_SUCCESS == init_cache_restore(vmi, cache, windows_init_cache_check)) {
+        dbprint(VMI_DEBUG_MISC, "--init state restored from cache\n");
+        g_key_file_free(cache);
+        return VMI_SUCCESS;
+    }
+
     if(VMI_FAILURE == check_pdbase_offset(vmi)) {
         goto error_exit;
     }
@@ -756,9 +875,16 @@ windows_init(
     goto error_exit;
 
 done:
+    windows_init_cache_save(vmi);
+    if (cache) {
+        g_key_file_free(cache);
+    }
     return status;
 
 error_exit:
+    if (cache) {
+        g_key_file_free(cache);
+    }
     windows_teardown(vmi);
     return VMI_FAILURE;
 }
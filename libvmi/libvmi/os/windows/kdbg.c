@@ -776,7 +776,8 @@ status_t find_kdbg_address(
                                   12);
     uint32_t find_ofs_64 = 0xc, find_ofs_32 = 0x8, find_ofs = 0;
 
-    for(;paddr<memsize;paddr+=VMI_PS_4KB) {
+    for(paddr = memory_map_next(vmi, 0); paddr < memsize;
+        paddr = memory_map_next(vmi, paddr + VMI_PS_4KB)) {
 
         find_ofs = 0;
 
@@ -833,7 +834,6 @@ find_kdbg_address_fast(
         return ret;
     }
 
-    addr_t memsize = vmi_get_max_physical_address(vmi);
     GSList *va_pages = vmi_get_va_pages(vmi, (addr_t)cr3);
     size_t read = 0;
     void *bm = 0;   // boyer-moore internal state
@@ -862,7 +862,7 @@ find_kdbg_address_fast(
             addr_t page_vaddr = vap->vaddr+vap->size;
             addr_t page_paddr = vap->paddr+vap->size;
 
-            if(page_paddr + VMI_PS_4KB - 1 > memsize) {
+            if(!memory_map_contains(vmi, page_paddr, VMI_PS_4KB)) {
                 continue;
             }
 
@@ -968,6 +968,10 @@ scan:
     page_paddr = (vmi_pagetable_lookup(vmi, cr3, fsgs) >> 12) << 12;
     for(; page_paddr + step < vmi->max_physical_address; page_paddr += step) {
 
+        if(!memory_map_contains(vmi, page_paddr, VMI_PS_4KB)) {
+            continue;
+        }
+
         uint8_t page[VMI_PS_4KB];
         status_t rc = peparse_get_image_phys(vmi, page_paddr, VMI_PS_4KB, page);
         if(VMI_FAILURE == rc) {
@@ -144,13 +144,15 @@ find_pname_offset(
         check = get_check_magic_func(vmi);
     }
 
-    for (block_pa = 4096; block_pa + BLOCK_SIZE < vmi->max_physical_address; block_pa += BLOCK_SIZE) {
+    /* a block that runs into a hole is scanned up to the hole */
+    for (block_pa = memory_map_next(vmi, 4096); block_pa < vmi->max_physical_address;
+         block_pa = memory_map_next(vmi, block_pa + BLOCK_SIZE)) {
         read = vmi_read_pa(vmi, block_pa, block_buffer, BLOCK_SIZE);
-        if (BLOCK_SIZE != read) {
+        if (read < sizeof(value)) {
             continue;
         }
 
-        for (offset = 0; offset < BLOCK_SIZE; offset += 8) {
+        for (offset = 0; offset + sizeof(value) <= read; offset += 8) {
             memcpy(&value, block_buffer + offset, 4);
 
             if (check(value)) { // look for specific magic #
@@ -209,8 +211,8 @@ find_process_by_name(
         check = get_check_magic_func(vmi);
     }
 
-    for (block_pa = start_address; block_pa + VMI_PS_4KB < vmi->max_physical_address;
-         block_pa += VMI_PS_4KB) {
+    for (block_pa = memory_map_next(vmi, start_address); block_pa + VMI_PS_4KB < vmi->max_physical_address;
+         block_pa = memory_map_next(vmi, block_pa + VMI_PS_4KB)) {
         read = vmi_read_pa(vmi, block_pa, block_buffer, VMI_PS_4KB);
         if (VMI_PS_4KB != read) {
             continue;
@@ -280,36 +282,21 @@ eprocess_list_search(
         size_t len,
         void *value)
 {
-    addr_t next_process = 0;
     int tasks_offset = 0;
-    void *buf = alloca(len);
+    vmi_list_field_t field = { offset, len };
+    vmi_list_walk_t walk;
     addr_t rtnval = 0;
 
     tasks_offset = vmi_get_offset(vmi, "win_tasks");
 
-    vmi_read_addr_va(vmi, list_head + tasks_offset, 0, &next_process);
-    vmi_read_va(vmi, list_head + offset, 0, buf, len);
-    if (memcmp(buf, value, len) == 0) {
-        rtnval = list_head + tasks_offset;
-        goto exit;
+    /* returns the ActiveProcessLinks of the matching process */
+    if (VMI_SUCCESS == vmi_walk_list_find(vmi, list_head + tasks_offset, 0, tasks_offset,
+                                          &field, 1, VMI_WALK_INCLUDE_HEAD, value, &walk)) {
+        memcpy(&rtnval, walk.records, sizeof(addr_t));
+        rtnval += tasks_offset;
     }
-    list_head = next_process;
 
-    while(1) {
-        addr_t tmp_next = 0;
-        vmi_read_addr_va(vmi, next_process, 0, &tmp_next);
-        if (list_head == tmp_next) {
-            break;
-        }
-        vmi_read_va(vmi, next_process + offset - tasks_offset, 0, buf, len);
-        if (memcmp(buf, value, len) == 0) {
-            rtnval = next_process;
-            goto exit;
-        }
-        next_process = tmp_next;
-    }
-
-exit:
+    vmi_walk_list_free(&walk);
     return rtnval;
 }
 
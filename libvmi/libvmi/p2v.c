@@ -0,0 +1,567 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+
+/*
+ * Physical to virtual reverse map. Every mapped page is indexed by its
+ * frame, tagged with its size class, in a hash table of buckets holding
+ * the virtual page numbers packed with the address space that maps them.
+ * Each address space keeps the keys of its pages, so adding, refreshing
+ * or removing one only touches the buckets of its own pages.
+ *
+ * The kernel half is mapped by the same tables in every process. As in the
+ * v2p cache, its pages are grouped by the top level entry (PML4E, PDPTE or
+ * PDE) mapping them and stored once per group, whose members are the dtbs
+ * whose entries match. A lookup reports a page of a group for every member.
+ */
+
+#define P2V_CLASSES 4
+#define P2V_CLASS_SHIFT 60
+#define P2V_SPACE_BITS 28
+#define P2V_SPACE_MASK ((1ULL << P2V_SPACE_BITS) - 1)
+#define P2V_GROUP (1ULL << (P2V_SPACE_BITS - 1))    /**< the space is a group */
+#define P2V_VPN_MASK ((1ULL << (64 - P2V_SPACE_BITS)) - 1)
+
+/* the pages mapping a frame */
+struct p2v_bucket {
+    uint64_t key;           /**< size class and frame */
+    guint count;
+    uint64_t vpn_space[];   /**< virtual page number and space */
+};
+
+/* an address space, or a group of kernel pages shared by address spaces */
+struct p2v_space {
+    addr_t dtb;             /**< dtb of an address space, 0 once removed */
+    uint64_t slot;          /**< index of the top level entry of a group */
+    uint64_t entry;         /**< value of the top level entry of a group */
+    GArray *members;        /**< addr_t, dtbs sharing a group, empty once freed */
+    GArray *keys;           /**< uint64_t, keys of the pages of the space */
+};
+
+struct vmi_p2v_map {
+    page_mode_t page_mode;
+    GArray *dtbs;           /**< struct p2v_space of the address spaces */
+    GArray *groups;         /**< struct p2v_space of the groups */
+    GHashTable *index;      /**< key -> struct p2v_bucket */
+    uint8_t classes;        /**< bitmap of the size classes recorded */
+    size_t pages;           /**< number of pages recorded */
+};
+
+/* page shift of each size class */
+static const uint8_t p2v_shifts[P2V_CLASSES] = { 12, 21, 22, 30 };
+
+static int
+p2v_class(
+    page_size_t size)
+{
+    switch (size) {
+        case VMI_PS_4KB:
+            return 0;
+        case VMI_PS_2MB:
+            return 1;
+        case VMI_PS_4MB:
+            return 2;
+        case VMI_PS_1GB:
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+static struct p2v_space *
+p2v_space(
+    vmi_p2v_map_t map,
+    uint64_t space)
+{
+    if (space & P2V_GROUP) {
+        return &g_array_index(map->groups, struct p2v_space, space & ~P2V_GROUP);
+    }
+    return &g_array_index(map->dtbs, struct p2v_space, space);
+}
+
+static void
+p2v_insert(
+    vmi_p2v_map_t map,
+    uint64_t space,
+    uint64_t key,
+    addr_t vaddr)
+{
+    struct p2v_bucket *bucket = g_hash_table_lookup(map->index, &key);
+    uint64_t vpn_space = (((vaddr >> 12) & P2V_VPN_MASK) << P2V_SPACE_BITS) | space;
+
+    /* the buckets grow in powers of two */
+    if (!bucket || !(bucket->count & (bucket->count - 1))) {
+        guint alloc = bucket ? 2 * bucket->count : 1;
+
+        if (bucket) {
+            g_hash_table_steal(map->index, &key);
+        }
+        bucket = g_realloc(bucket, sizeof(struct p2v_bucket) + alloc * sizeof(uint64_t));
+        if (alloc == 1) {
+            bucket->key = key;
+            bucket->count = 0;
+        }
+        g_hash_table_insert(map->index, &bucket->key, bucket);
+    }
+
+    bucket->vpn_space[bucket->count++] = vpn_space;
+    g_array_append_val(p2v_space(map, space)->keys, key);
+    map->classes |= 1 << (key >> P2V_CLASS_SHIFT);
+    map->pages++;
+}
+
+/* drops the pages of a space from their buckets */
+static void
+p2v_space_drop(
+    vmi_p2v_map_t map,
+    uint64_t space)
+{
+    GArray *keys = p2v_space(map, space)->keys;
+    guint i, j, kept;
+
+    for (i = 0; i < keys->len; i++) {
+        uint64_t key = g_array_index(keys, uint64_t, i);
+        struct p2v_bucket *bucket = g_hash_table_lookup(map->index, &key);
+
+        if (!bucket) {
+            continue;
+        }
+        for (j = 0, kept = 0; j < bucket->count; j++) {
+            if ((bucket->vpn_space[j] & P2V_SPACE_MASK) != space) {
+                bucket->vpn_space[kept++] = bucket->vpn_space[j];
+            } else {
+                map->pages--;
+            }
+        }
+        bucket->count = kept;
+        if (!kept) {
+            g_hash_table_remove(map->index, &key);
+        }
+    }
+    g_array_set_size(keys, 0);
+}
+
+/* the top level entry mapping a kernel half page */
+static gboolean
+p2v_top_slot(
+    vmi_instance_t vmi,
+    addr_t vaddr,
+    uint64_t *slot)
+{
+    switch (vmi->page_mode) {
+        case VMI_PM_IA32E:
+            *slot = (vaddr >> 39) & 0x1ff;
+            return VMI_GET_BIT(vaddr, 47);
+        case VMI_PM_PAE:
+            *slot = (vaddr >> 30) & 0x3;
+            return vaddr >= 0x80000000ULL;
+        case VMI_PM_LEGACY:
+            *slot = (vaddr >> 22) & 0x3ff;
+            return vaddr >= 0x80000000ULL;
+        default:
+            return FALSE;
+    }
+}
+
+static gboolean
+p2v_top_entry(
+    vmi_instance_t vmi,
+    addr_t dtb,
+    uint64_t slot,
+    uint64_t *entry)
+{
+    addr_t table = 0;
+    size_t size = 8;
+
+    switch (vmi->page_mode) {
+        case VMI_PM_IA32E:
+            table = dtb & VMI_BIT_MASK(12, 51);
+            break;
+        case VMI_PM_PAE:
+            table = dtb & VMI_BIT_MASK(5, 31);
+            break;
+        default:
+            table = dtb & VMI_BIT_MASK(12, 31);
+            size = 4;
+            break;
+    }
+
+    *entry = 0;
+    if (vmi_read_pa(vmi, table + slot * size, entry, size) != size) {
+        return FALSE;
+    }
+    /* the accessed and dirty bits change under the guest's feet */
+    *entry &= ~0x60ULL;
+    return TRUE;
+}
+
+/* the group of a top level entry, created if there's none */
+static guint
+p2v_group(
+    vmi_p2v_map_t map,
+    uint64_t slot,
+    uint64_t entry,
+    gboolean *created)
+{
+    struct p2v_space *group = NULL;
+    guint i, free_group = map->groups->len;
+
+    for (i = 0; i < map->groups->len; i++) {
+        group = &g_array_index(map->groups, struct p2v_space, i);
+        if (!group->members->len) {
+            free_group = i;
+        } else if (group->slot == slot && group->entry == entry) {
+            *created = FALSE;
+            return i;
+        }
+    }
+
+    if (free_group == map->groups->len) {
+        struct p2v_space new_group = { 0 };
+
+        new_group.members = g_array_new(FALSE, FALSE, sizeof(addr_t));
+        new_group.keys = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+        g_array_append_val(map->groups, new_group);
+    }
+
+    group = &g_array_index(map->groups, struct p2v_space, free_group);
+    group->slot = slot;
+    group->entry = entry;
+    *created = TRUE;
+    return free_group;
+}
+
+/* takes a dtb out of the groups, dropping the groups left without members */
+static void
+p2v_leave_groups(
+    vmi_p2v_map_t map,
+    addr_t dtb)
+{
+    guint i, j;
+
+    for (i = 0; i < map->groups->len; i++) {
+        struct p2v_space *group = &g_array_index(map->groups, struct p2v_space, i);
+
+        for (j = 0; j < group->members->len; j++) {
+            if (g_array_index(group->members, addr_t, j) == dtb) {
+                g_array_remove_index_fast(group->members, j);
+                break;
+            }
+        }
+        if (!group->members->len && group->keys->len) {
+            p2v_space_drop(map, P2V_GROUP | i);
+        }
+    }
+}
+
+/*
+ * Walks the tables of a dtb into the map. The pages of a group are
+ * recorded by its first member, or again by any member with refill, as a
+ * refresh asks for the current tables.
+ */
+static status_t
+p2v_map_add(
+    vmi_instance_t vmi,
+    vmi_p2v_map_t map,
+    guint dtb_index,
+    gboolean refill)
+{
+    addr_t dtb = g_array_index(map->dtbs, struct p2v_space, dtb_index).dtb;
+    GSList *pages = vmi_get_va_pages(vmi, dtb);
+    GSList *loop = NULL;
+    GHashTable *slots = NULL;
+
+    if (!pages) {
+        dbprint(VMI_DEBUG_PTLOOKUP, "--p2v: no pages mapped by dtb 0x%"PRIx64"\n", dtb);
+        return VMI_FAILURE;
+    }
+
+    /* slot -> 1 + group (0 if the entry can't be read), with P2V_GROUP
+       set if this walk records the pages of the group */
+    slots = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+
+    for (loop = pages; loop; loop = loop->next) {
+        page_info_t *info = loop->data;
+        int class = p2v_class(info->size);
+        uint64_t slot = 0, entry = 0, space = dtb_index;
+        uint64_t *group = NULL;
+
+        if (class >= 0 && p2v_top_slot(vmi, info->vaddr, &slot)) {
+            if (!(group = g_hash_table_lookup(slots, &slot))) {
+                group = g_malloc0(sizeof(uint64_t));
+                if (p2v_top_entry(vmi, dtb, slot, &entry)) {
+                    gboolean created = FALSE;
+                    guint i = p2v_group(map, slot, entry, &created);
+
+                    g_array_append_val(g_array_index(map->groups, struct p2v_space, i).members, dtb);
+                    if (!created && refill) {
+                        p2v_space_drop(map, P2V_GROUP | i);
+                    }
+                    *group = (i + 1) | ((created || refill) ? P2V_GROUP : 0);
+                }
+                g_hash_table_insert(slots, g_memdup(&slot, sizeof(slot)), group);
+            }
+
+            if (*group) {
+                /* else recorded by another member */
+                space = P2V_GROUP | ((*group & ~P2V_GROUP) - 1);
+                if (!(*group & P2V_GROUP)) {
+                    class = -1;
+                }
+            }
+        }
+
+        if (class >= 0) {
+            p2v_insert(map, space,
+                       ((uint64_t) class << P2V_CLASS_SHIFT) | (info->paddr >> p2v_shifts[class]),
+                       info->vaddr);
+        }
+        g_free(info);
+    }
+    g_slist_free(pages);
+    g_hash_table_destroy(slots);
+
+    return VMI_SUCCESS;
+}
+
+static gboolean
+p2v_map_find_dtb(
+    vmi_p2v_map_t map,
+    addr_t dtb,
+    guint *dtb_index)
+{
+    guint i;
+
+    for (i = 0; i < map->dtbs->len; i++) {
+        if (g_array_index(map->dtbs, struct p2v_space, i).dtb == dtb) {
+            *dtb_index = i;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* index of a new or reused address space of the map */
+static gboolean
+p2v_map_new_dtb(
+    vmi_p2v_map_t map,
+    addr_t dtb,
+    guint *dtb_index)
+{
+    struct p2v_space space = { 0 };
+
+    if (p2v_map_find_dtb(map, 0, dtb_index)) {
+        g_array_index(map->dtbs, struct p2v_space, *dtb_index).dtb = dtb;
+        return TRUE;
+    }
+
+    if (map->dtbs->len >= P2V_GROUP) {
+        errprint("p2v: too many address spaces\n");
+        return FALSE;
+    }
+
+    space.dtb = dtb;
+    space.keys = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+    *dtb_index = map->dtbs->len;
+    g_array_append_val(map->dtbs, space);
+    return TRUE;
+}
+
+vmi_p2v_map_t
+vmi_p2v_map_build(
+    vmi_instance_t vmi,
+    const addr_t *dtbs,
+    size_t ndtbs)
+{
+    vmi_p2v_map_t map = NULL;
+    guint dtb_index = 0;
+    size_t i;
+
+    if (!vmi || (ndtbs && !dtbs)) {
+        return NULL;
+    }
+
+    os_init_lazy(vmi);
+    map = g_malloc0(sizeof(struct vmi_p2v_map));
+    map->page_mode = vmi->page_mode;
+    map->dtbs = g_array_new(FALSE, FALSE, sizeof(struct p2v_space));
+    map->groups = g_array_new(FALSE, FALSE, sizeof(struct p2v_space));
+    map->index = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+
+    if (!ndtbs) {
+        dtbs = &vmi->kpgd;
+        ndtbs = 1;
+    }
+
+    for (i = 0; i < ndtbs; i++) {
+        if (!p2v_map_new_dtb(map, dtbs[i], &dtb_index)) {
+            break;
+        }
+        p2v_map_add(vmi, map, dtb_index, FALSE);
+    }
+
+    dbprint(VMI_DEBUG_PTLOOKUP, "--p2v: %zu pages of %u address spaces, %u kernel groups\n",
+            map->pages, map->dtbs->len, map->groups->len);
+    return map;
+}
+
+status_t
+vmi_p2v_map_refresh(
+    vmi_instance_t vmi,
+    vmi_p2v_map_t map,
+    addr_t dtb)
+{
+    guint dtb_index = 0;
+
+    if (!vmi || !map || !dtb) {
+        return VMI_FAILURE;
+    }
+
+    if (p2v_map_find_dtb(map, dtb, &dtb_index)) {
+        p2v_space_drop(map, dtb_index);
+        p2v_leave_groups(map, dtb);
+    } else if (!p2v_map_new_dtb(map, dtb, &dtb_index)) {
+        return VMI_FAILURE;
+    }
+
+    return p2v_map_add(vmi, map, dtb_index, TRUE);
+}
+
+status_t
+vmi_p2v_map_remove(
+    vmi_p2v_map_t map,
+    addr_t dtb)
+{
+    guint dtb_index = 0;
+
+    if (!map || !dtb || !p2v_map_find_dtb(map, dtb, &dtb_index)) {
+        return VMI_FAILURE;
+    }
+
+    p2v_space_drop(map, dtb_index);
+    p2v_leave_groups(map, dtb);
+    g_array_index(map->dtbs, struct p2v_space, dtb_index).dtb = 0;
+    return VMI_SUCCESS;
+}
+
+/* fills in a mapping, if there's room for it */
+static void
+p2v_mapping(
+    vmi_p2v_map_t map,
+    addr_t dtb,
+    addr_t vaddr,
+    vmi_p2v_t *mappings,
+    size_t max,
+    size_t count)
+{
+    if (count >= max) {
+        return;
+    }
+
+    /* canonical form of a kernel address */
+    if (VMI_PM_IA32E == map->page_mode && (vaddr & VMI_BIT_MASK(47, 47))) {
+        vaddr |= VMI_BIT_MASK(48, 63);
+    }
+
+    mappings[count].dtb = dtb;
+    mappings[count].vaddr = vaddr;
+}
+
+size_t
+vmi_translate_p2v(
+    vmi_p2v_map_t map,
+    addr_t paddr,
+    vmi_p2v_t *mappings,
+    size_t max)
+{
+    size_t count = 0;
+    int class;
+
+    if (!map) {
+        return 0;
+    }
+
+    for (class = 0; class < P2V_CLASSES; class++) {
+        uint64_t key = ((uint64_t) class << P2V_CLASS_SHIFT) | (paddr >> p2v_shifts[class]);
+        struct p2v_bucket *bucket = NULL;
+        guint i, j;
+
+        if (!(map->classes & (1 << class))) {
+            continue;
+        }
+
+        bucket = g_hash_table_lookup(map->index, &key);
+        if (!bucket) {
+            continue;
+        }
+
+        for (i = 0; i < bucket->count; i++) {
+            uint64_t space = bucket->vpn_space[i] & P2V_SPACE_MASK;
+            addr_t vaddr = ((bucket->vpn_space[i] >> P2V_SPACE_BITS) << 12)
+                           + (paddr & ((1ULL << p2v_shifts[class]) - 1));
+            struct p2v_space *owner = p2v_space(map, space);
+
+            if (!(space & P2V_GROUP)) {
+                p2v_mapping(map, owner->dtb, vaddr, mappings, max, count++);
+                continue;
+            }
+            for (j = 0; j < owner->members->len; j++) {
+                p2v_mapping(map, g_array_index(owner->members, addr_t, j), vaddr,
+                            mappings, max, count++);
+            }
+        }
+    }
+
+    return count;
+}
+
+static void
+p2v_spaces_free(
+    GArray *spaces)
+{
+    guint i;
+
+    for (i = 0; i < spaces->len; i++) {
+        struct p2v_space *space = &g_array_index(spaces, struct p2v_space, i);
+
+        if (space->members) {
+            g_array_free(space->members, TRUE);
+        }
+        g_array_free(space->keys, TRUE);
+    }
+    g_array_free(spaces, TRUE);
+}
+
+void
+vmi_p2v_map_free(
+    vmi_p2v_map_t map)
+{
+    if (!map) {
+        return;
+    }
+
+    g_hash_table_destroy(map->index);
+    p2v_spaces_free(map->dtbs);
+    p2v_spaces_free(map->groups);
+    g_free(map);
+}
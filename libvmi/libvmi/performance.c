@@ -25,6 +25,7 @@
  */
 
 #include <math.h>
+#include <time.h>
 #include <sys/time.h>
 
 #include "private.h"
@@ -115,3 +116,130 @@ timer_stop(
     gettimeofday(&stopTime, 0);
     print_measurement(id, startTime, stopTime, &diff);
 }
+
+//---------------------------------------------------------
+// Latency statistics
+
+static const char *stat_names[VMI_STAT_MAX] = {
+    [VMI_STAT_READ] = "read",
+    [VMI_STAT_TRANSLATE] = "translate",
+    [VMI_STAT_READ_PAGE] = "read_page",
+    [VMI_STAT_SYMBOL] = "symbol",
+    [VMI_STAT_INIT_DRIVER] = "init_driver",
+    [VMI_STAT_INIT_OS] = "init_os",
+};
+
+__thread unsigned int stat_depth;
+
+/* nanoseconds, CLOCK_MONOTONIC is read through the vDSO without a syscall */
+uint64_t
+stat_clock(
+    void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+stat_record(
+    vmi_instance_t vmi,
+    vmi_stat_t stat,
+    uint64_t start)
+{
+    vmi_stat_histogram_t *histogram = &vmi->stats[stat];
+    uint64_t ns = 0;
+    uint64_t max = 0;
+    int bucket = 0;
+
+    if (!start)
+        return;
+
+    ns = stat_clock() - start;
+    bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->buckets[bucket], 1, __ATOMIC_RELAXED);
+
+    max = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+    while (ns > max &&
+           !__atomic_compare_exchange_n(&histogram->max_ns, &max, ns, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void
+vmi_set_stats(
+    vmi_instance_t vmi,
+    uint8_t enabled)
+{
+    vmi->stats_enabled = !!enabled;
+}
+
+status_t
+vmi_get_stats(
+    vmi_instance_t vmi,
+    vmi_stat_t stat,
+    vmi_stat_histogram_t *histogram)
+{
+    int i;
+
+    if (stat >= VMI_STAT_MAX || !histogram)
+        return VMI_FAILURE;
+
+    histogram->count = __atomic_load_n(&vmi->stats[stat].count, __ATOMIC_RELAXED);
+    histogram->total_ns = __atomic_load_n(&vmi->stats[stat].total_ns, __ATOMIC_RELAXED);
+    histogram->max_ns = __atomic_load_n(&vmi->stats[stat].max_ns, __ATOMIC_RELAXED);
+    for (i = 0; i < VMI_STAT_BUCKETS; i++) {
+        histogram->buckets[i] = __atomic_load_n(&vmi->stats[stat].buckets[i], __ATOMIC_RELAXED);
+    }
+    return VMI_SUCCESS;
+}
+
+void
+vmi_reset_stats(
+    vmi_instance_t vmi)
+{
+    memset(vmi->stats, 0, sizeof(vmi->stats));
+}
+
+uint64_t
+vmi_stat_percentile(
+    const vmi_stat_histogram_t *histogram,
+    double percentile)
+{
+    uint64_t total = 0;
+    uint64_t seen = 0;
+    uint64_t rank = 0;
+    int i;
+
+    for (i = 0; i < VMI_STAT_BUCKETS; i++) {
+        total += histogram->buckets[i];
+    }
+    if (!total)
+        return 0;
+
+    rank = (uint64_t) ceil(total * percentile / 100.0);
+    if (!rank)
+        rank = 1;
+
+    for (i = 0; i < VMI_STAT_BUCKETS - 1; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+            break;
+    }
+
+    // the slowest call is known exactly
+    if (i == VMI_STAT_BUCKETS - 1 || (2ULL << i) > histogram->max_ns)
+        return histogram->max_ns;
+    return 2ULL << i;
+}
+
+const char *
+vmi_stat_name(
+    vmi_stat_t stat)
+{
+    return stat < VMI_STAT_MAX ? stat_names[stat] : NULL;
+}
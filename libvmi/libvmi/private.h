@@ -50,9 +50,37 @@
 #include "arch/arch_interface.h"
 #include "os/os_interface.h"
 
+/* number of independently locked parts of the v2p and page caches */
+#define VMI_CACHE_SHARDS 16
+
+typedef struct v2p_cache_shard {
+    GMutex lock;
+    GHashTable *cache;      /**< v2p entries by (va page, dtb or kernel top level entry) */
+} v2p_cache_shard_t;
+
+#if ENABLE_PAGE_CACHE == 1
+typedef struct memory_cache_shard {
+    GRecMutex lock;         /**< pins the pages of the shard while held */
+    GHashTable *cache;      /**< cached pages by paddr */
+    GQueue *lru;            /**< most recently used pages first */
+} memory_cache_shard_t;
+#endif
+
+typedef struct read_async read_async_t;
+
 /**
  * @brief LibVMI Instance.
  *
+ * An instance may be shared by threads reading and translating memory.
+ * The v2p and page caches are split into VMI_CACHE_SHARDS shards, each
+ * with its own lock; the other caches share cache_lock. Driver calls are
+ * serialized by driver_lock, except read_page which drivers have to make
+ * safe themselves (the page cache is). A thread reading a page returned by
+ * read_page holds the page cache lock of the page (memory_cache_lock)
+ * until it is done with it. driver_lock is never held while waiting for a
+ * page cache lock, drivers only try them. Setup, writes, events and
+ * teardown are not thread-safe.
+ *
  * This struct holds all of the relavent information for an instance of
  * LibVMI.  Each time a new domain is accessed, a new instance must
  * be created using the vmi_init function.  When you are done with an instance,
@@ -60,7 +88,7 @@
  */
 struct vmi_instance {
 
-    vmi_mode_t mode;        /**< VMI_FILE, VMI_XEN, VMI_KVM */
+    vmi_mode_t mode;        /**< VMI_FILE, VMI_XEN, VMI_KVM, VMI_TRACE, VMI_MEMORY */
 
     driver_interface_t driver; /**< The driver supporting the chosen mode */
 
@@ -98,6 +126,10 @@ struct vmi_instance {
 
     addr_t max_physical_address; /**< maximum valid physical memory address + 1 */
 
+    vmi_pa_range_t *memory_map; /**< ranges of RAM, sorted by address */
+
+    size_t memory_map_count; /**< number of ranges in memory_map */
+
     int hvm;                /**< nonzero if HVM */
 
     os_t os_type;           /**< type of os: VMI_OS_LINUX, etc */
@@ -106,32 +138,44 @@ struct vmi_instance {
 
     void* os_data; /**< Guest OS specific data */
 
+    gint *os_refs;          /**< instances sharing os_interface and os_data, see vmi_clone */
+
     GHashTable *pid_cache;  /**< hash table to hold the PID cache data */
 
     GHashTable *sym_cache;  /**< hash table to hold the sym cache data */
 
     GHashTable *rva_cache;  /**< hash table to hold the rva cache data */
 
-    GHashTable *v2p_cache;  /**< hash table to hold the v2p cache data */
+    v2p_cache_shard_t v2p_cache[VMI_CACHE_SHARDS]; /**< v2p cache, striped by key */
+
+    GMutex cache_lock;      /**< protects the pid, sym, rva and v2m caches */
+
+    GRecMutex driver_lock;  /**< serializes calls into the driver */
 
 #if ENABLE_SHM_SNAPSHOT == 1
     GHashTable *v2m_cache;  /**< hash table to hold the v2m cache data */
 #endif
 
 #if ENABLE_PAGE_CACHE == 1
-    GHashTable *memory_cache;  /**< hash table for memory cache */
-
-    GQueue *memory_cache_lru;  /**< queue holding the most recently used pages */
+    memory_cache_shard_t memory_cache[VMI_CACHE_SHARDS]; /**< page cache, striped by page */
 
     uint32_t memory_cache_age; /**< max age of memory cache entry */
 
     uint32_t memory_cache_size_max;/**< max size of memory cache */
+
+    const char *memory_cache_backing; /**< backing the cached pages are shared for, or NULL */
 #else
+    GRecMutex memory_cache_lock; /**< pins the last used page while held */
+
     void *last_used_page;   /**< the last used page */
 
     addr_t last_used_page_key; /**< the key (addr) of the last used page */
 #endif
 
+    void *(*get_data_callback) (vmi_instance_t, addr_t, uint32_t); /**< page fetch of the driver */
+
+    void (*release_data_callback) (void *, size_t); /**< page release of the driver */
+
     unsigned int num_vcpus; /**< number of VCPUs used by this instance */
 
     int event_listener_required; /**< Non-zero if event listener is required for the domain to run */
@@ -153,6 +197,32 @@ struct vmi_instance {
     gboolean event_callback; /**< flag indicating that libvmi is currently issuing an event callback */
 
     GHashTable *clear_events; /**< table to save vmi_clear_event requests when event_callback is set */
+
+    read_async_t *read_async; /**< workers and completions of vmi_read_async */
+
+    guint async_workers; /**< size of the vmi_read_async pool, 0 for the default */
+
+    gboolean stats_enabled; /**< nonzero to collect latency statistics */
+
+    vmi_stat_histogram_t stats[VMI_STAT_MAX]; /**< latency statistics, updated atomically */
+
+    char *init_cache; /**< file caching the OS init state, NULL if disabled */
+
+    char *init_cache_identity; /**< identity of the target stored in init_cache */
+
+    gint os_pending;        /**< TRUE while the OS init deferred by VMI_INIT_LAZY hasn't run */
+
+    gboolean os_initializing; /**< TRUE while the deferred OS init runs */
+
+    status_t os_status;     /**< result of the deferred OS init */
+
+    GRecMutex os_init_lock; /**< serializes the deferred OS init */
+
+    gint v2p_generation;    /**< bumped by every v2p cache flush and VM resume */
+
+    struct v2p_neg_entry *v2p_neg_cache; /**< unmapped ranges, see v2p_neg_cache_get */
+
+    GMutex v2p_neg_lock;    /**< protects v2p_neg_cache */
 };
 
 /** Page-level memevent struct to also hold byte-level events in the embedded hashtable */
@@ -198,6 +268,15 @@ addr_t canonical_addr(addr_t va) {
     return VMI_GET_BIT(va, 47) ? (va | 0xffff000000000000) : va;
 }
 
+/* runs the OS init deferred by VMI_INIT_LAZY before the first use of
+   kpgd, init_task, the page mode or the OS interface */
+static inline
+void os_init_lazy(vmi_instance_t vmi) {
+    if (G_UNLIKELY(g_atomic_int_get(&vmi->os_pending))) {
+        vmi_init_prefetch(vmi);
+    }
+}
+
 /*----------------------------------------------
  * convenience.c
  */
@@ -243,6 +322,52 @@ status_t vmi_pagetable_lookup_cache(
     addr_t vaddr,
     addr_t *paddr);
 
+/*-------------------------------------
+ * init_cache.c
+ */
+    typedef status_t (*init_cache_check_t) (
+    vmi_instance_t vmi,
+    GKeyFile *cache);
+    char *init_cache_file_identity(
+    const char *path);
+    void init_cache_open(
+    vmi_instance_t vmi);
+    GKeyFile *init_cache_load(
+    vmi_instance_t vmi);
+    gboolean init_cache_get(
+    GKeyFile *cache,
+    const char *key,
+    uint64_t *value);
+    void init_cache_set(
+    GKeyFile *cache,
+    const char *key,
+    uint64_t value);
+    char *init_cache_get_string(
+    GKeyFile *cache,
+    const char *key);
+    void init_cache_set_string(
+    GKeyFile *cache,
+    const char *key,
+    const char *value);
+    char *init_cache_page_digest(
+    vmi_instance_t vmi,
+    addr_t paddr);
+    status_t init_cache_restore(
+    vmi_instance_t vmi,
+    GKeyFile *cache,
+    init_cache_check_t check);
+    GKeyFile *init_cache_new(
+    vmi_instance_t vmi);
+    void init_cache_save(
+    vmi_instance_t vmi,
+    GKeyFile *cache);
+
+/*-------------------------------------
+ * read_async.c
+ */
+    void read_async_destroy(
+    vmi_instance_t vmi);
+
 /*-------------------------------------
  * cache.c
  */
@@ -330,6 +455,15 @@ status_t vmi_pagetable_lookup_cache(
     addr_t dtb);
     void v2p_cache_flush(
     vmi_instance_t vmi);
+    status_t v2p_neg_cache_get(
+    vmi_instance_t vmi,
+    addr_t va,
+    addr_t dtb);
+    void v2p_neg_cache_set(
+    vmi_instance_t vmi,
+    addr_t va,
+    addr_t dtb,
+    const page_info_t *info);
 #if ENABLE_SHM_SNAPSHOT == 1
     void v2m_cache_init(
     vmi_instance_t vmi);
@@ -361,6 +495,13 @@ status_t vmi_pagetable_lookup_cache(
 
     status_t find_page_mode_live(
     vmi_instance_t vmi);
+    gboolean memory_map_contains(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    size_t length);
+    addr_t memory_map_next(
+    vmi_instance_t vmi,
+    addr_t paddr);
 
 /*-----------------------------------------
  * strmatch.c
@@ -389,6 +530,39 @@ status_t vmi_pagetable_lookup_cache(
     );
     void timer_stop(
     const char *id);
+    uint64_t stat_clock(
+    void);
+    void stat_record(
+    vmi_instance_t vmi,
+    vmi_stat_t stat,
+    uint64_t start);
+
+/* start timing an operation, stat_record ignores a start of 0 */
+static inline
+uint64_t stat_start(vmi_instance_t vmi) {
+    return vmi->stats_enabled ? stat_clock() : 0;
+}
+
+/*
+ * Reads, page table walks, symbol lookups and OS inits in progress on this
+ * thread. What libvmi reads under one of them is for itself and is not
+ * recorded as VMI_STAT_READ, so that stat only counts the caller's reads.
+ */
+extern __thread unsigned int stat_depth;
+
+/* start timing one of them, pair with stat_leave */
+static inline
+uint64_t stat_enter(vmi_instance_t vmi, vmi_stat_t stat) {
+    if (stat_depth++ && VMI_STAT_READ == stat)
+        return 0;
+    return stat_start(vmi);
+}
+
+static inline
+void stat_leave(vmi_instance_t vmi, vmi_stat_t stat, uint64_t start) {
+    stat_depth--;
+    stat_record(vmi, stat, start);
+}
 
 /*----------------------------------------------
  * events.c
@@ -30,11 +30,12 @@
 
 #include "private.h"
 #include "driver/driver_wrapper.h"
+#include "driver/memory_cache.h"
 
 ///////////////////////////////////////////////////////////
 // Classic read functions for access to memory
-size_t
-vmi_read(
+static size_t
+read_memory(
     vmi_instance_t vmi,
     access_context_t *ctx,
     void *buf,
@@ -58,6 +59,10 @@ vmi_read(
         return 0;
     }
 
+    if (VMI_TM_NONE != ctx->translate_mechanism) {
+        os_init_lazy(vmi);
+    }
+
     switch (ctx->translate_mechanism) {
         case VMI_TM_NONE:
             start_addr = ctx->addr;
@@ -111,8 +116,12 @@ vmi_read(
         /* access the memory */
         pfn = paddr >> vmi->page_shift;
         offset = (vmi->page_size - 1) & paddr;
+
+        /* keep the page from being evicted by other threads while copying */
+        memory_cache_lock(vmi, paddr);
         memory = vmi_read_page(vmi, pfn);
         if (NULL == memory) {
+            memory_cache_unlock(vmi, paddr);
             return buf_offset;
         }
 
@@ -125,6 +134,7 @@ vmi_read(
 
         /* do the read */
         memcpy(((char *) buf) + (addr_t) buf_offset, memory + (addr_t) offset, read_len);
+        memory_cache_unlock(vmi, paddr);
 
         /* set variables for next loop */
         count -= read_len;
@@ -134,6 +144,19 @@ vmi_read(
     return buf_offset;
 }
 
+size_t
+vmi_read(
+    vmi_instance_t vmi,
+    access_context_t *ctx,
+    void *buf,
+    size_t count)
+{
+    uint64_t start = stat_enter(vmi, VMI_STAT_READ);
+    size_t ret = read_memory(vmi, ctx, buf, count);
+
+    stat_leave(vmi, VMI_STAT_READ, start);
+    return ret;
+}
 
 // Reads memory at a guest's physical address
 size_t
@@ -151,6 +174,183 @@ vmi_read_pa(
     return vmi_read(vmi, &ctx, buf, count);
 }
 
+status_t
+vmi_prefetch_pa(
+    vmi_instance_t vmi,
+    addr_t paddr,
+    size_t count)
+{
+    if (!count) {
+        return VMI_SUCCESS;
+    }
+
+    return driver_prefetch(vmi, paddr, count);
+}
+
+///////////////////////////////////////////////////////////
+// Compiled access contexts
+struct vmi_compiled_ctx {
+    addr_t addr;            /**< physical or virtual address of the context */
+    addr_t dtb;             /**< 0 for physical addresses */
+    uint8_t width;          /**< address width of the page mode */
+    GMutex lock;            /**< guards the three below, threads may share a handle */
+    gint generation;        /**< v2p_generation the page below was read in */
+    addr_t vpage;           /**< last page translated */
+    addr_t ppage;           /**< its physical address */
+};
+
+vmi_compiled_ctx_t
+vmi_ctx_compile(
+    vmi_instance_t vmi,
+    const access_context_t *ctx)
+{
+    vmi_compiled_ctx_t cctx = NULL;
+    addr_t addr = 0;
+    addr_t dtb = 0;
+
+    if (!vmi || !ctx) {
+        return NULL;
+    }
+
+    if (VMI_TM_NONE != ctx->translate_mechanism) {
+        os_init_lazy(vmi);
+    }
+
+    switch (ctx->translate_mechanism) {
+        case VMI_TM_NONE:
+            addr = ctx->addr;
+            break;
+        case VMI_TM_KERNEL_SYMBOL:
+            dtb = vmi->kpgd;
+            addr = vmi_translate_ksym2v(vmi, ctx->ksym);
+            if (!addr) {
+                dbprint(VMI_DEBUG_READ, "--%s: unknown symbol %s\n", __FUNCTION__, ctx->ksym);
+                return NULL;
+            }
+            break;
+        case VMI_TM_PROCESS_PID:
+            dtb = ctx->pid ? vmi_pid_to_dtb(vmi, ctx->pid) : vmi->kpgd;
+            addr = ctx->addr;
+            break;
+        case VMI_TM_PROCESS_DTB:
+            dtb = ctx->dtb;
+            addr = ctx->addr;
+            break;
+        default:
+            errprint("%s error: translation mechanism is not defined.\n", __FUNCTION__);
+            return NULL;
+    }
+
+    if (VMI_TM_NONE != ctx->translate_mechanism && (!dtb || !vmi->arch_interface)) {
+        dbprint(VMI_DEBUG_READ, "--%s: no page table to translate with\n", __FUNCTION__);
+        return NULL;
+    }
+
+    cctx = g_malloc0(sizeof(struct vmi_compiled_ctx));
+    cctx->addr = addr;
+    cctx->dtb = dtb;
+    cctx->width = (VMI_PM_IA32E == vmi_get_page_mode(vmi)) ? 8 : 4;
+    cctx->vpage = ~0ULL;
+    g_mutex_init(&cctx->lock);
+    return cctx;
+}
+
+size_t
+vmi_read_compiled(
+    vmi_instance_t vmi,
+    vmi_compiled_ctx_t cctx,
+    addr_t offset,
+    void *buf,
+    size_t count)
+{
+    uint64_t start = stat_enter(vmi, VMI_STAT_READ);
+    addr_t vaddr = cctx->addr + offset;
+    size_t buf_offset = 0;
+    gint generation = g_atomic_int_get(&vmi->v2p_generation);
+
+    while (count > 0) {
+        addr_t vpage = (vaddr + buf_offset) & ~((addr_t) vmi->page_size - 1);
+        addr_t page_offset = (vaddr + buf_offset) & (vmi->page_size - 1);
+        addr_t paddr = vpage;
+        unsigned char *memory = NULL;
+        size_t read_len = vmi->page_size - page_offset;
+
+        if (read_len > count) {
+            read_len = count;
+        }
+
+        if (cctx->dtb) {
+            gboolean hit = FALSE;
+
+            g_mutex_lock(&cctx->lock);
+            if (vpage == cctx->vpage && generation == cctx->generation) {
+                hit = TRUE;
+                paddr = cctx->ppage;
+            }
+            g_mutex_unlock(&cctx->lock);
+
+            /* walked unlocked, the lookup is safe to run from several threads */
+            if (!hit) {
+                if (VMI_SUCCESS != vmi_pagetable_lookup_cache(vmi, cctx->dtb, vpage, &paddr)) {
+                    break;
+                }
+                g_mutex_lock(&cctx->lock);
+                cctx->vpage = vpage;
+                cctx->ppage = paddr;
+                cctx->generation = generation;
+                g_mutex_unlock(&cctx->lock);
+            }
+        }
+        paddr += page_offset;
+
+        memory_cache_lock(vmi, paddr);
+        memory = vmi_read_page(vmi, paddr >> vmi->page_shift);
+        if (NULL == memory) {
+            memory_cache_unlock(vmi, paddr);
+            break;
+        }
+        memcpy((char *) buf + buf_offset, memory + page_offset, read_len);
+        memory_cache_unlock(vmi, paddr);
+
+        count -= read_len;
+        buf_offset += read_len;
+    }
+
+    stat_leave(vmi, VMI_STAT_READ, start);
+    return buf_offset;
+}
+
+status_t
+vmi_read_addr_compiled(
+    vmi_instance_t vmi,
+    vmi_compiled_ctx_t cctx,
+    addr_t offset,
+    addr_t *value)
+{
+    if (8 == cctx->width) {
+        return (vmi_read_compiled(vmi, cctx, offset, value, 8) == 8) ? VMI_SUCCESS : VMI_FAILURE;
+    } else {
+        uint32_t tmp = 0;
+
+        if (vmi_read_compiled(vmi, cctx, offset, &tmp, 4) != 4) {
+            return VMI_FAILURE;
+        }
+        *value = (uint64_t) tmp;
+        return VMI_SUCCESS;
+    }
+}
+
+void
+vmi_ctx_free(
+    vmi_compiled_ctx_t cctx)
+{
+    if (!cctx) {
+        return;
+    }
+    g_mutex_clear(&cctx->lock);
+    g_free(cctx);
+}
+
 size_t
 vmi_read_va(
     vmi_instance_t vmi,
@@ -243,6 +443,10 @@ vmi_read_addr(
 {
     status_t ret = VMI_FAILURE;
 
+    if (VMI_PM_UNKNOWN == vmi->page_mode) {
+        os_init_lazy(vmi);
+    }
+
     switch (vmi->page_mode) {
         case VMI_PM_IA32E:
             ret = vmi_read_X(vmi, ctx, value, 8);
@@ -281,6 +485,10 @@ vmi_read_str(
 
     rtnval = NULL;
 
+    if (VMI_TM_NONE != ctx->translate_mechanism) {
+        os_init_lazy(vmi);
+    }
+
     switch (ctx->translate_mechanism) {
         case VMI_TM_NONE:
             addr = ctx->addr;
@@ -323,8 +531,10 @@ vmi_read_str(
         /* access the memory */
         pfn = paddr >> vmi->page_shift;
         offset = (vmi->page_size - 1) & paddr;
+        memory_cache_lock(vmi, paddr);
         memory = vmi_read_page(vmi, pfn);
         if (NULL == memory) {
+            memory_cache_unlock(vmi, paddr);
             return rtnval;
         }
 
@@ -344,6 +554,7 @@ vmi_read_str(
          */
         rtnval = realloc(rtnval, len + 1 + read_len);
         memcpy(&rtnval[len], &memory[offset], read_len);
+        memory_cache_unlock(vmi, paddr);
         len += read_len;
         rtnval[len] = '\0';
     }
@@ -414,6 +625,10 @@ vmi_read_addr_pa(
 {
     status_t ret = VMI_FAILURE;
 
+    if (VMI_PM_UNKNOWN == vmi->page_mode) {
+        os_init_lazy(vmi);
+    }
+
     switch(vmi->page_mode) {
         case VMI_PM_IA32E:
             ret = vmi_read_X_pa(vmi, paddr, value, 8);
@@ -518,6 +733,10 @@ vmi_read_addr_va(
 {
     status_t ret = VMI_FAILURE;
 
+    if (VMI_PM_UNKNOWN == vmi->page_mode) {
+        os_init_lazy(vmi);
+    }
+
     switch(vmi->page_mode) {
         case VMI_PM_IA32E:
             ret = vmi_read_X_va(vmi, vaddr, pid, value, 8);
@@ -558,6 +777,7 @@ vmi_read_str_va(
 unicode_string_t *
 vmi_read_unicode_str_va(vmi_instance_t vmi, addr_t vaddr, vmi_pid_t pid) {
     unicode_string_t *ret = NULL;
+    os_init_lazy(vmi);
     if (vmi->os_interface && vmi->os_interface->os_read_unicode_struct) {
         ret = vmi->os_interface->os_read_unicode_struct(vmi, vaddr, pid);
     }
@@ -628,6 +848,10 @@ vmi_read_addr_ksym(
 {
     status_t ret = VMI_FAILURE;
 
+    if (VMI_PM_UNKNOWN == vmi->page_mode) {
+        os_init_lazy(vmi);
+    }
+
     switch(vmi->page_mode) {
         case VMI_PM_IA32E:
             ret = vmi_read_X_ksym(vmi, sym, value, 8);
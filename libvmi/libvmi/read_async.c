@@ -0,0 +1,245 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "private.h"
+#include "driver/driver_wrapper.h"
+
+/*
+ * Asynchronous reads are run by a pool of workers calling vmi_read on the
+ * instance itself, so they share its translation and page caches: misses
+ * of several workers on a page are fetched once, and a flush of the
+ * instance reaches them. The driver fetches are serialized by the driver
+ * lock; physical reads are handed to the driver as a prefetch hint first,
+ * which lets drivers with a real prefetch keep many fetches in flight.
+ */
+
+#define ASYNC_READ_WORKERS 8
+
+typedef struct read_async_req {
+    vmi_read_completion_t completion;
+    vmi_read_callback_t callback;
+    char *ksym;
+} read_async_req_t;
+
+struct read_async {
+    GThreadPool *pool;
+    GMutex lock;
+    GCond cond;
+    GQueue done;            /**< completions waiting to be reaped */
+    guint outstanding;      /**< requests submitted and not yet reaped */
+    int fd;                 /**< eventfd, readable while done isn't empty */
+};
+
+static void
+read_async_worker(
+    gpointer data,
+    gpointer user_data)
+{
+    read_async_req_t *req = data;
+    vmi_instance_t vmi = user_data;
+    read_async_t *async = vmi->read_async;
+    vmi_read_completion_t *completion = &req->completion;
+    access_context_t ctx = completion->ctx;
+    uint64_t one = 1;
+
+    ctx.ksym = req->ksym;
+    completion->bytes_read = vmi_read(vmi, &ctx, completion->buf, completion->count);
+    g_free(req->ksym);
+
+    if (req->callback) {
+        req->callback(vmi, completion);
+        g_free(req);
+
+        g_mutex_lock(&async->lock);
+        async->outstanding--;
+        g_cond_broadcast(&async->cond);
+        g_mutex_unlock(&async->lock);
+        return;
+    }
+
+    g_mutex_lock(&async->lock);
+    g_queue_push_tail(&async->done, req);
+    if (write(async->fd, &one, sizeof(one)) != sizeof(one)) {
+        dbprint(VMI_DEBUG_READ, "--failed to signal async read completion\n");
+    }
+    g_cond_broadcast(&async->cond);
+    g_mutex_unlock(&async->lock);
+}
+
+static read_async_t *
+read_async_init(
+    vmi_instance_t vmi)
+{
+    read_async_t *async = g_malloc0(sizeof(read_async_t));
+    gint workers = vmi->async_workers ? vmi->async_workers : ASYNC_READ_WORKERS;
+
+    async->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (async->fd < 0) {
+        errprint("Failed to create eventfd for async reads: %s\n", strerror(errno));
+        g_free(async);
+        return NULL;
+    }
+
+    async->pool = g_thread_pool_new(read_async_worker, vmi, workers, FALSE, NULL);
+    if (!async->pool) {
+        errprint("Failed to create worker pool for async reads\n");
+        close(async->fd);
+        g_free(async);
+        return NULL;
+    }
+
+    g_mutex_init(&async->lock);
+    g_cond_init(&async->cond);
+    g_queue_init(&async->done);
+
+    dbprint(VMI_DEBUG_READ, "--async reads with %d workers\n", workers);
+    return async;
+}
+
+/* the pool is set up by the first caller, whichever thread that is */
+static read_async_t *
+read_async_get(
+    vmi_instance_t vmi)
+{
+    read_async_t *async = g_atomic_pointer_get(&vmi->read_async);
+
+    if (async)
+        return async;
+
+    g_rec_mutex_lock(&vmi->os_init_lock);
+    if (!vmi->read_async) {
+        g_atomic_pointer_set(&vmi->read_async, read_async_init(vmi));
+    }
+    async = vmi->read_async;
+    g_rec_mutex_unlock(&vmi->os_init_lock);
+    return async;
+}
+
+void
+read_async_destroy(
+    vmi_instance_t vmi)
+{
+    read_async_t *async = vmi->read_async;
+
+    if (!async)
+        return;
+
+    // let the requests in flight finish, their buffers are the caller's
+    g_thread_pool_free(async->pool, FALSE, TRUE);
+    g_queue_foreach(&async->done, (GFunc) g_free, NULL);
+    g_queue_clear(&async->done);
+    g_cond_clear(&async->cond);
+    g_mutex_clear(&async->lock);
+    close(async->fd);
+    g_free(async);
+    vmi->read_async = NULL;
+}
+
+status_t
+vmi_read_async(
+    vmi_instance_t vmi,
+    access_context_t *ctx,
+    void *buf,
+    size_t count,
+    vmi_read_callback_t callback,
+    void *data)
+{
+    read_async_t *async = NULL;
+    read_async_req_t *req = NULL;
+
+    if (!vmi || !ctx || !buf)
+        return VMI_FAILURE;
+
+    if (!(async = read_async_get(vmi)))
+        return VMI_FAILURE;
+
+    req = g_malloc0(sizeof(read_async_req_t));
+    req->completion.ctx = *ctx;
+    req->completion.buf = buf;
+    req->completion.count = count;
+    req->completion.data = data;
+    req->callback = callback;
+    req->ksym = ctx->ksym ? g_strdup(ctx->ksym) : NULL;
+
+    // let drivers that can start fetching right away, e.g. with io_uring
+    if (VMI_TM_NONE == ctx->translate_mechanism) {
+        (void) driver_prefetch(vmi, ctx->addr, count);
+    }
+
+    g_mutex_lock(&async->lock);
+    async->outstanding++;
+    g_mutex_unlock(&async->lock);
+
+    g_thread_pool_push(async->pool, req, NULL);
+    return VMI_SUCCESS;
+}
+
+int
+vmi_read_async_fd(
+    vmi_instance_t vmi)
+{
+    read_async_t *async = read_async_get(vmi);
+
+    return async ? async->fd : -1;
+}
+
+size_t
+vmi_read_async_reap(
+    vmi_instance_t vmi,
+    vmi_read_completion_t *completions,
+    size_t max,
+    uint8_t wait)
+{
+    read_async_t *async = vmi->read_async;
+    size_t reaped = 0;
+    uint64_t value = 0;
+
+    if (!async || !completions)
+        return 0;
+
+    g_mutex_lock(&async->lock);
+
+    while (wait && g_queue_is_empty(&async->done) && async->outstanding) {
+        g_cond_wait(&async->cond, &async->lock);
+    }
+
+    while (reaped < max && !g_queue_is_empty(&async->done)) {
+        read_async_req_t *req = g_queue_pop_head(&async->done);
+
+        completions[reaped++] = req->completion;
+        async->outstanding--;
+        g_free(req);
+    }
+
+    // the fd stays readable as long as there are completions to reap
+    if (g_queue_is_empty(&async->done) && read(async->fd, &value, sizeof(value)) < 0) {
+        value = 0;
+    }
+
+    g_mutex_unlock(&async->lock);
+    return reaped;
+}
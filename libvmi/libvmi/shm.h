@@ -64,7 +64,7 @@ status_t vmi_shm_snapshot_destroy(
 /**
  * Direct Guest Physical Memory Access:  A similar memory read semantic to
  *  vmi_read_pa() but a non-copy direct access.
- * Note that it is only capable for shm-snapshot.
+ * Note that it is only capable for shm-snapshot and file mode.
  * @param[in] vmi LibVMI instance
  * @param[in] paddr
  * @param[out] medial_addr_ptr
@@ -79,8 +79,10 @@ size_t vmi_get_dgpma(
 
 /**
  * Direct Guest Virtual Memory Access:  A similar memory read semantic to
- *  vmi_read_pa() but a non-copy direct access.
- * Note that it is only capable for shm-snapshot.
+ *  vmi_read_va() but a non-copy direct access.
+ * Note that it is only capable for shm-snapshot and file mode. In file mode
+ *  the address space of a pid is mapped from the memory image on first use
+ *  and stays mapped until vmi_destroy().
  * @param[in] vmi LibVMI instance
  * @param[in] vaddr
  * @param[in] pid
@@ -0,0 +1,298 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+#include "os/windows/windows.h"
+#include "os/linux/linux.h"
+
+/*
+ * Struct snapshots: the member offsets are resolved once, from the Rekall
+ * profile or from the offsets of the config, and every read copies the
+ * bytes from the first to the end of the last member with a single read.
+ * The accessors then work on the local copy.
+ */
+
+struct vmi_struct {
+    size_t nmembers;
+    addr_t *offsets;        /**< offset of each member */
+    size_t *lengths;        /**< length of each member */
+    addr_t start;           /**< lowest member offset */
+    size_t span;            /**< bytes copied by a read */
+    size_t valid;           /**< bytes copied by the last read */
+    unsigned char *data;    /**< the copy */
+};
+
+static const char *
+struct_rekall_profile(
+    vmi_instance_t vmi)
+{
+    if (!vmi->os_data) {
+        return NULL;
+    }
+
+    switch (vmi->os_type) {
+#ifdef ENABLE_LINUX
+        case VMI_OS_LINUX:
+            return ((linux_instance_t) vmi->os_data)->rekall_profile;
+#endif
+#ifdef ENABLE_WINDOWS
+        case VMI_OS_WINDOWS:
+            return ((windows_instance_t) vmi->os_data)->rekall_profile;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+static status_t
+struct_member_offset(
+    vmi_instance_t vmi,
+    const char *rekall_profile,
+    const char *struct_name,
+    const char *member,
+    addr_t *offset)
+{
+    if (struct_name) {
+        return rekall_profile_symbol_to_rva(rekall_profile, struct_name, member, offset);
+    }
+
+    /* the offsets of the config are never 0 */
+    *offset = vmi_get_offset(vmi, (char *) member);
+    return *offset ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+vmi_struct_t
+vmi_struct_new(
+    vmi_instance_t vmi,
+    const char *struct_name,
+    const vmi_struct_member_t *members,
+    size_t nmembers)
+{
+    vmi_struct_t s = NULL;
+    const char *rekall_profile = NULL;
+    addr_t end = 0;
+    size_t i;
+
+    if (!vmi || !members || !nmembers) {
+        return NULL;
+    }
+
+    os_init_lazy(vmi);
+    if (struct_name) {
+        rekall_profile = struct_rekall_profile(vmi);
+        if (!rekall_profile) {
+            dbprint(VMI_DEBUG_READ, "--%s: no Rekall profile for %s\n", __FUNCTION__, struct_name);
+            return NULL;
+        }
+    }
+
+    s = g_malloc0(sizeof(struct vmi_struct));
+    s->nmembers = nmembers;
+    s->offsets = g_malloc0(nmembers * sizeof(addr_t));
+    s->lengths = g_malloc0(nmembers * sizeof(size_t));
+
+    for (i = 0; i < nmembers; i++) {
+        if (!members[i].name || !members[i].length
+            || VMI_FAILURE == struct_member_offset(vmi, rekall_profile, struct_name,
+                                                   members[i].name, &s->offsets[i])) {
+            dbprint(VMI_DEBUG_READ, "--%s: no offset for %s.%s\n", __FUNCTION__,
+                    struct_name ? struct_name : "config", members[i].name ? members[i].name : "");
+            vmi_struct_free(s);
+            return NULL;
+        }
+        s->lengths[i] = members[i].length;
+
+        if (!i || s->offsets[i] < s->start) {
+            s->start = s->offsets[i];
+        }
+        if (s->offsets[i] + s->lengths[i] > end) {
+            end = s->offsets[i] + s->lengths[i];
+        }
+    }
+
+    s->span = end - s->start;
+    s->data = g_malloc0(s->span);
+    return s;
+}
+
+status_t
+vmi_struct_read(
+    vmi_instance_t vmi,
+    vmi_struct_t s,
+    const access_context_t *ctx)
+{
+    access_context_t span_ctx;
+
+    if (!vmi || !s || !ctx) {
+        return VMI_FAILURE;
+    }
+
+    span_ctx = *ctx;
+    span_ctx.addr = ctx->addr + s->start;
+    s->valid = vmi_read(vmi, &span_ctx, s->data, s->span);
+    return s->valid == s->span ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+addr_t
+vmi_struct_offset(
+    vmi_struct_t s,
+    unsigned int member)
+{
+    if (!s || member >= s->nmembers) {
+        return 0;
+    }
+
+    return s->offsets[member];
+}
+
+/* the copy of a member, if the last read got all of it */
+static const unsigned char *
+struct_member(
+    vmi_struct_t s,
+    unsigned int member,
+    size_t length)
+{
+    addr_t offset;
+
+    if (!s || member >= s->nmembers || length > s->lengths[member]) {
+        return NULL;
+    }
+
+    offset = s->offsets[member] - s->start;
+    if (offset + length > s->valid) {
+        return NULL;
+    }
+
+    return s->data + offset;
+}
+
+status_t
+vmi_struct_get_8(
+    vmi_struct_t s,
+    unsigned int member,
+    uint8_t *value)
+{
+    const unsigned char *data = struct_member(s, member, sizeof(uint8_t));
+
+    if (!data) {
+        return VMI_FAILURE;
+    }
+    memcpy(value, data, sizeof(uint8_t));
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_struct_get_16(
+    vmi_struct_t s,
+    unsigned int member,
+    uint16_t *value)
+{
+    const unsigned char *data = struct_member(s, member, sizeof(uint16_t));
+
+    if (!data) {
+        return VMI_FAILURE;
+    }
+    memcpy(value, data, sizeof(uint16_t));
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_struct_get_32(
+    vmi_struct_t s,
+    unsigned int member,
+    uint32_t *value)
+{
+    const unsigned char *data = struct_member(s, member, sizeof(uint32_t));
+
+    if (!data) {
+        return VMI_FAILURE;
+    }
+    memcpy(value, data, sizeof(uint32_t));
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_struct_get_64(
+    vmi_struct_t s,
+    unsigned int member,
+    uint64_t *value)
+{
+    const unsigned char *data = struct_member(s, member, sizeof(uint64_t));
+
+    if (!data) {
+        return VMI_FAILURE;
+    }
+    memcpy(value, data, sizeof(uint64_t));
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_struct_get_addr(
+    vmi_struct_t s,
+    unsigned int member,
+    addr_t *value)
+{
+    uint32_t value32 = 0;
+
+    if (s && member < s->nmembers && 4 == s->lengths[member]) {
+        if (VMI_FAILURE == vmi_struct_get_32(s, member, &value32)) {
+            return VMI_FAILURE;
+        }
+        *value = value32;
+        return VMI_SUCCESS;
+    }
+
+    return vmi_struct_get_64(s, member, value);
+}
+
+char *
+vmi_struct_get_str(
+    vmi_struct_t s,
+    unsigned int member)
+{
+    const unsigned char *data = NULL;
+
+    if (!s || member >= s->nmembers) {
+        return NULL;
+    }
+
+    data = struct_member(s, member, s->lengths[member]);
+    if (!data) {
+        return NULL;
+    }
+
+    return strndup((const char *) data, s->lengths[member]);
+}
+
+void
+vmi_struct_free(
+    vmi_struct_t s)
+{
+    if (!s) {
+        return;
+    }
+
+    g_free(s->offsets);
+    g_free(s->lengths);
+    g_free(s->data);
+    g_free(s);
+}
@@ -0,0 +1,319 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+
+/*
+ * Walks of circular doubly linked lists (list_head, LIST_ENTRY). Each step
+ * depends on the pointer read in the step before, so the pages of the next
+ * node are handed to the driver as a prefetch hint as soon as its address
+ * is known, and fetched while the fields of the current node are copied.
+ */
+
+#define WALK_LIST_MAX_NODES 0x100000
+
+struct walk_state {
+    vmi_instance_t vmi;
+    access_context_t ctx;   /**< translation of the list's address space */
+    uint8_t width;          /**< pointer width */
+    addr_t span_start;      /**< lowest field offset */
+    size_t span_len;        /**< bytes from the lowest field to the end of the highest */
+    gboolean prefetch;      /**< cleared once the driver can't prefetch */
+    size_t capacity;        /**< records allocated */
+};
+
+static status_t
+walk_read_links(
+    struct walk_state *walk,
+    addr_t link,
+    addr_t *next,
+    addr_t *prev)
+{
+    uint64_t links[2] = { 0, 0 };
+
+    walk->ctx.addr = link;
+    if (vmi_read(walk->vmi, &walk->ctx, links, 2 * walk->width) != 2 * walk->width) {
+        return VMI_FAILURE;
+    }
+
+    if (8 == walk->width) {
+        *next = links[0];
+        *prev = links[1];
+    } else {
+        *next = ((uint32_t *) links)[0];
+        *prev = ((uint32_t *) links)[1];
+    }
+    return VMI_SUCCESS;
+}
+
+static void
+walk_prefetch(
+    struct walk_state *walk,
+    addr_t vaddr,
+    size_t len)
+{
+    vmi_instance_t vmi = walk->vmi;
+    addr_t page = vaddr & ~((addr_t) vmi->page_size - 1);
+    addr_t paddr = 0;
+
+    for (; walk->prefetch && page < vaddr + len; page += vmi->page_size) {
+        if (VMI_SUCCESS != vmi_pagetable_lookup_cache(vmi, walk->ctx.dtb, page, &paddr)) {
+            continue;
+        }
+        if (VMI_FAILURE == vmi_prefetch_pa(vmi, paddr, vmi->page_size)) {
+            walk->prefetch = FALSE;
+        }
+    }
+}
+
+/* appends the record of a node to the result */
+static status_t
+walk_capture(
+    struct walk_state *walk,
+    addr_t node,
+    const vmi_list_field_t *fields,
+    size_t nfields,
+    unsigned char *span,
+    vmi_list_walk_t *result)
+{
+    unsigned char *record = NULL;
+    size_t i;
+
+    walk->ctx.addr = node + walk->span_start;
+    if (walk->span_len
+        && vmi_read(walk->vmi, &walk->ctx, span, walk->span_len) != walk->span_len) {
+        dbprint(VMI_DEBUG_READ, "--%s: failed to read node 0x%"PRIx64"\n", __FUNCTION__, node);
+        return VMI_FAILURE;
+    }
+
+    if (result->count == walk->capacity) {
+        walk->capacity = walk->capacity ? 2 * walk->capacity : 64;
+        result->records = g_realloc(result->records, walk->capacity * result->record_size);
+    }
+
+    record = result->records + result->count * result->record_size;
+    memcpy(record, &node, sizeof(addr_t));
+    record += sizeof(addr_t);
+    for (i = 0; i < nfields; i++) {
+        memcpy(record, span + (fields[i].offset - walk->span_start), fields[i].length);
+        record += fields[i].length;
+    }
+
+    result->count++;
+    return VMI_SUCCESS;
+}
+
+/* with a key, only the record of a node whose first field matches is kept */
+static gboolean
+walk_match(
+    const vmi_list_field_t *fields,
+    const void *key,
+    vmi_list_walk_t *result)
+{
+    unsigned char *record = result->records + (result->count - 1) * result->record_size;
+
+    if (!memcmp(record + sizeof(addr_t), key, fields[0].length)) {
+        return TRUE;
+    }
+    result->count--;
+    return FALSE;
+}
+
+static status_t
+walk_list(
+    vmi_instance_t vmi,
+    addr_t head,
+    vmi_pid_t pid,
+    addr_t link_offset,
+    const vmi_list_field_t *fields,
+    size_t nfields,
+    size_t max_nodes,
+    uint32_t flags,
+    const void *key,
+    vmi_list_walk_t *result)
+{
+    status_t status = VMI_FAILURE;
+    struct walk_state walk;
+    unsigned char *span = NULL;
+    addr_t link = 0, next = 0, prev = 0, link_prev = 0, span_end = 0;
+    size_t i, visited = 0;
+
+    if (!vmi || !result || (nfields && !fields)) {
+        return VMI_FAILURE;
+    }
+
+    memset(result, 0, sizeof(*result));
+    memset(&walk, 0, sizeof(walk));
+    walk.vmi = vmi;
+    walk.prefetch = TRUE;
+    walk.ctx.translate_mechanism = VMI_TM_PROCESS_DTB;
+    walk.ctx.dtb = vmi_pid_to_dtb(vmi, pid);
+    if (!walk.ctx.dtb) {
+        dbprint(VMI_DEBUG_READ, "--%s: no dtb for pid %d\n", __FUNCTION__, pid);
+        return VMI_FAILURE;
+    }
+
+    switch (vmi_get_page_mode(vmi)) {
+        case VMI_PM_IA32E:
+            walk.width = 8;
+            break;
+        case VMI_PM_AARCH32:// intentional fall-through
+        case VMI_PM_LEGACY: // intentional fall-through
+        case VMI_PM_PAE:
+            walk.width = 4;
+            break;
+        default:
+            return VMI_FAILURE;
+    }
+
+    /* the fields are read from the node with a single read */
+    result->record_size = sizeof(addr_t);
+    walk.span_start = nfields ? fields[0].offset : 0;
+    for (i = 0; i < nfields; i++) {
+        if (fields[i].offset < walk.span_start) {
+            walk.span_start = fields[i].offset;
+        }
+        if (fields[i].offset + fields[i].length > span_end) {
+            span_end = fields[i].offset + fields[i].length;
+        }
+        result->record_size += fields[i].length;
+    }
+    walk.span_len = nfields ? span_end - walk.span_start : 0;
+    span = g_malloc0(walk.span_len + 1);
+
+    if (!max_nodes) {
+        max_nodes = WALK_LIST_MAX_NODES;
+    }
+
+    if (VMI_FAILURE == walk_read_links(&walk, head, &next, &prev)) {
+        dbprint(VMI_DEBUG_READ, "--%s: failed to read the list head\n", __FUNCTION__);
+        goto done;
+    }
+
+    if (flags & VMI_WALK_INCLUDE_HEAD) {
+        walk_prefetch(&walk, next, 2 * walk.width);
+        if (VMI_FAILURE == walk_capture(&walk, head - link_offset, fields, nfields, span, result)) {
+            goto done;
+        }
+        visited++;
+        if (key && walk_match(fields, key, result)) {
+            status = VMI_SUCCESS;
+            goto done;
+        }
+    }
+
+    prev = head;
+    link = next;
+    while (link != head) {
+        /* not result->count, a search only keeps the matching node */
+        if (visited == max_nodes) {
+            dbprint(VMI_DEBUG_READ, "--%s: stopped after %zu nodes\n", __FUNCTION__, max_nodes);
+            goto done;
+        }
+
+        if (VMI_FAILURE == walk_read_links(&walk, link, &next, &link_prev)) {
+            dbprint(VMI_DEBUG_READ, "--%s: bad link 0x%"PRIx64"\n", __FUNCTION__, link);
+            goto done;
+        }
+
+        /* a node entered from another one than its predecessor means a
+           corrupted list, or a cycle that doesn't go through the head */
+        if (link_prev != prev) {
+            dbprint(VMI_DEBUG_READ, "--%s: broken back link at 0x%"PRIx64"\n", __FUNCTION__, link);
+            goto done;
+        }
+
+        /* the next node is fetched while this one is copied */
+        if (next != head) {
+            walk_prefetch(&walk, next, 2 * walk.width);
+            walk_prefetch(&walk, next - link_offset + walk.span_start, walk.span_len);
+        }
+
+        if (VMI_FAILURE == walk_capture(&walk, link - link_offset, fields, nfields, span, result)) {
+            goto done;
+        }
+        visited++;
+        if (key && walk_match(fields, key, result)) {
+            status = VMI_SUCCESS;
+            goto done;
+        }
+
+        prev = link;
+        link = next;
+    }
+
+    /* a search that came back to the head found nothing */
+    status = key ? VMI_FAILURE : VMI_SUCCESS;
+
+done:
+    g_free(span);
+    return status;
+}
+
+status_t
+vmi_walk_list(
+    vmi_instance_t vmi,
+    addr_t head,
+    vmi_pid_t pid,
+    addr_t link_offset,
+    const vmi_list_field_t *fields,
+    size_t nfields,
+    size_t max_nodes,
+    uint32_t flags,
+    vmi_list_walk_t *result)
+{
+    return walk_list(vmi, head, pid, link_offset, fields, nfields, max_nodes, flags, NULL, result);
+}
+
+status_t
+vmi_walk_list_find(
+    vmi_instance_t vmi,
+    addr_t head,
+    vmi_pid_t pid,
+    addr_t link_offset,
+    const vmi_list_field_t *fields,
+    size_t nfields,
+    uint32_t flags,
+    const void *key,
+    vmi_list_walk_t *result)
+{
+    if (!nfields || !key) {
+        if (result) {
+            memset(result, 0, sizeof(*result));
+        }
+        return VMI_FAILURE;
+    }
+
+    return walk_list(vmi, head, pid, link_offset, fields, nfields, 0, flags, key, result);
+}
+
+void
+vmi_walk_list_free(
+    vmi_list_walk_t *result)
+{
+    if (!result) {
+        return;
+    }
+
+    g_free(result->records);
+    memset(result, 0, sizeof(*result));
+}
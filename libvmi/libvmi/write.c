@@ -55,6 +55,10 @@ vmi_write(
         return 0;
     }
 
+    if (VMI_TM_NONE != ctx->translate_mechanism) {
+        os_init_lazy(vmi);
+    }
+
     switch (ctx->translate_mechanism) {
         case VMI_TM_NONE:
             start_addr = ctx->addr;
@@ -237,6 +241,10 @@ vmi_write_addr(
     access_context_t *ctx,
     addr_t * value)
 {
+    if (VMI_PM_UNKNOWN == vmi->page_mode) {
+        os_init_lazy(vmi);
+    }
+
     switch(vmi->page_mode) {
         case VMI_PM_IA32E:
             return vmi_write_X(vmi, ctx, value, 8);
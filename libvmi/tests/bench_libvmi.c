@@ -0,0 +1,522 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmarks of the internal data structures: the address and page
+ * caches, Boyer-Moore matching, page table walks, string conversion and PE
+ * export lookups. They run on buffers built here with fixed seeds, so the
+ * numbers are repeatable without a VM. Every benchmark prints one JSON
+ * object per line with its ns/op and allocations/op.
+ *
+ * Built and run by "make bench" in this directory.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <glib.h>
+#include "../libvmi/libvmi.h"
+#include "../libvmi/libvmi_extra.h"
+#include "../libvmi/peparse.h"
+#include "../libvmi/private.h"
+#include "../libvmi/driver/memory_cache.h"
+#include "../libvmi/os/windows/windows.h"
+
+#define PAGE_SIZE       0x1000ULL
+#define MEMORY_SIZE     (8ULL << 20)
+#define KERNEL_PGD      0x1000ULL
+#define USER_PGD        0x2000ULL
+#define PE_PHYS         0x100000ULL
+#define PE_SIZE         0x100000ULL
+#define PE_BASE         0xfffff80000000000ULL
+#define TABLES_PHYS     0x200000ULL
+#define NR_EXPORTS      1024
+#define NR_USER_RANGES  64
+#define USER_RANGE      64      // pages
+
+/*
+ * Allocation counting
+ *
+ * Interposes the glibc allocator, which glib and LibVMI go through as
+ * well. GSlice is switched to malloc in main so its allocations count.
+ */
+
+static uint64_t allocs;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+static uint64_t seed;
+
+static uint64_t
+random64(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t bench_ns;
+static uint64_t bench_allocs;
+
+static void
+bench_start(void)
+{
+    bench_allocs = __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+    bench_ns = now_ns();
+}
+
+static void
+bench_stop(const char *benchmark, uint64_t ops)
+{
+    uint64_t ns = now_ns() - bench_ns;
+    uint64_t count = __atomic_load_n(&allocs, __ATOMIC_RELAXED) - bench_allocs;
+
+    printf("{\"benchmark\": \"%s\", \"ops\": %"PRIu64", \"ns_per_op\": %.1f, ",
+           benchmark, ops, (double) ns / ops);
+#ifdef __GLIBC__
+    printf("\"allocs_per_op\": %.2f}\n", (double) count / ops);
+#else
+    (void) count;
+    printf("\"allocs_per_op\": null}\n");
+#endif
+}
+
+static int
+check(int ok, const char *benchmark)
+{
+    if (!ok)
+        fprintf(stderr, "%s: wrong result\n", benchmark);
+    return !ok;
+}
+
+/*
+ * Guest memory: a PE image mapped in the kernel and scattered user pages
+ * in a second address space, both with IA-32e page tables.
+ */
+
+static unsigned char *memory;
+static addr_t next_table = TABLES_PHYS;
+
+static uint64_t
+get64(addr_t pa)
+{
+    uint64_t value;
+
+    memcpy(&value, memory + pa, sizeof(value));
+    return value;
+}
+
+static void
+put64(addr_t pa, uint64_t value)
+{
+    memcpy(memory + pa, &value, sizeof(value));
+}
+
+static void
+map_page(addr_t pgd, addr_t va, addr_t pa)
+{
+    addr_t table = pgd;
+    int level;
+
+    for (level = 4; level > 1; level--) {
+        addr_t entry = table + ((va >> (12 + 9 * (level - 1))) & 0x1ff) * 8;
+
+        if (!(get64(entry) & 1)) {
+            memset(memory + next_table, 0, PAGE_SIZE);
+            put64(entry, next_table | 0x7);
+            next_table += PAGE_SIZE;
+        }
+        table = get64(entry) & 0xffffffffff000ULL;
+    }
+    put64(table + ((va >> 12) & 0x1ff) * 8, pa | 0x7);
+}
+
+static addr_t
+export_rva(int index)
+{
+    return 0x80000 + index * 0x10;
+}
+
+static void
+build_pe(void)
+{
+    unsigned char *pe = memory + PE_PHYS;
+    struct dos_header *dos = (struct dos_header *) pe;
+    struct pe_header *nt = (struct pe_header *) (pe + 0x80);
+    struct optional_header_pe32plus *oh =
+        (struct optional_header_pe32plus *) (pe + 0x80 + sizeof(*nt));
+    struct export_table *et = (struct export_table *) (pe + 0x1000);
+    uint32_t name_rva = 0x5000;
+    int i;
+
+    memset(pe, 0, PE_SIZE);
+    dos->signature = IMAGE_DOS_HEADER;
+    dos->offset_to_pe = 0x80;
+    nt->signature = IMAGE_NT_SIGNATURE;
+    nt->machine = 0x8664;
+    nt->size_of_optional_header = sizeof(*oh);
+    oh->magic = IMAGE_PE32_PLUS_MAGIC;
+    oh->number_of_rva_and_sizes = 16;
+
+    et->number_of_functions = NR_EXPORTS;
+    et->number_of_names = NR_EXPORTS;
+    et->address_of_functions = 0x2000;
+    et->address_of_names = 0x3000;
+    et->address_of_name_ordinals = 0x4000;
+    et->name = name_rva;
+    name_rva += sprintf((char *) pe + name_rva, "bench.sys") + 1;
+
+    /* the names are sorted, as the binary search expects */
+    for (i = 0; i < NR_EXPORTS; i++) {
+        uint32_t function = export_rva(i);
+        uint16_t ordinal = i;
+
+        memcpy(pe + et->address_of_functions + i * 4, &function, 4);
+        memcpy(pe + et->address_of_names + i * 4, &name_rva, 4);
+        memcpy(pe + et->address_of_name_ordinals + i * 2, &ordinal, 2);
+        name_rva += sprintf((char *) pe + name_rva, "Export%04d", i) + 1;
+    }
+
+    oh->idd[IMAGE_DIRECTORY_ENTRY_EXPORT].virtual_address = 0x1000;
+    oh->idd[IMAGE_DIRECTORY_ENTRY_EXPORT].size = name_rva - 0x1000;
+}
+
+static void
+build_memory(void)
+{
+    addr_t offset;
+    int i;
+
+    memory = calloc(1, MEMORY_SIZE);
+
+    for (offset = 0; offset < PE_SIZE; offset += PAGE_SIZE) {
+        map_page(KERNEL_PGD, PE_BASE + offset, PE_PHYS + offset);
+    }
+    build_pe();
+
+    seed = 0x9a6e;
+    for (i = 0; i < NR_USER_RANGES; i++) {
+        addr_t va = (random64() % 0x7fff00000ULL) << 12;
+        int page;
+
+        for (page = 0; page < USER_RANGE; page++) {
+            map_page(USER_PGD, va + page * PAGE_SIZE, PE_PHYS + page * PAGE_SIZE);
+        }
+    }
+}
+
+static vmi_instance_t
+init_vmi(const char *sysmap)
+{
+    vmi_instance_t vmi = NULL;
+    GHashTable *config = g_hash_table_new(g_str_hash, g_str_equal);
+    uint64_t memory_size = MEMORY_SIZE;
+    uint64_t register_count = 4;
+    vmi_memory_register_t registers[] = {
+        { 0, CR0, 1ULL << 31 },
+        { 0, CR3, KERNEL_PGD },
+        { 0, CR4, 1ULL << 5 },
+        { 0, MSR_EFER, 1ULL << 8 },
+    };
+
+    g_hash_table_insert(config, "name", "bench");
+    g_hash_table_insert(config, "memory", memory);
+    g_hash_table_insert(config, "memory_size", &memory_size);
+    g_hash_table_insert(config, "vcpu_registers", registers);
+    g_hash_table_insert(config, "vcpu_register_count", &register_count);
+
+    /* a Linux init just to get kernel virtual addresses */
+    g_hash_table_insert(config, "ostype", "Linux");
+    g_hash_table_insert(config, "sysmap", (char *) sysmap);
+
+    if (VMI_FAILURE == vmi_init_custom(&vmi, VMI_MEMORY | VMI_INIT_COMPLETE | VMI_CONFIG_GHASHTABLE, config))
+        vmi = NULL;
+
+    g_hash_table_destroy(config);
+    return vmi;
+}
+
+/*
+ * Benchmarks
+ */
+
+static int
+bench_v2p_cache(vmi_instance_t vmi, uint64_t ops)
+{
+    int rc = 0;
+    uint64_t i;
+
+    v2p_cache_flush(vmi);
+
+    seed = 0xcac4e;
+    bench_start();
+    for (i = 0; i < ops; i++) {
+        addr_t va = random64() & 0xfffffffff000ULL;
+        v2p_cache_set(vmi, va, USER_PGD + (i & 0xf) * PAGE_SIZE, va >> 12);
+    }
+    bench_stop("v2p_cache_set", ops);
+
+    seed = 0xcac4e;
+    bench_start();
+    for (i = 0; i < ops; i++) {
+        addr_t va = random64() & 0xfffffffff000ULL;
+        addr_t pa = 0;
+
+        if (VMI_SUCCESS == v2p_cache_get(vmi, va, USER_PGD + (i & 0xf) * PAGE_SIZE, &pa))
+            rc |= (pa != va >> 12);
+    }
+    bench_stop("v2p_cache_get_hit", ops);
+
+    seed = 0x3155;
+    bench_start();
+    for (i = 0; i < ops; i++) {
+        addr_t pa = 0;
+        v2p_cache_get(vmi, random64() & 0xfffffffff000ULL, KERNEL_PGD, &pa);
+    }
+    bench_stop("v2p_cache_get_miss", ops);
+
+    v2p_cache_flush(vmi);
+    return check(!rc, "v2p_cache_get_hit");
+}
+
+static void *
+page_data(vmi_instance_t vmi, addr_t paddr, uint32_t length)
+{
+    return memory + (paddr % MEMORY_SIZE);
+}
+
+static void
+page_release(void *data, size_t length)
+{
+}
+
+static int
+bench_memory_cache(uint64_t ops)
+{
+    struct vmi_instance *vmi = calloc(1, sizeof(struct vmi_instance));
+    int rc = 0;
+    uint64_t i;
+
+    vmi->page_size = PAGE_SIZE;
+    vmi->page_shift = 12;
+    g_rec_mutex_init(&vmi->driver_lock);
+    memory_cache_lock_init(vmi);
+    memory_cache_init(vmi, page_data, page_release, 0);
+
+    /* a working set well within the cache */
+    bench_start();
+    for (i = 0; i < ops; i++) {
+        addr_t paddr = (i & 0x3f) * PAGE_SIZE;
+        rc |= (memory_cache_insert(vmi, paddr) != memory + paddr);
+    }
+    bench_stop("memory_cache_insert_hit", ops);
+
+    /* every page is new, so shards keep filling up and evicting */
+    vmi->memory_cache_size_max = 256;
+    bench_start();
+    for (i = 0; i < ops; i++) {
+        addr_t paddr = (0x100 + i) * PAGE_SIZE;
+        rc |= (memory_cache_insert(vmi, paddr) != memory + paddr % MEMORY_SIZE);
+    }
+    bench_stop("memory_cache_insert_evict", ops);
+
+    memory_cache_destroy(vmi);
+    memory_cache_lock_clear(vmi);
+    g_rec_mutex_clear(&vmi->driver_lock);
+    free(vmi);
+    return check(!rc, "memory_cache_insert");
+}
+
+static int
+bench_boyer_moore(uint64_t ops)
+{
+    const int length = 0x10000;
+    unsigned char *haystack = malloc(length);
+    unsigned char needle[16];
+    void *bm = NULL;
+    int rc = 0;
+    uint64_t i;
+    int j;
+
+    seed = 0xb0e7;
+    for (j = 0; j < length; j++) {
+        haystack[j] = random64();
+    }
+    memcpy(needle, haystack + length - 0x100, sizeof(needle));
+
+    bm = boyer_moore_init(needle, sizeof(needle));
+    bench_start();
+    for (i = 0; i < ops; i++) {
+        rc |= (boyer_moore2(bm, haystack, length) != length - 0x100);
+    }
+    bench_stop("boyer_moore2_64k", ops);
+
+    boyer_moore_fini(bm);
+    free(haystack);
+    return check(!rc, "boyer_moore2_64k");
+}
+
+static int
+bench_va_pages(vmi_instance_t vmi, uint64_t ops)
+{
+    int rc = 0;
+    uint64_t i;
+
+    bench_start();
+    for (i = 0; i < ops; i++) {
+        GSList *pages = vmi_get_va_pages(vmi, USER_PGD);
+
+        rc |= (g_slist_length(pages) != NR_USER_RANGES * USER_RANGE);
+        g_slist_free_full(pages, g_free);
+    }
+    bench_stop("get_va_pages_ia32e", ops);
+
+    return check(!rc, "get_va_pages_ia32e");
+}
+
+static int
+bench_convert_str(uint64_t ops)
+{
+    const char *path = "\\SystemRoot\\System32\\ntoskrnl.exe";
+    unsigned char utf16[128];
+    unicode_string_t in = { 0, utf16, "UTF-16LE" };
+    unicode_string_t out;
+    int rc = 0;
+    uint64_t i;
+
+    for (i = 0; path[i]; i++) {
+        utf16[2 * i] = path[i];
+        utf16[2 * i + 1] = 0;
+    }
+    in.length = 2 * i;
+
+    bench_start();
+    for (i = 0; i < ops; i++) {
+        if (VMI_SUCCESS == vmi_convert_str_encoding(&in, &out, "UTF-8")) {
+            rc |= strcmp((char *) out.contents, path);
+            free(out.contents);
+        } else {
+            rc = 1;
+        }
+    }
+    bench_stop("convert_str_encoding", ops);
+
+    return check(!rc, "convert_str_encoding");
+}
+
+static int
+bench_exports(vmi_instance_t vmi, uint64_t ops)
+{
+    int rc = 0;
+    uint64_t i;
+
+    seed = 0xe8907;
+    bench_start();
+    for (i = 0; i < ops; i++) {
+        int index = random64() % NR_EXPORTS;
+        char symbol[16];
+        addr_t rva = 0;
+
+        snprintf(symbol, sizeof(symbol), "Export%04d", index);
+        rc |= (VMI_SUCCESS != windows_export_to_rva(vmi, PE_BASE, 0, symbol, &rva) ||
+               rva != export_rva(index));
+    }
+    bench_stop("peparse_export_to_rva", ops);
+
+    return check(!rc, "peparse_export_to_rva");
+}
+
+int main(int argc, char **argv)
+{
+    char sysmap[] = "/tmp/libvmi_bench_sysmap_XXXXXX";
+    vmi_instance_t vmi = NULL;
+    uint64_t scale = 1;
+    FILE *f = NULL;
+    int fd;
+    int rc = 0;
+
+    if (argc > 2 || (argc == 2 && !(scale = strtoull(argv[1], NULL, 0)))) {
+        printf("Usage: %s [scale]\n", argv[0]);
+        return 1;
+    }
+
+    setenv("G_SLICE", "always-malloc", 1);
+    build_memory();
+
+    if ((fd = mkstemp(sysmap)) < 0 || !(f = fdopen(fd, "w"))) {
+        fprintf(stderr, "Failed to write %s\n", sysmap);
+        return 1;
+    }
+    fprintf(f, "%016"PRIx64" D init_task\n", (uint64_t) PE_BASE);
+    fclose(f);
+
+    vmi = init_vmi(sysmap);
+    if (!vmi) {
+        fprintf(stderr, "Failed to init LibVMI on the benchmark memory\n");
+        unlink(sysmap);
+        return 1;
+    }
+
+    rc |= bench_v2p_cache(vmi, 100000 * scale);
+    rc |= bench_memory_cache(100000 * scale);
+    rc |= bench_boyer_moore(1000 * scale);
+    rc |= bench_va_pages(vmi, 100 * scale);
+    rc |= bench_convert_str(100000 * scale);
+    rc |= bench_exports(vmi, 10000 * scale);
+
+    vmi_destroy(vmi);
+    unlink(sysmap);
+    free(memory);
+    return rc;
+}
@@ -22,6 +22,7 @@
  * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <config.h>
 #include <check.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -65,6 +66,20 @@ main (void)
 #endif
     suite_add_tcase(s, cache_tcase());
     suite_add_tcase(s, get_va_pages_tcase());
+#if ENABLE_FILE == 1
+    suite_add_tcase(s, file_tcase());
+    /* concurrent readers of one instance and its clones, over a raw image */
+    suite_add_tcase(s, threads_tcase());
+#endif
+#if ENABLE_MEMORY == 1
+    suite_add_tcase(s, memory_tcase());
+#if ENABLE_LINUX == 1
+    suite_add_tcase(s, memory_linux_tcase());
+#endif
+#endif
+#if ENABLE_TRACE == 1 && ENABLE_FILE == 1
+    suite_add_tcase(s, trace_tcase());
+#endif
 
     /* run the tests */
     SRunner *sr = srunner_create(s);
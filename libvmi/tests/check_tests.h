@@ -32,5 +32,18 @@ const char *get_testvm();
 TCase *init_tcase (void);
 TCase *translate_tcase (void);
 TCase *read_tcase (void);
+TCase *write_tcase (void);
+TCase *print_tcase (void);
+TCase *accessor_tcase (void);
+TCase *util_tcase (void);
+TCase *peparse_tcase (void);
+TCase *shm_snapshot_tcase (void);
+TCase *cache_tcase (void);
+TCase *get_va_pages_tcase (void);
+TCase *file_tcase (void);
+TCase *threads_tcase (void);
+TCase *memory_tcase (void);
+TCase *memory_linux_tcase (void);
+TCase *trace_tcase (void);
 
 #endif /* CHECK_TESTS_H */
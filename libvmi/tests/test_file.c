@@ -0,0 +1,308 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <elf.h>
+#include <glib.h>
+#include "../libvmi/libvmi.h"
+#include "check_tests.h"
+#include "../libvmi/private.h"
+
+/*
+ * These tests build small memory images on disk, so they don't need a
+ * test VM. The images hold the pages [0x1000-0x3000) and [0x5000-0x6000),
+ * every byte of a page being its page frame number.
+ */
+
+#define TEST_PAGE 0x1000
+
+struct test_range {
+    uint64_t paddr;
+    uint64_t length;
+};
+
+static const struct test_range test_ranges[] = {
+    { 0x1000, 0x2000 },
+    { 0x5000, 0x1000 },
+};
+
+#define TEST_NR_RANGES (sizeof(test_ranges) / sizeof(test_ranges[0]))
+
+static void
+write_range (FILE *f, const struct test_range *range)
+{
+    uint64_t pa;
+    unsigned char page[TEST_PAGE];
+
+    for (pa = range->paddr; pa < range->paddr + range->length; pa += TEST_PAGE) {
+        memset(page, (int) (pa / TEST_PAGE), TEST_PAGE);
+        fwrite(page, TEST_PAGE, 1, f);
+    }
+}
+
+static FILE *
+create_image (char *path)
+{
+    int fd = mkstemp(path);
+    fail_unless(fd >= 0, "failed to create temporary image");
+    return fdopen(fd, "w");
+}
+
+static void
+write_lime (char *path)
+{
+    FILE *f = create_image(path);
+    size_t i;
+
+    for (i = 0; i < TEST_NR_RANGES; i++) {
+        struct {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t s_addr;
+            uint64_t e_addr;
+            uint8_t reserved[8];
+        } __attribute__ ((packed)) header = {
+            0x4C694D45, 1, test_ranges[i].paddr,
+            test_ranges[i].paddr + test_ranges[i].length - 1, { 0 } };
+
+        fwrite(&header, sizeof(header), 1, f);
+        write_range(f, &test_ranges[i]);
+    }
+    fclose(f);
+}
+
+static void
+write_elf (char *path)
+{
+    FILE *f = create_image(path);
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr phdr;
+    uint64_t offset = TEST_PAGE;
+    size_t i;
+
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_CORE;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_phoff = sizeof(ehdr);
+    ehdr.e_ehsize = sizeof(ehdr);
+    ehdr.e_phentsize = sizeof(phdr);
+    ehdr.e_phnum = TEST_NR_RANGES;
+    fwrite(&ehdr, sizeof(ehdr), 1, f);
+
+    for (i = 0; i < TEST_NR_RANGES; i++) {
+        memset(&phdr, 0, sizeof(phdr));
+        phdr.p_type = PT_LOAD;
+        phdr.p_offset = offset;
+        phdr.p_paddr = test_ranges[i].paddr;
+        phdr.p_filesz = test_ranges[i].length;
+        phdr.p_memsz = test_ranges[i].length;
+        fwrite(&phdr, sizeof(phdr), 1, f);
+        offset += test_ranges[i].length;
+    }
+
+    fseek(f, TEST_PAGE, SEEK_SET);
+    for (i = 0; i < TEST_NR_RANGES; i++) {
+        write_range(f, &test_ranges[i]);
+    }
+    fclose(f);
+}
+
+static void
+check_image (const char *path)
+{
+    vmi_instance_t vmi = NULL;
+    unsigned char buf[TEST_PAGE];
+    const vmi_pa_range_t *map = NULL;
+    size_t i;
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE | VMI_INIT_PARTIAL, path),
+                "vmi_init failed on %s", path);
+
+    fail_unless(vmi_get_memsize(vmi) == 0x3000,
+                "wrong memory size 0x%"PRIx64, vmi_get_memsize(vmi));
+    fail_unless(vmi_get_max_physical_address(vmi) == 0x6000,
+                "wrong max physical address");
+
+    // the memory map is the ranges of the image
+    fail_unless(vmi_get_memory_map(vmi, &map) == TEST_NR_RANGES, "wrong number of ranges");
+    for (i = 0; i < TEST_NR_RANGES; i++) {
+        fail_unless(map[i].paddr == test_ranges[i].paddr && map[i].length == test_ranges[i].length,
+                    "wrong range %zu", i);
+    }
+
+    for (i = 0; i < TEST_NR_RANGES; i++) {
+        addr_t pa;
+        for (pa = test_ranges[i].paddr;
+             pa < test_ranges[i].paddr + test_ranges[i].length;
+             pa += TEST_PAGE) {
+            fail_unless(vmi_read_pa(vmi, pa, buf, TEST_PAGE) == TEST_PAGE,
+                        "failed to read PA 0x%"PRIx64, pa);
+            fail_unless(buf[0] == pa / TEST_PAGE && buf[TEST_PAGE - 1] == pa / TEST_PAGE,
+                        "wrong contents at PA 0x%"PRIx64, pa);
+        }
+    }
+
+    // holes of the image
+    fail_unless(vmi_read_pa(vmi, 0x0, buf, TEST_PAGE) == 0, "read from hole at 0x0");
+    fail_unless(vmi_read_pa(vmi, 0x3000, buf, TEST_PAGE) == 0, "read from hole at 0x3000");
+
+    vmi_destroy(vmi);
+}
+
+START_TEST (test_file_lime)
+{
+    char path[] = "/tmp/libvmi_check_lime_XXXXXX";
+    write_lime(path);
+    check_image(path);
+    unlink(path);
+}
+END_TEST
+
+START_TEST (test_file_elf)
+{
+    char path[] = "/tmp/libvmi_check_elf_XXXXXX";
+    write_elf(path);
+    check_image(path);
+    unlink(path);
+}
+END_TEST
+
+START_TEST (test_file_prefetch)
+{
+    char path[] = "/tmp/libvmi_check_prefetch_XXXXXX";
+    vmi_instance_t vmi = NULL;
+    unsigned char buf[TEST_PAGE];
+    addr_t pa;
+
+    write_lime(path);
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE | VMI_INIT_PARTIAL, path),
+                "vmi_init failed on %s", path);
+
+    // hints covering holes are fine, the holes just stay unreadable
+    fail_unless(VMI_SUCCESS == vmi_prefetch_pa(vmi, 0x0, 0x6000), "prefetch failed");
+
+    for (pa = 0x1000; pa < 0x3000; pa += TEST_PAGE) {
+        fail_unless(vmi_read_pa(vmi, pa, buf, TEST_PAGE) == TEST_PAGE,
+                    "failed to read prefetched PA 0x%"PRIx64, pa);
+        fail_unless(buf[0] == pa / TEST_PAGE, "wrong contents at PA 0x%"PRIx64, pa);
+    }
+    fail_unless(vmi_read_pa(vmi, 0x3000, buf, TEST_PAGE) == 0, "read from hole at 0x3000");
+
+    // destroying with reads in flight must not leak or crash
+    fail_unless(VMI_SUCCESS == vmi_prefetch_pa(vmi, 0x5000, TEST_PAGE), "prefetch failed");
+    vmi_destroy(vmi);
+    unlink(path);
+}
+END_TEST
+
+#if ENABLE_PAGE_CACHE == 1
+START_TEST (test_file_shared_cache)
+{
+    char path[] = "/tmp/libvmi_check_shared_XXXXXX";
+    vmi_instance_t vmi1 = NULL, vmi2 = NULL;
+    GHashTable *config = g_hash_table_new(g_str_hash, g_str_equal);
+    unsigned char buf[TEST_PAGE];
+    void *page = NULL;
+
+    write_lime(path);
+    g_hash_table_insert(config, "name", path);
+    g_hash_table_insert(config, "shared_page_cache", "yes");
+
+    fail_unless(VMI_SUCCESS == vmi_init_custom(&vmi1, VMI_FILE | VMI_INIT_PARTIAL | VMI_CONFIG_GHASHTABLE, config),
+                "vmi_init_custom failed on %s", path);
+    fail_unless(VMI_SUCCESS == vmi_init_custom(&vmi2, VMI_FILE | VMI_INIT_PARTIAL | VMI_CONFIG_GHASHTABLE, config),
+                "vmi_init_custom failed on %s", path);
+
+    // both instances get the very same frame
+    page = vmi_read_page(vmi1, 0x2);
+    fail_unless(page != NULL, "failed to read page 0x2");
+    fail_unless(page == vmi_read_page(vmi2, 0x2), "page 0x2 is not shared");
+
+    // and it outlives the instance that read it first
+    vmi_destroy(vmi1);
+    fail_unless(vmi_read_pa(vmi2, 0x2000, buf, TEST_PAGE) == TEST_PAGE, "failed to read PA 0x2000");
+    fail_unless(buf[0] == 0x2 && buf[TEST_PAGE - 1] == 0x2, "wrong contents at PA 0x2000");
+
+    vmi_destroy(vmi2);
+    g_hash_table_destroy(config);
+    unlink(path);
+}
+END_TEST
+#endif
+
+START_TEST (test_file_stats)
+{
+    char path[] = "/tmp/libvmi_check_stats_XXXXXX";
+    vmi_instance_t vmi = NULL;
+    vmi_stat_histogram_t h;
+    unsigned char buf[TEST_PAGE];
+    int i;
+
+    write_lime(path);
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE | VMI_INIT_PARTIAL, path),
+                "vmi_init failed on %s", path);
+
+    vmi_set_stats(vmi, 1);
+    vmi_reset_stats(vmi);
+    for (i = 0; i < 10; i++) {
+        fail_unless(vmi_read_pa(vmi, 0x1000, buf, TEST_PAGE) == TEST_PAGE, "failed to read PA 0x1000");
+    }
+
+    fail_unless(VMI_SUCCESS == vmi_get_stats(vmi, VMI_STAT_READ, &h), "no read stats");
+    fail_unless(h.count == 10, "counted %"PRIu64" reads", h.count);
+    fail_unless(vmi_stat_percentile(&h, 50.0) <= vmi_stat_percentile(&h, 99.9), "p50 above p999");
+    fail_unless(vmi_stat_percentile(&h, 99.9) <= h.max_ns, "p999 above max");
+
+    // the page was fetched once, the other reads hit the page cache
+    fail_unless(VMI_SUCCESS == vmi_get_stats(vmi, VMI_STAT_READ_PAGE, &h), "no read_page stats");
+    fail_unless(h.count >= 1 && h.count < 10, "counted %"PRIu64" page fetches", h.count);
+
+    fail_unless(VMI_FAILURE == vmi_get_stats(vmi, VMI_STAT_MAX, &h), "stats of unknown operation");
+    fail_unless(!strcmp(vmi_stat_name(VMI_STAT_READ), "read"), "wrong stat name");
+
+    vmi_destroy(vmi);
+    unlink(path);
+}
+END_TEST
+
+/* file driver test cases */
+TCase *file_tcase (void)
+{
+    TCase *tc_file = tcase_create("LibVMI file driver");
+    tcase_add_test(tc_file, test_file_lime);
+    tcase_add_test(tc_file, test_file_elf);
+    tcase_add_test(tc_file, test_file_prefetch);
+    tcase_add_test(tc_file, test_file_stats);
+#if ENABLE_PAGE_CACHE == 1
+    tcase_add_test(tc_file, test_file_shared_cache);
+#endif
+    return tc_file;
+}
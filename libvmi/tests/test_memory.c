@@ -0,0 +1,800 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <glib.h>
+#include "../libvmi/libvmi.h"
+#include "check_tests.h"
+
+/*
+ * The memory driver views buffers of the caller, so these tests need no
+ * test VM: two ranges [0x0-0x2000) and [0x4000-0x5000), every byte of a
+ * page being its page frame number.
+ */
+
+#define TEST_PAGE 0x1000
+
+static unsigned char low[2 * TEST_PAGE];
+static unsigned char high[TEST_PAGE];
+
+static vmi_memory_range_t test_ranges[] = {
+    { 0x4000, TEST_PAGE, high },
+    { 0x0, 2 * TEST_PAGE, low },
+};
+
+static vmi_memory_register_t test_registers[] = {
+    { 0, CR3, 0x1000 },
+    { 1, RIP, 0xffffffff81000000ULL },
+};
+
+static vmi_instance_t
+init_memory (void)
+{
+    vmi_instance_t vmi = NULL;
+    GHashTable *config = g_hash_table_new(g_str_hash, g_str_equal);
+    uint64_t range_count = 2;
+    uint64_t register_count = 2;
+
+    memset(low, 0, TEST_PAGE);
+    memset(low + TEST_PAGE, 1, TEST_PAGE);
+    memset(high, 4, TEST_PAGE);
+
+    g_hash_table_insert(config, "name", "check-memory");
+    g_hash_table_insert(config, "memory_ranges", test_ranges);
+    g_hash_table_insert(config, "memory_range_count", &range_count);
+    g_hash_table_insert(config, "vcpu_registers", test_registers);
+    g_hash_table_insert(config, "vcpu_register_count", &register_count);
+
+    fail_unless(VMI_SUCCESS == vmi_init_custom(&vmi,
+                VMI_MEMORY | VMI_INIT_PARTIAL | VMI_CONFIG_GHASHTABLE, config),
+                "vmi_init_custom failed for VMI_MEMORY");
+    g_hash_table_destroy(config);
+    return vmi;
+}
+
+START_TEST (test_memory_read)
+{
+    vmi_instance_t vmi = init_memory();
+    unsigned char buf[2 * TEST_PAGE];
+    addr_t pa;
+
+    fail_unless(vmi_get_memsize(vmi) == 3 * TEST_PAGE, "wrong memory size");
+    fail_unless(vmi_get_max_physical_address(vmi) == 0x5000, "wrong max physical address");
+
+    for (pa = 0; pa < 0x5000; pa += TEST_PAGE) {
+        size_t expected = (pa == 0x2000 || pa == 0x3000) ? 0 : TEST_PAGE;
+
+        fail_unless(vmi_read_pa(vmi, pa, buf, TEST_PAGE) == expected,
+                    "wrong read size at PA 0x%"PRIx64, pa);
+        if (expected) {
+            fail_unless(buf[0] == pa / TEST_PAGE && buf[TEST_PAGE - 1] == pa / TEST_PAGE,
+                        "wrong contents at PA 0x%"PRIx64, pa);
+        }
+    }
+
+    /* across the page boundary of the first range */
+    fail_unless(vmi_read_pa(vmi, 0x800, buf, TEST_PAGE) == TEST_PAGE, "failed to read across pages");
+    fail_unless(buf[0] == 0 && buf[TEST_PAGE - 1] == 1, "wrong contents across pages");
+
+    vmi_destroy(vmi);
+}
+END_TEST
+
+START_TEST (test_memory_write)
+{
+    vmi_instance_t vmi = init_memory();
+    uint32_t value = 0xdeadbeef;
+    uint32_t readback = 0;
+
+    /* writes go straight to the buffer of the caller */
+    fail_unless(VMI_SUCCESS == vmi_write_32_pa(vmi, 0x4010, &value), "write failed");
+    fail_unless(!memcmp(high + 0x10, &value, sizeof(value)), "write didn't reach the buffer");
+
+    /* and reads see changes of the buffer */
+    high[0x20] = 0x42;
+    fail_unless(VMI_SUCCESS == vmi_read_32_pa(vmi, 0x4010, &readback), "read failed");
+    fail_unless(readback == value, "read back 0x%"PRIx32, readback);
+    fail_unless(vmi_read_pa(vmi, 0x4020, &readback, 1) == 1 && (readback & 0xff) == 0x42,
+                "buffer change not visible");
+
+    fail_unless(VMI_FAILURE == vmi_write_32_pa(vmi, 0x2000, &value), "write to a hole");
+
+    vmi_destroy(vmi);
+}
+END_TEST
+
+START_TEST (test_memory_vcpureg)
+{
+    vmi_instance_t vmi = init_memory();
+    reg_t value = 0;
+
+    fail_unless(vmi_get_num_vcpus(vmi) == 2, "wrong number of vcpus");
+    fail_unless(VMI_SUCCESS == vmi_get_vcpureg(vmi, &value, CR3, 0) && value == 0x1000,
+                "wrong CR3");
+    fail_unless(VMI_SUCCESS == vmi_get_vcpureg(vmi, &value, RIP, 1)
+                && value == 0xffffffff81000000ULL, "wrong RIP");
+    fail_unless(VMI_FAILURE == vmi_get_vcpureg(vmi, &value, RIP, 0), "RIP of vcpu 0 is not set");
+
+    fail_unless(VMI_SUCCESS == vmi_set_vcpureg(vmi, 0x2000, CR3, 0), "failed to set CR3");
+    fail_unless(VMI_SUCCESS == vmi_get_vcpureg(vmi, &value, CR3, 0) && value == 0x2000,
+                "CR3 not updated");
+
+    vmi_destroy(vmi);
+}
+END_TEST
+
+START_TEST (test_memory_clone)
+{
+    vmi_instance_t vmi = init_memory();
+    vmi_instance_t clone = NULL;
+    unsigned char buf[TEST_PAGE];
+    reg_t value = 0;
+
+    /* the config was destroyed by init_memory, the clone copies the driver */
+    fail_unless(VMI_SUCCESS == vmi_set_vcpureg(vmi, 0x3000, CR3, 0), "failed to set CR3");
+    fail_unless(VMI_SUCCESS == vmi_clone(vmi, &clone), "vmi_clone failed");
+    vmi_destroy(vmi);
+
+    fail_unless(vmi_get_max_physical_address(clone) == 0x5000, "wrong max physical address");
+    fail_unless(vmi_read_pa(clone, 0x4000, buf, TEST_PAGE) == TEST_PAGE && buf[0] == 4,
+                "wrong contents read by the clone");
+    fail_unless(vmi_read_pa(clone, 0x2000, buf, TEST_PAGE) == 0, "clone read a hole");
+    fail_unless(vmi_get_num_vcpus(clone) == 2, "wrong number of vcpus of the clone");
+    fail_unless(VMI_SUCCESS == vmi_get_vcpureg(clone, &value, CR3, 0) && value == 0x3000,
+                "wrong CR3 of the clone");
+
+    vmi_destroy(clone);
+}
+END_TEST
+
+#if ENABLE_LINUX == 1
+/*
+ * A Linux kernel in 64 KiB of IA-32e memory: the tables at 0x1000-0x4000 map
+ * the kernel page 0xffffffff81000000 to 0x8000, init_task lies at 0x8100
+ * and a second swapper-like task at 0x8200.
+ */
+
+#define KERNEL_VA 0xffffffff81000000ULL
+#define TASK_PID 0x40
+#define TASK_NAME 0x50
+
+#define SYSMAP_TEMPLATE "/tmp/libvmi_check_sysmap_XXXXXX"
+
+static uint64_t kernel[16 * TEST_PAGE / 8];
+static uint64_t kernel_size = sizeof(kernel);
+static uint64_t kernel_register_count = 4;
+static addr_t kernel_pid_offset = TASK_PID;
+static addr_t kernel_name_offset = TASK_NAME;
+static vmi_memory_register_t kernel_registers[] = {
+    { 0, CR0, 1ULL << 31 },
+    { 0, CR3, 0x1000 },
+    { 0, CR4, 1ULL << 5 },
+    { 0, MSR_EFER, 1ULL << 8 },
+};
+
+/*
+ * The guest of the Linux tests. The fixture writes the tables and a
+ * System.map naming init_task, a test adds its own memory and starts the
+ * guest. The config lives until the teardown, a lazy OS init reads it on
+ * first use.
+ */
+static struct {
+    char sysmap[sizeof(SYSMAP_TEMPLATE)];
+    GHashTable *config;
+    vmi_instance_t vmi;
+} guest;
+
+static void
+setup_linux (void)
+{
+    int fd = -1;
+
+    strcpy(guest.sysmap, SYSMAP_TEMPLATE);
+    fd = mkstemp(guest.sysmap);
+    fail_unless(fd >= 0, "failed to create temporary System.map");
+    dprintf(fd, "%016llx D init_task\n", KERNEL_VA + 0x100);
+    close(fd);
+
+    memset(kernel, 0, sizeof(kernel));
+    kernel[0x1000 / 8 + 511] = 0x2000 | 0x3;
+    kernel[0x2000 / 8 + 510] = 0x3000 | 0x3;
+    kernel[0x3000 / 8 + 8] = 0x4000 | 0x3;
+    kernel[0x4000 / 8] = 0x8000 | 0x3;
+
+    guest.config = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_insert(guest.config, "name", "check-linux");
+    g_hash_table_insert(guest.config, "memory", kernel);
+    g_hash_table_insert(guest.config, "memory_size", &kernel_size);
+    g_hash_table_insert(guest.config, "vcpu_registers", kernel_registers);
+    g_hash_table_insert(guest.config, "vcpu_register_count", &kernel_register_count);
+    g_hash_table_insert(guest.config, "ostype", "Linux");
+    g_hash_table_insert(guest.config, "sysmap", guest.sysmap);
+    g_hash_table_insert(guest.config, "linux_pid", &kernel_pid_offset);
+    g_hash_table_insert(guest.config, "linux_name", &kernel_name_offset);
+    guest.vmi = NULL;
+}
+
+/* inits the guest, with its init state cached in cache_dir unless NULL */
+static vmi_instance_t
+start_linux (const char *cache_dir, uint32_t flags)
+{
+    if (cache_dir) {
+        g_hash_table_insert(guest.config, "init_cache", (char *) cache_dir);
+    }
+
+    fail_unless(VMI_SUCCESS == vmi_init_custom(&guest.vmi,
+                VMI_MEMORY | VMI_INIT_COMPLETE | VMI_CONFIG_GHASHTABLE | flags, guest.config),
+                "Linux init failed for VMI_MEMORY");
+    return guest.vmi;
+}
+
+static void
+stop_linux (void)
+{
+    if (guest.vmi) {
+        vmi_destroy(guest.vmi);
+        guest.vmi = NULL;
+    }
+}
+
+static void
+teardown_linux (void)
+{
+    stop_linux();
+    g_hash_table_destroy(guest.config);
+    unlink(guest.sysmap);
+}
+
+/* the init cache file of the guest, the only file in cache_dir */
+static char *
+init_cache_path (const char *cache_dir)
+{
+    GDir *dir = g_dir_open(cache_dir, 0, NULL);
+    const char *name = NULL;
+    char *path = NULL;
+
+    fail_unless(dir != NULL, "failed to open %s", cache_dir);
+    name = g_dir_read_name(dir);
+    fail_unless(name != NULL, "init cache not saved");
+    path = g_build_filename(cache_dir, name, NULL);
+    fail_unless(g_dir_read_name(dir) == NULL, "more than one init cache saved");
+    g_dir_close(dir);
+    return path;
+}
+
+START_TEST (test_memory_init_cache)
+{
+    char cache_dir[] = "/tmp/libvmi_check_cache_XXXXXX";
+    vmi_instance_t vmi = NULL;
+    GKeyFile *cache = NULL;
+    char *path = NULL;
+    char *data = NULL;
+    gsize length = 0;
+
+    fail_unless(mkdtemp(cache_dir) != NULL, "failed to create temporary directory");
+
+    // the first init finds init_task in the System.map and saves it
+    vmi = start_linux(cache_dir, 0);
+    fail_unless(vmi_get_offset(vmi, "linux_name") == TASK_NAME, "wrong name offset");
+    stop_linux();
+
+    path = init_cache_path(cache_dir);
+    cache = g_key_file_new();
+    fail_unless(g_key_file_load_from_file(cache, path, G_KEY_FILE_NONE, NULL), "init cache not saved");
+    fail_unless(g_key_file_get_uint64(cache, "init", "init_task_pa", NULL) == 0x8100,
+                "wrong init_task_pa cached");
+
+    // the next init takes init_task and the offsets from the cache
+    g_key_file_set_uint64(cache, "init", "init_task", KERNEL_VA + 0x200);
+    g_key_file_set_uint64(cache, "init", "init_task_pa", 0x8200);
+    g_key_file_set_uint64(cache, "init", "linux_name", TASK_NAME + 0x10);
+    data = g_key_file_to_data(cache, &length, NULL);
+    fail_unless(g_file_set_contents(path, data, length, NULL), "failed to rewrite the init cache");
+    g_free(data);
+
+    vmi = start_linux(cache_dir, 0);
+    fail_unless(vmi_get_offset(vmi, "linux_name") == TASK_NAME + 0x10, "init state not restored");
+    stop_linux();
+
+    // and searches again once the cached task stops checking out
+    ((uint32_t *) kernel)[(0x8200 + TASK_PID) / 4] = 42;
+    vmi = start_linux(cache_dir, 0);
+    fail_unless(vmi_get_offset(vmi, "linux_name") == TASK_NAME, "stale init cache used");
+    stop_linux();
+
+    fail_unless(g_key_file_load_from_file(cache, path, G_KEY_FILE_NONE, NULL), "init cache not saved");
+    fail_unless(g_key_file_get_uint64(cache, "init", "init_task_pa", NULL) == 0x8100,
+                "init cache not saved again");
+
+    g_key_file_free(cache);
+    unlink(path);
+    g_free(path);
+    rmdir(cache_dir);
+}
+END_TEST
+
+/* the OS inits run since the stats were turned on */
+static uint64_t
+os_inits (vmi_instance_t vmi)
+{
+    vmi_stat_histogram_t h;
+
+    fail_unless(VMI_SUCCESS == vmi_get_stats(vmi, VMI_STAT_INIT_OS, &h), "no init_os stats");
+    return h.count;
+}
+
+START_TEST (test_memory_lazy_init)
+{
+    vmi_instance_t vmi = NULL;
+    unsigned char byte = 0;
+
+    kernel[0x8100 / 8] = 0x42;
+
+    // physical reads don't need the OS
+    vmi = start_linux(NULL, VMI_INIT_LAZY);
+    vmi_set_stats(vmi, 1);
+    fail_unless(VMI_SUCCESS == vmi_read_8_pa(vmi, 0x8100, &byte) && byte == 0x42,
+                "failed to read PA 0x8100");
+    fail_unless(os_inits(vmi) == 0, "OS init run by a physical read");
+
+    // the first kernel read runs it, once
+    byte = 0;
+    fail_unless(VMI_SUCCESS == vmi_read_8_va(vmi, KERNEL_VA + 0x100, 0, &byte) && byte == 0x42,
+                "failed to read init_task");
+    fail_unless(vmi_get_offset(vmi, "linux_pid") == TASK_PID, "OS init not run on first use");
+    fail_unless(VMI_SUCCESS == vmi_init_prefetch(vmi), "prefetch after the OS init failed");
+    fail_unless(os_inits(vmi) == 1, "OS init run %"PRIu64" times", os_inits(vmi));
+    stop_linux();
+
+    // and prefetch runs it up front
+    vmi = start_linux(NULL, VMI_INIT_LAZY);
+    fail_unless(VMI_SUCCESS == vmi_init_prefetch(vmi), "prefetch failed");
+    fail_unless(vmi_translate_kv2p(vmi, KERNEL_VA + 0x100) == 0x8100, "wrong translation");
+}
+END_TEST
+
+START_TEST (test_memory_compiled_ctx)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_compiled_ctx_t cctx = NULL;
+    access_context_t ctx = { .translate_mechanism = VMI_TM_KERNEL_SYMBOL, .ksym = "init_task" };
+    uint64_t value = 0;
+    addr_t addr = 0;
+
+    kernel[0x8100 / 8] = 0x42;
+    kernel[0x8108 / 8] = KERNEL_VA;
+    kernel[0x9100 / 8] = 0x43;
+
+    vmi = start_linux(NULL, 0);
+    cctx = vmi_ctx_compile(vmi, &ctx);
+    fail_unless(cctx != NULL, "failed to compile the init_task context");
+
+    fail_unless(vmi_read_compiled(vmi, cctx, 0, &value, 8) == 8 && value == 0x42,
+                "wrong init_task contents");
+    fail_unless(VMI_SUCCESS == vmi_read_addr_compiled(vmi, cctx, 8, &addr) && addr == KERNEL_VA,
+                "wrong address read");
+
+    // a read across the end of the mapped page stops there
+    fail_unless(vmi_read_compiled(vmi, cctx, TEST_PAGE - 0x104, &value, 8) == 4,
+                "read past the mapped page");
+
+    // remapping is noticed once the translations are flushed
+    kernel[0x4000 / 8] = 0x9000 | 0x3;
+    vmi_v2pcache_flush(vmi);
+    fail_unless(vmi_read_compiled(vmi, cctx, 0, &value, 8) == 8 && value == 0x43,
+                "stale translation used");
+    vmi_ctx_free(cctx);
+
+    ctx.ksym = "no_such_symbol";
+    fail_unless(vmi_ctx_compile(vmi, &ctx) == NULL, "compiled an unknown symbol");
+
+}
+END_TEST
+
+struct compiled_reader {
+    vmi_instance_t vmi;
+    vmi_compiled_ctx_t cctx;
+    int wrong;
+};
+
+/* alternates between the two kernel pages through the shared handle */
+static gpointer
+read_compiled_pages (gpointer data)
+{
+    struct compiled_reader *reader = data;
+    uint64_t value = 0;
+    int i;
+
+    for (i = 0; i < 10000; i++) {
+        addr_t offset = (i & 1) * TEST_PAGE;
+
+        if (vmi_read_compiled(reader->vmi, reader->cctx, offset, &value, 8) != 8
+                || value != (offset ? 0x22 : 0x11)) {
+            reader->wrong++;
+        }
+    }
+    return NULL;
+}
+
+START_TEST (test_memory_compiled_ctx_threads)
+{
+    access_context_t ctx = { .translate_mechanism = VMI_TM_PROCESS_DTB, .dtb = 0x1000, .addr = KERNEL_VA };
+    struct compiled_reader readers[4];
+    GThread *threads[4];
+    vmi_compiled_ctx_t cctx = NULL;
+    vmi_instance_t vmi = NULL;
+    int i;
+
+    kernel[0x4000 / 8 + 1] = 0x9000 | 0x3;
+    kernel[0x8000 / 8] = 0x11;
+    kernel[0x9000 / 8] = 0x22;
+
+    vmi = start_linux(NULL, 0);
+    cctx = vmi_ctx_compile(vmi, &ctx);
+    fail_unless(cctx != NULL, "failed to compile the kernel context");
+
+    for (i = 0; i < 4; i++) {
+        readers[i].vmi = vmi;
+        readers[i].cctx = cctx;
+        readers[i].wrong = 0;
+        threads[i] = g_thread_new("compiled", read_compiled_pages, &readers[i]);
+    }
+    for (i = 0; i < 4; i++) {
+        g_thread_join(threads[i]);
+        fail_unless(readers[i].wrong == 0, "%d reads through the shared handle went wrong",
+                    readers[i].wrong);
+    }
+
+    vmi_ctx_free(cctx);
+}
+END_TEST
+
+START_TEST (test_memory_walk_list)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_list_field_t field = { TASK_PID, sizeof(uint32_t) };
+    vmi_list_walk_t walk;
+    uint32_t pid = 0;
+    addr_t node = 0;
+    size_t i;
+
+    
+    // init_task and two more tasks on a list linked at offset 0x10
+    for (i = 0; i < 3; i++) {
+        addr_t task = 0x8100 + i * 0x200;
+        kernel[(task + 0x10) / 8] = KERNEL_VA + 0x100 + ((i + 1) % 3) * 0x200 + 0x10;
+        kernel[(task + 0x18) / 8] = KERNEL_VA + 0x100 + ((i + 2) % 3) * 0x200 + 0x10;
+        ((uint32_t *) kernel)[(task + TASK_PID) / 4] = i;
+    }
+
+    vmi = start_linux(NULL, 0);
+
+    fail_unless(VMI_SUCCESS == vmi_walk_list(vmi, KERNEL_VA + 0x110, 0, 0x10, &field, 1, 0,
+                VMI_WALK_INCLUDE_HEAD, &walk), "failed to walk the task list");
+    fail_unless(walk.count == 3, "walked %zu tasks", walk.count);
+    fail_unless(walk.record_size == sizeof(addr_t) + sizeof(uint32_t), "wrong record size");
+    for (i = 0; i < walk.count; i++) {
+        memcpy(&node, walk.records + i * walk.record_size, sizeof(addr_t));
+        memcpy(&pid, walk.records + i * walk.record_size + sizeof(addr_t), sizeof(uint32_t));
+        fail_unless(node == KERNEL_VA + 0x100 + i * 0x200, "wrong node 0x%"PRIx64, node);
+        fail_unless(pid == i, "wrong pid %u", pid);
+    }
+    vmi_walk_list_free(&walk);
+
+    // the bound stops the walk early
+    fail_unless(VMI_FAILURE == vmi_walk_list(vmi, KERNEL_VA + 0x110, 0, 0x10, &field, 1, 2,
+                VMI_WALK_INCLUDE_HEAD, &walk), "walk not bounded");
+    fail_unless(walk.count == 2, "walked %zu tasks past the bound", walk.count);
+    vmi_walk_list_free(&walk);
+
+    // a search keeps only the matching task
+    pid = 1;
+    fail_unless(VMI_SUCCESS == vmi_walk_list_find(vmi, KERNEL_VA + 0x110, 0, 0x10, &field, 1,
+                VMI_WALK_INCLUDE_HEAD, &pid, &walk), "pid 1 not found");
+    memcpy(&node, walk.records, sizeof(addr_t));
+    fail_unless(walk.count == 1 && node == KERNEL_VA + 0x300, "wrong task 0x%"PRIx64, node);
+    vmi_walk_list_free(&walk);
+
+    pid = 7;
+    fail_unless(VMI_FAILURE == vmi_walk_list_find(vmi, KERNEL_VA + 0x110, 0, 0x10, &field, 1,
+                VMI_WALK_INCLUDE_HEAD, &pid, &walk), "found a missing pid");
+    fail_unless(walk.count == 0, "kept %zu tasks of a failed search", walk.count);
+    vmi_walk_list_free(&walk);
+
+    // a broken back link fails the walk, keeping the tasks before it
+    kernel[(0x8500 + 0x18) / 8] = KERNEL_VA + 0x110;
+    fail_unless(VMI_FAILURE == vmi_walk_list(vmi, KERNEL_VA + 0x110, 0, 0x10, &field, 1, 0,
+                VMI_WALK_INCLUDE_HEAD, &walk), "walked a corrupted list");
+    fail_unless(walk.count == 2, "kept %zu tasks", walk.count);
+    vmi_walk_list_free(&walk);
+
+}
+END_TEST
+
+START_TEST (test_memory_struct)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_struct_member_t members[] = { { "linux_pid", 4 }, { "linux_name", 16 } };
+    vmi_struct_member_t unknown[] = { { "linux_pid", 4 }, { "no_such_offset", 4 } };
+    access_context_t ctx = { .translate_mechanism = VMI_TM_PROCESS_PID, .addr = KERNEL_VA + 0x100 };
+    vmi_struct_t task = NULL;
+    uint32_t pid = 0;
+    uint64_t value = 0;
+    char *name = NULL;
+
+    ((uint32_t *) kernel)[(0x8100 + TASK_PID) / 4] = 42;
+    strcpy((char *) kernel + 0x8100 + TASK_NAME, "swapper/0");
+    ((uint32_t *) kernel)[(0x8fa8 + TASK_PID) / 4] = 43;
+
+    vmi = start_linux(NULL, 0);
+    task = vmi_struct_new(vmi, NULL, members, 2);
+    fail_unless(task != NULL, "failed to resolve the task_struct members");
+    fail_unless(vmi_struct_offset(task, 1) == TASK_NAME, "wrong name offset");
+
+    fail_unless(VMI_SUCCESS == vmi_struct_read(vmi, task, &ctx), "failed to read init_task");
+    fail_unless(VMI_SUCCESS == vmi_struct_get_32(task, 0, &pid) && pid == 42, "wrong pid");
+    fail_unless(VMI_FAILURE == vmi_struct_get_64(task, 0, &value), "read past the pid");
+    name = vmi_struct_get_str(task, 1);
+    fail_unless(name && !strcmp(name, "swapper/0"), "wrong name");
+    free(name);
+
+    // a task whose name lies past the mapped page keeps its pid readable
+    ctx.addr = KERNEL_VA + 0xfa8;
+    fail_unless(VMI_FAILURE == vmi_struct_read(vmi, task, &ctx), "read past the mapped page");
+    fail_unless(VMI_SUCCESS == vmi_struct_get_32(task, 0, &pid) && pid == 43, "wrong pid");
+    fail_unless(vmi_struct_get_str(task, 1) == NULL, "name read past the mapped page");
+    vmi_struct_free(task);
+
+    fail_unless(vmi_struct_new(vmi, NULL, unknown, 2) == NULL, "resolved an unknown offset");
+
+}
+END_TEST
+
+START_TEST (test_memory_translate_batch)
+{
+    vmi_instance_t vmi = NULL;
+    addr_t vaddrs[] = { KERNEL_VA + 0xff0, KERNEL_VA + 0x1000, 0xffff800000000000ULL, KERNEL_VA + 0x10 };
+    addr_t paddrs[4];
+
+    vmi = start_linux(NULL, 0);
+
+    fail_unless(vmi_translate_batch(vmi, 0x1000, vaddrs, paddrs, 4) == 2, "wrong number of translations");
+    fail_unless(paddrs[0] == 0x8ff0 && paddrs[3] == 0x8010, "wrong translations");
+    fail_unless(paddrs[1] == 0 && paddrs[2] == 0, "translated unmapped addresses");
+
+}
+END_TEST
+
+START_TEST (test_memory_p2v)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_p2v_map_t map = NULL;
+    vmi_p2v_t mappings[2];
+
+    vmi = start_linux(NULL, 0);
+
+    // the kernel address space maps a single page
+    map = vmi_p2v_map_build(vmi, NULL, 0);
+    fail_unless(map != NULL, "failed to build the reverse map");
+    fail_unless(vmi_translate_p2v(map, 0x8123, mappings, 2) == 1, "wrong number of mappings");
+    fail_unless(mappings[0].dtb == 0x1000 && mappings[0].vaddr == KERNEL_VA + 0x123,
+                "wrong mapping 0x%"PRIx64, mappings[0].vaddr);
+    fail_unless(vmi_translate_p2v(map, 0x9000, mappings, 2) == 0, "mapping of an unmapped page");
+
+    // a process sharing the kernel half
+    kernel[0x5000 / 8 + 511] = 0x2000 | 0x3;
+    fail_unless(VMI_SUCCESS == vmi_p2v_map_refresh(vmi, map, 0x5000), "failed to add a process");
+    fail_unless(vmi_translate_p2v(map, 0x8000, mappings, 1) == 2, "process not indexed");
+
+    // the shared kernel pages are recorded once, whichever dtb is refreshed
+    fail_unless(VMI_SUCCESS == vmi_p2v_map_refresh(vmi, map, 0x5000), "failed to refresh a process");
+    fail_unless(VMI_SUCCESS == vmi_p2v_map_refresh(vmi, map, 0x1000), "failed to refresh the kernel");
+    fail_unless(vmi_translate_p2v(map, 0x8000, mappings, 2) == 2, "kernel pages recorded twice");
+    fail_unless(VMI_SUCCESS == vmi_p2v_map_remove(map, 0x5000), "failed to remove a process");
+    fail_unless(vmi_translate_p2v(map, 0x8000, mappings, 2) == 1 && mappings[0].dtb == 0x1000,
+                "process not removed");
+
+    vmi_p2v_map_free(map);
+}
+END_TEST
+
+START_TEST (test_memory_va_runs)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_va_run_t *runs = NULL;
+    size_t count = 0;
+
+    vmi = start_linux(NULL, 0);
+
+    // a process at 0x5000 with user pages at 0x0-0x6000 and the kernel half
+    kernel[0x5000 / 8] = 0x6000 | 0x7;
+    kernel[0x5000 / 8 + 511] = 0x2000 | 0x3;
+    kernel[0x6000 / 8] = 0x7000 | 0x7;
+    kernel[0x7000 / 8] = 0x9000 | 0x7;
+    kernel[0x9000 / 8] = 0xa000 | 0x7;
+    kernel[0x9000 / 8 + 1] = 0xb000 | 0x7;
+    kernel[0x9000 / 8 + 2] = 0xd000 | 0x7;
+    kernel[0x9000 / 8 + 4] = 0xe000 | 0x7;
+    kernel[0x9000 / 8 + 5] = 0xa000 | 0x7;
+
+    count = vmi_get_va_runs(vmi, 0x5000, VMI_VA_RUNS_USER, &runs);
+    fail_unless(count == 4, "%zu user runs", count);
+    fail_unless(runs[0].vaddr == 0 && runs[0].paddr == 0xa000 && runs[0].length == 0x2000,
+                "contiguous pages not joined");
+    fail_unless(runs[1].vaddr == 0x2000 && runs[1].paddr == 0xd000 && runs[1].length == 0x1000,
+                "wrong run at 0x2000");
+    fail_unless(runs[3].vaddr == 0x5000 && runs[3].paddr == 0xa000, "wrong run at 0x5000");
+    free(runs);
+
+    // the kernel page comes last
+    count = vmi_get_va_runs(vmi, 0x5000, 0, &runs);
+    fail_unless(count == 5 && runs[4].vaddr == KERNEL_VA && runs[4].paddr == 0x8000,
+                "kernel page missing");
+    free(runs);
+
+}
+END_TEST
+
+START_TEST (test_memory_read_stats)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_stat_histogram_t h;
+    uint64_t value = 0;
+    int i;
+
+    vmi = start_linux(NULL, 0);
+    vmi_set_stats(vmi, 1);
+    vmi_reset_stats(vmi);
+
+    // the page table entries read by the walks are not counted as reads
+    for (i = 0; i < 3; i++) {
+        fail_unless(VMI_SUCCESS == vmi_read_64_va(vmi, KERNEL_VA + i * 8, 0, &value),
+                    "failed to read the kernel page");
+    }
+    fail_unless(vmi_translate_kv2p(vmi, KERNEL_VA + 0x100) == 0x8100, "wrong translation");
+
+    fail_unless(VMI_SUCCESS == vmi_get_stats(vmi, VMI_STAT_READ, &h), "no read stats");
+    fail_unless(h.count == 3, "counted %"PRIu64" reads", h.count);
+    fail_unless(VMI_SUCCESS == vmi_get_stats(vmi, VMI_STAT_TRANSLATE, &h), "no translate stats");
+    fail_unless(h.count >= 1, "no page table walk counted");
+
+}
+END_TEST
+
+#if ENABLE_ADDRESS_CACHE == 1
+START_TEST (test_memory_shared_kernel_v2p)
+{
+    vmi_instance_t vmi = NULL;
+
+    // a process with the kernel PML4E of init_task and one with another
+    kernel[0x5000 / 8 + 511] = 0x2000 | 0x3;
+    kernel[0x6000 / 8 + 511] = 0x2000 | 0x7;
+
+    vmi = start_linux(NULL, 0);
+    fail_unless(vmi_pagetable_lookup(vmi, 0x1000, KERNEL_VA) == 0x8000, "wrong translation");
+
+    // without a flush, only the process with the same entry sees the old mapping
+    kernel[0x4000 / 8] = 0x9000 | 0x3;
+    fail_unless(vmi_pagetable_lookup(vmi, 0x5000, KERNEL_VA) == 0x8000,
+                "kernel translation not shared");
+    fail_unless(vmi_pagetable_lookup(vmi, 0x6000, KERNEL_VA) == 0x9000,
+                "kernel translation shared across different entries");
+
+}
+END_TEST
+
+START_TEST (test_memory_negative_v2p)
+{
+    vmi_instance_t vmi = NULL;
+    // the pages of KERNEL_VA in the unmapped PML4 slot 300
+    addr_t va = (KERNEL_VA & ~VMI_BIT_MASK(39, 46)) | (300ULL << 39);
+
+    vmi = start_linux(NULL, 0);
+    fail_unless(vmi_translate_kv2p(vmi, va) == 0, "translated an unmapped address");
+
+    // the whole 512 GB of the slot stays unmapped until the translations are flushed
+    kernel[0x1000 / 8 + 300] = 0x2000 | 0x3;
+    fail_unless(vmi_translate_kv2p(vmi, va) == 0, "unmapped address walked again");
+    fail_unless(vmi_translate_kv2p(vmi, va + 0x1000) == 0, "unmapped range walked again");
+    vmi_v2pcache_flush(vmi);
+    fail_unless(vmi_translate_kv2p(vmi, va) == 0x8000, "mapping not noticed after the flush");
+
+}
+END_TEST
+
+/* reads the first word of KERNEL_VA with vmi_read_async */
+static uint64_t
+read_kernel_async (vmi_instance_t vmi)
+{
+    access_context_t ctx = {
+        .translate_mechanism = VMI_TM_PROCESS_DTB,
+        .dtb = 0x1000,
+        .addr = KERNEL_VA
+    };
+    vmi_read_completion_t completion;
+    uint64_t value = 0;
+
+    fail_unless(VMI_SUCCESS == vmi_read_async(vmi, &ctx, &value, sizeof(value), NULL, NULL),
+                "vmi_read_async failed");
+    fail_unless(vmi_read_async_reap(vmi, &completion, 1, 1) == 1
+                && completion.bytes_read == sizeof(value), "async read failed");
+    return value;
+}
+
+START_TEST (test_memory_async_flush)
+{
+    vmi_instance_t vmi = NULL;
+
+    kernel[0x8000 / 8] = 0x11;
+    kernel[0x9000 / 8] = 0x22;
+    vmi = start_linux(NULL, 0);
+    fail_unless(read_kernel_async(vmi) == 0x11, "wrong async read");
+
+    // the workers read through the caches of the instance, flushed here
+    kernel[0x4000 / 8] = 0x9000 | 0x3;
+    vmi_v2pcache_flush(vmi);
+    fail_unless(read_kernel_async(vmi) == 0x22, "async read used a flushed translation");
+
+}
+END_TEST
+#endif
+#endif
+
+/* memory driver test cases */
+TCase *memory_tcase (void)
+{
+    TCase *tc_memory = tcase_create("LibVMI memory driver");
+    tcase_add_test(tc_memory, test_memory_read);
+    tcase_add_test(tc_memory, test_memory_write);
+    tcase_add_test(tc_memory, test_memory_vcpureg);
+    tcase_add_test(tc_memory, test_memory_clone);
+    return tc_memory;
+}
+
+#if ENABLE_LINUX == 1
+/* memory driver test cases over a Linux guest */
+TCase *memory_linux_tcase (void)
+{
+    TCase *tc_linux = tcase_create("LibVMI memory driver, Linux guest");
+    tcase_add_checked_fixture(tc_linux, setup_linux, teardown_linux);
+    tcase_add_test(tc_linux, test_memory_init_cache);
+    tcase_add_test(tc_linux, test_memory_lazy_init);
+    tcase_add_test(tc_linux, test_memory_compiled_ctx);
+    tcase_add_test(tc_linux, test_memory_compiled_ctx_threads);
+    tcase_add_test(tc_linux, test_memory_walk_list);
+    tcase_add_test(tc_linux, test_memory_struct);
+    tcase_add_test(tc_linux, test_memory_translate_batch);
+    tcase_add_test(tc_linux, test_memory_p2v);
+    tcase_add_test(tc_linux, test_memory_va_runs);
+    tcase_add_test(tc_linux, test_memory_read_stats);
+#if ENABLE_ADDRESS_CACHE == 1
+    tcase_add_test(tc_linux, test_memory_shared_kernel_v2p);
+    tcase_add_test(tc_linux, test_memory_negative_v2p);
+    tcase_add_test(tc_linux, test_memory_async_flush);
+#endif
+    return tc_linux;
+}
+#endif
@@ -22,6 +22,7 @@
  * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <config.h>
 #include <check.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +30,7 @@
 #include <inttypes.h>
 #include <pwd.h>
 #include "../libvmi/libvmi.h"
+#include "../libvmi/shm.h"
 #include "check_tests.h"
 
 
@@ -86,9 +88,10 @@ START_TEST (test_vmi_get_dgpma)
 }
 END_TEST
 
-#if ENABLE_KVM == 1
+#if ENABLE_KVM == 1 || ENABLE_FILE == 1
 /* test vmi_get_dgvma */
 // we use vmi_read_va() to verify vmi_get_dgvma()
+// (in file mode vmi_shm_snapshot_create() fails and the image is used as is)
 START_TEST (test_vmi_get_dgvma)
 {
     vmi_instance_t vmi = NULL;
@@ -128,7 +131,7 @@ TCase *shm_snapshot_tcase (void)
 #if ENABLE_SHM_SNAPSHOT == 1
     tcase_add_test(tc_init, test_libvmi_shm_snapshot_create);
     tcase_add_test(tc_init, test_vmi_get_dgpma);
-    #if ENABLE_KVM == 1
+    #if ENABLE_KVM == 1 || ENABLE_FILE == 1
     tcase_add_test(tc_init, test_vmi_get_dgvma);
     #endif
 #endif
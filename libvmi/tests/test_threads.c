@@ -0,0 +1,280 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <glib.h>
+#include "../libvmi/libvmi.h"
+#include "check_tests.h"
+#include "../libvmi/private.h"
+
+/*
+ * Several threads sharing one instance, or each using a clone of it, over a
+ * raw image larger than the page cache, every byte of a page being the low
+ * byte of its frame number.
+ */
+
+#define TEST_PAGE 0x1000
+#define TEST_PAGES 1024
+#define TEST_THREADS 8
+#define TEST_ROUNDS 8
+
+struct thread_args {
+    vmi_instance_t vmi;
+    unsigned int seed;
+    gboolean failed;
+};
+
+static void
+write_raw (char *path)
+{
+    int fd = mkstemp(path);
+    FILE *f = NULL;
+    unsigned char page[TEST_PAGE];
+    uint64_t pfn;
+
+    fail_unless(fd >= 0, "failed to create temporary image");
+    f = fdopen(fd, "w");
+    for (pfn = 0; pfn < TEST_PAGES; pfn++) {
+        memset(page, (int) (pfn & 0xff), TEST_PAGE);
+        fwrite(page, TEST_PAGE, 1, f);
+    }
+    fclose(f);
+}
+
+static gpointer
+reader (gpointer data)
+{
+    struct thread_args *args = data;
+    unsigned char buf[2 * TEST_PAGE];
+    int round;
+
+    for (round = 0; round < TEST_ROUNDS && !args->failed; round++) {
+        uint64_t pfn;
+
+        for (pfn = 0; pfn < TEST_PAGES - 1; pfn++) {
+            // reads straddle two pages, so two page cache shards
+            addr_t offset = rand_r(&args->seed) % TEST_PAGE;
+            addr_t pa = pfn * TEST_PAGE + offset;
+            size_t tail = TEST_PAGE - offset;
+
+            if (vmi_read_pa(args->vmi, pa, buf, TEST_PAGE) != TEST_PAGE
+                || buf[0] != (pfn & 0xff)
+                || buf[tail - 1] != (pfn & 0xff)
+                || buf[tail] != ((pfn + 1) & 0xff)
+                || buf[TEST_PAGE - 1] != ((pfn + 1) & 0xff)) {
+                args->failed = TRUE;
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+#if ENABLE_ADDRESS_CACHE == 1
+static gpointer
+translator (gpointer data)
+{
+    struct thread_args *args = data;
+    addr_t dtb = (args->seed + 1) * TEST_PAGE;
+    addr_t va;
+
+    for (va = TEST_PAGE; va <= TEST_PAGES * TEST_PAGE && !args->failed; va += TEST_PAGE) {
+        addr_t pa = 0;
+
+        vmi_v2pcache_add(args->vmi, va, dtb, va + dtb);
+        if (VMI_SUCCESS != v2p_cache_get(args->vmi, va + 0x10, dtb, &pa)
+            || pa != va + dtb + 0x10) {
+            args->failed = TRUE;
+        }
+        if (va % (64 * TEST_PAGE) == 0) {
+            v2p_cache_del(args->vmi, va, dtb);
+        }
+    }
+    return NULL;
+}
+#endif
+
+static void
+run_threads (vmi_instance_t vmi, GThreadFunc func, const char *name, gboolean clone)
+{
+    struct thread_args args[TEST_THREADS];
+    GThread *threads[TEST_THREADS];
+    gint64 start = g_get_monotonic_time();
+    gint64 elapsed = 0;
+    int i;
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        args[i].vmi = vmi;
+        if (clone) {
+            fail_unless(VMI_SUCCESS == vmi_clone(vmi, &args[i].vmi), "vmi_clone failed");
+        }
+        args[i].seed = i;
+        args[i].failed = FALSE;
+        threads[i] = g_thread_new(name, func, &args[i]);
+    }
+    for (i = 0; i < TEST_THREADS; i++) {
+        g_thread_join(threads[i]);
+        fail_unless(!args[i].failed, "%s thread %d saw wrong data", name, i);
+        if (clone) {
+            vmi_destroy(args[i].vmi);
+        }
+    }
+
+    elapsed = g_get_monotonic_time() - start;
+    printf("%d %s threads done in %"PRId64" us\n", TEST_THREADS, name, elapsed);
+}
+
+START_TEST (test_threads_read)
+{
+    char path[] = "/tmp/libvmi_check_threads_XXXXXX";
+    vmi_instance_t vmi = NULL;
+
+    write_raw(path);
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE | VMI_INIT_PARTIAL, path),
+                "vmi_init failed on %s", path);
+
+    run_threads(vmi, reader, "reader", FALSE);
+
+    vmi_destroy(vmi);
+    unlink(path);
+}
+END_TEST
+
+START_TEST (test_threads_clone)
+{
+    char path[] = "/tmp/libvmi_check_threads_XXXXXX";
+    vmi_instance_t vmi = NULL;
+    vmi_instance_t clone = NULL;
+
+    write_raw(path);
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE | VMI_INIT_PARTIAL, path),
+                "vmi_init failed on %s", path);
+
+    run_threads(vmi, reader, "clone reader", TRUE);
+
+    // the parent may go first
+    fail_unless(VMI_SUCCESS == vmi_clone(vmi, &clone), "vmi_clone failed");
+    vmi_destroy(vmi);
+    fail_unless(vmi_get_memsize(clone) == TEST_PAGES * TEST_PAGE, "wrong memory size of clone");
+    vmi_destroy(clone);
+    unlink(path);
+}
+END_TEST
+
+#if ENABLE_ADDRESS_CACHE == 1
+START_TEST (test_threads_translate)
+{
+    char path[] = "/tmp/libvmi_check_threads_XXXXXX";
+    vmi_instance_t vmi = NULL;
+
+    write_raw(path);
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE | VMI_INIT_PARTIAL, path),
+                "vmi_init failed on %s", path);
+
+    run_threads(vmi, translator, "translator", FALSE);
+
+    vmi_destroy(vmi);
+    unlink(path);
+}
+END_TEST
+#endif
+
+static void
+read_done (vmi_instance_t vmi, const vmi_read_completion_t *completion)
+{
+    gint *done = completion->data;
+    unsigned char *page = completion->buf;
+
+    if (completion->bytes_read == TEST_PAGE && page[0] == ((completion->ctx.addr / TEST_PAGE) & 0xff)) {
+        g_atomic_int_inc(done);
+    }
+}
+
+START_TEST (test_threads_read_async)
+{
+    char path[] = "/tmp/libvmi_check_threads_XXXXXX";
+    vmi_instance_t vmi = NULL;
+    unsigned char *pages = g_malloc(TEST_PAGES * TEST_PAGE);
+    vmi_read_completion_t completions[16];
+    access_context_t ctx = { .translate_mechanism = VMI_TM_NONE };
+    gint done = 0;
+    size_t reaped = 0;
+    uint64_t pfn;
+
+    write_raw(path);
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE | VMI_INIT_PARTIAL, path),
+                "vmi_init failed on %s", path);
+    fail_unless(vmi_read_async_fd(vmi) >= 0, "no async completion fd");
+
+    // completions queued for reaping
+    for (pfn = 0; pfn < TEST_PAGES; pfn++) {
+        ctx.addr = pfn * TEST_PAGE;
+        fail_unless(VMI_SUCCESS == vmi_read_async(vmi, &ctx, pages + pfn * TEST_PAGE,
+                                                  TEST_PAGE, NULL, NULL),
+                    "vmi_read_async failed");
+    }
+    while (reaped < TEST_PAGES) {
+        size_t i, n = vmi_read_async_reap(vmi, completions, 16, 1);
+
+        fail_unless(n > 0, "reaped nothing with reads in flight");
+        for (i = 0; i < n; i++) {
+            fail_unless(completions[i].bytes_read == TEST_PAGE, "short async read");
+        }
+        reaped += n;
+    }
+    for (pfn = 0; pfn < TEST_PAGES; pfn++) {
+        fail_unless(pages[pfn * TEST_PAGE] == (pfn & 0xff), "wrong contents of page %"PRIu64, pfn);
+    }
+
+    // completions through callbacks
+    for (pfn = 0; pfn < TEST_PAGES; pfn++) {
+        ctx.addr = pfn * TEST_PAGE;
+        fail_unless(VMI_SUCCESS == vmi_read_async(vmi, &ctx, pages + pfn * TEST_PAGE,
+                                                  TEST_PAGE, read_done, &done),
+                    "vmi_read_async failed");
+    }
+    fail_unless(vmi_read_async_reap(vmi, completions, 16, 1) == 0, "callback read got queued");
+    fail_unless(g_atomic_int_get(&done) == TEST_PAGES, "only %d reads called back", done);
+
+    vmi_destroy(vmi);
+    g_free(pages);
+    unlink(path);
+}
+END_TEST
+
+/* concurrent access test cases */
+TCase *threads_tcase (void)
+{
+    TCase *tc_threads = tcase_create("LibVMI threads");
+    tcase_set_timeout(tc_threads, 60);
+    tcase_add_test(tc_threads, test_threads_read);
+    tcase_add_test(tc_threads, test_threads_clone);
+    tcase_add_test(tc_threads, test_threads_read_async);
+#if ENABLE_ADDRESS_CACHE == 1
+    tcase_add_test(tc_threads, test_threads_translate);
+#endif
+    return tc_threads;
+}
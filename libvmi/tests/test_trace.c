@@ -0,0 +1,190 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <glib.h>
+#include "../libvmi/libvmi.h"
+#include "check_tests.h"
+
+/*
+ * Record a session on a small raw image and replay it from the trace.
+ * Pages 1 and 2 of the image have the same contents.
+ */
+
+#define TEST_PAGE 0x1000
+#define TEST_NR_PAGES 4
+
+static const unsigned char test_contents[TEST_NR_PAGES] = { 0x10, 0x20, 0x20, 0x30 };
+
+static void
+write_image (char *path)
+{
+    unsigned char page[TEST_PAGE];
+    int fd = mkstemp(path);
+    int i;
+
+    fail_unless(fd >= 0, "failed to create temporary image");
+    for (i = 0; i < TEST_NR_PAGES; i++) {
+        memset(page, test_contents[i], TEST_PAGE);
+        fail_unless(write(fd, page, TEST_PAGE) == TEST_PAGE, "failed to write image");
+    }
+    close(fd);
+}
+
+static void
+read_pages (vmi_instance_t vmi)
+{
+    unsigned char buf[TEST_PAGE];
+    addr_t pa;
+
+    for (pa = 0; pa < TEST_NR_PAGES * TEST_PAGE; pa += TEST_PAGE) {
+        fail_unless(vmi_read_pa(vmi, pa, buf, TEST_PAGE) == TEST_PAGE,
+                    "failed to read PA 0x%"PRIx64, pa);
+        fail_unless(buf[0] == test_contents[pa / TEST_PAGE]
+                    && buf[TEST_PAGE - 1] == test_contents[pa / TEST_PAGE],
+                    "wrong contents at PA 0x%"PRIx64, pa);
+    }
+}
+
+START_TEST (test_trace_record_replay)
+{
+    char image[] = "/tmp/libvmi_check_image_XXXXXX";
+    char trace[] = "/tmp/libvmi_check_trace_XXXXXX";
+    vmi_instance_t vmi = NULL;
+    GHashTable *config = NULL;
+    int fd = -1;
+
+    write_image(image);
+    fd = mkstemp(trace);
+    fail_unless(fd >= 0, "failed to create temporary trace");
+    close(fd);
+
+    /* record */
+    config = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_insert(config, "name", image);
+    g_hash_table_insert(config, "trace_record", trace);
+    fail_unless(VMI_SUCCESS == vmi_init_custom(&vmi,
+                VMI_FILE | VMI_INIT_PARTIAL | VMI_CONFIG_GHASHTABLE, config),
+                "vmi_init_custom failed on %s", image);
+    read_pages(vmi);
+    vmi_destroy(vmi);
+    g_hash_table_destroy(config);
+
+    /* the image is not needed for the replay */
+    unlink(image);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_TRACE | VMI_INIT_PARTIAL, trace),
+                "failed to replay %s", trace);
+    fail_unless(vmi_get_access_mode(vmi) == VMI_FILE, "replay has the wrong access mode");
+    fail_unless(vmi_get_memsize(vmi) == TEST_NR_PAGES * TEST_PAGE,
+                "wrong memory size 0x%"PRIx64, vmi_get_memsize(vmi));
+    read_pages(vmi);
+    vmi_destroy(vmi);
+    unlink(trace);
+}
+END_TEST
+
+/* a page whose contents change between reads, read through the memory driver */
+static void
+read_changing (vmi_instance_t vmi, unsigned char *memory)
+{
+    static const unsigned char expected[] = { 0x10, 0x10, 0x11, 0x20, 0x11, 0x11, 0x10 };
+    unsigned char buf[TEST_PAGE];
+    size_t i;
+
+    for (i = 0; i < sizeof(expected); i++) {
+        addr_t pa = 0x20 == expected[i] ? TEST_PAGE : 0;
+
+        if (memory && i && expected[i] != expected[i - 1] && !pa) {
+            memset(memory, expected[i], TEST_PAGE);
+        }
+        fail_unless(vmi_read_pa(vmi, pa, buf, TEST_PAGE) == TEST_PAGE, "failed to read %zu", i);
+        fail_unless(buf[0] == expected[i], "read %zu returned 0x%x", i, buf[0]);
+    }
+}
+
+#if ENABLE_MEMORY == 1
+START_TEST (test_trace_changing_page)
+{
+    char trace[] = "/tmp/libvmi_check_trace_XXXXXX";
+    unsigned char *memory = g_malloc(2 * TEST_PAGE);
+    uint64_t size = 2 * TEST_PAGE;
+    vmi_instance_t vmi = NULL;
+    GHashTable *config = NULL;
+    int fd = mkstemp(trace);
+
+    fail_unless(fd >= 0, "failed to create temporary trace");
+    close(fd);
+    memset(memory, 0x10, TEST_PAGE);
+    memset(memory + TEST_PAGE, 0x20, TEST_PAGE);
+
+    /* every read is replayed in order, also those repeating an older one */
+    config = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_insert(config, "name", "check-trace");
+    g_hash_table_insert(config, "memory", memory);
+    g_hash_table_insert(config, "memory_size", &size);
+    g_hash_table_insert(config, "trace_record", trace);
+    fail_unless(VMI_SUCCESS == vmi_init_custom(&vmi,
+                VMI_MEMORY | VMI_INIT_PARTIAL | VMI_CONFIG_GHASHTABLE, config),
+                "vmi_init_custom failed for VMI_MEMORY");
+    g_hash_table_destroy(config);
+    read_changing(vmi, memory);
+    vmi_destroy(vmi);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_TRACE | VMI_INIT_PARTIAL, trace),
+                "failed to replay %s", trace);
+    read_changing(vmi, NULL);
+    vmi_destroy(vmi);
+    g_free(memory);
+    unlink(trace);
+}
+END_TEST
+#endif
+
+START_TEST (test_trace_bad_file)
+{
+    char path[] = "/tmp/libvmi_check_trace_XXXXXX";
+    vmi_instance_t vmi = NULL;
+
+    write_image(path);
+    fail_unless(VMI_FAILURE == vmi_init(&vmi, VMI_TRACE | VMI_INIT_PARTIAL, path),
+                "replayed a file that is not a trace");
+    vmi_destroy(vmi);
+    unlink(path);
+}
+END_TEST
+
+/* trace record and replay test cases */
+TCase *trace_tcase (void)
+{
+    TCase *tc_trace = tcase_create("LibVMI trace");
+    tcase_add_test(tc_trace, test_trace_record_replay);
+#if ENABLE_MEMORY == 1
+    tcase_add_test(tc_trace, test_trace_changing_page);
+#endif
+    tcase_add_test(tc_trace, test_trace_bad_file);
+    return tc_trace;
+}
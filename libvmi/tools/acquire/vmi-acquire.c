@@ -0,0 +1,734 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Acquires the physical memory of a guest into a raw, LiME or ELF core
+ * image. The RAM ranges of the memory map are cut into chunks that a pool
+ * of threads, each with its own clone of the instance, reads with one
+ * bulk read per chunk and writes with pwrite at the chunk's place in the
+ * image. Zero and unreadable pages are never written, so they stay holes
+ * of a sparse file.
+ *
+ * Compressed images are a stream of one zstd or LZ4 frame per chunk, so
+ * the chunks are compressed in parallel and written in order.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <glib.h>
+#include <libvmi/libvmi.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#define ACQUIRE_PAGE 0x1000
+#define ACQUIRE_CHUNK_SIZE (4 * 1024 * 1024)
+
+/* LiME range header, see lime.h of the LiME module */
+#define LIME_MAGIC 0x4C694D45
+#define LIME_VERSION 1
+
+typedef struct lime_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t s_addr;
+    uint64_t e_addr;
+    uint8_t reserved[8];
+} __attribute__ ((packed)) lime_header_t;
+
+typedef enum {
+    FORMAT_RAW,
+    FORMAT_LIME,
+    FORMAT_ELF
+} format_t;
+
+typedef enum {
+    COMPRESS_NONE,
+    COMPRESS_ZSTD,
+    COMPRESS_LZ4
+} compress_t;
+
+typedef struct chunk {
+    addr_t paddr;
+    size_t length;
+    off_t offset;           /**< place of the data in the uncompressed image */
+    void *prefix;           /**< format headers written right before the data */
+    size_t prefix_length;
+    gboolean hole;          /**< zeros between the ranges of a compressed raw image */
+    uint64_t unreadable;    /**< pages that couldn't be read */
+    char *digest;           /**< SHA-256 of the data */
+} chunk_t;
+
+typedef struct acquire {
+    vmi_instance_t vmi;
+    int fd;
+    int direct_fd;          /**< O_DIRECT descriptor, -1 if not used */
+    format_t format;
+    compress_t compress;
+    gboolean manifest;
+    chunk_t *chunks;
+    guint nchunks;
+    off_t image_size;       /**< size of the uncompressed image */
+    gint next_chunk;        /**< next chunk to take, atomic */
+
+    GMutex lock;
+    GCond written;
+    guint next_write;       /**< next chunk of the compressed stream */
+    gint failed;
+    uint64_t pages_acquired;
+    uint64_t pages_zero;
+    uint64_t pages_unreadable;
+} acquire_t;
+
+typedef struct worker {
+    acquire_t *acq;
+    vmi_instance_t vmi;
+    GThread *thread;
+} worker_t;
+
+static void
+usage(
+    const char *name)
+{
+    printf("Usage: %s [options] <name of VM or file> <output file>\n", name);
+    printf("  -t <threads>   number of reader threads (default: number of CPUs)\n");
+    printf("  -s <MB>        chunk size in MB (default: 4)\n");
+    printf("  -f <format>    raw, lime or elf (default: raw)\n");
+#if defined(HAVE_ZSTD) || defined(HAVE_LZ4)
+    printf("  -z <method>    compress the image:%s%s\n",
+#ifdef HAVE_ZSTD
+           " zstd",
+#else
+           "",
+#endif
+#ifdef HAVE_LZ4
+           " lz4"
+#else
+           ""
+#endif
+          );
+#endif
+    printf("  -d             write with O_DIRECT where the layout allows it\n");
+    printf("  -m             write a SHA-256 manifest of the chunks to <output file>.sha256\n");
+}
+
+static gboolean
+write_all(
+    int fd,
+    const void *buf,
+    size_t length,
+    off_t offset)
+{
+    while (length) {
+        ssize_t ret = offset < 0 ? write(fd, buf, length) : pwrite(fd, buf, length, offset);
+
+        if (ret < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            fprintf(stderr, "write failed: %s\n", strerror(errno));
+            return FALSE;
+        }
+        buf = (const char *) buf + ret;
+        length -= ret;
+        if (offset >= 0) {
+            offset += ret;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean
+page_is_zero(
+    const unsigned char *page,
+    size_t length)
+{
+    return !page[0] && !memcmp(page, page + 1, length - 1);
+}
+
+/* reads a chunk, the pages that fail are left zero */
+static void
+read_chunk(
+    vmi_instance_t vmi,
+    chunk_t *chunk,
+    unsigned char *buf)
+{
+    size_t done = 0;
+
+    if (chunk->hole) {
+        memset(buf, 0, chunk->length);
+        return;
+    }
+
+    vmi_prefetch_pa(vmi, chunk->paddr, chunk->length);
+    while (done < chunk->length) {
+        size_t next;
+
+        done += vmi_read_pa(vmi, chunk->paddr + done, buf + done, chunk->length - done);
+        if (done >= chunk->length) {
+            break;
+        }
+
+        /* skip the page that failed */
+        next = ((chunk->paddr + done) | (ACQUIRE_PAGE - 1)) + 1 - chunk->paddr;
+        if (next > chunk->length) {
+            next = chunk->length;
+        }
+        memset(buf + done, 0, next - done);
+        chunk->unreadable++;
+        done = next;
+    }
+}
+
+/* writes the non-zero pages of a chunk at its place in the image */
+static gboolean
+write_sparse(
+    acquire_t *acq,
+    chunk_t *chunk,
+    const unsigned char *buf)
+{
+    size_t start = 0, pos = 0;
+    uint64_t zero = 0;
+
+    if (chunk->prefix_length
+        && !write_all(acq->fd, chunk->prefix, chunk->prefix_length,
+                      chunk->offset - chunk->prefix_length)) {
+        return FALSE;
+    }
+
+    while (pos <= chunk->length) {
+        size_t len = MIN(ACQUIRE_PAGE, chunk->length - pos);
+
+        if (pos < chunk->length && !page_is_zero(buf + pos, len)) {
+            pos += len;
+            continue;
+        }
+
+        /* a run of data ends here */
+        if (pos > start) {
+            off_t offset = chunk->offset + start;
+            size_t run = pos - start;
+            int fd = acq->direct_fd;
+
+            if (fd < 0 || (offset | run) & (ACQUIRE_PAGE - 1)) {
+                fd = acq->fd;
+            }
+            if (!write_all(fd, buf + start, run, offset)) {
+                return FALSE;
+            }
+        }
+
+        if (pos == chunk->length) {
+            break;
+        }
+        zero++;
+        pos += len;
+        start = pos;
+    }
+
+    g_mutex_lock(&acq->lock);
+    acq->pages_zero += zero;
+    g_mutex_unlock(&acq->lock);
+    return TRUE;
+}
+
+/* compresses the prefix and data of a chunk into a frame */
+static size_t
+compress_chunk(
+    acquire_t *acq,
+    chunk_t *chunk,
+    const unsigned char *in,
+    size_t in_length,
+    unsigned char **out,
+    size_t *out_capacity)
+{
+    size_t bound = 0, ret = 0;
+
+    switch (acq->compress) {
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+            bound = ZSTD_compressBound(in_length);
+            break;
+#endif
+#ifdef HAVE_LZ4
+        case COMPRESS_LZ4:
+            bound = LZ4F_compressFrameBound(in_length, NULL);
+            break;
+#endif
+        default:
+            return 0;
+    }
+
+    if (*out_capacity < bound) {
+        *out = g_realloc(*out, bound);
+        *out_capacity = bound;
+    }
+
+    switch (acq->compress) {
+#ifdef HAVE_ZSTD
+        case COMPRESS_ZSTD:
+            ret = ZSTD_compress(*out, bound, in, in_length, 3);
+            if (ZSTD_isError(ret)) {
+                fprintf(stderr, "zstd: %s\n", ZSTD_getErrorName(ret));
+                return 0;
+            }
+            break;
+#endif
+#ifdef HAVE_LZ4
+        case COMPRESS_LZ4:
+            ret = LZ4F_compressFrame(*out, bound, in, in_length, NULL);
+            if (LZ4F_isError(ret)) {
+                fprintf(stderr, "lz4: %s\n", LZ4F_getErrorName(ret));
+                return 0;
+            }
+            break;
+#endif
+        default:
+            return 0;
+    }
+
+    return ret;
+}
+
+/* appends a frame to the stream once the chunks before it are written */
+static gboolean
+write_ordered(
+    acquire_t *acq,
+    guint index,
+    const unsigned char *frame,
+    size_t length)
+{
+    gboolean ok = FALSE;
+
+    g_mutex_lock(&acq->lock);
+    while (acq->next_write != index && !acq->failed) {
+        g_cond_wait(&acq->written, &acq->lock);
+    }
+    if (acq->failed) {
+        g_mutex_unlock(&acq->lock);
+        return FALSE;
+    }
+    g_mutex_unlock(&acq->lock);
+
+    /* the other workers wait for this chunk, no need to hold the lock */
+    ok = write_all(acq->fd, frame, length, -1);
+
+    g_mutex_lock(&acq->lock);
+    acq->next_write++;
+    g_cond_broadcast(&acq->written);
+    g_mutex_unlock(&acq->lock);
+    return ok;
+}
+
+static void
+fail(
+    acquire_t *acq)
+{
+    g_mutex_lock(&acq->lock);
+    acq->failed = TRUE;
+    g_cond_broadcast(&acq->written);
+    g_mutex_unlock(&acq->lock);
+}
+
+static gpointer
+worker_run(
+    gpointer data)
+{
+    worker_t *w = data;
+    acquire_t *acq = w->acq;
+    vmi_instance_t vmi = w->vmi ? w->vmi : acq->vmi;
+    size_t max_prefix = 0, max_length = 0;
+    unsigned char *buf = NULL, *out = NULL;
+    size_t out_capacity = 0;
+    guint i;
+
+    for (i = 0; i < acq->nchunks; i++) {
+        max_prefix = MAX(max_prefix, acq->chunks[i].prefix_length);
+        max_length = MAX(max_length, acq->chunks[i].length);
+    }
+
+    /* page aligned for O_DIRECT, the prefix goes right before the data */
+    max_prefix = (max_prefix + ACQUIRE_PAGE - 1) & ~((size_t) ACQUIRE_PAGE - 1);
+    if (posix_memalign((void **) &buf, ACQUIRE_PAGE, max_prefix + max_length)) {
+        fail(acq);
+        return NULL;
+    }
+
+    while (!g_atomic_int_get(&acq->failed)) {
+        guint index = g_atomic_int_add(&acq->next_chunk, 1);
+        chunk_t *chunk = NULL;
+        unsigned char *data = buf + max_prefix;
+        GChecksum *checksum = NULL;
+
+        if (index >= acq->nchunks) {
+            break;
+        }
+        chunk = &acq->chunks[index];
+
+        read_chunk(vmi, chunk, data);
+
+        if (acq->manifest) {
+            checksum = g_checksum_new(G_CHECKSUM_SHA256);
+            g_checksum_update(checksum, data, chunk->length);
+            chunk->digest = g_strdup(g_checksum_get_string(checksum));
+            g_checksum_free(checksum);
+        }
+
+        if (COMPRESS_NONE == acq->compress) {
+            if (!write_sparse(acq, chunk, data)) {
+                fail(acq);
+                break;
+            }
+        } else {
+            unsigned char *in = data - chunk->prefix_length;
+            size_t length = 0;
+
+            memcpy(in, chunk->prefix, chunk->prefix_length);
+            length = compress_chunk(acq, chunk, in, chunk->prefix_length + chunk->length,
+                                    &out, &out_capacity);
+            if (!length || !write_ordered(acq, index, out, length)) {
+                fail(acq);
+                break;
+            }
+        }
+
+        g_mutex_lock(&acq->lock);
+        acq->pages_acquired += (chunk->length + ACQUIRE_PAGE - 1) / ACQUIRE_PAGE;
+        acq->pages_unreadable += chunk->unreadable;
+        g_mutex_unlock(&acq->lock);
+    }
+
+    free(buf);
+    g_free(out);
+    return NULL;
+}
+
+static void
+add_chunks(
+    GArray *chunks,
+    addr_t paddr,
+    addr_t length,
+    off_t offset,
+    size_t chunk_size,
+    gboolean hole)
+{
+    addr_t done = 0;
+
+    for (done = 0; done < length; done += chunk_size) {
+        chunk_t chunk = {
+            .paddr = paddr + done,
+            .length = MIN(chunk_size, length - done),
+            .offset = offset + done,
+            .hole = hole
+        };
+        g_array_append_val(chunks, chunk);
+    }
+}
+
+/* cuts the memory map into chunks and lays out the image */
+static void
+plan_image(
+    acquire_t *acq,
+    size_t chunk_size)
+{
+    const vmi_pa_range_t *ranges = NULL;
+    size_t count = vmi_get_memory_map(acq->vmi, &ranges), i;
+    GArray *chunks = g_array_new(FALSE, TRUE, sizeof(chunk_t));
+    off_t offset = 0;
+    addr_t end = 0;
+
+    if (FORMAT_ELF == acq->format) {
+        size_t headers = sizeof(Elf64_Ehdr) + count * sizeof(Elf64_Phdr);
+        offset = (headers + ACQUIRE_PAGE - 1) & ~((off_t) ACQUIRE_PAGE - 1);
+    }
+
+    for (i = 0; i < count; i++) {
+        guint first = chunks->len;
+
+        if (FORMAT_RAW == acq->format) {
+            /* a compressed stream can't skip the holes */
+            if (COMPRESS_NONE != acq->compress && ranges[i].paddr > end) {
+                add_chunks(chunks, end, ranges[i].paddr - end, end, chunk_size, TRUE);
+            }
+            offset = ranges[i].paddr;
+        } else if (FORMAT_LIME == acq->format) {
+            lime_header_t *header = g_malloc0(sizeof(lime_header_t));
+
+            header->magic = LIME_MAGIC;
+            header->version = LIME_VERSION;
+            header->s_addr = ranges[i].paddr;
+            header->e_addr = ranges[i].paddr + ranges[i].length - 1;
+            offset += sizeof(lime_header_t);
+
+            add_chunks(chunks, ranges[i].paddr, ranges[i].length, offset, chunk_size, FALSE);
+            g_array_index(chunks, chunk_t, first).prefix = header;
+            g_array_index(chunks, chunk_t, first).prefix_length = sizeof(lime_header_t);
+            offset += ranges[i].length;
+            continue;
+        }
+
+        add_chunks(chunks, ranges[i].paddr, ranges[i].length, offset, chunk_size, FALSE);
+        offset += ranges[i].length;
+        end = ranges[i].paddr + ranges[i].length;
+    }
+
+    if (FORMAT_RAW == acq->format) {
+        offset = vmi_get_max_physical_address(acq->vmi);
+        if (COMPRESS_NONE != acq->compress && (addr_t) offset > end) {
+            add_chunks(chunks, end, offset - end, end, chunk_size, TRUE);
+        }
+    }
+
+    if (FORMAT_ELF == acq->format && chunks->len) {
+        chunk_t *first = &g_array_index(chunks, chunk_t, 0);
+        unsigned char *headers = g_malloc0(first->offset);
+        Elf64_Ehdr *ehdr = (Elf64_Ehdr *) headers;
+        Elf64_Phdr *phdr = (Elf64_Phdr *) (headers + sizeof(Elf64_Ehdr));
+        off_t data = first->offset;
+
+        memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+        ehdr->e_ident[EI_CLASS] = ELFCLASS64;
+        ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+        ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+        ehdr->e_type = ET_CORE;
+        ehdr->e_machine = 4 == vmi_get_address_width(acq->vmi) ? EM_386 : EM_X86_64;
+        ehdr->e_version = EV_CURRENT;
+        ehdr->e_phoff = sizeof(Elf64_Ehdr);
+        ehdr->e_ehsize = sizeof(Elf64_Ehdr);
+        ehdr->e_phentsize = sizeof(Elf64_Phdr);
+        ehdr->e_phnum = count;
+
+        for (i = 0; i < count; i++) {
+            phdr[i].p_type = PT_LOAD;
+            phdr[i].p_offset = data;
+            phdr[i].p_paddr = ranges[i].paddr;
+            phdr[i].p_filesz = ranges[i].length;
+            phdr[i].p_memsz = ranges[i].length;
+            phdr[i].p_align = ACQUIRE_PAGE;
+            data += ranges[i].length;
+        }
+
+        first->prefix = headers;
+        first->prefix_length = first->offset;
+    }
+
+    acq->image_size = offset;
+    acq->nchunks = chunks->len;
+    acq->chunks = (chunk_t *) g_array_free(chunks, FALSE);
+}
+
+static gboolean
+write_manifest(
+    acquire_t *acq,
+    const char *output)
+{
+    char *path = g_strdup_printf("%s.sha256", output);
+    FILE *f = fopen(path, "w");
+    guint i;
+
+    if (!f) {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        g_free(path);
+        return FALSE;
+    }
+
+    /* paddr, length, unreadable pages and digest of every chunk of RAM */
+    for (i = 0; i < acq->nchunks; i++) {
+        if (!acq->chunks[i].hole) {
+            fprintf(f, "0x%016"PRIx64" 0x%zx %"PRIu64" %s\n", acq->chunks[i].paddr,
+                    acq->chunks[i].length, acq->chunks[i].unreadable, acq->chunks[i].digest);
+        }
+    }
+
+    fclose(f);
+    g_free(path);
+    return TRUE;
+}
+
+int
+main(
+    int argc,
+    char **argv)
+{
+    acquire_t acq;
+    worker_t *workers = NULL;
+    unsigned int nworkers = g_get_num_processors();
+    size_t chunk_size = ACQUIRE_CHUNK_SIZE;
+    gboolean direct = FALSE;
+    struct timeval start, end;
+    double seconds = 0;
+    int ret = 1, opt;
+    unsigned int i;
+
+    memset(&acq, 0, sizeof(acq));
+    acq.fd = -1;
+    acq.direct_fd = -1;
+    g_mutex_init(&acq.lock);
+    g_cond_init(&acq.written);
+
+    while ((opt = getopt(argc, argv, "t:s:f:z:dmh")) != -1) {
+        switch (opt) {
+            case 't':
+                nworkers = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                chunk_size = strtoull(optarg, NULL, 0) * 1024 * 1024;
+                break;
+            case 'f':
+                if (!strcmp(optarg, "raw")) {
+                    acq.format = FORMAT_RAW;
+                } else if (!strcmp(optarg, "lime")) {
+                    acq.format = FORMAT_LIME;
+                } else if (!strcmp(optarg, "elf")) {
+                    acq.format = FORMAT_ELF;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'z':
+#ifdef HAVE_ZSTD
+                if (!strcmp(optarg, "zstd")) {
+                    acq.compress = COMPRESS_ZSTD;
+                    break;
+                }
+#endif
+#ifdef HAVE_LZ4
+                if (!strcmp(optarg, "lz4")) {
+                    acq.compress = COMPRESS_LZ4;
+                    break;
+                }
+#endif
+                fprintf(stderr, "unsupported compression %s\n", optarg);
+                return 1;
+            case 'd':
+                direct = TRUE;
+                break;
+            case 'm':
+                acq.manifest = TRUE;
+                break;
+            default:
+                usage(argv[0]);
+                return 'h' == opt ? 0 : 1;
+        }
+    }
+
+    if (argc - optind != 2 || !nworkers || !chunk_size) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (vmi_init(&acq.vmi, VMI_AUTO | VMI_INIT_PARTIAL, argv[optind]) == VMI_FAILURE) {
+        printf("Failed to init LibVMI library.\n");
+        return 1;
+    }
+
+    acq.fd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (acq.fd < 0) {
+        printf("failed to open file for writing.\n");
+        goto done;
+    }
+    if (direct && COMPRESS_NONE == acq.compress) {
+        acq.direct_fd = open(argv[optind + 1], O_WRONLY | O_DIRECT);
+        if (acq.direct_fd < 0) {
+            fprintf(stderr, "O_DIRECT not available, using buffered writes\n");
+        }
+    }
+
+    plan_image(&acq, chunk_size & ~((size_t) ACQUIRE_PAGE - 1));
+
+    /* the holes of the sparse image are everything that isn't written */
+    if (COMPRESS_NONE == acq.compress && ftruncate(acq.fd, acq.image_size)) {
+        printf("failed to set the size of the file.\n");
+        goto done;
+    }
+
+    gettimeofday(&start, NULL);
+
+    /* every worker reads through its own clone of the instance */
+    workers = g_malloc0(nworkers * sizeof(worker_t));
+    for (i = 0; i < nworkers; i++) {
+        workers[i].acq = &acq;
+        if (VMI_FAILURE == vmi_clone(acq.vmi, &workers[i].vmi)) {
+            /* reads are thread safe, the parent is just slower to share */
+            workers[i].vmi = NULL;
+        }
+        workers[i].thread = g_thread_new("acquire", worker_run, &workers[i]);
+    }
+    for (i = 0; i < nworkers; i++) {
+        g_thread_join(workers[i].thread);
+        if (workers[i].vmi) {
+            vmi_destroy(workers[i].vmi);
+        }
+    }
+
+    gettimeofday(&end, NULL);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+
+    if (acq.failed) {
+        printf("acquisition failed.\n");
+        goto done;
+    }
+    if (fsync(acq.fd)) {
+        printf("failed to flush the image.\n");
+        goto done;
+    }
+    if (acq.manifest && !write_manifest(&acq, argv[optind + 1])) {
+        goto done;
+    }
+
+    printf("%"PRIu64" pages in %.2fs (%.1f MB/s), %"PRIu64" zero, %"PRIu64" unreadable\n",
+           acq.pages_acquired, seconds,
+           seconds > 0 ? acq.pages_acquired * ACQUIRE_PAGE / seconds / (1024 * 1024) : 0,
+           acq.pages_zero, acq.pages_unreadable);
+    ret = 0;
+
+done:
+    for (i = 0; i < acq.nchunks; i++) {
+        g_free(acq.chunks[i].prefix);
+        g_free(acq.chunks[i].digest);
+    }
+    g_free(acq.chunks);
+    g_free(workers);
+    if (acq.direct_fd >= 0) {
+        close(acq.direct_fd);
+    }
+    if (acq.fd >= 0) {
+        close(acq.fd);
+    }
+    g_cond_clear(&acq.written);
+    g_mutex_clear(&acq.lock);
+    vmi_destroy(acq.vmi);
+    return ret;
+}
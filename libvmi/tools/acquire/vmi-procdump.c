@@ -0,0 +1,563 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Dumps the user address space of processes, each into an ELF core with a
+ * PT_LOAD segment per virtually contiguous span, or into a sparse file.
+ * The sparse file starts with a page holding a sparse_header_t, the page
+ * of virtual address base + n is at offset PROCDUMP_PAGE + n, base being
+ * the first mapped page. The pages come from vmi_get_va_runs, so every
+ * physically contiguous run is read at once.
+ *
+ * The processes are dumped in parallel, each thread with its own clone of
+ * the instance, created before the threads start. Pages shared by several
+ * processes (the text of libraries, shared memory) are read from the guest
+ * once: the dumps that come later copy them from the first file with
+ * copy_file_range, which shares the blocks on filesystems with reflinks.
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib.h>
+#include <libvmi/libvmi.h>
+
+#define PROCDUMP_PAGE 0x1000
+#define PROCDUMP_MAX_READ (4 * 1024 * 1024)
+#define PROCDUMP_SPARSE_MAGIC "VMISPARS"
+
+typedef enum {
+    FORMAT_ELF,
+    FORMAT_SPARSE
+} format_t;
+
+/* where the contents of a physical page were written */
+typedef struct page_copy {
+    int fd;
+    off_t offset;
+} page_copy_t;
+
+/* first bytes of a sparse dump, the rest of its page is zero */
+typedef struct sparse_header {
+    char magic[8];          /**< PROCDUMP_SPARSE_MAGIC */
+    uint64_t base;          /**< virtual address of the page at PROCDUMP_PAGE */
+} sparse_header_t;
+
+typedef struct procdump {
+    vmi_instance_t vmi;
+    format_t format;
+    uint32_t flags;
+    const char *outdir;
+    vmi_pid_t *pids;
+    int *fds;               /**< output of each process, kept open for the copies */
+    guint npids;
+    gint next_pid;          /**< next process to take, atomic */
+
+    GMutex lock;
+    GHashTable *pages;      /**< frame -> page_copy_t */
+    gint failures;
+} procdump_t;
+
+typedef struct process_stats {
+    size_t runs;
+    size_t segments;
+    uint64_t bytes;
+    uint64_t shared;        /**< bytes copied from another dump */
+    uint64_t unreadable;    /**< bytes that couldn't be read */
+} process_stats_t;
+
+typedef struct worker {
+    procdump_t *pd;
+    vmi_instance_t vmi;
+    GThread *thread;
+} worker_t;
+
+static void
+usage(
+    const char *name)
+{
+    printf("Usage: %s [options] <name of VM or file> <output directory> <pid>...\n", name);
+    printf("  -t <threads>   number of processes dumped at once (default: number of CPUs)\n");
+    printf("  -f <format>    elf or sparse (default: elf)\n");
+    printf("  -k             include the kernel half of the address spaces\n");
+    printf("\n");
+    printf("Sparse dumps span from the lowest to the highest mapped address\n");
+    printf("after a header page, the filesystem must support such files\n");
+    printf("(e.g. XFS or btrfs, ext4 stops at 16 TB).\n");
+}
+
+static gboolean
+write_all(
+    int fd,
+    const void *buf,
+    size_t length,
+    off_t offset)
+{
+    while (length) {
+        ssize_t ret = pwrite(fd, buf, length, offset);
+
+        if (ret < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            fprintf(stderr, "write failed: %s\n", strerror(errno));
+            return FALSE;
+        }
+        buf = (const char *) buf + ret;
+        length -= ret;
+        offset += ret;
+    }
+    return TRUE;
+}
+
+/* copies a range already in another dump, FALSE if it has to be read */
+static gboolean
+copy_range(
+    int src_fd,
+    off_t src_offset,
+    int dst_fd,
+    off_t dst_offset,
+    size_t length)
+{
+    while (length) {
+        ssize_t ret = copy_file_range(src_fd, &src_offset, dst_fd, &dst_offset, length, 0);
+
+        if (ret <= 0) {
+            return FALSE;
+        }
+        length -= ret;
+    }
+    return TRUE;
+}
+
+static gboolean
+page_is_zero(
+    const unsigned char *page)
+{
+    return !page[0] && !memcmp(page, page + 1, PROCDUMP_PAGE - 1);
+}
+
+/* reads pages of a run from the guest and writes the non-zero ones */
+static gboolean
+dump_read(
+    procdump_t *pd,
+    vmi_instance_t vmi,
+    int fd,
+    addr_t paddr,
+    off_t offset,
+    size_t length,
+    unsigned char *buf,
+    process_stats_t *stats)
+{
+    size_t done = 0, pos;
+
+    while (done < length) {
+        done += vmi_read_pa(vmi, paddr + done, buf + done, length - done);
+        if (done < length) {
+            /* paged out or ballooned, left as a hole */
+            memset(buf + done, 0, PROCDUMP_PAGE);
+            stats->unreadable += PROCDUMP_PAGE;
+            done += PROCDUMP_PAGE;
+        }
+    }
+
+    for (pos = 0; pos < length; pos += PROCDUMP_PAGE) {
+        size_t start = pos;
+
+        if (page_is_zero(buf + pos)) {
+            continue;
+        }
+        while (pos + PROCDUMP_PAGE < length && !page_is_zero(buf + pos + PROCDUMP_PAGE)) {
+            pos += PROCDUMP_PAGE;
+        }
+        if (!write_all(fd, buf + start, pos + PROCDUMP_PAGE - start, offset + start)) {
+            return FALSE;
+        }
+    }
+
+    /* the pages are only looked up once written */
+    g_mutex_lock(&pd->lock);
+    for (pos = 0; pos < length; pos += PROCDUMP_PAGE) {
+        guint64 *frame = g_new(guint64, 1);
+        page_copy_t *copy = g_new(page_copy_t, 1);
+
+        *frame = (paddr + pos) / PROCDUMP_PAGE;
+        copy->fd = fd;
+        copy->offset = offset + pos;
+        if (g_hash_table_contains(pd->pages, frame)) {
+            g_free(frame);
+            g_free(copy);
+        } else {
+            g_hash_table_insert(pd->pages, frame, copy);
+        }
+    }
+    g_mutex_unlock(&pd->lock);
+    return TRUE;
+}
+
+/* dumps a run, copying the pages another dump holds already */
+static gboolean
+dump_run(
+    procdump_t *pd,
+    vmi_instance_t vmi,
+    int fd,
+    const vmi_va_run_t *run,
+    off_t offset,
+    unsigned char *buf,
+    process_stats_t *stats)
+{
+    size_t pos = 0;
+
+    while (pos < run->length) {
+        guint64 frame = (run->paddr + pos) / PROCDUMP_PAGE;
+        page_copy_t first, *copy = NULL;
+        size_t end = pos + PROCDUMP_PAGE;
+        gboolean shared = FALSE;
+
+        /* the longest stretch that is either all copies of consecutive
+           pages of one other dump, or all to be read */
+        g_mutex_lock(&pd->lock);
+        copy = g_hash_table_lookup(pd->pages, &frame);
+        if (copy && copy->fd != fd) {
+            first = *copy;
+            shared = TRUE;
+        }
+        for (; end < run->length && end - pos < PROCDUMP_MAX_READ; end += PROCDUMP_PAGE) {
+            frame = (run->paddr + end) / PROCDUMP_PAGE;
+            copy = g_hash_table_lookup(pd->pages, &frame);
+            if (shared) {
+                if (!copy || copy->fd != first.fd
+                    || copy->offset != first.offset + (off_t) (end - pos)) {
+                    break;
+                }
+            } else if (copy && copy->fd != fd) {
+                break;
+            }
+        }
+        g_mutex_unlock(&pd->lock);
+
+        if (shared && copy_range(first.fd, first.offset, fd, offset + pos, end - pos)) {
+            stats->shared += end - pos;
+        } else if (!dump_read(pd, vmi, fd, run->paddr + pos, offset + pos, end - pos,
+                              buf, stats)) {
+            return FALSE;
+        }
+        pos = end;
+    }
+
+    stats->bytes += run->length;
+    return TRUE;
+}
+
+/* the ELF header and a PT_LOAD per virtually contiguous span of runs */
+static off_t
+write_elf_headers(
+    vmi_instance_t vmi,
+    int fd,
+    const vmi_va_run_t *runs,
+    size_t count,
+    off_t *offsets,
+    process_stats_t *stats)
+{
+    GArray *phdrs = g_array_new(FALSE, TRUE, sizeof(Elf64_Phdr));
+    Elf64_Ehdr ehdr;
+    off_t data = 0, headers = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        Elf64_Phdr *last = phdrs->len ? &g_array_index(phdrs, Elf64_Phdr, phdrs->len - 1) : NULL;
+
+        if (last && last->p_vaddr + last->p_memsz == runs[i].vaddr) {
+            last->p_filesz += runs[i].length;
+            last->p_memsz += runs[i].length;
+        } else {
+            Elf64_Phdr phdr = {
+                .p_type = PT_LOAD,
+                .p_flags = PF_R,
+                .p_vaddr = runs[i].vaddr,
+                .p_paddr = runs[i].paddr,
+                .p_filesz = runs[i].length,
+                .p_memsz = runs[i].length,
+                .p_align = PROCDUMP_PAGE
+            };
+            g_array_append_val(phdrs, phdr);
+        }
+    }
+
+    headers = sizeof(Elf64_Ehdr) + phdrs->len * sizeof(Elf64_Phdr);
+    data = (headers + PROCDUMP_PAGE - 1) & ~((off_t) PROCDUMP_PAGE - 1);
+
+    /* the runs of a span follow each other in the file */
+    for (i = 0; i < count; i++) {
+        offsets[i] = data;
+        data += runs[i].length;
+    }
+    data = offsets[0];
+    for (i = 0; i < phdrs->len; i++) {
+        Elf64_Phdr *phdr = &g_array_index(phdrs, Elf64_Phdr, i);
+        phdr->p_offset = data;
+        data += phdr->p_filesz;
+    }
+
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_type = ET_CORE;
+    ehdr.e_machine = 4 == vmi_get_address_width(vmi) ? EM_386 : EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_phoff = sizeof(Elf64_Ehdr);
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_phentsize = sizeof(Elf64_Phdr);
+    ehdr.e_phnum = phdrs->len;
+
+    stats->segments = phdrs->len;
+    if (!write_all(fd, &ehdr, sizeof(ehdr), 0)
+        || !write_all(fd, phdrs->data, phdrs->len * sizeof(Elf64_Phdr), sizeof(ehdr))) {
+        data = -1;
+    }
+
+    g_array_free(phdrs, TRUE);
+    return data;
+}
+
+static gboolean
+dump_process(
+    procdump_t *pd,
+    vmi_instance_t vmi,
+    guint index)
+{
+    vmi_pid_t pid = pd->pids[index];
+    int fd = pd->fds[index];
+    process_stats_t stats;
+    vmi_va_run_t *runs = NULL;
+    off_t *offsets = NULL;
+    off_t end = 0;
+    unsigned char *buf = NULL;
+    size_t count = 0, max_length = 0, i;
+    gboolean ok = FALSE;
+    addr_t dtb = vmi_pid_to_dtb(vmi, pid);
+
+    memset(&stats, 0, sizeof(stats));
+    if (!dtb) {
+        fprintf(stderr, "pid %d: no such process\n", pid);
+        return FALSE;
+    }
+
+    count = vmi_get_va_runs(vmi, dtb, pd->flags, &runs);
+    if (!count) {
+        fprintf(stderr, "pid %d: no pages mapped\n", pid);
+        return FALSE;
+    }
+    stats.runs = count;
+
+    offsets = g_malloc0(count * sizeof(off_t));
+    if (FORMAT_ELF == pd->format) {
+        end = write_elf_headers(vmi, fd, runs, count, offsets, &stats);
+        if (end < 0) {
+            goto done;
+        }
+        end = offsets[count - 1] + runs[count - 1].length;
+    } else {
+        sparse_header_t header;
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, PROCDUMP_SPARSE_MAGIC, sizeof(header.magic));
+        header.base = runs[0].vaddr & ~((addr_t) PROCDUMP_PAGE - 1);
+        if (!write_all(fd, &header, sizeof(header), 0)) {
+            goto done;
+        }
+        for (i = 0; i < count; i++) {
+            offsets[i] = PROCDUMP_PAGE + (runs[i].vaddr - header.base);
+        }
+        end = offsets[count - 1] + runs[count - 1].length;
+    }
+
+    /* the holes of the file are whatever isn't written */
+    if (ftruncate(fd, end)) {
+        if (EFBIG == errno) {
+            fprintf(stderr, "pid %d: the dump spans %"PRIu64" GB, more than the "
+                    "filesystem allows in one file, use -f elf\n",
+                    pid, (uint64_t) end >> 30);
+        } else {
+            fprintf(stderr, "pid %d: failed to size the dump: %s\n", pid, strerror(errno));
+        }
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        max_length = MAX(max_length, runs[i].length);
+    }
+    buf = g_malloc(MIN(max_length, PROCDUMP_MAX_READ));
+
+    for (i = 0; i < count; i++) {
+        if (!dump_run(pd, vmi, fd, &runs[i], offsets[i], buf, &stats)) {
+            goto done;
+        }
+    }
+
+    printf("pid %d: %zu runs in %zu segments, %"PRIu64" KB, %"PRIu64" KB shared, "
+           "%"PRIu64" KB unreadable\n", pid, stats.runs, stats.segments,
+           stats.bytes / 1024, stats.shared / 1024, stats.unreadable / 1024);
+    ok = TRUE;
+
+done:
+    g_free(buf);
+    g_free(offsets);
+    free(runs);
+    return ok;
+}
+
+static gpointer
+worker_run(
+    gpointer data)
+{
+    worker_t *w = data;
+    procdump_t *pd = w->pd;
+    vmi_instance_t vmi = w->vmi ? w->vmi : pd->vmi;
+
+    while (TRUE) {
+        guint index = g_atomic_int_add(&pd->next_pid, 1);
+
+        if (index >= pd->npids) {
+            break;
+        }
+        if (!dump_process(pd, vmi, index)) {
+            fprintf(stderr, "failed to dump pid %d\n", pd->pids[index]);
+            g_atomic_int_inc(&pd->failures);
+        }
+    }
+    return NULL;
+}
+
+int
+main(
+    int argc,
+    char **argv)
+{
+    procdump_t pd;
+    worker_t *workers = NULL;
+    unsigned int nthreads = g_get_num_processors();
+    int ret = 1, opt;
+    guint i;
+
+    memset(&pd, 0, sizeof(pd));
+    pd.flags = VMI_VA_RUNS_USER;
+
+    while ((opt = getopt(argc, argv, "t:f:kh")) != -1) {
+        switch (opt) {
+            case 't':
+                nthreads = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                if (!strcmp(optarg, "elf")) {
+                    pd.format = FORMAT_ELF;
+                } else if (!strcmp(optarg, "sparse")) {
+                    pd.format = FORMAT_SPARSE;
+                } else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'k':
+                pd.flags &= ~VMI_VA_RUNS_USER;
+                break;
+            default:
+                usage(argv[0]);
+                return 'h' == opt ? 0 : 1;
+        }
+    }
+
+    if (argc - optind < 3 || !nthreads) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (vmi_init(&pd.vmi, VMI_AUTO | VMI_INIT_COMPLETE, argv[optind]) == VMI_FAILURE) {
+        printf("Failed to init LibVMI library.\n");
+        return 1;
+    }
+
+    pd.outdir = argv[optind + 1];
+    pd.npids = argc - optind - 2;
+    pd.pids = g_malloc0(pd.npids * sizeof(vmi_pid_t));
+    pd.fds = g_malloc0(pd.npids * sizeof(int));
+    g_mutex_init(&pd.lock);
+    pd.pages = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+
+    for (i = 0; i < pd.npids; i++) {
+        char *path = NULL;
+
+        pd.pids[i] = strtol(argv[optind + 2 + i], NULL, 0);
+        path = g_strdup_printf("%s/%d.%s", pd.outdir, pd.pids[i],
+                               FORMAT_ELF == pd.format ? "core" : "mem");
+        pd.fds[i] = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (pd.fds[i] < 0) {
+            fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+            g_free(path);
+            pd.npids = i;
+            goto done;
+        }
+        g_free(path);
+    }
+
+    if (nthreads > pd.npids) {
+        nthreads = pd.npids;
+    }
+
+    /* every worker reads through its own clone of the instance */
+    workers = g_malloc0(nthreads * sizeof(worker_t));
+    for (i = 0; i < nthreads; i++) {
+        workers[i].pd = &pd;
+        if (VMI_FAILURE == vmi_clone(pd.vmi, &workers[i].vmi)) {
+            /* reads are thread safe, the parent is just slower to share */
+            workers[i].vmi = NULL;
+        }
+        workers[i].thread = g_thread_new("procdump", worker_run, &workers[i]);
+    }
+    for (i = 0; i < nthreads; i++) {
+        g_thread_join(workers[i].thread);
+        if (workers[i].vmi) {
+            vmi_destroy(workers[i].vmi);
+        }
+    }
+    ret = pd.failures ? 1 : 0;
+
+done:
+    for (i = 0; i < pd.npids; i++) {
+        close(pd.fds[i]);
+    }
+    g_free(workers);
+    g_hash_table_destroy(pd.pages);
+    g_mutex_clear(&pd.lock);
+    g_free(pd.fds);
+    g_free(pd.pids);
+    vmi_destroy(pd.vmi);
+    return ret;
+}
@@ -0,0 +1,103 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * Author: Guanglin Xu (guanglin@andrew.cmu.edu)
+ * Author: Tamas K Lengyel (tamas.lengyel@zentific.com)
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs a mix of reads, translations and symbol lookups against a VM and
+ * prints the latency distribution LibVMI recorded for each operation.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "libvmi/libvmi.h"
+
+static void
+print_stats(
+    vmi_instance_t vmi)
+{
+    vmi_stat_histogram_t h;
+    int stat;
+
+    printf("%-12s %10s %10s %10s %10s %10s %10s\n",
+           "operation", "count", "mean ns", "p50 ns", "p99 ns", "p999 ns", "max ns");
+
+    for (stat = 0; stat < VMI_STAT_MAX; stat++) {
+        if (VMI_SUCCESS != vmi_get_stats(vmi, stat, &h) || !h.count)
+            continue;
+
+        printf("%-12s %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+               vmi_stat_name(stat), h.count, h.total_ns / h.count,
+               vmi_stat_percentile(&h, 50.0),
+               vmi_stat_percentile(&h, 99.0),
+               vmi_stat_percentile(&h, 99.9),
+               h.max_ns);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    vmi_instance_t vmi;
+    unsigned char buf[4096];
+    const char *symbol = NULL;
+    addr_t pa = 0;
+    addr_t max_pa = 0;
+    int loops = 0;
+    int i = 0;
+
+    if (argc != 3) {
+        printf("Usage: %s <vmname> <loops>\n", argv[0]);
+        return 1;
+    }
+    loops = atoi(argv[2]);
+
+    /* set LIBVMI_STATS to include vmi_init */
+    if (VMI_FAILURE == vmi_init(&vmi, VMI_AUTO | VMI_INIT_COMPLETE, argv[1])) {
+        printf("Failed to init LibVMI library.\n");
+        return 1;
+    }
+    vmi_set_stats(vmi, 1);
+
+    symbol = (VMI_OS_WINDOWS == vmi_get_ostype(vmi)) ? "PsInitialSystemProcess" : "init_task";
+    max_pa = vmi_get_max_physical_address(vmi);
+
+    for (i = 0; i < loops; ++i) {
+        addr_t va = 0;
+
+        /* start cold so the lookups and walks aren't cache hits */
+        vmi_symcache_flush(vmi);
+        vmi_v2pcache_flush(vmi);
+
+        va = vmi_translate_ksym2v(vmi, symbol);
+        if (va) {
+            vmi_read_va(vmi, va, 0, buf, sizeof(buf));
+        }
+
+        vmi_read_pa(vmi, pa, buf, sizeof(buf));
+        pa += sizeof(buf);
+        if (pa >= max_pa)
+            pa = 0;
+    }
+
+    print_stats(vmi);
+    vmi_destroy(vmi);
+    return 0;
+}
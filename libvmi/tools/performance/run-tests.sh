@@ -20,4 +20,10 @@ sudo ./read_mem $DOMU_ID 10 $NUM_LOOPS 1
 sleep 10
 echo "Running read mem loop test..."
 sudo ./read_mem $DOMU_ID 10 $NUM_LOOPS 2
+sleep 10
+echo "Running latency distribution test..."
+sudo LIBVMI_STATS=1 ./latency $DOMU_ID 10000
+sleep 10
+echo "Running synthetic image benchmark (no VM needed)..."
+./synthetic 1000
 echo "Done!"
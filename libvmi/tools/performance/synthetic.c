@@ -0,0 +1,619 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks LibVMI on synthetic memory images, so unlike the other tools
+ * here it needs no VM. For both IA-32e and PAE it builds a raw image with
+ * the kernel mapped by real page tables, a task list and a System.map and
+ * Rekall profile describing them, then measures init, reads, translations,
+ * symbol lookups and process enumeration through the file driver.
+ *
+ * Every result is printed as one JSON object per line so runs can be
+ * compared over time. All results are checked against the generated
+ * image, a mismatch fails the run.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <glib.h>
+#include "libvmi/libvmi.h"
+
+#define PAGE_SIZE       0x1000ULL
+#define IMAGE_SIZE      (64ULL << 20)
+#define KERNEL_PHYS     0x1000000ULL
+#define KERNEL_SIZE     0x1000000ULL
+#define KERNEL_DATA     0x200000ULL     // page tables and tasks are placed from here
+#define NR_SYMBOLS      16384
+#define NR_TASKS        256
+
+/* layout of the fake task_struct and mm_struct */
+#define TASK_SIZE       0x400
+#define TASKS_OFFSET    0x100
+#define MM_OFFSET       0x120
+#define PID_OFFSET      0x140
+#define COMM_OFFSET     0x160
+#define MM_SIZE         0x100
+#define PGD_OFFSET      0x40
+
+struct image {
+    const char *mode;
+    int ia32e;
+    unsigned char *mem;
+    addr_t kvirt;           // virtual address of KERNEL_PHYS
+    addr_t next;            // next free byte of the kernel data
+    addr_t pgd;             // kernel page table root
+    addr_t init_task;
+    addr_t dtb[NR_TASKS];
+    addr_t offsets[5];
+    char path[32];
+    char sysmap[32];
+    char rekall[32];
+};
+
+static uint64_t seed;
+
+static uint64_t
+random64(void)
+{
+    /* xorshift, so the runs don't depend on the libc */
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+report(
+    struct image *img,
+    const char *benchmark,
+    uint64_t ops,
+    uint64_t ns,
+    uint64_t bytes)
+{
+    printf("{\"mode\": \"%s\", \"benchmark\": \"%s\", \"ops\": %"PRIu64", "
+           "\"total_ns\": %"PRIu64", \"ns_per_op\": %.1f",
+           img->mode, benchmark, ops, ns, ops ? (double) ns / ops : 0.0);
+    if (bytes) {
+        printf(", \"mb_per_s\": %.1f", ns ? (bytes / 1048576.0) / (ns / 1e9) : 0.0);
+    }
+    printf("}\n");
+}
+
+/*
+ * Image generation
+ */
+
+static addr_t
+kv(struct image *img, addr_t pa)
+{
+    return pa - KERNEL_PHYS + img->kvirt;
+}
+
+static uint64_t
+get64(struct image *img, addr_t pa)
+{
+    uint64_t value;
+
+    memcpy(&value, img->mem + pa, sizeof(value));
+    return value;
+}
+
+static void
+put64(struct image *img, addr_t pa, uint64_t value)
+{
+    memcpy(img->mem + pa, &value, sizeof(value));
+}
+
+static void
+put_ptr(struct image *img, addr_t pa, addr_t value)
+{
+    uint32_t value32 = value;
+
+    if (img->ia32e) {
+        put64(img, pa, value);
+    } else {
+        memcpy(img->mem + pa, &value32, sizeof(value32));
+    }
+}
+
+static addr_t
+alloc(struct image *img, size_t size)
+{
+    addr_t pa = img->next;
+
+    img->next += (size + 63) & ~63ULL;
+    memset(img->mem + pa, 0, size);
+    return pa;
+}
+
+static addr_t
+alloc_page(struct image *img)
+{
+    img->next = (img->next + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    return alloc(img, PAGE_SIZE);
+}
+
+/* IA-32e walks 4 levels of 512 entries, PAE starts from a 4 entry PDPT */
+static void
+map_page(struct image *img, addr_t va, addr_t pa)
+{
+    addr_t table = img->pgd;
+    int level = img->ia32e ? 4 : 3;
+
+    for (; level > 1; level--) {
+        int shift = 12 + 9 * (level - 1);
+        int pdpt = !img->ia32e && level == 3;
+        addr_t entry = table + ((va >> shift) & (pdpt ? 0x3 : 0x1ff)) * 8;
+
+        if (!(get64(img, entry) & 1)) {
+            put64(img, entry, alloc_page(img) | (pdpt ? 0x1 : 0x3));
+        }
+        table = get64(img, entry) & ~(PAGE_SIZE - 1);
+    }
+    put64(img, table + ((va >> 12) & 0x1ff) * 8, pa | 0x3);
+}
+
+static void
+build_tasks(struct image *img)
+{
+    addr_t tasks[NR_TASKS];
+    int ptr_size = img->ia32e ? 8 : 4;
+    int i;
+
+    for (i = 0; i < NR_TASKS; i++) {
+        tasks[i] = alloc(img, TASK_SIZE);
+    }
+
+    for (i = 0; i < NR_TASKS; i++) {
+        addr_t next = tasks[(i + 1) % NR_TASKS];
+        addr_t prev = tasks[(i + NR_TASKS - 1) % NR_TASKS];
+        addr_t mm = alloc(img, MM_SIZE);
+        char *comm = (char *) img->mem + tasks[i] + COMM_OFFSET;
+
+        /* every process gets its own copy of the kernel page tables */
+        img->dtb[i] = alloc_page(img);
+        memcpy(img->mem + img->dtb[i], img->mem + img->pgd, PAGE_SIZE);
+        put_ptr(img, mm + PGD_OFFSET, kv(img, img->dtb[i]));
+
+        put_ptr(img, tasks[i] + TASKS_OFFSET, kv(img, next) + TASKS_OFFSET);
+        put_ptr(img, tasks[i] + TASKS_OFFSET + ptr_size, kv(img, prev) + TASKS_OFFSET);
+
+        /* like a kernel thread, the init task only has an active_mm */
+        if (i) {
+            put_ptr(img, tasks[i] + MM_OFFSET, kv(img, mm));
+        }
+        put_ptr(img, tasks[i] + MM_OFFSET + ptr_size, kv(img, mm));
+
+        put64(img, tasks[i] + PID_OFFSET, i);
+        snprintf(comm, 16, i ? "task-%d" : "swapper/0", i);
+    }
+
+    img->init_task = kv(img, tasks[0]);
+}
+
+static addr_t
+symbol_address(struct image *img, int index)
+{
+    return img->kvirt + PAGE_SIZE + index * 0x40;
+}
+
+static int
+write_profiles(struct image *img)
+{
+    const char *suffix = img->ia32e ? "64" : "32";
+    const char *pgt = img->ia32e ? "init_level4_pgt" : "swapper_pg_dir";
+    int width = img->ia32e ? 16 : 8;
+    FILE *sysmap = NULL, *rekall = NULL;
+    int fd;
+    int i;
+
+    if ((fd = mkstemp(img->sysmap)) < 0 || !(sysmap = fdopen(fd, "w")))
+        goto error;
+    if ((fd = mkstemp(img->rekall)) < 0 || !(rekall = fdopen(fd, "w")))
+        goto error;
+
+    /* System.map is sorted, so the lookups have to scan past the text */
+    fprintf(sysmap, "%0*"PRIx64" A phys_startup_%s\n", width, (uint64_t) KERNEL_PHYS, suffix);
+    fprintf(sysmap, "%0*"PRIx64" T startup_%s\n", width, img->kvirt, suffix);
+    for (i = 0; i < NR_SYMBOLS; i++) {
+        fprintf(sysmap, "%0*"PRIx64" T sym_%05d\n", width, symbol_address(img, i), i);
+    }
+    fprintf(sysmap, "%0*"PRIx64" D %s\n", width, kv(img, img->pgd), pgt);
+    fprintf(sysmap, "%0*"PRIx64" D init_task\n", width, img->init_task);
+
+    /* Rekall keeps the addresses as signed 64-bit integers */
+    fprintf(rekall, "{\"$CONSTANTS\": {\n");
+    fprintf(rekall, "  \"phys_startup_%s\": %"PRId64",\n", suffix, (int64_t) KERNEL_PHYS);
+    fprintf(rekall, "  \"startup_%s\": %"PRId64",\n", suffix, (int64_t) img->kvirt);
+    for (i = 0; i < NR_SYMBOLS; i++) {
+        fprintf(rekall, "  \"sym_%05d\": %"PRId64",\n", i, (int64_t) symbol_address(img, i));
+    }
+    fprintf(rekall, "  \"%s\": %"PRId64",\n", pgt, (int64_t) kv(img, img->pgd));
+    fprintf(rekall, "  \"init_task\": %"PRId64"\n", (int64_t) img->init_task);
+    fprintf(rekall, "},\n\"$STRUCTS\": {\n");
+    fprintf(rekall, "  \"task_struct\": [%d, {\"tasks\": [%d, [\"list_head\"]], "
+            "\"mm\": [%d, [\"Pointer\"]], \"pid\": [%d, [\"int\"]], "
+            "\"comm\": [%d, [\"String\"]]}],\n",
+            TASK_SIZE, TASKS_OFFSET, MM_OFFSET, PID_OFFSET, COMM_OFFSET);
+    fprintf(rekall, "  \"mm_struct\": [%d, {\"pgd\": [%d, [\"Pointer\"]]}]\n",
+            MM_SIZE, PGD_OFFSET);
+    fprintf(rekall, "}}\n");
+
+    fclose(sysmap);
+    fclose(rekall);
+    return 0;
+
+error:
+    fprintf(stderr, "Failed to write the %s profiles.\n", img->mode);
+    if (sysmap)
+        fclose(sysmap);
+    return 1;
+}
+
+static int
+build_image(struct image *img, int ia32e)
+{
+    FILE *f = NULL;
+    int fd;
+    addr_t offset;
+    size_t i;
+
+    memset(img, 0, sizeof(*img));
+    img->mode = ia32e ? "ia32e" : "pae";
+    img->ia32e = ia32e;
+    img->kvirt = ia32e ? 0xffffffff81000000ULL : 0xc1000000ULL;
+    img->offsets[0] = TASKS_OFFSET;
+    img->offsets[1] = MM_OFFSET;
+    img->offsets[2] = PID_OFFSET;
+    img->offsets[3] = COMM_OFFSET;
+    img->offsets[4] = PGD_OFFSET;
+    strcpy(img->path, "/tmp/libvmi_bench_XXXXXX");
+    strcpy(img->sysmap, "/tmp/libvmi_sysmap_XXXXXX");
+    strcpy(img->rekall, "/tmp/libvmi_rekall_XXXXXX");
+
+    img->mem = malloc(IMAGE_SIZE);
+    if (!img->mem) {
+        fprintf(stderr, "Failed to allocate the %s image.\n", img->mode);
+        return 1;
+    }
+
+    /* whatever isn't a kernel structure is noise */
+    seed = 0x5eed;
+    for (i = 0; i < IMAGE_SIZE; i += sizeof(uint64_t)) {
+        put64(img, i, random64());
+    }
+
+    img->next = KERNEL_PHYS + KERNEL_DATA;
+    img->pgd = alloc_page(img);
+    for (offset = 0; offset < KERNEL_SIZE; offset += PAGE_SIZE) {
+        map_page(img, img->kvirt + offset, KERNEL_PHYS + offset);
+    }
+    build_tasks(img);
+
+    if ((fd = mkstemp(img->path)) < 0 || !(f = fdopen(fd, "w")) ||
+        fwrite(img->mem, IMAGE_SIZE, 1, f) != 1) {
+        fprintf(stderr, "Failed to write the %s image.\n", img->mode);
+        if (f)
+            fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    return write_profiles(img);
+}
+
+static void
+destroy_image(struct image *img)
+{
+    unlink(img->path);
+    unlink(img->sysmap);
+    unlink(img->rekall);
+    free(img->mem);
+}
+
+/*
+ * Benchmarks
+ */
+
+static GHashTable *
+image_config(struct image *img, int rekall)
+{
+    GHashTable *config = g_hash_table_new(g_str_hash, g_str_equal);
+
+    g_hash_table_insert(config, "name", img->path);
+    g_hash_table_insert(config, "ostype", "Linux");
+    if (rekall) {
+        g_hash_table_insert(config, "rekall_profile", img->rekall);
+    } else {
+        g_hash_table_insert(config, "sysmap", img->sysmap);
+        g_hash_table_insert(config, "linux_tasks", &img->offsets[0]);
+        g_hash_table_insert(config, "linux_mm", &img->offsets[1]);
+        g_hash_table_insert(config, "linux_pid", &img->offsets[2]);
+        g_hash_table_insert(config, "linux_name", &img->offsets[3]);
+        g_hash_table_insert(config, "linux_pgd", &img->offsets[4]);
+    }
+    return config;
+}
+
+static int
+bench_init(struct image *img, int rekall, int ops)
+{
+    GHashTable *config = image_config(img, rekall);
+    vmi_instance_t vmi = NULL;
+    page_mode_t mode = img->ia32e ? VMI_PM_IA32E : VMI_PM_PAE;
+    uint64_t start = now_ns();
+    int i;
+
+    for (i = 0; i < ops; i++) {
+        if (VMI_FAILURE == vmi_init_custom(&vmi, VMI_FILE | VMI_INIT_COMPLETE | VMI_CONFIG_GHASHTABLE, config)) {
+            g_hash_table_destroy(config);
+            if (rekall) {
+                /* LibVMI may be built without Rekall support */
+                printf("{\"mode\": \"%s\", \"benchmark\": \"init_rekall\", \"skipped\": true}\n",
+                       img->mode);
+                return 0;
+            }
+            fprintf(stderr, "Failed to init LibVMI on the %s image.\n", img->mode);
+            return 1;
+        }
+        if (vmi_get_page_mode(vmi) != mode) {
+            fprintf(stderr, "Wrong page mode detected on the %s image.\n", img->mode);
+            vmi_destroy(vmi);
+            g_hash_table_destroy(config);
+            return 1;
+        }
+        vmi_destroy(vmi);
+    }
+
+    report(img, rekall ? "init_rekall" : "init_sysmap", ops, now_ns() - start, 0);
+    g_hash_table_destroy(config);
+    return 0;
+}
+
+static int
+bench_read(vmi_instance_t vmi, struct image *img, int virtual, int ops)
+{
+    unsigned char buf[PAGE_SIZE];
+    uint64_t start = now_ns();
+    int i;
+
+    for (i = 0; i < ops; i++) {
+        addr_t pa = KERNEL_PHYS + (i * PAGE_SIZE) % KERNEL_SIZE;
+        size_t read = virtual ?
+            vmi_read_va(vmi, kv(img, pa), 0, buf, PAGE_SIZE) :
+            vmi_read_pa(vmi, (i * PAGE_SIZE) % IMAGE_SIZE, buf, PAGE_SIZE);
+
+        if (read != PAGE_SIZE) {
+            fprintf(stderr, "Failed to read page %d of the %s image.\n", i, img->mode);
+            return 1;
+        }
+    }
+
+    report(img, virtual ? "read_va" : "read_pa", ops, now_ns() - start,
+           (uint64_t) ops * PAGE_SIZE);
+    return 0;
+}
+
+static int
+bench_translate(vmi_instance_t vmi, struct image *img, int cold, int ops)
+{
+    uint64_t ns = 0;
+    int i;
+
+    seed = 0x7a11;
+    for (i = 0; i < ops; i++) {
+        addr_t offset = random64() % KERNEL_SIZE;
+        uint64_t start;
+        addr_t pa;
+
+        if (cold) {
+            vmi_v2pcache_flush(vmi);
+        }
+        start = now_ns();
+        pa = vmi_translate_kv2p(vmi, img->kvirt + offset);
+        ns += now_ns() - start;
+
+        if (pa != KERNEL_PHYS + offset) {
+            fprintf(stderr, "Wrong translation of 0x%"PRIx64" in the %s image.\n",
+                    img->kvirt + offset, img->mode);
+            return 1;
+        }
+    }
+
+    report(img, cold ? "translate_cold" : "translate_warm", ops, ns, 0);
+    return 0;
+}
+
+static int
+bench_symbols(vmi_instance_t vmi, struct image *img, int ops)
+{
+    uint64_t ns = 0;
+    int i;
+
+    seed = 0x5b1;
+    for (i = 0; i < ops; i++) {
+        int index = random64() % NR_SYMBOLS;
+        char symbol[16];
+        uint64_t start;
+        addr_t va;
+
+        snprintf(symbol, sizeof(symbol), "sym_%05d", index);
+        vmi_symcache_flush(vmi);
+        start = now_ns();
+        va = vmi_translate_ksym2v(vmi, symbol);
+        ns += now_ns() - start;
+
+        if (va != symbol_address(img, index)) {
+            fprintf(stderr, "Wrong address of %s in the %s image.\n", symbol, img->mode);
+            return 1;
+        }
+    }
+
+    report(img, "symbol_lookup", ops, ns, 0);
+    return 0;
+}
+
+static int
+bench_processes(vmi_instance_t vmi, struct image *img, int ops)
+{
+    addr_t list_head = img->init_task + TASKS_OFFSET;
+    uint64_t start = now_ns();
+    int i;
+
+    for (i = 0; i < ops; i++) {
+        addr_t next = list_head;
+        int count = 0;
+
+        do {
+            addr_t task = next - TASKS_OFFSET;
+            uint32_t pid = 0;
+            char *name = NULL;
+
+            if (VMI_FAILURE == vmi_read_32_va(vmi, task + PID_OFFSET, 0, &pid) ||
+                !(name = vmi_read_str_va(vmi, task + COMM_OFFSET, 0)) ||
+                VMI_FAILURE == vmi_read_addr_va(vmi, next, 0, &next) ||
+                pid != (uint32_t) count++) {
+                fprintf(stderr, "Failed to walk the task list of the %s image.\n", img->mode);
+                free(name);
+                return 1;
+            }
+            free(name);
+        } while (next != list_head && count <= NR_TASKS);
+
+        if (count != NR_TASKS) {
+            fprintf(stderr, "Found %d tasks in the %s image.\n", count, img->mode);
+            return 1;
+        }
+    }
+
+    report(img, "process_list", ops, now_ns() - start, 0);
+    return 0;
+}
+
+static int
+bench_pid_to_dtb(vmi_instance_t vmi, struct image *img, int ops)
+{
+    uint64_t ns = 0;
+    int i;
+
+    seed = 0xd7b;
+    for (i = 0; i < ops; i++) {
+        vmi_pid_t pid = 1 + random64() % (NR_TASKS - 1);
+        uint64_t start;
+        addr_t dtb;
+
+        vmi_pidcache_flush(vmi);
+        start = now_ns();
+        dtb = vmi_pid_to_dtb(vmi, pid);
+        ns += now_ns() - start;
+
+        if (dtb != img->dtb[pid]) {
+            fprintf(stderr, "Wrong dtb for pid %d in the %s image.\n", pid, img->mode);
+            return 1;
+        }
+    }
+
+    report(img, "pid_to_dtb", ops, ns, 0);
+    return 0;
+}
+
+static void
+print_stats(vmi_instance_t vmi, struct image *img)
+{
+    vmi_stat_histogram_t h;
+    int stat;
+
+    for (stat = 0; stat < VMI_STAT_MAX; stat++) {
+        if (VMI_SUCCESS != vmi_get_stats(vmi, stat, &h) || !h.count)
+            continue;
+
+        printf("{\"mode\": \"%s\", \"stat\": \"%s\", \"count\": %"PRIu64", "
+               "\"p50_ns\": %"PRIu64", \"p99_ns\": %"PRIu64", \"max_ns\": %"PRIu64"}\n",
+               img->mode, vmi_stat_name(stat), h.count,
+               vmi_stat_percentile(&h, 50.0), vmi_stat_percentile(&h, 99.0), h.max_ns);
+    }
+}
+
+static int
+run(int ia32e, int ops)
+{
+    struct image *img = malloc(sizeof(struct image));
+    GHashTable *config = NULL;
+    vmi_instance_t vmi = NULL;
+    int init_ops = ops / 100 + 1;
+    int rc = 1;
+
+    if (!img || build_image(img, ia32e))
+        goto done;
+
+    if (bench_init(img, 0, init_ops) || bench_init(img, 1, init_ops))
+        goto done;
+
+    config = image_config(img, 0);
+    if (VMI_FAILURE == vmi_init_custom(&vmi, VMI_FILE | VMI_INIT_COMPLETE | VMI_CONFIG_GHASHTABLE, config)) {
+        fprintf(stderr, "Failed to init LibVMI on the %s image.\n", img->mode);
+        goto done;
+    }
+    vmi_set_stats(vmi, 1);
+
+    rc = bench_read(vmi, img, 0, ops) ||
+         bench_read(vmi, img, 1, ops) ||
+         bench_translate(vmi, img, 1, ops) ||
+         bench_translate(vmi, img, 0, ops) ||
+         bench_symbols(vmi, img, ops) ||
+         bench_processes(vmi, img, ops / NR_TASKS + 1) ||
+         bench_pid_to_dtb(vmi, img, ops);
+
+    print_stats(vmi, img);
+    vmi_destroy(vmi);
+
+done:
+    if (config)
+        g_hash_table_destroy(config);
+    if (img) {
+        destroy_image(img);
+        free(img);
+    }
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    int ops = 1000;
+
+    if (argc > 2 || (argc == 2 && (ops = atoi(argv[1])) <= 0)) {
+        printf("Usage: %s [ops]\n", argv[0]);
+        return 1;
+    }
+
+    return run(1, ops) || run(0, ops);
+}
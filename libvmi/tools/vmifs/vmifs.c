@@ -27,90 +27,439 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <glib.h>
 #include <libvmi/libvmi.h>
 
-static const char *mem_path = "/mem";
+/*
+ * /mem                 physical memory, holes read as zeros
+ * /kernel/mem          kernel address space
+ * /kernel/maps         mapped runs of the kernel address space
+ * /kernel/sym/<name>   kernel address space starting at a symbol
+ * /proc/<pid>/mem      user address space of a process
+ * /proc/<pid>/maps     mapped runs of the process
+ *
+ * The address space files are read through the runs of their page tables,
+ * walked when the file is opened, so reopen a file to see new mappings.
+ * The kernel half of a 64-bit space is at offset vaddr - 0xffff800000000000
+ * of /kernel/mem, everything else is at offset vaddr.
+ *
+ * Lookups and opens go through the shared instance one at a time. The
+ * reads, physical once the file is open, go through a pool of clones made
+ * from the physical memory only instance before FUSE starts its threads,
+ * so reading /mem never looks for the OS.
+ */
+
+#define KERNEL_BASE_IA32E 0xffff800000000000ULL
+
+enum vmifs_type {
+    VMIFS_DIR,
+    VMIFS_MEM,
+    VMIFS_VMEM,
+    VMIFS_MAPS,
+};
+
+/* what a path names */
+struct vmifs_node {
+    enum vmifs_type type;
+    addr_t dtb;         /**< address space of VMIFS_VMEM and VMIFS_MAPS */
+    uint32_t flags;     /**< flags of vmi_get_va_runs */
+    addr_t base;        /**< address at offset 0 */
+    addr_t size;        /**< file size */
+};
+
+/* an open file */
+struct vmifs_file {
+    addr_t base;
+    addr_t size;
+    vmi_va_run_t *runs;     /**< walked on open, sorted by vaddr */
+    size_t count;
+    GString *text;          /**< contents of a maps file */
+};
+
 vmi_instance_t vmi;
 
+/* held by whoever uses vmi, FUSE calls from several threads */
+static GMutex vmi_lock;
+
+/* clones not in use by a read, all made in main */
+static GAsyncQueue *idle;
+static guint nclones;
+
+static vmi_instance_t vmifs_get(void)
+{
+    /* without clones the reads take turns on the shared instance */
+    if(!nclones) {
+        g_mutex_lock(&vmi_lock);
+        return vmi;
+    }
+
+    return g_async_queue_pop(idle);
+}
+
+static void vmifs_put(vmi_instance_t v)
+{
+    if(v == vmi)
+        g_mutex_unlock(&vmi_lock);
+    else
+        g_async_queue_push(idle, v);
+}
+
+/* the OS layer, found on first use */
+static gboolean vmifs_has_os(void)
+{
+    return VMI_SUCCESS == vmi_init_prefetch(vmi);
+}
+
+/* size of an address space view */
+static addr_t vmifs_space(void)
+{
+    return VMI_PM_IA32E == vmi_get_page_mode(vmi) ? 1ULL << 47 : 1ULL << 32;
+}
+
+static addr_t vmifs_kernel_base(void)
+{
+    return VMI_PM_IA32E == vmi_get_page_mode(vmi) ? KERNEL_BASE_IA32E : 0;
+}
+
+/* called with vmi_lock held */
+static int vmifs_lookup(const char *path, struct vmifs_node *node)
+{
+    const char *rest = NULL;
+    char *end = NULL;
+
+    memset(node, 0, sizeof(*node));
+
+    if(!strcmp(path, "/"))
+        return 0;
+
+    if(!strcmp(path, "/mem")) {
+        node->type = VMIFS_MEM;
+        node->size = vmi_get_max_physical_address(vmi);
+        return 0;
+    }
+
+    if(!strncmp(path, "/kernel", 7) && vmifs_has_os()) {
+        rest = path + 7;
+        node->dtb = vmi_pid_to_dtb(vmi, 0);
+        node->base = vmifs_kernel_base();
+
+        if(!*rest || !strcmp(rest, "/sym"))
+            return 0;
+        if(!strcmp(rest, "/mem")) {
+            node->type = VMIFS_VMEM;
+            node->size = vmifs_space();
+            return 0;
+        }
+        if(!strcmp(rest, "/maps")) {
+            node->type = VMIFS_MAPS;
+            return 0;
+        }
+        if(!strncmp(rest, "/sym/", 5) && rest[5] && !strchr(rest + 5, '/')) {
+            addr_t vaddr = vmi_translate_ksym2v(vmi, rest + 5);
+
+            if(!vaddr || vaddr < node->base || vaddr - node->base >= vmifs_space())
+                return -ENOENT;
+            node->type = VMIFS_VMEM;
+            node->size = node->base + vmifs_space() - vaddr;
+            node->base = vaddr;
+            return 0;
+        }
+        return -ENOENT;
+    }
+
+    if(!strncmp(path, "/proc", 5) && vmifs_has_os()) {
+        vmi_pid_t pid = 0;
+
+        rest = path + 5;
+        if(!*rest)
+            return 0;
+        if(*rest != '/' || !g_ascii_isdigit(rest[1]))
+            return -ENOENT;
+
+        pid = strtol(rest + 1, &end, 10);
+        node->dtb = vmi_pid_to_dtb(vmi, pid);
+        if(!node->dtb)
+            return -ENOENT;
+
+        node->flags = VMI_VA_RUNS_USER;
+        if(!*end)
+            return 0;
+        if(!strcmp(end, "/mem")) {
+            node->type = VMIFS_VMEM;
+            node->size = vmifs_space();
+            return 0;
+        }
+        if(!strcmp(end, "/maps")) {
+            node->type = VMIFS_MAPS;
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
 static int vmifs_getattr(const char *path, struct stat *stbuf)
 {
+    struct vmifs_node node;
     int res = 0;
 
+    g_mutex_lock(&vmi_lock);
+    res = vmifs_lookup(path, &node);
+    g_mutex_unlock(&vmi_lock);
+
+    if(res)
+        return res;
+
     memset(stbuf, 0, sizeof(struct stat));
-    if(strcmp(path, "/") == 0) {
-        stbuf->st_mode = S_IFDIR | 0755;
+    if(VMIFS_DIR == node.type) {
+        stbuf->st_mode = S_IFDIR | 0555;
         stbuf->st_nlink = 2;
-    }
-    else if(strcmp(path, mem_path) == 0) {
+    } else {
+        /* maps files are generated on open and read with direct_io */
         stbuf->st_mode = S_IFREG | 0444;
         stbuf->st_nlink = 1;
-        stbuf->st_size = vmi_get_memsize(vmi);
+        stbuf->st_size = node.size;
     }
-    else
-        res = -ENOENT;
 
-    return res;
+    return 0;
+}
+
+/* lists the pids of the process list, called with vmi_lock held */
+static void vmifs_fill_procs(void *buf, fuse_fill_dir_t filler)
+{
+    addr_t list_head = 0;
+    unsigned long tasks_offset = 0, pid_offset = 0;
+    vmi_list_field_t field;
+    vmi_list_walk_t walk;
+    uint32_t flags = 0;
+    size_t i;
+
+    if(VMI_OS_LINUX == vmi_get_ostype(vmi)) {
+        tasks_offset = vmi_get_offset(vmi, "linux_tasks");
+        pid_offset = vmi_get_offset(vmi, "linux_pid");
+        list_head = vmi_translate_ksym2v(vmi, "init_task") + tasks_offset;
+        flags = VMI_WALK_INCLUDE_HEAD;
+    } else if(VMI_OS_WINDOWS == vmi_get_ostype(vmi)) {
+        tasks_offset = vmi_get_offset(vmi, "win_tasks");
+        pid_offset = vmi_get_offset(vmi, "win_pid");
+        if(VMI_FAILURE == vmi_read_addr_ksym(vmi, "PsActiveProcessHead", &list_head))
+            return;
+    }
+
+    if(!tasks_offset || !pid_offset || !list_head)
+        return;
+
+    field.offset = pid_offset;
+    field.length = sizeof(uint32_t);
+
+    /* a list cut short by a running guest still lists what was walked */
+    vmi_walk_list(vmi, list_head, 0, tasks_offset, &field, 1, 0, flags, &walk);
+    for(i = 0; i < walk.count; i++) {
+        char name[16];
+        vmi_pid_t pid = 0;
+
+        memcpy(&pid, walk.records + i * walk.record_size + sizeof(addr_t), sizeof(uint32_t));
+        snprintf(name, sizeof(name), "%d", pid);
+        filler(buf, name, NULL, 0);
+    }
+    vmi_walk_list_free(&walk);
 }
 
 static int vmifs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                          off_t offset, struct fuse_file_info *fi)
 {
+    struct vmifs_node node;
+    int res = 0;
     (void) offset;
     (void) fi;
 
-    if(strcmp(path, "/") != 0)
-        return -ENOENT;
+    g_mutex_lock(&vmi_lock);
+    res = vmifs_lookup(path, &node);
+    if(!res && VMIFS_DIR != node.type)
+        res = -ENOTDIR;
+    if(res) {
+        g_mutex_unlock(&vmi_lock);
+        return res;
+    }
 
     filler(buf, ".", NULL, 0);
     filler(buf, "..", NULL, 0);
-    filler(buf, mem_path + 1, NULL, 0);
 
+    if(!strcmp(path, "/")) {
+        filler(buf, "mem", NULL, 0);
+        if(vmifs_has_os()) {
+            filler(buf, "kernel", NULL, 0);
+            filler(buf, "proc", NULL, 0);
+        }
+    } else if(!strcmp(path, "/kernel")) {
+        filler(buf, "mem", NULL, 0);
+        filler(buf, "maps", NULL, 0);
+        filler(buf, "sym", NULL, 0);
+    } else if(!strcmp(path, "/proc")) {
+        vmifs_fill_procs(buf, filler);
+    } else if(!strncmp(path, "/proc/", 6)) {
+        filler(buf, "mem", NULL, 0);
+        filler(buf, "maps", NULL, 0);
+    }
+    /* the symbols of /kernel/sym can be looked up, but not listed */
+
+    g_mutex_unlock(&vmi_lock);
     return 0;
 }
 
+static void vmifs_file_free(struct vmifs_file *file)
+{
+    if(file->text)
+        g_string_free(file->text, TRUE);
+    free(file->runs);
+    g_free(file);
+}
+
 static int vmifs_open(const char *path, struct fuse_file_info *fi)
 {
-    if(strcmp(path, mem_path) != 0)
-        return -ENOENT;
+    struct vmifs_node node;
+    struct vmifs_file *file = NULL;
+    size_t i;
+    int res = 0;
 
     uint32_t accmod = O_RDONLY | O_WRONLY | O_RDWR;
     if((fi->flags & accmod) != O_RDONLY)
         return -EACCES;
 
+    /* the page tables are walked under the lock too, opens take turns */
+    g_mutex_lock(&vmi_lock);
+    res = vmifs_lookup(path, &node);
+    if(!res && VMIFS_DIR == node.type)
+        res = -EISDIR;
+    if(res) {
+        g_mutex_unlock(&vmi_lock);
+        return res;
+    }
+
+    file = g_malloc0(sizeof(struct vmifs_file));
+    file->base = node.base;
+    file->size = node.size;
+
+    if(VMIFS_MEM == node.type) {
+        const vmi_pa_range_t *ranges = NULL;
+
+        /* physical memory is an identity mapping of the memory map */
+        file->count = vmi_get_memory_map(vmi, &ranges);
+        file->runs = malloc(file->count * sizeof(vmi_va_run_t));
+        for(i = 0; file->runs && i < file->count; i++) {
+            file->runs[i].vaddr = ranges[i].paddr;
+            file->runs[i].paddr = ranges[i].paddr;
+            file->runs[i].length = ranges[i].length;
+        }
+        if(!file->runs)
+            file->count = 0;
+    } else {
+        /* walked again by every open, the kernel's too, to see new mappings */
+        file->count = vmi_get_va_runs(vmi, node.dtb, node.flags, &file->runs);
+    }
+    g_mutex_unlock(&vmi_lock);
+
+    if(VMIFS_MAPS == node.type) {
+        file->text = g_string_new(NULL);
+        for(i = 0; i < file->count; i++)
+            g_string_append_printf(file->text, "%016"PRIx64"-%016"PRIx64" %016"PRIx64"\n",
+                                   file->runs[i].vaddr,
+                                   file->runs[i].vaddr + file->runs[i].length,
+                                   file->runs[i].paddr);
+
+        /* the size isn't known to getattr */
+        fi->direct_io = 1;
+    }
+
+    fi->fh = (uint64_t) (uintptr_t) file;
     return 0;
 }
 
+static int vmifs_release(const char *path, struct fuse_file_info *fi)
+{
+    (void) path;
+
+    vmifs_file_free((struct vmifs_file *) (uintptr_t) fi->fh);
+    return 0;
+}
+
+/* reads a physical range, the pages that can't be read stay zero */
+static void vmifs_read_pa(vmi_instance_t v, addr_t paddr, char *buf, size_t size)
+{
+    addr_t end = paddr + size;
+
+    while(paddr < end) {
+        size_t done = vmi_read_pa(v, paddr, buf, end - paddr);
+        addr_t next = paddr + done;
+
+        if(next < end)
+            next = (next | (VMI_PS_4KB - 1)) + 1;
+        buf += next - paddr;
+        paddr = next;
+    }
+}
+
 static int vmifs_read(const char *path, char *buf, size_t size, off_t offset,
                       struct fuse_file_info *fi)
 {
-    (void) fi;
-    if(strcmp(path, mem_path) != 0)
-        return -ENOENT;
+    struct vmifs_file *file = (struct vmifs_file *) (uintptr_t) fi->fh;
+    vmi_instance_t v = NULL;
+    addr_t start, end;
+    size_t lo = 0, hi;
+    (void) path;
 
-    unsigned long memsize = vmi_get_memsize(vmi);
-    if(offset < memsize && size) {
-        if(offset + size > memsize)
-            size = memsize-offset;
+    if(file->text) {
+        if((size_t) offset >= file->text->len)
+            return 0;
+        if(offset + size > file->text->len)
+            size = file->text->len - offset;
+        memcpy(buf, file->text->str + offset, size);
+        return size;
+    }
 
-        uint8_t *buffer = g_malloc0(sizeof(uint8_t)*size);
-        size_t size_read = vmi_read_pa(vmi, offset, buffer, size);
+    if((addr_t) offset >= file->size || !size)
+        return 0;
+    if(offset + size > file->size)
+        size = file->size - offset;
 
-        if(size != size_read) {
-            g_free(buffer);
-        } else {
-            memcpy(buf, buffer, size);
-            g_free(buffer);
-        }
+    /* straight into the FUSE buffer, unmapped pages read as zeros */
+    memset(buf, 0, size);
+    start = file->base + offset;
+    end = start + size;
 
-    } else {
-        return 0;
+    /* first run ending after the start of the read */
+    hi = file->count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if(file->runs[mid].vaddr + file->runs[mid].length <= start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    v = vmifs_get();
+    for(; lo < file->count && file->runs[lo].vaddr < end; lo++) {
+        const vmi_va_run_t *run = &file->runs[lo];
+        addr_t from = run->vaddr > start ? run->vaddr : start;
+        addr_t to = run->vaddr + run->length < end ? run->vaddr + run->length : end;
+
+        vmifs_read_pa(v, run->paddr + (from - run->vaddr), buf + (from - start), to - from);
     }
+    vmifs_put(v);
 
     return size;
 }
 
-void vmifs_destroy() {
+void vmifs_destroy(void *private_data)
+{
+    vmi_instance_t v = NULL;
+    (void) private_data;
+
+    while((v = g_async_queue_try_pop(idle)))
+        vmi_destroy(v);
+    g_async_queue_unref(idle);
     vmi_destroy(vmi);
 }
 
@@ -119,14 +468,15 @@ static struct fuse_operations vmifs_oper = {
     .readdir    = vmifs_readdir,
     .open   = vmifs_open,
     .read   = vmifs_read,
+    .release   = vmifs_release,
     .destroy   = vmifs_destroy,
 };
 
 int main(int argc, char *argv[])
 {
     /* this is the VM or file that we are looking at */
-    if (argc != 4) {
-        printf("Usage: %s name|domid <name|domid> <path>\n", argv[0]);
+    if (argc < 4) {
+        printf("Usage: %s name|domid <name|domid> <path> [FUSE options]\n", argv[0]);
         return 1;
     }
 
@@ -150,9 +500,38 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    /* the reads only need physical memory, so their clones are made from
+       the partial instance and don't look for the OS */
+    unsigned int i, nthreads = g_get_num_processors();
+    vmi_instance_t clone = NULL;
+
+    idle = g_async_queue_new();
+    for (i = 0; i < nthreads; i++) {
+        if (vmi_clone(vmi, &clone) == VMI_FAILURE)
+            break;
+        g_async_queue_push(idle, clone);
+        nclones++;
+    }
+
     g_hash_table_destroy(config);
 
-    char *fuse_argv[2] = { argv[0], argv[3] };
+    /* with a config entry the kernel and process views are available too,
+       the OS is looked for on their first use */
+    char *name = strcmp(argv[1],"name")==0 ? strdup(argv[2]) : vmi_get_name(vmi);
+    vmi_instance_t complete = NULL;
+
+    if (name && vmi_init(&complete, VMI_AUTO | VMI_INIT_COMPLETE | VMI_INIT_LAZY, name) == VMI_SUCCESS) {
+        vmi_destroy(vmi);
+        vmi = complete;
+    } else {
+        printf("No config entry for %s, only physical memory is available.\n", name ? name : argv[2]);
+    }
+    free(name);
+
+    /* the FUSE options are passed through, FUSE serves requests from
+       several threads unless -s is given */
+    char **fuse_argv = argv + 2;
+    fuse_argv[0] = argv[0];
 
-    return fuse_main(2, fuse_argv, &vmifs_oper);
+    return fuse_main(argc - 2, fuse_argv, &vmifs_oper);
 }